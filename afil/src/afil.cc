@@ -3,25 +3,37 @@
 #include "parser.hh"
 #include "incomplete_module.hh"
 #include "template_instantiation.hh"
+#include "utils/mapped_file.hh"
 #include "utils/string.hh"
 
 namespace afil
 {
 
-	auto parse_module(std::string_view module_name) noexcept -> expected<complete::Program, SyntaxError>
+	auto parse_module(std::string_view module_name, incomplete::ModuleCache const * cache, incomplete::ModuleResolver * resolver,
+		instantiation::FunctionBodyAnalysis function_body_analysis, instantiation::FunctionFolding function_folding) noexcept -> expected<complete::Program, SyntaxError>
 	{
+		incomplete::ModuleResolver local_resolver;
+		if (resolver == nullptr)
+			resolver = &local_resolver;
+
 		std::string const module_path = incomplete::module_path_from_name(module_name);
-		auto source = load_whole_file(std::string_view(module_path));
-		if (!source.has_value())
+		std::filesystem::path const * const canonical_path = incomplete::resolve_canonical_path(*resolver, module_path);
+		SourceBuffer const * const loaded_source = canonical_path ? incomplete::load_source(*resolver, *canonical_path) : nullptr;
+		if (loaded_source == nullptr)
 			return Error(make_complete_syntax_error("", join("Cannot open module file ", module_path), "", ""));
-		return parse_module(module_name, *source);
+
+		// Keeps the module file mapped while it is parsed even if the resolver loads it again.
+		SourceBuffer const source = *loaded_source;
+		return parse_module(module_name, source, cache, resolver, function_body_analysis, function_folding);
 	}
 
-	auto parse_module(std::string_view module_name, std::string_view source) noexcept -> expected<complete::Program, SyntaxError>
+	auto parse_module(std::string_view module_name, std::string_view source, incomplete::ModuleCache const * cache, incomplete::ModuleResolver * resolver,
+		instantiation::FunctionBodyAnalysis function_body_analysis, instantiation::FunctionFolding function_folding) noexcept -> expected<complete::Program, SyntaxError>
 	{
-		try_call_decl(std::vector<incomplete::Module> incomplete_modules, incomplete::load_module_and_dependencies(module_name, source));
-		try_call_decl(std::vector<int> const parse_order, parser::parse_modules(incomplete_modules));
-		return instantiation::semantic_analysis(incomplete_modules, parse_order);
+		incomplete::ModuleResolver local_resolver;
+		try_call_decl(std::vector<incomplete::Module> incomplete_modules, incomplete::load_module_and_dependencies(module_name, source, resolver ? *resolver : local_resolver));
+		try_call_decl(std::vector<int> const parse_order, parser::parse_modules(incomplete_modules, cache));
+		return instantiation::semantic_analysis(incomplete_modules, parse_order, function_body_analysis, instantiation::ProgramAllocation::arena, 0, function_folding);
 	}
 
 } // namespace afil
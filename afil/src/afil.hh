@@ -2,16 +2,27 @@
 
 #include "program.hh"
 #include "syntax_error.hh"
+#include "template_instantiation.hh"
 #include "utils/out.hh"
 #include "utils/expected.hh"
 #include <string_view>
 
 namespace complete { struct Program; }
+namespace incomplete { struct ModuleCache; struct ModuleResolver; }
 
 namespace afil
 {
 
-	[[nodiscard]] auto parse_module(std::string_view module_name) noexcept->expected<complete::Program, SyntaxError>;
-	[[nodiscard]] auto parse_module(std::string_view module_name, std::string_view source) noexcept->expected<complete::Program, SyntaxError>;
+	// A resolver can be passed to reuse the paths and sources that previous calls resolved and loaded.
+	// Eager function body analysis reports errors in the bodies of functions that are never used. Keeping functions with identical code
+	// apart makes the program easier to inspect.
+	[[nodiscard]] auto parse_module(std::string_view module_name, incomplete::ModuleCache const * cache = nullptr, incomplete::ModuleResolver * resolver = nullptr,
+		instantiation::FunctionBodyAnalysis function_body_analysis = instantiation::FunctionBodyAnalysis::lazy,
+		instantiation::FunctionFolding function_folding = instantiation::FunctionFolding::fold) noexcept
+		->expected<complete::Program, SyntaxError>;
+	[[nodiscard]] auto parse_module(std::string_view module_name, std::string_view source, incomplete::ModuleCache const * cache = nullptr, incomplete::ModuleResolver * resolver = nullptr,
+		instantiation::FunctionBodyAnalysis function_body_analysis = instantiation::FunctionBodyAnalysis::lazy,
+		instantiation::FunctionFolding function_folding = instantiation::FunctionFolding::fold) noexcept
+		->expected<complete::Program, SyntaxError>;
 
 } // namespace afil
@@ -884,7 +884,7 @@ namespace c_transpiler
 		// Write all functions.
 		for (complete::Function const & function : program.functions)
 		{
-			if (function.is_callable_at_runtime)
+			if (function.is_callable_at_runtime && has_analyzed_body(program, function))
 			{
 				auto const id = FunctionId(FunctionId::Type::program, unsigned(&function - program.functions.data()));
 				write_function(function, id, program, c_source);
@@ -0,0 +1,557 @@
+#include "code_folding.hh"
+#include "program.hh"
+#include "complete_expression.hh"
+#include "complete_statement.hh"
+#include "utils/overload.hh"
+#include "utils/variant.hh"
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace complete
+{
+
+	namespace code_folding_locals
+	{
+
+		using Key = std::vector<unsigned>;
+
+		struct KeyHash
+		{
+			auto operator () (Key const & key) const noexcept -> size_t
+			{
+				// FNV-1a over the words of the key.
+				size_t hash = 2166136261u;
+				for (unsigned const word : key)
+					hash = (hash ^ word) * 16777619u;
+				return hash;
+			}
+		};
+
+		// Gives consecutive ids to distinct keys.
+		struct Partition
+		{
+			std::unordered_map<Key, unsigned, KeyHash> ids;
+
+			auto id_of(Key && key) -> unsigned
+			{
+				unsigned const next_id = static_cast<unsigned>(ids.size());
+				return ids.emplace(std::move(key), next_id).first->second;
+			}
+		};
+
+		// Equivalence class of every type and program function, as of the previous round of refinement.
+		struct Classes
+		{
+			std::vector<unsigned> types;
+			std::vector<unsigned> functions;
+		};
+
+		auto encode_type(Key & key, Classes const & classes, TypeId id) -> void
+		{
+			// Mutability does not change what the code does at runtime, so it is left out.
+			if (id.is_function)
+			{
+				key.push_back(1);
+				key.push_back(id.flat_value);
+			}
+			else
+			{
+				key.push_back(0);
+				key.push_back(classes.types[id.index]);
+				key.push_back(id.is_reference);
+			}
+		}
+
+		auto encode_function_id(Key & key, Classes const & classes, FunctionId id) -> void
+		{
+			if (id.type == FunctionId::Type::program)
+			{
+				key.push_back(0);
+				key.push_back(classes.functions[id.index]);
+			}
+			else
+			{
+				key.push_back(1);
+				key.push_back(static_cast<unsigned>(id.type));
+				key.push_back(id.index);
+			}
+		}
+
+		auto encode_bytes(Key & key, char const * bytes, size_t size) -> void
+		{
+			key.push_back(static_cast<unsigned>(size));
+			for (size_t i = 0; i < size; ++i)
+				key.push_back(static_cast<unsigned char>(bytes[i]));
+		}
+
+		template <typename T>
+		auto bits_of(T value) noexcept -> unsigned
+		{
+			static_assert(sizeof(T) <= sizeof(unsigned));
+			unsigned bits = 0;
+			memcpy(&bits, &value, sizeof(value));
+			return bits;
+		}
+
+		// Encodes a function body as a sequence of words in which every variable length list is preceded by its size,
+		// so that two bodies have the same encoding only if they have the same structure.
+		struct BodyEncoder
+		{
+			Classes const & classes;
+			Key & key;
+			bool is_foldable = true;
+
+			auto encode(Scope const & scope) -> void
+			{
+				key.push_back(static_cast<unsigned>(scope.stack_frame_size));
+				key.push_back(static_cast<unsigned>(scope.stack_frame_alignment));
+				key.push_back(static_cast<unsigned>(scope.variables.size()));
+				for (Variable const & variable : scope.variables)
+				{
+					encode_type(key, classes, variable.type);
+					key.push_back(static_cast<unsigned>(variable.offset));
+				}
+			}
+
+			auto encode(std::vector<Expression> const & expressions) -> void
+			{
+				key.push_back(static_cast<unsigned>(expressions.size()));
+				for (Expression const & expression : expressions)
+					encode(expression);
+			}
+
+			auto encode(std::vector<Statement> const & statements) -> void
+			{
+				key.push_back(static_cast<unsigned>(statements.size()));
+				for (Statement const & statement : statements)
+					encode(statement);
+			}
+
+			auto encode(Expression const & expression) -> void
+			{
+				key.push_back(static_cast<unsigned>(expression.as_variant().index()));
+
+				auto const visitor = overload(
+					[&](expression::Literal<int> literal) { key.push_back(bits_of(literal.value)); },
+					[&](expression::Literal<float> literal) { key.push_back(bits_of(literal.value)); },
+					[&](expression::Literal<bool> literal) { key.push_back(literal.value); },
+					[&](expression::Literal<char_t> literal) { key.push_back(literal.value); },
+					[&](expression::Literal<null_t>) {},
+					[&](expression::Literal<TypeId> literal) { key.push_back(literal.value.flat_value); },
+					[&](expression::StringLiteral const & literal)
+					{
+						encode_type(key, classes, literal.type);
+						encode_bytes(key, literal.value.data(), literal.value.size());
+					},
+					[&](expression::LocalVariable const & variable)
+					{
+						encode_type(key, classes, variable.variable_type);
+						key.push_back(static_cast<unsigned>(variable.variable_offset));
+					},
+					[&](expression::GlobalVariable const & variable)
+					{
+						encode_type(key, classes, variable.variable_type);
+						key.push_back(static_cast<unsigned>(variable.variable_offset));
+					},
+					[&](expression::MemberVariable const & variable)
+					{
+						encode_type(key, classes, variable.variable_type);
+						key.push_back(static_cast<unsigned>(variable.variable_offset));
+						encode(*variable.owner);
+					},
+					[&](expression::Constant const & constant)
+					{
+						encode_type(key, classes, constant.type);
+						encode_bytes(key, constant.value.data(), constant.value.size());
+					},
+					[&](expression::ConstantTemporary const & constant)
+					{
+						encode_type(key, classes, constant.type);
+						encode_bytes(key, constant.value.data(), constant.value.size());
+					},
+					[&](expression::FunctionCall const & call)
+					{
+						encode_function_id(key, classes, call.function_id);
+						encode(call.parameters);
+					},
+					[&](expression::RelationalOperatorCall const & call)
+					{
+						key.push_back(static_cast<unsigned>(call.op));
+						encode_function_id(key, classes, call.function_id);
+						encode(call.parameters);
+					},
+					[&](expression::Assignment const & assignment)
+					{
+						encode(*assignment.destination);
+						encode(*assignment.source);
+					},
+					[&](expression::Constructor const & constructor)
+					{
+						encode_type(key, classes, constructor.constructed_type);
+						encode(constructor.parameters);
+					},
+					[&](expression::Dereference const & dereference)
+					{
+						encode_type(key, classes, dereference.return_type);
+						encode(*dereference.expression);
+					},
+					[&](expression::ReinterpretCast const & cast)
+					{
+						encode_type(key, classes, cast.return_type);
+						encode(*cast.operand);
+					},
+					[&](expression::Subscript const & subscript)
+					{
+						encode_type(key, classes, subscript.return_type);
+						encode(*subscript.array);
+						encode(*subscript.index);
+					},
+					[&](expression::PointerPlusInt const & arithmetic)
+					{
+						encode_type(key, classes, arithmetic.return_type);
+						encode(*arithmetic.pointer);
+						encode(*arithmetic.index);
+					},
+					[&](expression::PointerMinusInt const & arithmetic)
+					{
+						encode_type(key, classes, arithmetic.return_type);
+						encode(*arithmetic.pointer);
+						encode(*arithmetic.index);
+					},
+					[&](expression::PointerMinusPointer const & arithmetic)
+					{
+						encode(*arithmetic.left);
+						encode(*arithmetic.right);
+					},
+					[&](expression::If const & if_node)
+					{
+						encode(*if_node.condition);
+						encode(*if_node.then_case);
+						encode(*if_node.else_case);
+					},
+					[&](expression::StatementBlock const & block)
+					{
+						encode(block.scope);
+						encode(block.statements);
+						encode_type(key, classes, block.return_type);
+					},
+					[&](expression::Compiles const &)
+					{
+						// Refers to incomplete expressions, which cannot be compared.
+						is_foldable = false;
+					}
+				);
+				my::visit(expression.as_variant(), visitor);
+			}
+
+			auto encode_optional(value_ptr<Statement> const & statement) -> void
+			{
+				key.push_back(statement != nullptr);
+				if (statement != nullptr)
+					encode(*statement);
+			}
+
+			auto encode(Statement const & statement) -> void
+			{
+				key.push_back(static_cast<unsigned>(statement.as_variant().index()));
+
+				auto const visitor = overload(
+					[&](statement::VariableDeclaration const & declaration)
+					{
+						key.push_back(static_cast<unsigned>(declaration.variable_offset));
+						encode(declaration.assigned_expression);
+					},
+					[&](statement::PlacementLet const & placement)
+					{
+						encode(placement.address_expression);
+						encode(placement.assigned_expression);
+					},
+					[&](statement::ExpressionStatement const & expression_statement) { encode(expression_statement.expression); },
+					[&](statement::If const & if_node)
+					{
+						encode(if_node.condition);
+						encode_optional(if_node.then_case);
+						encode_optional(if_node.else_case);
+					},
+					[&](statement::StatementBlock const & block)
+					{
+						encode(block.scope);
+						encode(block.statements);
+					},
+					[&](statement::While const & while_node)
+					{
+						encode(while_node.condition);
+						encode_optional(while_node.body);
+					},
+					[&](statement::For const & for_node)
+					{
+						encode(for_node.scope);
+						encode_optional(for_node.init_statement);
+						encode(for_node.condition);
+						encode(for_node.end_expression);
+						encode_optional(for_node.body);
+					},
+					[&](statement::Return const & return_node)
+					{
+						encode(return_node.returned_expression);
+						key.push_back(static_cast<unsigned>(return_node.destroyed_stack_frame_size));
+					},
+					[&](statement::Break const & break_node) { key.push_back(static_cast<unsigned>(break_node.destroyed_stack_frame_size)); },
+					[&](statement::Continue const & continue_node) { key.push_back(static_cast<unsigned>(continue_node.destroyed_stack_frame_size)); }
+				);
+				my::visit(statement.as_variant(), visitor);
+			}
+
+			auto encode(Function const & function) -> void
+			{
+				encode(static_cast<Scope const &>(function));
+				key.push_back(static_cast<unsigned>(function.parameter_count));
+				key.push_back(static_cast<unsigned>(function.parameter_size));
+				encode_type(key, classes, function.return_type);
+				key.push_back(function.is_callable_at_compile_time);
+				key.push_back(function.is_callable_at_runtime);
+				encode(function.preconditions);
+				encode(function.statements);
+			}
+		};
+
+		auto type_key(Program const & program, Classes const & classes, size_t type_index) -> Key
+		{
+			Type const & type = program.types[type_index];
+			Key key = {classes.types[type_index], static_cast<unsigned>(type.extra_data.index()), static_cast<unsigned>(type.size), static_cast<unsigned>(type.alignment)};
+
+			auto const visitor = overload(
+				[](Type::BuiltIn) {},
+				[&](Type::Pointer pointer) { encode_type(key, classes, pointer.value_type); },
+				[&](Type::ArrayPointer pointer) { encode_type(key, classes, pointer.value_type); },
+				[&](Type::Array const & array)
+				{
+					encode_type(key, classes, array.value_type);
+					key.push_back(static_cast<unsigned>(array.size));
+					encode_function_id(key, classes, array.destructor);
+					encode_function_id(key, classes, array.copy_constructor);
+					encode_function_id(key, classes, array.move_constructor);
+				},
+				[&](Type::Struct struct_type)
+				{
+					Struct const & struct_data = program.structs[struct_type.struct_index];
+					encode_function_id(key, classes, struct_data.destructor);
+					encode_function_id(key, classes, struct_data.copy_constructor);
+					encode_function_id(key, classes, struct_data.move_constructor);
+					key.push_back(static_cast<unsigned>(struct_data.member_variables.size()));
+					for (MemberVariable const & member : struct_data.member_variables)
+					{
+						encode_type(key, classes, member.type);
+						key.push_back(static_cast<unsigned>(member.offset));
+					}
+				}
+			);
+			my::visit(type.extra_data, visitor);
+
+			return key;
+		}
+
+		auto function_key(Program const & program, Classes const & classes, size_t function_index) -> Key
+		{
+			Function const & function = program.functions[function_index];
+			Key key = {classes.functions[function_index], 1};
+
+			bool is_foldable = has_analyzed_body(program, function);
+			if (is_foldable)
+			{
+				BodyEncoder encoder{classes, key};
+				encoder.encode(function);
+				is_foldable = encoder.is_foldable;
+			}
+
+			// Functions that cannot be compared keep a class of their own.
+			if (!is_foldable)
+				key = {classes.functions[function_index], 0, static_cast<unsigned>(function_index)};
+
+			return key;
+		}
+
+		// Assigns every type and function to a class such that the members of a class are interchangeable at runtime.
+		// Starts with everything in the same class and splits classes until their members have the same encoding,
+		// which makes recursive functions and types that point to themselves equivalent when their structure is.
+		auto equivalence_classes(Program const & program) -> Classes
+		{
+			Classes classes;
+			classes.types.assign(program.types.size(), 0);
+			classes.functions.assign(program.functions.size(), 0);
+			size_t type_class_count = 0;
+			size_t function_class_count = 0;
+
+			while (true)
+			{
+				Partition type_partition;
+				Partition function_partition;
+				Classes refined;
+				refined.types.reserve(program.types.size());
+				refined.functions.reserve(program.functions.size());
+
+				for (size_t i = 0; i < program.types.size(); ++i)
+					refined.types.push_back(type_partition.id_of(type_key(program, classes, i)));
+
+				for (size_t i = 0; i < program.functions.size(); ++i)
+					refined.functions.push_back(function_partition.id_of(function_key(program, classes, i)));
+
+				// The previous class is part of every key, so classes can only split. Once none does, the partition is stable.
+				bool const is_stable = type_partition.ids.size() == type_class_count && function_partition.ids.size() == function_class_count;
+				type_class_count = type_partition.ids.size();
+				function_class_count = function_partition.ids.size();
+				classes = std::move(refined);
+
+				if (is_stable)
+					return classes;
+			}
+		}
+
+		struct Redirect
+		{
+			std::vector<unsigned> const & representatives;
+
+			auto operator () (FunctionId & id) const noexcept -> void
+			{
+				if (id.type == FunctionId::Type::program)
+					id.index = representatives[id.index];
+			}
+
+			auto operator () (Expression & expression) const -> void
+			{
+				auto const visitor = overload(
+					[&](expression::FunctionCall & call) { (*this)(call.function_id); for (Expression & param : call.parameters) (*this)(param); },
+					[&](expression::RelationalOperatorCall & call) { (*this)(call.function_id); for (Expression & param : call.parameters) (*this)(param); },
+					[&](expression::Constructor & constructor) { for (Expression & param : constructor.parameters) (*this)(param); },
+					[&](expression::MemberVariable & variable) { (*this)(*variable.owner); },
+					[&](expression::Assignment & assignment) { (*this)(*assignment.destination); (*this)(*assignment.source); },
+					[&](expression::Dereference & dereference) { (*this)(*dereference.expression); },
+					[&](expression::ReinterpretCast & cast) { (*this)(*cast.operand); },
+					[&](expression::Subscript & subscript) { (*this)(*subscript.array); (*this)(*subscript.index); },
+					[&](expression::PointerPlusInt & arithmetic) { (*this)(*arithmetic.pointer); (*this)(*arithmetic.index); },
+					[&](expression::PointerMinusInt & arithmetic) { (*this)(*arithmetic.pointer); (*this)(*arithmetic.index); },
+					[&](expression::PointerMinusPointer & arithmetic) { (*this)(*arithmetic.left); (*this)(*arithmetic.right); },
+					[&](expression::If & if_node) { (*this)(*if_node.condition); (*this)(*if_node.then_case); (*this)(*if_node.else_case); },
+					[&](expression::StatementBlock & block) { for (Statement & statement : block.statements) (*this)(statement); },
+					[](auto &) {}
+				);
+				std::visit(visitor, expression.as_variant());
+			}
+
+			auto operator () (Statement & statement) const -> void
+			{
+				auto const optional = [&](value_ptr<Statement> & substatement) { if (substatement != nullptr) (*this)(*substatement); };
+				auto const visitor = overload(
+					[&](statement::VariableDeclaration & declaration) { (*this)(declaration.assigned_expression); },
+					[&](statement::PlacementLet & placement) { (*this)(placement.address_expression); (*this)(placement.assigned_expression); },
+					[&](statement::ExpressionStatement & expression_statement) { (*this)(expression_statement.expression); },
+					[&](statement::If & if_node) { (*this)(if_node.condition); optional(if_node.then_case); optional(if_node.else_case); },
+					[&](statement::StatementBlock & block) { for (Statement & substatement : block.statements) (*this)(substatement); },
+					[&](statement::While & while_node) { (*this)(while_node.condition); optional(while_node.body); },
+					[&](statement::For & for_node)
+					{
+						optional(for_node.init_statement);
+						(*this)(for_node.condition);
+						(*this)(for_node.end_expression);
+						optional(for_node.body);
+					},
+					[&](statement::Return & return_node) { (*this)(return_node.returned_expression); },
+					[](statement::Break &) {},
+					[](statement::Continue &) {}
+				);
+				std::visit(visitor, statement.as_variant());
+			}
+
+			auto operator () (Namespace & scope) const -> void
+			{
+				for (FunctionName & function : scope.functions)
+					(*this)(function.id);
+				for (Namespace & nested_namespace : scope.nested_namespaces)
+					(*this)(nested_namespace);
+			}
+		};
+
+	} // namespace code_folding_locals
+
+	auto fold_identical_functions(Program & program) noexcept -> void
+	{
+		using namespace code_folding_locals;
+
+		Classes const classes = equivalence_classes(program);
+
+		// The first function of each class is the one that is kept.
+		size_t const function_count = program.functions.size();
+		std::vector<unsigned> representatives(function_count);
+		std::unordered_map<unsigned, unsigned> representative_of_class;
+		bool any_folded = false;
+		for (size_t i = 0; i < function_count; ++i)
+		{
+			unsigned const representative = representative_of_class.emplace(classes.functions[i], static_cast<unsigned>(i)).first->second;
+			representatives[i] = representative;
+			any_folded = any_folded || representative != i;
+		}
+
+		if (!any_folded)
+			return;
+
+		Redirect const redirect{representatives};
+
+		for (size_t i = 0; i < function_count; ++i)
+		{
+			Function & function = program.functions[i];
+			if (representatives[i] != i)
+			{
+				// Nothing refers to this function anymore. Only its prototype is kept so that the function ids stay valid.
+				function.preconditions.clear();
+				function.statements.clear();
+				remove_names_from_scope(function, NameKind::variable, static_cast<size_t>(function.parameter_count));
+				continue;
+			}
+
+			for (Expression & precondition : function.preconditions)
+				redirect(precondition);
+			for (Statement & statement : function.statements)
+				redirect(statement);
+		}
+
+		for (Statement & statement : program.global_initialization_statements)
+			redirect(statement);
+
+		for (Struct & struct_data : program.structs)
+		{
+			redirect(struct_data.destructor);
+			redirect(struct_data.default_constructor);
+			redirect(struct_data.copy_constructor);
+			redirect(struct_data.move_constructor);
+			for (Constructor & constructor : struct_data.constructors)
+				redirect(constructor.function);
+		}
+
+		for (Type & type : program.types)
+		{
+			if (Type::Array * const array = try_get<Type::Array>(type.extra_data))
+			{
+				redirect(array->destructor);
+				redirect(array->copy_constructor);
+				redirect(array->move_constructor);
+			}
+		}
+
+		for (OverloadSet & overload_set : program.overload_set_types)
+			for (FunctionId & function_id : overload_set.function_ids)
+				redirect(function_id);
+
+		for (FunctionTemplate & function_template : program.function_templates)
+			for (FunctionId & concept_function : function_template.concepts)
+				redirect(concept_function);
+
+		for (StructTemplate & struct_template : program.struct_templates)
+			for (FunctionId & concept_function : struct_template.concepts)
+				redirect(concept_function);
+
+		redirect(program.global_scope);
+		redirect(program.main_function);
+	}
+
+} // namespace complete
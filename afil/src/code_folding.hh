@@ -0,0 +1,13 @@
+#pragma once
+
+namespace complete
+{
+
+	struct Program;
+
+	// Merges functions whose bodies are identical once types with the same layout, destructor, copy and move
+	// constructor are considered equal, like instantiations of a template for int32 and uint32. Calls and every
+	// other reference to a merged function are redirected to the one that is kept, and the body of the others is discarded.
+	auto fold_identical_functions(Program & program) noexcept -> void;
+
+} // namespace complete
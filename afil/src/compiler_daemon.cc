@@ -0,0 +1,369 @@
+#include "compiler_daemon.hh"
+#include "interpreter.hh"
+#include "parser.hh"
+#include "program_image.hh"
+#include "template_instantiation.hh"
+#include "utils/compatibility.hh"
+#include "utils/mapped_file.hh"
+#include "utils/string.hh"
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
+
+#if !AFIL_WINDOWS
+#	include <poll.h>
+#	include <signal.h>
+#	include <sys/socket.h>
+#	include <sys/stat.h>
+#	include <sys/time.h>
+#	include <sys/un.h>
+#	include <sys/wait.h>
+#	include <unistd.h>
+#	include <cerrno>
+#	include <chrono>
+#	include <cstdio>
+#	include <cstring>
+#endif
+
+namespace afil
+{
+
+	namespace compiler_daemon_locals
+	{
+
+		constexpr size_t max_request_size = 4096;
+
+		auto extract_word(std::string_view & text) noexcept -> std::string_view
+		{
+			text = ignore_starting_whitespace(text);
+			size_t const word_size = std::min(text.find_first_of(" \t\r\n"), text.size());
+			std::string_view const word = text.substr(0, word_size);
+			text.remove_prefix(word_size);
+			return word;
+		}
+
+		auto error_response(std::string_view message) noexcept -> std::string
+		{
+			return join("error\n", message, '\n');
+		}
+
+		auto run_response(complete::Program const & program) noexcept -> std::string
+		{
+			auto const result = interpreter::run(program);
+			if (result.has_value())
+				return join("ok\n", *result, '\n');
+			else
+				return error_response(join("Unmet precondition ", result.error().precondition));
+		}
+
+#if !AFIL_WINDOWS
+		auto set_timeout(int socket, int option, int milliseconds) noexcept -> void
+		{
+			timeval timeout = {};
+			timeout.tv_sec = milliseconds / 1000;
+			timeout.tv_usec = (milliseconds % 1000) * 1000;
+			setsockopt(socket, SOL_SOCKET, option, &timeout, sizeof(timeout));
+		}
+
+		// The program may not finish, or crash the process, so it runs in a child process that sends the response through a pipe.
+		auto run_in_child_process(complete::Program const & program, int time_limit_milliseconds) noexcept -> std::string
+		{
+			int pipe_ends[2];
+			if (pipe(pipe_ends) != 0)
+				return error_response("Cannot create a pipe to run the program.");
+
+			// Otherwise what is buffered would be printed by both processes.
+			fflush(nullptr);
+
+			pid_t const child = fork();
+			if (child == -1)
+			{
+				close(pipe_ends[0]);
+				close(pipe_ends[1]);
+				return error_response("Cannot create a process to run the program.");
+			}
+
+			if (child == 0)
+			{
+				close(pipe_ends[0]);
+				std::string const response = run_response(program);
+				for (size_t bytes_written = 0; bytes_written < response.size();)
+				{
+					ssize_t const written = write(pipe_ends[1], response.data() + bytes_written, response.size() - bytes_written);
+					if (written > 0)
+						bytes_written += static_cast<size_t>(written);
+					else if (written == 0 || errno != EINTR)
+						break;
+				}
+				fflush(nullptr);
+				_exit(0);
+			}
+
+			close(pipe_ends[1]);
+
+			// The response is complete when the child closes its end of the pipe by exiting.
+			auto const deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(time_limit_milliseconds);
+			std::string response;
+			bool timed_out = false;
+			char buffer[512];
+			for (;;)
+			{
+				auto const remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+				pollfd pipe_poll = {pipe_ends[0], POLLIN, 0};
+				int const ready = (remaining > 0) ? poll(&pipe_poll, 1, static_cast<int>(remaining)) : 0;
+				if (ready == 0)
+				{
+					timed_out = true;
+					break;
+				}
+				if (ready == -1)
+				{
+					if (errno == EINTR)
+						continue;
+					break;
+				}
+
+				ssize_t const bytes_read = read(pipe_ends[0], buffer, sizeof(buffer));
+				if (bytes_read > 0)
+					response.append(buffer, static_cast<size_t>(bytes_read));
+				else if (bytes_read == 0 || errno != EINTR)
+					break;
+			}
+			close(pipe_ends[0]);
+
+			if (timed_out)
+				kill(child, SIGKILL);
+			int status = 0;
+			while (waitpid(child, &status, 0) == -1 && errno == EINTR)
+				;
+
+			if (timed_out)
+				return error_response(join("The program did not finish in ", time_limit_milliseconds, " milliseconds."));
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || response.empty())
+				return error_response("The program terminated abnormally.");
+			return response;
+		}
+#endif
+
+	} // namespace compiler_daemon_locals
+
+	auto analyzed_program(CompilerDaemon & daemon, std::string_view module_name) noexcept -> expected<complete::Program const *, SyntaxError>
+	{
+		std::string const module_path = incomplete::module_path_from_name(module_name);
+		std::filesystem::path const * const canonical_path = incomplete::resolve_canonical_path(daemon.resolver, module_path);
+		SourceBuffer const * const loaded_source = canonical_path ? incomplete::load_source(daemon.resolver, *canonical_path) : nullptr;
+		if (loaded_source == nullptr)
+			return Error(make_complete_syntax_error("", join("Cannot open module file ", module_path), "", ""));
+
+		// Keeps the module file mapped while it is scanned even if the resolver loads it again.
+		SourceBuffer const source = *loaded_source;
+		try_call_decl(std::vector<incomplete::Module> incomplete_modules, incomplete::load_module_and_dependencies(module_name, source, daemon.resolver));
+
+		// The hash of the module covers its files and the hashes of its dependencies, so it changes if any file that the program is made of does.
+		try_call_decl(std::vector<int> const sorted_modules, incomplete::sort_modules_by_dependencies(incomplete_modules));
+		std::vector<uint64_t> module_hashes(incomplete_modules.size());
+		for (int const module_index : sorted_modules)
+			module_hashes[module_index] = incomplete::module_hash(incomplete_modules[module_index], module_hashes);
+
+		auto const it = daemon.analyzed_modules.find(std::string(module_name));
+		if (it != daemon.analyzed_modules.end() && it->second.module_hashes[0] == module_hashes[0])
+			return &it->second.program;
+
+		// Take the modules that didn't change from memory. Their statements point into the sources that were loaded when they were parsed, which
+		// have the same contents as the ones that were just loaded. Where the files are and which modules are the dependencies may have changed.
+		std::vector<std::vector<parser::TypeName>> module_type_names(incomplete_modules.size());
+		std::vector<char> is_parsed(incomplete_modules.size(), false);
+		for (size_t i = 0; i < incomplete_modules.size(); ++i)
+		{
+			auto const parsed_module = daemon.parsed_modules.find(module_hashes[i]);
+			if (parsed_module == daemon.parsed_modules.end())
+				continue;
+
+			incomplete::Module & module = incomplete_modules[i];
+			incomplete::Module & resident_module = parsed_module->second.module;
+			for (size_t file_index = 0; file_index < module.files.size(); ++file_index)
+				resident_module.files[file_index].filename = std::move(module.files[file_index].filename);
+			resident_module.dependencies = std::move(module.dependencies);
+			module = std::move(resident_module);
+			module_type_names[i] = std::move(parsed_module->second.type_names);
+			is_parsed[i] = true;
+			daemon.parsed_modules.erase(parsed_module);
+		}
+
+		auto const parse_order = parser::parse_modules(incomplete_modules, module_type_names, is_parsed, daemon.cache ? &*daemon.cache : nullptr);
+		auto program = parse_order.has_value()
+			? instantiation::semantic_analysis(incomplete_modules, *parse_order)
+			: expected<complete::Program, SyntaxError>(Error(parse_order.error()));
+
+		// Keep the modules that were parsed, even if another one or the analysis failed, since only the modules that change need to be parsed again.
+		for (size_t i = 0; i < incomplete_modules.size(); ++i)
+			if (is_parsed[i])
+				daemon.parsed_modules[module_hashes[i]] = {std::move(incomplete_modules[i]), std::move(module_type_names[i])};
+
+		if (program.has_value())
+		{
+			CompilerDaemon::AnalyzedModule & analyzed_module = daemon.analyzed_modules[std::string(module_name)];
+			analyzed_module.module_hashes = module_hashes;
+			analyzed_module.program = std::move(*program);
+		}
+
+		// Old versions of the modules whose files were edited are dropped. The modules of this request are kept even if it failed.
+		std::unordered_set<uint64_t> used_module_hashes(module_hashes.begin(), module_hashes.end());
+		for (auto const & [name, analyzed_module] : daemon.analyzed_modules)
+			used_module_hashes.insert(analyzed_module.module_hashes.begin(), analyzed_module.module_hashes.end());
+		for (auto parsed_module = daemon.parsed_modules.begin(); parsed_module != daemon.parsed_modules.end();)
+		{
+			if (used_module_hashes.count(parsed_module->first) == 0)
+				parsed_module = daemon.parsed_modules.erase(parsed_module);
+			else
+				++parsed_module;
+		}
+
+		if (!program.has_value())
+			return Error(std::move(program.error()));
+		return &daemon.analyzed_modules[std::string(module_name)].program;
+	}
+
+	auto serve_request(CompilerDaemon & daemon, std::string_view request) noexcept -> std::string
+	{
+		using namespace compiler_daemon_locals;
+
+		std::string_view const command = extract_word(request);
+		if (command != "check" && command != "run" && command != "compile")
+			return error_response(join("Unknown command ", command));
+
+		std::string_view const module_name = extract_word(request);
+		if (module_name.empty())
+			return error_response("Expected a command and a module.");
+
+		auto const program = analyzed_program(daemon, module_name);
+		if (!program.has_value())
+			return error_response(error_string(program.error()));
+
+		if (command == "check")
+		{
+			return "ok\n";
+		}
+		else if (command == "run")
+		{
+			if ((*program)->main_function == function_id_constants::invalid)
+				return error_response("The module has no main function.");
+
+#if AFIL_WINDOWS
+			return run_response(**program);
+#else
+			return run_in_child_process(**program, daemon.run_time_limit_milliseconds);
+#endif
+		}
+		else
+		{
+			std::string_view const image_path = extract_word(request);
+			if (image_path.empty())
+				return error_response("Expected the path of the program image.");
+			if (!complete::save_program_image(**program, std::filesystem::path(image_path)))
+				return error_response(join("Cannot save program image ", image_path));
+			return "ok\n";
+		}
+	}
+
+	auto run_compiler_daemon(CompilerDaemon & daemon, std::filesystem::path const & socket_path) noexcept -> expected<void, std::string>
+	{
+#if AFIL_WINDOWS
+		// Only POSIX sockets are supported for now.
+		static_cast<void>(daemon);
+		static_cast<void>(socket_path);
+		return Error(std::string("The compiler daemon is not supported on Windows."));
+#else
+		using namespace compiler_daemon_locals;
+
+		std::string const path = socket_path.string();
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path))
+			return Error(join("The socket path ", path, " is too long."));
+		memcpy(address.sun_path, path.data(), path.size());
+
+		// A socket left behind by a daemon that was killed would make bind fail. Anything else at the path is left alone.
+		struct stat existing_file;
+		if (lstat(path.c_str(), &existing_file) == 0)
+		{
+			if (!S_ISSOCK(existing_file.st_mode))
+				return Error(join(path, " already exists and is not a socket."));
+			unlink(path.c_str());
+		}
+		else if (errno != ENOENT)
+			return Error(join("Cannot access ", path, ": ", strerror(errno)));
+
+		int const listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener == -1)
+			return Error(join("Cannot create a socket: ", strerror(errno)));
+
+		// Clients can run programs and write images anywhere the daemon can, so only its owner may connect.
+		// The permissions of the socket come from the umask when it is created by bind.
+		mode_t const previous_umask = umask(077);
+		bool const is_bound = bind(listener, reinterpret_cast<sockaddr const *>(&address), sizeof(address)) == 0;
+		umask(previous_umask);
+		if (!is_bound || listen(listener, SOMAXCONN) != 0)
+		{
+			std::string error = join("Cannot listen on socket ", path, ": ", strerror(errno));
+			close(listener);
+			return Error(std::move(error));
+		}
+
+		for (;;)
+		{
+			int const connection = accept(listener, nullptr, nullptr);
+			if (connection == -1)
+			{
+				if (errno == EINTR || errno == ECONNABORTED)
+					continue;
+				std::string error = join("Cannot accept connections: ", strerror(errno));
+				close(listener);
+				return Error(std::move(error));
+			}
+
+			// A client that neither sends its request nor reads the response would block the requests of the other clients.
+			set_timeout(connection, SO_RCVTIMEO, daemon.connection_timeout_milliseconds);
+			set_timeout(connection, SO_SNDTIMEO, daemon.connection_timeout_milliseconds);
+
+			// The request ends at the first new line or when the client shuts down its side of the connection.
+			std::string request;
+			char buffer[512];
+			bool timed_out = false;
+			while (request.size() < max_request_size && request.find('\n') == std::string::npos)
+			{
+				ssize_t const bytes_read = recv(connection, buffer, sizeof(buffer), 0);
+				if (bytes_read > 0)
+					request.append(buffer, static_cast<size_t>(bytes_read));
+				else if (bytes_read == 0 || errno != EINTR)
+				{
+					timed_out = (bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK));
+					break;
+				}
+			}
+
+			// What was received of a request that timed out may be cut anywhere, so it is not served.
+			if (timed_out)
+			{
+				close(connection);
+				continue;
+			}
+
+			std::string const response = serve_request(daemon, split_first_line(request).first);
+
+			// The client may have gone away already, in which case the response is dropped without raising SIGPIPE.
+			size_t bytes_sent = 0;
+			while (bytes_sent < response.size())
+			{
+				ssize_t const sent = send(connection, response.data() + bytes_sent, response.size() - bytes_sent, MSG_NOSIGNAL);
+				if (sent > 0)
+					bytes_sent += static_cast<size_t>(sent);
+				else if (sent == 0 || errno != EINTR)
+					break;
+			}
+			close(connection);
+		}
+#endif
+	}
+
+} // namespace afil
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "incomplete_module.hh"
+#include "module_cache.hh"
+#include "parser.hh"
+#include "program.hh"
+#include "syntax_error.hh"
+#include "utils/expected.hh"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace afil
+{
+
+	// State that a long running compiler keeps between requests so that compiling modules again only does the work for what changed.
+	// The resolver keeps the sources of the files and the parsed modules are kept in memory by their hash, so only the modules that changed
+	// are parsed again. The module cache, if there is one, is used for the modules that aren't in memory yet. The analyzed program of each
+	// entry module is kept with the hashes of its modules, so it is reused for as long as none of their files change.
+	// The files are edited while the daemon runs, so the resolver reads them into buffers instead of mapping them.
+	struct CompilerDaemon
+	{
+		CompilerDaemon() noexcept { resolver.map_files = false; }
+
+		struct ParsedModule
+		{
+			incomplete::Module module; // Its statements point into the sources of its files, which are kept with it.
+			std::vector<parser::TypeName> type_names;
+		};
+
+		struct AnalyzedModule
+		{
+			std::vector<uint64_t> module_hashes; // The first one is the hash of the entry module, which covers all of its dependencies.
+			complete::Program program;
+		};
+
+		incomplete::ModuleResolver resolver;
+		std::optional<incomplete::ModuleCache> cache;
+		std::unordered_map<uint64_t, ParsedModule> parsed_modules; // By module hash. Only the modules of the analyzed programs are kept.
+		std::unordered_map<std::string, AnalyzedModule> analyzed_modules; // By module name.
+		int connection_timeout_milliseconds = 5000; // For a client to send its request and to receive the response.
+		int run_time_limit_milliseconds = 10000; // For a program that is run, after which it is killed.
+	};
+
+	// Returns the analyzed program of the module. It is analyzed again only if a file of the module or of its dependencies changed, in which case
+	// only the modules whose files or dependencies changed are parsed again. The program stays valid until the next call for the same module.
+	auto analyzed_program(CompilerDaemon & daemon, std::string_view module_name) noexcept -> expected<complete::Program const *, SyntaxError>;
+
+	// Requests are one line, with paths relative to the working directory of the daemon:
+	//   check <module>                 Analyzes the module.
+	//   run <module>                   Runs the module in a child process of the daemon, which is killed if it runs for longer than
+	//                                  the time limit. What it prints goes to the output of the daemon.
+	//   compile <module> <image>       Saves the analyzed module as a program image that can be run with --run-image.
+	// The first line of the response is "ok", followed by the exit code for run, or "error", followed by the error in the next lines.
+	auto serve_request(CompilerDaemon & daemon, std::string_view request) noexcept -> std::string;
+
+	// Listens on a Unix domain socket created at socket_path, replacing a socket that is already there, and serves one request per
+	// connection until the process is killed. Only the user that runs the daemon can connect to the socket. Requests are served one at
+	// a time, so a client that doesn't send its request or doesn't read the response is dropped after the connection timeout.
+	// Returns an error if the socket can't be created, or if there is already a file that is not a socket at socket_path.
+	[[nodiscard]] auto run_compiler_daemon(CompilerDaemon & daemon, std::filesystem::path const & socket_path) noexcept -> expected<void, std::string>;
+
+} // namespace afil
@@ -1,5 +1,8 @@
 #include "complete_scope.hh"
 #include "program.hh"
+#include "utils/algorithm.hh"
+#include "utils/unreachable.hh"
+#include <cassert>
 
 namespace complete
 {
@@ -126,9 +129,137 @@ namespace complete
             type == TypeId::uint8 || type == TypeId::uint16 || type == TypeId::uint32 || type == TypeId::uint64;
     }
 
+	auto index_name(Scope & scope, Symbol name, NameKind kind, size_t index) -> void
+	{
+		scope.name_index.entries[name.id].push_back({kind, static_cast<unsigned>(index)});
+	}
+
+	template <typename T>
+	auto remove_names_from_scope(Scope & scope, std::vector<T> & names, NameKind kind, size_t new_size) noexcept -> void
+	{
+		for (size_t i = new_size; i < names.size(); ++i)
+		{
+			auto const it = scope.name_index.entries.find(names[i].name.id);
+			assert(it != scope.name_index.entries.end());
+			std::vector<ScopeNameIndex::Entry> & entries = it->second;
+			auto const entry = std::find_if(entries, [=](ScopeNameIndex::Entry entry) { return entry.kind == kind && entry.index == i; });
+			assert(entry != entries.end());
+			entries.erase(entry);
+			if (entries.empty())
+				scope.name_index.entries.erase(it);
+		}
+		names.resize(new_size);
+	}
+
+	template <typename T>
+	auto find_name(Scope const & scope, std::vector<T> const & names, NameKind kind, Symbol name) noexcept -> T const *
+	{
+		auto const it = scope.name_index.entries.find(name.id);
+		if (it == scope.name_index.entries.end())
+			return nullptr;
+
+		for (ScopeNameIndex::Entry const entry : it->second)
+			if (entry.kind == kind)
+				return &names[entry.index];
+
+		return nullptr;
+	}
+
+	template <typename T, typename Id>
+	auto find_names(Scope const & scope, std::vector<T> const & names, NameKind kind, Symbol name, std::vector<Id> & ids) -> void
+	{
+		auto const it = scope.name_index.entries.find(name.id);
+		if (it == scope.name_index.entries.end())
+			return;
+
+		for (ScopeNameIndex::Entry const entry : it->second)
+			if (entry.kind == kind)
+				ids.push_back(names[entry.index].id);
+	}
+
 	auto add_variable_to_scope(complete::Scope & scope, std::string_view name, complete::TypeId type_id, int scope_offset, complete::Program const & program) -> int
 	{
+		return add_variable_to_scope(scope, intern(name), type_id, scope_offset, program);
+	}
+
+	auto add_variable_to_scope(complete::Scope & scope, Symbol name, complete::TypeId type_id, int scope_offset, complete::Program const & program) -> int
+	{
+		index_name(scope, name, NameKind::variable, scope.variables.size());
 		return add_variable_to_scope(scope.variables, scope.stack_frame_size, scope.stack_frame_alignment, name, type_id, scope_offset, program);
 	}
 
+	auto add_constant_to_scope(Scope & scope, Constant constant) -> void
+	{
+		index_name(scope, constant.name, NameKind::constant, scope.constants.size());
+		scope.constants.push_back(std::move(constant));
+	}
+
+	auto add_function_to_scope(Scope & scope, Symbol name, FunctionId id) -> void
+	{
+		index_name(scope, name, NameKind::function, scope.functions.size());
+		scope.functions.push_back({name, id});
+	}
+
+	auto add_type_to_scope(Scope & scope, Symbol name, TypeId id) -> void
+	{
+		index_name(scope, name, NameKind::type, scope.types.size());
+		scope.types.push_back({name, id});
+	}
+
+	auto add_function_template_to_scope(Scope & scope, Symbol name, FunctionTemplateId id) -> void
+	{
+		index_name(scope, name, NameKind::function_template, scope.function_templates.size());
+		scope.function_templates.push_back({name, id});
+	}
+
+	auto add_struct_template_to_scope(Scope & scope, Symbol name, StructTemplateId id) -> void
+	{
+		index_name(scope, name, NameKind::struct_template, scope.struct_templates.size());
+		scope.struct_templates.push_back({name, id});
+	}
+
+	auto remove_names_from_scope(Scope & scope, NameKind kind, size_t new_size) noexcept -> void
+	{
+		switch (kind)
+		{
+			case NameKind::variable:			return remove_names_from_scope(scope, scope.variables, kind, new_size);
+			case NameKind::constant:			return remove_names_from_scope(scope, scope.constants, kind, new_size);
+			case NameKind::function:			return remove_names_from_scope(scope, scope.functions, kind, new_size);
+			case NameKind::type:				return remove_names_from_scope(scope, scope.types, kind, new_size);
+			case NameKind::function_template:	return remove_names_from_scope(scope, scope.function_templates, kind, new_size);
+			case NameKind::struct_template:		return remove_names_from_scope(scope, scope.struct_templates, kind, new_size);
+		}
+		declare_unreachable();
+	}
+
+	auto find_variable(Scope const & scope, Symbol name) noexcept -> Variable const *
+	{
+		return find_name(scope, scope.variables, NameKind::variable, name);
+	}
+
+	auto find_constant(Scope const & scope, Symbol name) noexcept -> Constant const *
+	{
+		return find_name(scope, scope.constants, NameKind::constant, name);
+	}
+
+	auto find_type(Scope const & scope, Symbol name) noexcept -> TypeName const *
+	{
+		return find_name(scope, scope.types, NameKind::type, name);
+	}
+
+	auto find_struct_template(Scope const & scope, Symbol name) noexcept -> StructTemplateName const *
+	{
+		return find_name(scope, scope.struct_templates, NameKind::struct_template, name);
+	}
+
+	auto find_functions(Scope const & scope, Symbol name, std::vector<FunctionId> & function_ids) -> void
+	{
+		find_names(scope, scope.functions, NameKind::function, name, function_ids);
+	}
+
+	auto find_function_templates(Scope const & scope, Symbol name, std::vector<FunctionTemplateId> & function_template_ids) -> void
+	{
+		find_names(scope, scope.function_templates, NameKind::function_template, name, function_template_ids);
+	}
+
 } // namespace complete
@@ -2,9 +2,12 @@
 
 #include "utils/compatibility.hh"
 #include "function_id.hh"
+#include "symbol.hh"
 #include "utils/utils.hh"
 #include <algorithm>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace complete
@@ -67,26 +70,26 @@ namespace complete
 
 	struct Variable
 	{
-		std::string name;
+		Symbol name;
 		TypeId type;
 		int offset;
 	};
 
 	struct FunctionName
 	{
-		std::string name;
+		Symbol name;
 		FunctionId id;
 	};
 
 	struct TypeName
 	{
-		std::string name;
+		Symbol name;
 		TypeId id;
 	};
 
 	struct FunctionTemplateName
 	{
-		std::string name;
+		Symbol name;
 		FunctionTemplateId id;
 	};
 
@@ -96,17 +99,39 @@ namespace complete
 
 	struct StructTemplateName
 	{
-		std::string name;
+		Symbol name;
 		StructTemplateId id;
 	};
 
 	struct Constant
 	{
-		std::string name;
+		Symbol name;
 		std::vector<char> value;
 		TypeId type;
 	};
 
+	enum struct NameKind : unsigned char
+	{
+		variable,
+		constant,
+		function,
+		type,
+		function_template,
+		struct_template
+	};
+
+	// Maps the id of a name to the positions where it is declared in the vectors of a scope, in declaration order.
+	struct ScopeNameIndex
+	{
+		struct Entry
+		{
+			NameKind kind;
+			unsigned index;
+		};
+
+		std::unordered_map<unsigned, std::vector<Entry>> entries;
+	};
+
 	struct Scope
 	{
 		int stack_frame_size = 0;
@@ -117,14 +142,41 @@ namespace complete
 		std::vector<TypeName> types;
 		std::vector<FunctionTemplateName> function_templates;
 		std::vector<StructTemplateName> struct_templates;
+		ScopeNameIndex name_index;
 	};
 
+	// Names must be added to a scope through these functions so that the name index stays in sync.
+	auto add_constant_to_scope(Scope & scope, Constant constant) -> void;
+	auto add_function_to_scope(Scope & scope, Symbol name, FunctionId id) -> void;
+	auto add_type_to_scope(Scope & scope, Symbol name, TypeId id) -> void;
+	auto add_function_template_to_scope(Scope & scope, Symbol name, FunctionTemplateId id) -> void;
+	auto add_struct_template_to_scope(Scope & scope, Symbol name, StructTemplateId id) -> void;
+
+	// Removes the names of the given kind declared after the first new_size ones.
+	auto remove_names_from_scope(Scope & scope, NameKind kind, size_t new_size) noexcept -> void;
+
+	// Hashed lookups. Return the first declaration with the given name or nullptr if there is none.
+	auto find_variable(Scope const & scope, Symbol name) noexcept -> Variable const *;
+	auto find_constant(Scope const & scope, Symbol name) noexcept -> Constant const *;
+	auto find_type(Scope const & scope, Symbol name) noexcept -> TypeName const *;
+	auto find_struct_template(Scope const & scope, Symbol name) noexcept -> StructTemplateName const *;
+
+	// Append every function or function template with the given name in declaration order.
+	auto find_functions(Scope const & scope, Symbol name, std::vector<FunctionId> & function_ids) -> void;
+	auto find_function_templates(Scope const & scope, Symbol name, std::vector<FunctionTemplateId> & function_template_ids) -> void;
+
 	template <typename T>
 	auto add_variable_to_scope(
 		std::vector<T> & variables, int & scope_size, int & scope_alignment,
 		std::string_view name, complete::TypeId type_id, int scope_offset, complete::Program const & program) -> int;
 
+	template <typename T>
+	auto add_variable_to_scope(
+		std::vector<T> & variables, int & scope_size, int & scope_alignment,
+		Symbol name, complete::TypeId type_id, int scope_offset, complete::Program const & program) -> int;
+
 	auto add_variable_to_scope(complete::Scope & scope, std::string_view name, complete::TypeId type_id, int scope_offset, complete::Program const & program) -> int;
+	auto add_variable_to_scope(complete::Scope & scope, Symbol name, complete::TypeId type_id, int scope_offset, complete::Program const & program) -> int;
 
 } // namespace complete
 
@@ -140,6 +192,14 @@ namespace complete
 	auto add_variable_to_scope(
 		std::vector<T> & variables, int & scope_size, int & scope_alignment,
 		std::string_view name, complete::TypeId type_id, int scope_offset, complete::Program const & program) -> int
+	{
+		return add_variable_to_scope(variables, scope_size, scope_alignment, intern(name), type_id, scope_offset, program);
+	}
+
+	template <typename T>
+	auto add_variable_to_scope(
+		std::vector<T> & variables, int & scope_size, int & scope_alignment,
+		Symbol name, complete::TypeId type_id, int scope_offset, complete::Program const & program) -> int
 	{
 		int const size = type_size(program, type_id);
 		int const alignment = type_alignment(program, type_id);
@@ -36,7 +36,7 @@ namespace incomplete
 
 		struct IdentifierInsideStruct
 		{
-			TypeId type;
+			value_ptr<TypeId> type;
 			std::string_view name;
 		};
 
@@ -62,19 +62,20 @@ namespace incomplete
 			value_ptr<Expression> index;
 		};
 
+		// Functions are boxed to keep them from making every expression node as big as them.
 		struct Function
 		{
-			incomplete::Function function;
+			value_ptr<incomplete::Function> function;
 		};
 
 		struct FunctionTemplate
 		{
-			incomplete::FunctionTemplate function_template;
+			value_ptr<incomplete::FunctionTemplate> function_template;
 		};
 
 		struct ExternFunction
 		{
-			incomplete::ExternFunction function;
+			value_ptr<incomplete::ExternFunction> function;
 		};
 
 		struct FunctionCall
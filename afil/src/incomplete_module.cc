@@ -10,7 +10,7 @@
 #include "utils/load_dll.hh"
 #include <string>
 #include <filesystem>
-#include <map>
+#include <unordered_map>
 
 using namespace std::literals;
 
@@ -55,16 +55,74 @@ namespace incomplete
 		return sorted_modules;
 	}
 
+	auto resolve_canonical_path(ModuleResolver & resolver, std::filesystem::path const & path) noexcept -> std::filesystem::path const *
+	{
+		std::error_code error;
+		std::filesystem::path absolute_path = std::filesystem::absolute(path, error);
+		if (error)
+			return nullptr;
+
+		auto const it = resolver.canonical_paths.find(absolute_path.native());
+		if (it != resolver.canonical_paths.end())
+			return &it->second;
+
+		std::filesystem::path canonical_path = std::filesystem::canonical(absolute_path, error);
+		if (error)
+			return nullptr;
+
+		return &resolver.canonical_paths.emplace(absolute_path.native(), std::move(canonical_path)).first->second;
+	}
+
+	auto load_source(ModuleResolver & resolver, std::filesystem::path const & canonical_path) noexcept -> SourceBuffer const *
+	{
+		std::error_code error;
+		std::filesystem::file_time_type const last_write_time = std::filesystem::last_write_time(canonical_path, error);
+		if (error)
+			return nullptr;
+		std::uintmax_t const file_size = std::filesystem::file_size(canonical_path, error);
+		if (error)
+			return nullptr;
+
+		auto const it = resolver.sources.find(canonical_path.native());
+		if (it != resolver.sources.end() && it->second.last_write_time == last_write_time && it->second.file_size == file_size)
+			return &it->second.source;
+
+		// If the file is written again while it is loaded, it has a later write time or another size than the ones stored here and will be loaded again next time.
+		std::optional<SourceBuffer> source;
+		if (resolver.map_files)
+			source = load_source_file(canonical_path);
+		else if (std::optional<std::string> text = load_whole_file(canonical_path))
+			source = SourceBuffer(std::move(*text));
+		if (!source.has_value())
+		{
+			if (it != resolver.sources.end())
+				resolver.sources.erase(it);
+			return nullptr;
+		}
+
+		ModuleResolver::LoadedSource & loaded_source = resolver.sources[canonical_path.native()];
+		loaded_source.last_write_time = last_write_time;
+		loaded_source.file_size = file_size;
+		loaded_source.source = std::move(*source);
+		return &loaded_source.source;
+	}
+
 	constexpr std::string_view import_keyword = "import";
 	constexpr std::string_view file_keyword = "file";
 	constexpr std::string_view module_extension = ".afilm";
 
+	struct ScanState
+	{
+		ModuleResolver & resolver;
+		std::unordered_map<std::filesystem::path::string_type, int> scanned_modules; // By canonical path.
+		std::unordered_map<std::filesystem::path::string_type, std::string> loaded_files; // Name of the module that loaded each file, by canonical path.
+	};
+
 	[[nodiscard]] auto scan_dependencies(
 		std::string_view module_name,
 		std::string_view module_source,
 		std::vector<incomplete::Module> & modules,
-		std::map<std::filesystem::path, int> & already_scanned_modules,
-		std::map<std::filesystem::path, std::string_view> & already_loaded_files) noexcept -> expected<void, SyntaxError>
+		ScanState & state) noexcept -> expected<void, SyntaxError>
 	{
 		auto const current_module_index = &modules.emplace_back() - modules.data();
 
@@ -77,40 +135,47 @@ namespace incomplete
 			if (starts_with(first_line, import_keyword))
 			{
 				std::string_view const dependency_name = ignore_whitespace(first_line.substr(import_keyword.size()));
-				std::filesystem::path canonical_path = std::filesystem::canonical(module_path_from_name(dependency_name));
+				std::filesystem::path const * const canonical_path = resolve_canonical_path(state.resolver, module_path_from_name(dependency_name));
+				if (canonical_path == nullptr)
+					return make_complete_syntax_error(first_line, "Could not open module file.", module_source, module_name);
 
-				auto const it = already_scanned_modules.find(canonical_path);
-				if (it != already_scanned_modules.end())
+				auto const it = state.scanned_modules.find(canonical_path->native());
+				if (it != state.scanned_modules.end())
 				{
 					modules[current_module_index].dependencies.push_back(it->second);
 				}
 				else
 				{
-					std::optional<std::string> dependency_source = load_whole_file(canonical_path);
-					if (!dependency_source.has_value())
-						return make_complete_syntax_error(module_name, "Could not open module file.", module_source, module_name);
+					SourceBuffer const * const loaded_source = load_source(state.resolver, *canonical_path);
+					if (loaded_source == nullptr)
+						return make_complete_syntax_error(first_line, "Could not open module file.", module_source, module_name);
+
+					// Shares the mapping, so that the module file stays loaded while it is scanned even if the resolver loads it again.
+					SourceBuffer const dependency_source = *loaded_source;
 
 					int const dependency_index = static_cast<int>(modules.size());
 					modules[current_module_index].dependencies.push_back(dependency_index);
-					already_scanned_modules[std::move(canonical_path)] = dependency_index;
-					try_call_void(scan_dependencies(dependency_name, std::move(*dependency_source), modules, already_scanned_modules, already_loaded_files));
+					state.scanned_modules[canonical_path->native()] = dependency_index;
+					try_call_void(scan_dependencies(dependency_name, dependency_source, modules, state));
 				}
 			}
 			else if (starts_with(first_line, file_keyword))
 			{
 				std::string_view const file_name = ignore_whitespace(first_line.substr(file_keyword.size()));
-				std::filesystem::path canonical_path = std::filesystem::canonical(file_name);
+				std::filesystem::path const * const canonical_path = resolve_canonical_path(state.resolver, file_name);
+				if (canonical_path == nullptr)
+					return make_complete_syntax_error(first_line, join("Could not open file ", file_name), module_source, module_name);
 
-				auto const it = already_loaded_files.find(canonical_path);
-				if (it != already_loaded_files.end())
+				auto const it = state.loaded_files.find(canonical_path->native());
+				if (it != state.loaded_files.end())
 					return make_complete_syntax_error(first_line, join("File already loaded for module ", it->second), module_source, module_name);
 
-				std::optional<std::string> file_source = load_whole_file(canonical_path);
-				if (!file_source.has_value())
-					return make_complete_syntax_error(first_line, join("Could not open file ", canonical_path), module_source, module_name);
+				SourceBuffer const * const file_source = load_source(state.resolver, *canonical_path);
+				if (file_source == nullptr)
+					return make_complete_syntax_error(first_line, join("Could not open file ", *canonical_path), module_source, module_name);
 
-				modules[current_module_index].files.push_back({ std::string(file_name), std::move(*file_source) });
-				already_loaded_files[std::move(canonical_path)] = module_name;
+				modules[current_module_index].files.push_back({ std::string(file_name), *file_source });
+				state.loaded_files[canonical_path->native()] = std::string(module_name);
 			}
 			else
 			{
@@ -125,11 +190,16 @@ namespace incomplete
 
 	auto load_module_and_dependencies(std::string_view module_name, std::string_view source) noexcept -> expected<std::vector<incomplete::Module>, SyntaxError>
 	{
-		std::vector<incomplete::Module> modules;
-		std::map<std::filesystem::path, int> already_scanned_modules;
-		std::map<std::filesystem::path, std::string_view> already_loaded_files;
+		ModuleResolver resolver;
+		return load_module_and_dependencies(module_name, source, resolver);
+	}
 
-		try_call_void(scan_dependencies(module_name, source, modules, already_scanned_modules, already_loaded_files));
+	auto load_module_and_dependencies(std::string_view module_name, std::string_view source, ModuleResolver & resolver) noexcept
+		-> expected<std::vector<incomplete::Module>, SyntaxError>
+	{
+		std::vector<incomplete::Module> modules;
+		ScanState state{resolver, {}, {}};
+		try_call_void(scan_dependencies(module_name, source, modules, state));
 		return std::move(modules);
 	}
 
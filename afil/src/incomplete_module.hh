@@ -1,10 +1,15 @@
 #pragma once
 
 #include "syntax_error.hh"
+#include "utils/arena.hh"
+#include "utils/mapped_file.hh"
 #include "utils/out.hh"
 #include "utils/span.hh"
-#include <vector>
+#include <cstdint>
+#include <filesystem>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace parser
 {
@@ -21,15 +26,44 @@ namespace incomplete
 		struct File
 		{
 			std::string filename;
-			std::string source;
+			SourceBuffer source; // Mapped from disk for the files of modules. Names point into it and tokens refer to positions in it.
 		};
 
+		Arena arena; // The nodes of the statements are allocated from it. First so that it is destroyed after them.
 		std::vector<File> files;
 		std::vector<int> dependencies;
 		std::vector<incomplete::Statement> statements;
 	};
 
+	// Resolves the paths in module files to canonical paths and keeps the sources it loads, so that loading several modules that share
+	// dependencies, for example one after another by the same process, doesn't resolve and read the same files again.
+	// A source is loaded again if the last write time or the size of its file changes. The size catches most writes that happen
+	// within the resolution of the write time of the file system. Paths are relative to the working directory, and canonical paths
+	// are kept for as long as the resolver, so symbolic links must not be changed to point somewhere else while it is in use.
+	struct ModuleResolver
+	{
+		struct LoadedSource
+		{
+			std::filesystem::file_time_type last_write_time;
+			std::uintmax_t file_size;
+			SourceBuffer source;
+		};
+
+		std::unordered_map<std::filesystem::path::string_type, std::filesystem::path> canonical_paths; // By absolute path as written.
+		std::unordered_map<std::filesystem::path::string_type, LoadedSource> sources; // By canonical path.
+
+		// Reading a mapping of a file that was truncated after it was mapped raises SIGBUS, so a process that keeps the resolver
+		// while the files may be edited should read them into buffers instead.
+		bool map_files = true;
+	};
+
+	// Return nullptr if the file does not exist or can't be read.
+	auto resolve_canonical_path(ModuleResolver & resolver, std::filesystem::path const & path) noexcept -> std::filesystem::path const *;
+	auto load_source(ModuleResolver & resolver, std::filesystem::path const & canonical_path) noexcept -> SourceBuffer const *;
+
 	auto load_module_and_dependencies(std::string_view module_name, std::string_view source) noexcept -> expected<std::vector<incomplete::Module>, SyntaxError>;
+	auto load_module_and_dependencies(std::string_view module_name, std::string_view source, ModuleResolver & resolver) noexcept
+		-> expected<std::vector<incomplete::Module>, SyntaxError>;
 	auto sort_modules_by_dependencies(span<incomplete::Module const> modules) noexcept -> expected<std::vector<int>, SyntaxError>;
 	auto module_path_from_name(std::string_view module_name) noexcept -> std::string;
 	auto file_that_contains(Module const & module, std::string_view src) noexcept -> Module::File const *;
@@ -39,7 +39,8 @@ namespace incomplete
 		};
 		struct Deduce{};
 
-		std::variant<BaseCase, Pointer, Array, ArrayPointer, TemplateInstantiation, Deduce> value;
+		// Template instantiations are boxed because they are far bigger than the other alternatives.
+		std::variant<BaseCase, Pointer, Array, ArrayPointer, value_ptr<TemplateInstantiation>, Deduce> value;
 		bool is_mutable : 1;
 		bool is_reference : 1;
 
@@ -69,14 +69,15 @@ namespace incomplete
 		struct Break {};
 		struct Continue {};
 
+		// Structs are boxed to keep them from making every statement node as big as them.
 		struct StructDeclaration
 		{
-			Struct declared_struct;
+			value_ptr<Struct> declared_struct;
 		};
 
 		struct StructTemplateDeclaration
 		{
-			StructTemplate declared_struct_template;
+			value_ptr<StructTemplate> declared_struct_template;
 		};
 
 		struct TypeAliasDeclaration
@@ -104,6 +104,7 @@ namespace interpreter
 	) noexcept -> expected<void, UnmetPrecondition>
 	{
 		assert(is_constant_expression(expression, *args.program, next_block_scope_offset(args.scope_stack)));
+		instantiation::note_compile_time_evaluation(expression, args.template_cache);
 
 		interpreter::ProgramStack stack;
 		alloc_stack(stack, 256);
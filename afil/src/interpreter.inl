@@ -454,7 +454,7 @@ namespace interpreter
 		}
 		else if (function_id.type == FunctionId::Type::program)
 		{
-			auto const func = [&context, function_id]() -> complete::Function const & { return context.program.functions[function_id.index]; };
+			auto const func = [&context, function_id]() -> complete::Function const & { return complete::function_to_run(context.program, function_id); };
 
 			// Run the preconditions
 			int const parameters_start = stack.base_pointer;
@@ -2,46 +2,77 @@
 #include "syntax_error.hh"
 #include "utils/unreachable.hh"
 #include "utils/multicomparison.hh"
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstdint>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define AFIL_LEXER_AVX2
+	#define AFIL_LEXER_SIMD
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define AFIL_LEXER_SSE2
+	#define AFIL_LEXER_SIMD
+#endif
+
+#if defined(AFIL_LEXER_SIMD) && defined(_MSC_VER) && !defined(__clang__)
+	#include <intrin.h>
+#endif
 
 using namespace std::literals;
 
 namespace lex
 {
 
-	auto starts_with(std::string_view s, int index, std::string_view pattern) noexcept -> bool
+	// Every char of the source is classified with a single lookup in this table.
+	namespace char_class
 	{
-		int const pattern_length = static_cast<int>(pattern.size());
-		if (pattern_length > static_cast<int>(s.size()) - index)
-			return false;
-		return std::equal(pattern.begin(), pattern.end(), s.begin() + index);
-	}
-
-	auto is_number(char c) noexcept -> bool
+		constexpr uint8_t whitespace		= 1 << 0;
+		constexpr uint8_t digit				= 1 << 1;
+		constexpr uint8_t operator_first	= 1 << 2; // + - * / % < > = ! & | ~ ^
+		constexpr uint8_t reserved			= 1 << 3; // ( ) { } [ ] ; , . :
+		constexpr uint8_t identifier		= 1 << 4; // Anything that isn't whitespace, an operator or reserved.
+	} // namespace char_class
+
+	constexpr auto make_char_class_table() noexcept -> std::array<uint8_t, 256>
 	{
-		return (c >= '0') && (c <= '9');
+		std::array<uint8_t, 256> table{};
+		for (char const c : " \n\t\r"sv)
+			table[static_cast<unsigned char>(c)] |= char_class::whitespace;
+		for (char const c : "0123456789"sv)
+			table[static_cast<unsigned char>(c)] |= char_class::digit;
+		for (char const c : "+-*/%<>=!&|~^"sv)
+			table[static_cast<unsigned char>(c)] |= char_class::operator_first;
+		for (char const c : "(){}[];,.:"sv)
+			table[static_cast<unsigned char>(c)] |= char_class::reserved;
+		for (uint8_t & c : table)
+			if ((c & (char_class::whitespace | char_class::operator_first | char_class::reserved)) == 0)
+				c |= char_class::identifier;
+		return table;
 	}
 
-	auto is_first_char_of_operator(char c) noexcept -> bool
+	constexpr std::array<uint8_t, 256> char_class_table = make_char_class_table();
+
+	auto char_class_of(char c) noexcept -> uint8_t
 	{
-		return
-			(c == '+') || (c == '-') || (c == '*') || (c == '/') || (c == '%') || (c == '<') || 
-			(c == '>') || (c == '=') || (c == '!') || (c == '&') || (c == '|') || (c == '~') || (c == '^');
+		return char_class_table[static_cast<unsigned char>(c)];
 	}
 
-	auto is_reserved_for_the_language(char c) noexcept -> bool
+	auto is_number(char c) noexcept -> bool
 	{
-		return (c == '(') || (c == ')') || (c == '{') || (c == '}') || (c == '[') || (c == ']') || (c == ';') || (c == ',') || (c == '.') || (c == ':');
+		return (char_class_of(c) & char_class::digit) != 0;
 	}
 
 	auto is_whitespace(char c) noexcept -> bool
 	{
-		return (c == ' ') || (c == '\n') || (c == '\t');
+		return (char_class_of(c) & char_class::whitespace) != 0;
 	}
 
 	auto is_valid_identifier_char(char c) noexcept -> bool
 	{
-		return !(is_first_char_of_operator(c) || is_reserved_for_the_language(c) || is_whitespace(c));
+		return (char_class_of(c) & char_class::identifier) != 0;
 	}
 
 	auto is_valid_after_literal(char c) noexcept -> bool
@@ -49,66 +80,149 @@ namespace lex
 		return !is_valid_identifier_char(c);
 	}
 
-	auto is_operator(std::string_view src, int index) noexcept -> bool
+	auto starts_with(std::string_view s, int index, std::string_view pattern) noexcept -> bool
 	{
-		char const c = src[index];
-		return 
-			is_first_char_of_operator(c)
-			|| starts_with(src, index, "=="sv)
-			|| starts_with(src, index, "!="sv)
-			|| (starts_with(src, index, "and"sv) && is_valid_after_literal(src[index + 3]))
-			|| (starts_with(src, index, "or"sv) && is_valid_after_literal(src[index + 2]))
-			|| (starts_with(src, index, "xor"sv) && is_valid_after_literal(src[index + 3]))
-			|| (starts_with(src, index, "not"sv) && is_valid_after_literal(src[index + 3]))
-			;
+		int const pattern_length = static_cast<int>(pattern.size());
+		if (pattern_length > static_cast<int>(s.size()) - index)
+			return false;
+		return std::equal(pattern.begin(), pattern.end(), s.begin() + index);
 	}
 
-	auto is_arrow(std::string_view src, int index) noexcept -> bool
+	auto end_reached(std::string_view src, int index) noexcept -> bool
 	{
-		return starts_with(src, index, "->"sv);
+		return index >= static_cast<int>(src.size());
 	}
 
-	auto is_scope_resolution(std::string_view src, int index) noexcept -> bool
+	// The source may be a mapped file that isn't null terminated, so past its end we read whitespace, which ends any token.
+	auto char_at(std::string_view src, int index) noexcept -> char
 	{
-		return starts_with(src, index, "::"sv);
+		return end_reached(src, index) ? ' ' : src[index];
 	}
 
-	auto is_boolean(std::string_view src, int index) noexcept -> bool
+#if defined(AFIL_LEXER_SIMD)
+	auto count_trailing_zeros(uint32_t mask) noexcept -> int
 	{
-		return 
-			(starts_with(src, index, "true"sv) && is_valid_after_literal(src[index + 4])) ||
-			(starts_with(src, index, "false"sv) && is_valid_after_literal(src[index + 5]));
+		assert(mask != 0);
+	#if defined(_MSC_VER) && !defined(__clang__)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<int>(index);
+	#else
+		return __builtin_ctz(mask);
+	#endif
 	}
 
-	auto end_reached(std::string_view src, int index) noexcept -> bool
+	// The widest vector of chars the target supports. Masks have one bit per char, the first char in the lowest bit.
+	struct simd
 	{
-		return index >= static_cast<int>(src.size());
+	#if defined(AFIL_LEXER_AVX2)
+		using vector = __m256i;
+		static constexpr int width = 32;
+		static constexpr uint32_t all_chars = 0xFFFF'FFFF;
+
+		static auto load(char const * p) noexcept -> vector { return _mm256_loadu_si256(reinterpret_cast<vector const *>(p)); }
+		static auto splat(char c) noexcept -> vector { return _mm256_set1_epi8(c); }
+		static auto equal(vector a, vector b) noexcept -> vector { return _mm256_cmpeq_epi8(a, b); }
+		static auto less(vector a, vector b) noexcept -> vector { return _mm256_cmpgt_epi8(b, a); } // Signed
+		static auto add(vector a, vector b) noexcept -> vector { return _mm256_add_epi8(a, b); }
+		static auto or_(vector a, vector b) noexcept -> vector { return _mm256_or_si256(a, b); }
+		static auto mask(vector v) noexcept -> uint32_t { return static_cast<uint32_t>(_mm256_movemask_epi8(v)); }
+	#else
+		using vector = __m128i;
+		static constexpr int width = 16;
+		static constexpr uint32_t all_chars = 0xFFFF;
+
+		static auto load(char const * p) noexcept -> vector { return _mm_loadu_si128(reinterpret_cast<vector const *>(p)); }
+		static auto splat(char c) noexcept -> vector { return _mm_set1_epi8(c); }
+		static auto equal(vector a, vector b) noexcept -> vector { return _mm_cmpeq_epi8(a, b); }
+		static auto less(vector a, vector b) noexcept -> vector { return _mm_cmplt_epi8(a, b); } // Signed
+		static auto add(vector a, vector b) noexcept -> vector { return _mm_add_epi8(a, b); }
+		static auto or_(vector a, vector b) noexcept -> vector { return _mm_or_si128(a, b); }
+		static auto mask(vector v) noexcept -> uint32_t { return static_cast<uint32_t>(_mm_movemask_epi8(v)); }
+	#endif
+	};
+
+	auto whitespace_mask(simd::vector chars) noexcept -> uint32_t
+	{
+		return simd::mask(simd::or_(
+			simd::or_(simd::equal(chars, simd::splat(' ')), simd::equal(chars, simd::splat('\n'))),
+			simd::or_(simd::equal(chars, simd::splat('\t')), simd::equal(chars, simd::splat('\r')))
+		));
+	}
+
+	// Chars in [first, first + count). Adding 128 - first maps the range to the lowest signed values, so a single signed comparison checks it.
+	auto in_range(simd::vector chars, char first, int count) noexcept -> simd::vector
+	{
+		simd::vector const shifted = simd::add(chars, simd::splat(static_cast<char>(128 - first)));
+		return simd::less(shifted, simd::splat(static_cast<char>(count - 128)));
+	}
+
+	// Letters, digits and '_'. They are the usual identifier chars, but not the only ones, so a run of them may be followed by more identifier chars.
+	auto word_mask(simd::vector chars) noexcept -> uint32_t
+	{
+		simd::vector const lowercase = simd::or_(chars, simd::splat(0x20));
+		return simd::mask(simd::or_(
+			simd::or_(in_range(lowercase, 'a', 26), in_range(chars, '0', 10)),
+			simd::equal(chars, simd::splat('_'))
+		));
+	}
+
+	auto char_mask(simd::vector chars, char c) noexcept -> uint32_t
+	{
+		return simd::mask(simd::equal(chars, simd::splat(c)));
+	}
+#endif
+
+	// Returns the index of the first c at or after index, or the size of the source if there is none.
+	auto find_char(std::string_view src, int index, char c) noexcept -> int
+	{
+		int const size = static_cast<int>(src.size());
+#if defined(AFIL_LEXER_SIMD)
+		for (; index + simd::width <= size; index += simd::width)
+			if (uint32_t const matches = char_mask(simd::load(src.data() + index), c))
+				return index + count_trailing_zeros(matches);
+#endif
+		while (index < size && src[index] != c)
+			++index;
+		return index;
 	}
 
 	// Skips all whitespace and returns the number of characters skipped.
 	auto skip_whitespace(std::string_view src, int index) noexcept -> int
 	{
-		int chars_skipped = 0;
-		while (!end_reached(src, index + chars_skipped) && is_whitespace(src[index + chars_skipped]))
-			chars_skipped++;
-		return chars_skipped;
+		int const size = static_cast<int>(src.size());
+		int end = index;
+#if defined(AFIL_LEXER_SIMD)
+		// Tokens are usually separated by a single space or none, which isn't worth a vector load.
+		if (end + 1 < size && !is_whitespace(src[end + 1]))
+			return is_whitespace(src[end]) ? 1 : 0;
+		for (; end + simd::width <= size; end += simd::width)
+			if (uint32_t const not_whitespace = ~whitespace_mask(simd::load(src.data() + end)) & simd::all_chars)
+				return end + count_trailing_zeros(not_whitespace) - index;
+#endif
+		while (end < size && is_whitespace(src[end]))
+			++end;
+		return end - index;
 	}
 
 	auto skip_comments(std::string_view src, int index) noexcept -> expected<int, PartialSyntaxError>
 	{
-		if (starts_with(src, index, "//"sv))
+		if (char_at(src, index) != '/')
+			return 0;
+		else if (starts_with(src, index, "//"sv))
 		{
-			size_t const newline = src.find('\n', index);
-			if (newline == std::string_view::npos)
+			int const newline = find_char(src, index + 2, '\n');
+			if (end_reached(src, newline))
 				return static_cast<int>(src.size()) - index;
 			else
-				return static_cast<int>(newline + 1) - index;
+				return newline + 1 - index;
 		}
 		else if (starts_with(src, index, "/*"sv))
 		{
-			size_t const comment_end = src.find("*/"sv, index);
-			if (comment_end == std::string_view::npos) return make_syntax_error({src.data() + index, 2}, "A C comment must be closed.");
-			return static_cast<int>(comment_end + 2) - index;
+			for (int star = find_char(src, index + 2, '*'); !end_reached(src, star); star = find_char(src, star + 1, '*'))
+				if (char_at(src, star + 1) == '/')
+					return star + 2 - index;
+			return make_syntax_error({src.data() + index, 2}, "A C comment must be closed.");
 		}
 		else
 			return 0;
@@ -129,14 +243,6 @@ namespace lex
 		return index - original_index;
 	}
 
-	auto token_length_literal_int(std::string_view src, int index) noexcept -> int
-	{
-		int length = 0;
-		while (!end_reached(src, index + length) && is_number(src[index + length]))
-			++length;
-		return length;
-	}
-
 	auto token_type_and_length_number(std::string_view src, int index) noexcept -> expected<std::pair<Token::Type, int>, PartialSyntaxError>
 	{
 		bool dot_read = false;
@@ -155,7 +261,7 @@ namespace lex
 			{
 				exp_read = true;
 				// Account for unary plus and minus in the exponent
-				if (src[end + 1] == '+' || src[end + 1] == '-')
+				if (char_at(src, end + 1) == any_of('+', '-'))
 					++end;
 			}
 			else if (is_valid_after_literal(src[end]))
@@ -170,96 +276,253 @@ namespace lex
 		};
 	}
 
+	// Length of the operator made of symbols that starts at index.
 	auto token_length_operator(std::string_view src, int index) noexcept -> int
 	{
-		constexpr std::string_view three_char_ops[] = { "<=>", "and", "xor", "not" };
-		for (auto const s : three_char_ops)
-			if (starts_with(src, index, s))
-				return 3;
+		char const next = char_at(src, index + 1);
+		switch (src[index])
+		{
+			case '<':
+				if (next == '=')
+					return char_at(src, index + 2) == '>' ? 3 : 2; // <=> or <=
+				return next == '<' ? 2 : 1;
+			case '>': return next == any_of('=', '>') ? 2 : 1;
+			case '=': return next == '=' ? 2 : 1;
+			case '!': return next == '=' ? 2 : 1;
+			default: return 1;
+		}
+	}
+
+	// Length of keyword if it starts at index and isn't the beginning of a longer identifier, 0 otherwise.
+	auto keyword_length(std::string_view src, int index, std::string_view keyword) noexcept -> int
+	{
+		int const length = static_cast<int>(keyword.size());
+		if (starts_with(src, index, keyword) && is_valid_after_literal(char_at(src, index + length)))
+			return length;
+		else
+			return 0;
+	}
 
-		constexpr std::string_view two_char_ops[] = { "==", "!=", "<=", ">=", "or", ">>", "<<" };
-		for (auto const s : two_char_ops)
-			if (starts_with(src, index, s))
-				return 2;
+	// Length of the operator written as a word (and, or, xor, not) that starts at index, 0 if there is none.
+	auto token_length_keyword_operator(std::string_view src, int index) noexcept -> int
+	{
+		switch (src[index])
+		{
+			case 'a': return keyword_length(src, index, "and"sv);
+			case 'o': return keyword_length(src, index, "or"sv);
+			case 'x': return keyword_length(src, index, "xor"sv);
+			case 'n': return keyword_length(src, index, "not"sv);
+			default: return 0;
+		}
+	}
 
-		return 1;
+	auto token_length_boolean(std::string_view src, int index) noexcept -> int
+	{
+		switch (src[index])
+		{
+			case 't': return keyword_length(src, index, "true"sv);
+			case 'f': return keyword_length(src, index, "false"sv);
+			default: return 0;
+		}
 	}
 
 	auto token_length_string(std::string_view src, int index) noexcept -> int
 	{
-		int length = 1;
-		while (!end_reached(src, index + length) && src[index + length] != '"')
-			++length;
-
-		++length; // The closing '"' is part of the string.
-		return length;
+		// The closing '"' is part of the string.
+		return find_char(src, index + 1, '"') + 1 - index;
 	}
 
 	auto token_length_char(std::string_view src, int index) noexcept -> int
 	{
-		int length = 1;
-		while (!end_reached(src, index + length) && src[index + length] != '\'')
-			++length;
-
-		++length; // The closing '"' is part of the string.
-		return length;
+		// The closing '\'' is part of the char.
+		return find_char(src, index + 1, '\'') + 1 - index;
 	}
 
 	auto token_length_identifier(std::string_view src, int index) noexcept -> int
 	{
-		int length = 1;
-		while (!end_reached(src, index + length) && is_valid_identifier_char(src[index + length]))
-			++length;
-		return length;
+		int const size = static_cast<int>(src.size());
+		int end = index + 1;
+#if defined(AFIL_LEXER_SIMD)
+		for (; end + simd::width <= size; end += simd::width)
+		{
+			if (uint32_t const not_word = ~word_mask(simd::load(src.data() + end)) & simd::all_chars)
+			{
+				end += count_trailing_zeros(not_word);
+				break;
+			}
+		}
+#endif
+		while (end < size && is_valid_identifier_char(src[end]))
+			++end;
+		return end - index;
 	}
 
 	auto next_token_type_and_length(std::string_view src, int index) noexcept -> expected<std::pair<Token::Type, int>, PartialSyntaxError>
 	{
-		if (is_number(src[index]))				return token_type_and_length_number(src, index);
-		if (is_arrow(src, index))				return std::pair<Token::Type, int>{Token::Type::arrow,				2};
-		if (is_scope_resolution(src, index))	return std::pair<Token::Type, int>{Token::Type::scope_resolution,	2};
-		if (is_operator(src, index))			return std::pair<Token::Type, int>{Token::Type::operator_,			token_length_operator(src, index)};
-		if (src[index] == '"')					return std::pair<Token::Type, int>{Token::Type::literal_string,		token_length_string(src, index)};
-		if (src[index] == '\'')					return std::pair<Token::Type, int>{Token::Type::literal_char,		token_length_char(src, index)};
-		if (src[index] == '(')					return std::pair<Token::Type, int>{Token::Type::open_parenthesis,	1};
-		if (src[index] == ')')					return std::pair<Token::Type, int>{Token::Type::close_parenthesis,	1};
-		if (src[index] == '{')					return std::pair<Token::Type, int>{Token::Type::open_brace,			1};
-		if (src[index] == '}')					return std::pair<Token::Type, int>{Token::Type::close_brace,		1};
-		if (src[index] == '[')					return std::pair<Token::Type, int>{Token::Type::open_bracket,		1};
-		if (src[index] == ']')					return std::pair<Token::Type, int>{Token::Type::close_bracket,		1};
-		if (src[index] == ';')					return std::pair<Token::Type, int>{Token::Type::semicolon,			1};
-		if (src[index] == ',')					return std::pair<Token::Type, int>{Token::Type::comma,				1};
-		if (src[index] == '.')					return std::pair<Token::Type, int>{Token::Type::period,				1};
-		if (is_boolean(src, index))				return std::pair<Token::Type, int>{Token::Type::literal_bool,		src[index] == 't' ? 4 : 5};
-		else									return std::pair<Token::Type, int>{Token::Type::identifier,			token_length_identifier(src, index)};
+		using TypeAndLength = std::pair<Token::Type, int>;
+
+		char const c = src[index];
+		uint8_t const c_class = char_class_of(c);
+
+		if (c_class & char_class::digit)
+			return token_type_and_length_number(src, index);
+
+		if (c_class & char_class::operator_first)
+		{
+			if (c == '-' && char_at(src, index + 1) == '>')
+				return TypeAndLength{Token::Type::arrow, 2};
+			return TypeAndLength{Token::Type::operator_, token_length_operator(src, index)};
+		}
+
+		switch (c)
+		{
+			case '"':	return TypeAndLength{Token::Type::literal_string,		token_length_string(src, index)};
+			case '\'':	return TypeAndLength{Token::Type::literal_char,			token_length_char(src, index)};
+			case '(':	return TypeAndLength{Token::Type::open_parenthesis,		1};
+			case ')':	return TypeAndLength{Token::Type::close_parenthesis,	1};
+			case '{':	return TypeAndLength{Token::Type::open_brace,			1};
+			case '}':	return TypeAndLength{Token::Type::close_brace,			1};
+			case '[':	return TypeAndLength{Token::Type::open_bracket,			1};
+			case ']':	return TypeAndLength{Token::Type::close_bracket,		1};
+			case ';':	return TypeAndLength{Token::Type::semicolon,			1};
+			case ',':	return TypeAndLength{Token::Type::comma,				1};
+			case '.':	return TypeAndLength{Token::Type::period,				1};
+			case ':':
+				if (char_at(src, index + 1) == ':')
+					return TypeAndLength{Token::Type::scope_resolution, 2};
+				break;
+			case 'a': case 'o': case 'x': case 'n':
+				if (int const length = token_length_keyword_operator(src, index))
+					return TypeAndLength{Token::Type::operator_, length};
+				break;
+			case 't': case 'f':
+				if (int const length = token_length_boolean(src, index))
+					return TypeAndLength{Token::Type::literal_bool, length};
+				break;
+		}
+
+		return TypeAndLength{Token::Type::identifier, token_length_identifier(src, index)};
+	}
+
+	// Reads the token that starts at index and moves index past it and the whitespace and comments that follow it.
+	auto read_token(std::string_view src, int & index) noexcept -> expected<Token, PartialSyntaxError>
+	{
+		try_call_decl(auto token_type_and_length, next_token_type_and_length(src, index));
+		auto const [token_type, token_length] = token_type_and_length;
+		int const token_end = std::min(index + token_length, static_cast<int>(src.size()));
+
+		Token token;
+		token.type = token_type;
+		token.offset = static_cast<uint32_t>(index);
+		token.length = static_cast<uint16_t>(std::min(token_end - index, static_cast<int>(Token::long_length)));
+		index += token_length;
+
+		// After a literal we must find whitespace, an operator, a delimiter or the end of the source.
+		// Operators written as words are only recognized when followed by one of those, so they need no check here.
+		if (token.type == any_of(Token::Type::literal_int, Token::Type::literal_float))
+		{
+			if (!end_reached(src, index) && !is_valid_after_literal(src[index]))
+				return make_syntax_error({src.data() + index, 1}, "Expected whitespace, operator or delimiter after literal.");
+		}
+
+		try_call_decl(int const comment_length, skip_whitespace_and_comments(src, index));
+		index += comment_length;
+		return token;
 	}
 
-	auto tokenize(std::string_view src, std::vector<Token> tokens) noexcept -> expected<std::vector<Token>, PartialSyntaxError>
+	auto long_token_length(std::string_view file_source, size_t offset) noexcept -> size_t
 	{
-		try_call_decl(int index, skip_whitespace_and_comments(src, 0));
+		// The token was read without errors before, so it is read the same way again.
+		int const index = static_cast<int>(offset);
+		auto token_type_and_length = next_token_type_and_length(file_source, index);
+		assert(token_type_and_length.has_value());
+		return static_cast<size_t>(std::min(index + token_type_and_length->second, static_cast<int>(file_source.size())) - index);
+	}
 
-		while (!end_reached(src, index))
+	auto check_source_size(std::string_view src) noexcept -> expected<void, PartialSyntaxError>
+	{
+		if (src.size() > Token::max_source_size)
+			return make_syntax_error(src.substr(Token::max_source_size, 1), "Source file is too large.");
+		return success;
+	}
+
+	TokenStream::Mark::Mark(TokenStream & tokens_, size_t index) noexcept
+		: tokens(&tokens_)
+	{
+		assert(index >= tokens->first_kept);
+		tokens->marks.push_back(index);
+	}
+
+	TokenStream::TokenStream(std::string_view source_) noexcept
+		: source(source_)
+		, kept_tokens(window_size)
+	{
+		if (auto const size_checked = check_source_size(source); !size_checked.has_value())
+			syntax_error = size_checked.error();
+		else if (auto const start = skip_whitespace_and_comments(source, 0); !start.has_value())
+			syntax_error = start.error();
+		else
+			source_index = *start;
+	}
+
+	auto TokenStream::operator [] (size_t i) noexcept -> Token
+	{
+		assert(i >= first_kept); // Too far behind the last token read.
+
+		while (i >= tokens_read)
 		{
-			try_call_decl(auto token_type_and_length, next_token_type_and_length(src, index));
-			auto const [token_type, token_length] = token_type_and_length;
-			Token token;
-			token.type = token_type;
-			token.source = src.substr(index, token_length);
-			index += token_length;
-
-			// After a literal we must find whitespace, an operator, a delimiter or the end of the source.
-			if (token.type == any_of(Token::Type::literal_int, Token::Type::literal_float) || 
-				token.source == any_of("and"sv, "or"sv, "xor"sv))
+			if (syntax_error || end_reached(source, source_index))
 			{
-				if (!end_reached(src, index) && !is_valid_after_literal(src[index])) 
-					return make_syntax_error({src.data() + index, 1}, "Expected whitespace, operator or delimiter after literal.");
+				Token end;
+				end.offset = static_cast<uint32_t>(source.size());
+				end.length = 0;
+				end.type = Token::Type::end_of_source;
+				return end;
 			}
 
-			try_call_decl(int const comment_length, skip_whitespace_and_comments(src, index));
-			index += comment_length;
-			tokens.push_back(token);
+			auto token = read_token(source, source_index);
+			if (!token.has_value())
+				syntax_error = std::move(token.error());
+			else
+				keep_token(*token, i);
+		}
+
+		return kept_tokens[i & (kept_tokens.size() - 1)];
+	}
+
+	auto TokenStream::keep_token(Token token, size_t looked_up_index) noexcept -> void
+	{
+		// Tokens in the window behind the one looked up and the ones from the marks on are needed. The buffer grows instead of
+		// overwriting one of them.
+		size_t first_needed = (looked_up_index + 1 > window_size) ? looked_up_index + 1 - window_size : 0;
+		for (size_t const mark : marks)
+			first_needed = std::min(first_needed, mark);
+
+		if (tokens_read >= first_needed + kept_tokens.size())
+		{
+			std::vector<Token> grown_tokens(2 * kept_tokens.size());
+			for (size_t i = first_kept; i < tokens_read; ++i)
+				grown_tokens[i & (grown_tokens.size() - 1)] = kept_tokens[i & (kept_tokens.size() - 1)];
+			kept_tokens = std::move(grown_tokens);
 		}
 
+		kept_tokens[tokens_read & (kept_tokens.size() - 1)] = token;
+		++tokens_read;
+		if (tokens_read - first_kept > kept_tokens.size())
+			first_kept = tokens_read - kept_tokens.size();
+	}
+
+	auto tokenize(std::string_view src, std::vector<Token> tokens) noexcept -> expected<std::vector<Token>, PartialSyntaxError>
+	{
+		try_call_void(check_source_size(src));
+
+		// Typical code has a token every 4 to 6 chars.
+		tokens.reserve(tokens.size() + src.size() / 4);
+
+		try_call_decl(int index, skip_whitespace_and_comments(src, 0));
+		while (!end_reached(src, index))
+			try_call(tokens.push_back, read_token(src, index));
+
 		return std::move(tokens);
 	}
 
@@ -1,15 +1,22 @@
 #pragma once
 
 #include "syntax_error.hh"
+#include <cstdint>
+#include <limits>
+#include <optional>
 #include <string_view>
 #include <vector>
 
 namespace lex
 {
 
+	// Length of a token that is too long for Token::length, found by reading the token that starts at offset again.
+	auto long_token_length(std::string_view file_source, size_t offset) noexcept -> size_t;
+
+	// Tokens refer to their text by position in the source of their file, so the text is read from the token and the source.
 	struct Token
 	{
-		enum struct Type
+		enum struct Type : uint8_t
 		{
 			identifier,
 			literal_int,
@@ -26,11 +33,64 @@ namespace lex
 			period,									// .
 			arrow,									// ->
 			scope_resolution,						// ::
+			end_of_source,							// Read past the last token
 		};
 
-		std::string_view source;
+		static constexpr size_t max_source_size = std::numeric_limits<int>::max(); // The lexer indexes sources with int.
+		static constexpr uint16_t long_length = std::numeric_limits<uint16_t>::max(); // Stored as the length of tokens at least this long, which are rare.
+
+		uint32_t offset;
+		uint16_t length;
 		Type type;
+
+		auto text(std::string_view file_source) const noexcept -> std::string_view
+		{
+			return file_source.substr(offset, (length == long_length) ? long_token_length(file_source, offset) : length);
+		}
 	};
+	static_assert(sizeof(Token) == 8);
+
+	// Reads the tokens of a source as they are asked for, instead of tokenizing all of it up front. Only window_size tokens behind the
+	// last one read are kept, so memory doesn't grow with the size of the source, except while a mark is held: every token from the marked
+	// one on is then kept, so that the parser may go back to it however far it reads before it does, and read those tokens again after the
+	// mark is released. Past the end of the source, or after a syntax error, every token is end_of_source.
+	struct TokenStream
+	{
+		static constexpr size_t window_size = 64;
+		static_assert((window_size & (window_size - 1)) == 0);
+
+		// Keeps the tokens from the one at index on for as long as it lives. Marks must be released in the reverse order they were taken.
+		struct Mark
+		{
+			Mark(TokenStream & tokens_, size_t index) noexcept;
+			Mark(Mark const &) = delete;
+			Mark & operator = (Mark const &) = delete;
+			~Mark() noexcept { tokens->marks.pop_back(); }
+
+			TokenStream * tokens;
+		};
+
+		explicit TokenStream(std::string_view source_) noexcept;
+
+		auto operator [] (size_t i) noexcept -> Token;
+		auto text(size_t i) noexcept -> std::string_view { return (*this)[i].text(source); }
+		auto at_end(size_t i) noexcept -> bool { return (*this)[i].type == Token::Type::end_of_source; }
+		auto error() const noexcept -> std::optional<PartialSyntaxError> const & { return syntax_error; }
+
+		std::string_view source;
+
+	private:
+		auto keep_token(Token token, size_t looked_up_index) noexcept -> void;
+
+		std::vector<Token> kept_tokens; // Ring buffer whose size is a power of two, at least window_size. Token i is at i % size.
+		std::vector<size_t> marks;
+		size_t tokens_read = 0;
+		size_t first_kept = 0; // Tokens before it were overwritten.
+		int source_index = 0; // Where the next token starts.
+		std::optional<PartialSyntaxError> syntax_error;
+	};
+
+	// Tokens are appended to the given vector, after reserving space for them from the size of the source.
 	auto tokenize(std::string_view src, std::vector<Token> tokens = {}) noexcept->expected<std::vector<Token>, PartialSyntaxError>;
 
 } // namespace tr
@@ -0,0 +1,304 @@
+#include "module_cache.hh"
+#include "incomplete_module.hh"
+#include "incomplete_statement.hh"
+#include "parser.hh"
+#include "utils/serialization.hh"
+#include "utils/string.hh"
+#include "utils/value_ptr.hh"
+#include <cstdio>
+
+namespace incomplete
+{
+
+	namespace module_cache_locals
+	{
+
+		constexpr char magic[8] = {'a', 'f', 'i', 'l', 'p', 'a', 'r', 's'};
+		constexpr uint32_t format_version = 1; // Must be incremented whenever the nodes of the incomplete tree change.
+
+		struct FileRange
+		{
+			int32_t file_index; // -1 if the characters are not in a file of the module.
+			uint32_t offset;
+			uint32_t size;
+		};
+
+		auto range_in_files(span<Module::File const> files, std::string_view view) noexcept -> FileRange
+		{
+			for (size_t i = 0; i < files.size(); ++i)
+				if (!view.empty() && is_contained_in(files[i].source, view))
+					return {static_cast<int32_t>(i), static_cast<uint32_t>(view.data() - files[i].source.data()), static_cast<uint32_t>(view.size())};
+
+			return {-1, 0, static_cast<uint32_t>(view.size())};
+		}
+
+		// Most string views point into the source of the module, and are written as a range in one of its files.
+		struct Writer : ArchiveWriter<Writer>
+		{
+			using ArchiveWriter::write;
+
+			span<Module::File const> files;
+
+			auto write(std::string_view & view) noexcept -> void
+			{
+				FileRange const range = range_in_files(files, view);
+				bytes.write(range);
+				if (range.file_index == -1)
+					bytes.write_bytes(view.data(), view.size());
+			}
+		};
+
+		// Nodes are allocated from the memory resource of the current thread, which should be the arena of the module.
+		struct Reader : ArchiveReader<Reader>
+		{
+			using ArchiveReader::read;
+
+			Reader(std::string_view bytes_, span<Module::File const> files_, std::pmr::memory_resource * string_resource_) noexcept
+				: ArchiveReader(bytes_)
+				, files(files_)
+				, string_resource(string_resource_)
+			{}
+
+			span<Module::File const> files;
+			std::pmr::memory_resource * string_resource; // Holds the characters of string views that are not in the files of the module.
+
+			auto read(std::string_view & view) noexcept -> void
+			{
+				FileRange const range = bytes.read<FileRange>();
+				if (range.file_index == -1)
+				{
+					char const * const characters = bytes.read_bytes(range.size);
+					if (characters == nullptr || range.size == 0)
+					{
+						view = std::string_view();
+						return;
+					}
+
+					char * const copy = static_cast<char *>(string_resource->allocate(range.size, 1));
+					memcpy(copy, characters, range.size);
+					view = std::string_view(copy, range.size);
+				}
+				else if (range.file_index >= 0 && static_cast<size_t>(range.file_index) < files.size() &&
+					uint64_t(range.offset) + range.size <= files[range.file_index].source.size())
+				{
+					view = std::string_view(files[range.file_index].source).substr(range.offset, range.size);
+				}
+				else
+					bytes.fail();
+			}
+		};
+
+		template <typename Archive> auto serialize(Archive &, nothing_t &) noexcept -> void {}
+		template <typename Archive> auto serialize(Archive &, defaulted_t &) noexcept -> void {}
+		template <typename Archive> auto serialize(Archive &, null_t &) noexcept -> void {}
+
+		template <typename Archive> auto serialize(Archive & archive, parser::TypeName & node) noexcept -> void { archive(node.name, node.type); }
+
+		template <typename Archive> auto serialize(Archive & archive, TypeId::BaseCase & node) noexcept -> void { archive(node.namespaces, node.name); }
+		template <typename Archive> auto serialize(Archive & archive, TypeId::Pointer & node) noexcept -> void { archive(node.pointee); }
+		template <typename Archive> auto serialize(Archive & archive, TypeId::Array & node) noexcept -> void { archive(node.value_type, node.size); }
+		template <typename Archive> auto serialize(Archive & archive, TypeId::ArrayPointer & node) noexcept -> void { archive(node.pointee); }
+		template <typename Archive> auto serialize(Archive & archive, TypeId::TemplateInstantiation & node) noexcept -> void { archive(node.namespaces, node.template_name, node.parameters); }
+		template <typename Archive> auto serialize(Archive &, TypeId::Deduce &) noexcept -> void {}
+
+		template <typename Archive> auto serialize(Archive & archive, TypeId & node) noexcept -> void
+		{
+			// Bitfields can't be bound to references.
+			bool is_mutable = node.is_mutable;
+			bool is_reference = node.is_reference;
+			archive(node.value, is_mutable, is_reference);
+			if constexpr (Archive::is_reader)
+			{
+				node.is_mutable = is_mutable;
+				node.is_reference = is_reference;
+			}
+		}
+
+		template <typename Archive> auto serialize(Archive & archive, TemplateParameter & node) noexcept -> void { archive(node.concept, node.name); }
+		template <typename Archive> auto serialize(Archive & archive, FunctionParameter & node) noexcept -> void { archive(node.name, node.type); }
+		template <typename Archive> auto serialize(Archive & archive, FunctionPrototype & node) noexcept -> void { archive(node.parameters, node.return_type); }
+		template <typename Archive> auto serialize(Archive & archive, Function & node) noexcept -> void
+		{
+			archive(static_cast<FunctionPrototype &>(node), node.preconditions, node.statements);
+		}
+		template <typename Archive> auto serialize(Archive & archive, FunctionTemplate & node) noexcept -> void
+		{
+			archive(static_cast<Function &>(node), node.template_parameters);
+		}
+		template <typename Archive> auto serialize(Archive & archive, Constructor & node) noexcept -> void
+		{
+			archive(static_cast<Function &>(node), node.name);
+		}
+		template <typename Archive> auto serialize(Archive & archive, ExternFunction & node) noexcept -> void
+		{
+			archive(node.name, node.ABI_name_source, node.ABI_name, node.prototype);
+		}
+
+		template <typename Archive, typename T> auto serialize(Archive & archive, expression::Literal<T> & node) noexcept -> void { archive(node.value); }
+		template <typename Archive> auto serialize(Archive & archive, expression::Identifier & node) noexcept -> void { archive(node.namespaces, node.name); }
+		template <typename Archive> auto serialize(Archive & archive, expression::IdentifierInsideStruct & node) noexcept -> void { archive(node.type, node.name); }
+		template <typename Archive> auto serialize(Archive & archive, expression::MemberVariable & node) noexcept -> void { archive(node.name, node.owner); }
+		template <typename Archive> auto serialize(Archive & archive, expression::Addressof & node) noexcept -> void { archive(node.operand); }
+		template <typename Archive> auto serialize(Archive & archive, expression::Dereference & node) noexcept -> void { archive(node.operand); }
+		template <typename Archive> auto serialize(Archive & archive, expression::Subscript & node) noexcept -> void { archive(node.array, node.index); }
+		template <typename Archive> auto serialize(Archive & archive, expression::Function & node) noexcept -> void { archive(node.function); }
+		template <typename Archive> auto serialize(Archive & archive, expression::FunctionTemplate & node) noexcept -> void { archive(node.function_template); }
+		template <typename Archive> auto serialize(Archive & archive, expression::ExternFunction & node) noexcept -> void { archive(node.function); }
+		template <typename Archive> auto serialize(Archive & archive, expression::FunctionCall & node) noexcept -> void { archive(node.parameters); }
+		template <typename Archive> auto serialize(Archive & archive, expression::UnaryOperatorCall & node) noexcept -> void { archive(node.op, node.operand); }
+		template <typename Archive> auto serialize(Archive & archive, expression::BinaryOperatorCall & node) noexcept -> void { archive(node.op, node.left, node.right); }
+		template <typename Archive> auto serialize(Archive & archive, expression::If & node) noexcept -> void { archive(node.condition, node.then_case, node.else_case); }
+		template <typename Archive> auto serialize(Archive & archive, expression::StatementBlock & node) noexcept -> void { archive(node.statements); }
+		template <typename Archive> auto serialize(Archive & archive, expression::DesignatedInitializerConstructor & node) noexcept -> void { archive(node.constructed_type, node.parameters); }
+		template <typename Archive> auto serialize(Archive & archive, expression::Compiles & node) noexcept -> void { archive(node.variables, node.body); }
+		template <typename Archive> auto serialize(Archive & archive, expression::TypeOf & node) noexcept -> void { archive(node.parameter); }
+		template <typename Archive> auto serialize(Archive & archive, Expression & node) noexcept -> void { archive(node.variant, node.source); }
+
+		template <typename Archive> auto serialize(Archive & archive, MemberVariable & node) noexcept -> void { archive(node.name, node.type, node.initializer_expression); }
+		template <typename Archive> auto serialize(Archive & archive, Struct & node) noexcept -> void
+		{
+			archive(node.name, node.member_variables, node.constructors, node.destructor, node.default_constructor, node.copy_constructor, node.move_constructor);
+		}
+		template <typename Archive> auto serialize(Archive & archive, StructTemplate & node) noexcept -> void
+		{
+			archive(static_cast<Struct &>(node), node.template_parameters);
+		}
+		template <typename Archive> auto serialize(Archive & archive, DesignatedInitializer & node) noexcept -> void { archive(node.member_name, node.assigned_expression); }
+		template <typename Archive> auto serialize(Archive & archive, CompilesFakeVariable & node) noexcept -> void { archive(node.type, node.name); }
+		template <typename Archive> auto serialize(Archive & archive, ExpressionToTest & node) noexcept -> void { archive(node.expression, node.expected_type); }
+
+		template <typename Archive> auto serialize(Archive & archive, statement::LetDeclaration & node) noexcept -> void
+		{
+			archive(node.variable_name, node.assigned_expression, node.is_mutable, node.is_reference);
+		}
+		template <typename Archive> auto serialize(Archive & archive, statement::PlacementLet & node) noexcept -> void { archive(node.address_expression, node.assigned_expression); }
+		template <typename Archive> auto serialize(Archive & archive, statement::UninitDeclaration & node) noexcept -> void { archive(node.variable_name, node.variable_type); }
+		template <typename Archive> auto serialize(Archive & archive, statement::ExpressionStatement & node) noexcept -> void { archive(node.expression); }
+		template <typename Archive> auto serialize(Archive & archive, statement::Return & node) noexcept -> void { archive(node.returned_expression); }
+		template <typename Archive> auto serialize(Archive & archive, statement::If & node) noexcept -> void { archive(node.condition, node.then_case, node.else_case); }
+		template <typename Archive> auto serialize(Archive & archive, statement::StatementBlock & node) noexcept -> void { archive(node.statements); }
+		template <typename Archive> auto serialize(Archive & archive, statement::While & node) noexcept -> void { archive(node.condition, node.body); }
+		template <typename Archive> auto serialize(Archive & archive, statement::For & node) noexcept -> void
+		{
+			archive(node.init_statement, node.condition, node.end_expression, node.body);
+		}
+		template <typename Archive> auto serialize(Archive &, statement::Break &) noexcept -> void {}
+		template <typename Archive> auto serialize(Archive &, statement::Continue &) noexcept -> void {}
+		template <typename Archive> auto serialize(Archive & archive, statement::StructDeclaration & node) noexcept -> void { archive(node.declared_struct); }
+		template <typename Archive> auto serialize(Archive & archive, statement::StructTemplateDeclaration & node) noexcept -> void { archive(node.declared_struct_template); }
+		template <typename Archive> auto serialize(Archive & archive, statement::TypeAliasDeclaration & node) noexcept -> void { archive(node.name, node.type); }
+		template <typename Archive> auto serialize(Archive & archive, statement::NamespaceDeclaration & node) noexcept -> void { archive(node.names, node.statements); }
+		template <typename Archive> auto serialize(Archive & archive, statement::ConversionDeclaration & node) noexcept -> void { archive(node.is_implicit, node.conversion_function); }
+		template <typename Archive> auto serialize(Archive & archive, Statement & node) noexcept -> void { archive(node.variant, node.source); }
+
+		auto cache_entry_path(ModuleCache const & cache, uint64_t hash) noexcept -> std::filesystem::path
+		{
+			char name[32];
+			snprintf(name, sizeof(name), "%016llx.afilp", static_cast<unsigned long long>(hash));
+			return cache.directory / name;
+		}
+
+		auto write_header(ByteWriter & bytes, uint64_t hash, span<Module::File const> files) noexcept -> void
+		{
+			bytes.write_bytes(magic, sizeof(magic));
+			bytes.write(format_version);
+			bytes.write(hash);
+			bytes.write(static_cast<uint32_t>(files.size()));
+			for (Module::File const & file : files)
+				bytes.write(static_cast<uint64_t>(file.source.size()));
+		}
+
+		// The hash is in the name of the file, but the header is checked too in case of a collision or a truncated file.
+		auto read_header(ByteReader & bytes, uint64_t hash, span<Module::File const> files) noexcept -> bool
+		{
+			char const * const file_magic = bytes.read_bytes(sizeof(magic));
+			if (file_magic == nullptr || memcmp(file_magic, magic, sizeof(magic)) != 0)
+				return false;
+			if (bytes.read<uint32_t>() != format_version || bytes.read<uint64_t>() != hash || bytes.read<uint32_t>() != files.size())
+				return false;
+			for (Module::File const & file : files)
+				if (bytes.read<uint64_t>() != file.source.size())
+					return false;
+			return !bytes.has_failed();
+		}
+
+	} // namespace module_cache_locals
+
+	auto module_hash(Module const & module, span<uint64_t const> module_hashes) noexcept -> uint64_t
+	{
+		// FNV-1a. Sizes are included so that characters cannot shift between files.
+		uint64_t hash = 14695981039346656037ull;
+		auto const combine_byte = [&](unsigned char byte) { hash = (hash ^ byte) * 1099511628211ull; };
+		auto const combine = [&](uint64_t word)
+		{
+			for (int i = 0; i < 8; ++i)
+				combine_byte(static_cast<unsigned char>(word >> (i * 8)));
+		};
+
+		combine(module_cache_locals::format_version);
+		combine(module.files.size());
+		for (Module::File const & file : module.files)
+		{
+			combine(file.source.size());
+			for (char const c : std::string_view(file.source))
+				combine_byte(static_cast<unsigned char>(c));
+		}
+
+		combine(module.dependencies.size());
+		for (int const dependency_index : module.dependencies)
+			combine(module_hashes[dependency_index]);
+
+		return hash;
+	}
+
+	auto load_cached_module(
+		ModuleCache const & cache,
+		uint64_t hash,
+		Module & module,
+		out<std::vector<parser::TypeName>> type_names
+	) noexcept -> bool
+	{
+		using namespace module_cache_locals;
+
+		std::optional<MappedFile> const entry = map_whole_file(cache_entry_path(cache, hash));
+		if (!entry.has_value())
+			return false;
+
+		if (module.arena.resource == nullptr)
+			module.arena.resource = std::make_unique<std::pmr::monotonic_buffer_resource>();
+		ScopedValuePtrResource const allocate_from_arena(module.arena.resource.get());
+
+		Reader reader(entry->contents(), module.files, module.arena.resource.get());
+		if (!read_header(reader.bytes, hash, module.files))
+			return false;
+
+		std::vector<parser::TypeName> cached_type_names;
+		std::vector<Statement> statements;
+		reader(cached_type_names, statements);
+		if (reader.bytes.has_failed() || !reader.bytes.is_at_end())
+			return false;
+
+		*type_names = std::move(cached_type_names);
+		module.statements = std::move(statements);
+		return true;
+	}
+
+	auto save_cached_module(ModuleCache const & cache, uint64_t hash, Module const & module, span<parser::TypeName const> type_names) noexcept -> void
+	{
+		using namespace module_cache_locals;
+
+		Writer writer;
+		writer.files = module.files;
+		write_header(writer.bytes, hash, module.files);
+
+		// The writer only reads the nodes, but serialize takes them as mutable so that it can be shared with the reader.
+		std::vector<parser::TypeName> type_names_to_write(type_names.begin(), type_names.end());
+		writer(type_names_to_write, const_cast<std::vector<Statement> &>(module.statements));
+
+		std::error_code error;
+		std::filesystem::create_directories(cache.directory, error);
+		std::string_view const bytes(writer.bytes.bytes.data(), writer.bytes.bytes.size());
+		(void)write_whole_binary_file(cache_entry_path(cache, hash), bytes);
+	}
+
+} // namespace incomplete
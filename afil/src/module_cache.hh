@@ -0,0 +1,42 @@
+#pragma once
+
+#include "utils/out.hh"
+#include "utils/span.hh"
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace parser
+{
+	struct TypeName;
+}
+
+namespace incomplete
+{
+
+	struct Module;
+
+	// Directory where parsed modules are stored so that they don't need to be parsed again by later compilations.
+	// A module is stored under a hash of its files and of the hashes of its dependencies, so changing a module
+	// invalidates the entries of every module that imports it, directly or not.
+	struct ModuleCache
+	{
+		std::filesystem::path directory;
+	};
+
+	// module_hashes must contain the hashes of the dependencies of the module.
+	auto module_hash(Module const & module, span<uint64_t const> module_hashes) noexcept -> uint64_t;
+
+	// Loads the statements of the module and the names of the types it declares. The files of the module must already be loaded.
+	// Returns false if the module is not in the cache or the entry can't be read, in which case the module is left unchanged.
+	[[nodiscard]] auto load_cached_module(
+		ModuleCache const & cache,
+		uint64_t hash,
+		Module & module,
+		out<std::vector<parser::TypeName>> type_names
+	) noexcept -> bool;
+
+	// Failing to write to the cache is not an error, the module will just be parsed again next time.
+	auto save_cached_module(ModuleCache const & cache, uint64_t hash, Module const & module, span<parser::TypeName const> type_names) noexcept -> void;
+
+} // namespace incomplete
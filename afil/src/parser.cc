@@ -1,6 +1,7 @@
 #include "parser.hh"
 #include "incomplete_statement.hh"
 #include "incomplete_module.hh"
+#include "module_cache.hh"
 #include "syntax_error.hh"
 #include "lexer.hh"
 #include "utils/algorithm.hh"
@@ -8,11 +9,13 @@
 #include "utils/overload.hh"
 #include "utils/span.hh"
 #include "utils/string.hh"
+#include "utils/task_graph.hh"
 #include "utils/unreachable.hh"
 #include "utils/variant.hh"
 #include "utils/warning_macro.hh"
 #include <cassert>
 #include "utils/charconv.hh"
+#include <limits>
 #include <optional>
 #include <filesystem>
 #include <string>
@@ -130,32 +133,33 @@ namespace parser
 		declare_unreachable();
 	}
 
-	auto parse_operator_tokens(span<lex::Token const> tokens, size_t & index) noexcept -> expected<std::string_view, PartialSyntaxError>
+	auto parse_operator_tokens(lex::TokenStream & tokens, size_t & index) noexcept -> expected<std::string_view, PartialSyntaxError>
 	{
 		if (tokens[index].type == lex::Token::Type::open_bracket)
 		{
 			index++;
 			if (tokens[index].type != lex::Token::Type::close_bracket) 
-				return make_syntax_error(tokens[index], "Expected operator after '(' in function declaration.");
+				return make_syntax_error(tokens.text(index), "Expected operator after '(' in function declaration.");
 			index++;
 			return "[]"sv;
 		}
 		else
 		{
 			if (tokens[index].type != lex::Token::Type::operator_) 
-				return make_syntax_error(tokens[index], "Expected operator name after keyword \"operator\".");
-			return tokens[index++].source;
+				return make_syntax_error(tokens.text(index), "Expected operator name after keyword \"operator\".");
+			return tokens.text(index++);
 		}
 	}
 
-	auto is_unary_operator(lex::Token const & token) noexcept -> bool
+	auto is_unary_operator(lex::TokenStream & tokens, size_t index) noexcept -> bool
 	{
-		return token.type == lex::Token::Type::operator_ &&
-			(token.source == "-"sv ||
-			token.source == "&"sv ||
-			token.source == "*"sv ||
-			token.source == "~"sv ||
-			token.source == "not"sv);
+		std::string_view const source = tokens.text(index);
+		return tokens[index].type == lex::Token::Type::operator_ &&
+			(source == "-"sv ||
+			source == "&"sv ||
+			source == "*"sv ||
+			source == "~"sv ||
+			source == "not"sv);
 	}
 
 	template <typename T>
@@ -180,50 +184,6 @@ namespace parser
 		return token_source[1];
 	}
 
-	auto insert_expression(incomplete::Expression & tree, incomplete::Expression & new_node) noexcept -> void
-	{
-		using incomplete::expression::BinaryOperatorCall;
-		BinaryOperatorCall & tree_op = std::get<BinaryOperatorCall>(tree.variant);
-		BinaryOperatorCall & new_op = std::get<BinaryOperatorCall>(new_node.variant);
-
-		if (precedence(new_op.op) <= precedence(tree_op.op))
-		{
-			new_op.left = allocate(std::move(tree));
-			tree = std::move(new_node);
-		}
-		else if (!has_type<BinaryOperatorCall>(tree_op.right->variant))
-		{
-			new_op.left = std::move(tree_op.right);
-			tree_op.right = allocate(std::move(new_node));
-		}
-		else
-			insert_expression(*tree_op.right, new_node);
-	}
-
-	auto resolve_operator_precedence(span<incomplete::Expression> operands, span<std::string_view const> operators) noexcept -> incomplete::Expression
-	{
-		using incomplete::expression::BinaryOperatorCall;
-
-		if (operators.empty())
-		{
-			assert(operands.size() == 1);
-			return std::move(operands[0]);
-		}
-
-		incomplete::Expression root = incomplete::Expression(BinaryOperatorCall{parse_operator(operators[0]),
-				allocate(std::move(operands[0])),
-				allocate(std::move(operands[1]))
-		}, operators[0]);
-
-		for (size_t i = 1; i < operators.size(); ++i)
-		{
-			auto new_node = incomplete::Expression(BinaryOperatorCall{parse_operator(operators[i]), nullptr, allocate(std::move(operands[i + 1]))}, operators[i]);
-			insert_expression(root, new_node);
-		}
-
-		return root;
-	}
-
 	auto pointer_type_for(incomplete::TypeId type) noexcept -> incomplete::TypeId
 	{
 		incomplete::TypeId pointer_type;
@@ -251,39 +211,39 @@ namespace parser
 		return pointer_type;
 	}
 
-	auto parse_type_name(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<std::optional<incomplete::TypeId>, PartialSyntaxError>;
-	auto parse_expression(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Expression, PartialSyntaxError>;
-	auto parse_expression_and_trailing_subexpressions(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Expression, PartialSyntaxError>;
-	auto parse_statement(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Statement, PartialSyntaxError>;
+	auto parse_type_name(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<std::optional<incomplete::TypeId>, PartialSyntaxError>;
+	auto parse_expression(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Expression, PartialSyntaxError>;
+	auto parse_expression_and_trailing_subexpressions(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Expression, PartialSyntaxError>;
+	auto parse_statement(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Statement, PartialSyntaxError>;
 
-	auto parse_namespaces(span<lex::Token const> tokens, size_t & index) noexcept -> expected<std::vector<std::string_view>, PartialSyntaxError>
+	auto parse_namespaces(lex::TokenStream & tokens, size_t & index) noexcept -> expected<std::vector<std::string_view>, PartialSyntaxError>
 	{
 		std::vector<std::string_view> namespaces;
 
 		while (tokens[index + 1].type == lex::Token::Type::scope_resolution)
 		{
-			namespaces.push_back(tokens[index].source);
+			namespaces.push_back(tokens.text(index));
 			index += 2;
 
 			if (tokens[index].type != lex::Token::Type::identifier)
-				return make_syntax_error(tokens[index].source, "Expected identifier after \"::\".");
+				return make_syntax_error(tokens.text(index), "Expected identifier after \"::\".");
 		}
 
 		return std::move(namespaces);
 	}
 
-	auto parse_mutable_pointer_and_array(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names, incomplete::TypeId type) noexcept 
+	auto parse_mutable_pointer_and_array(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names, incomplete::TypeId type) noexcept 
 		-> expected<incomplete::TypeId, PartialSyntaxError>
 	{
 		// Look for mutable qualifier.
-		if (tokens[index].source == "mut"sv)
+		if (tokens.text(index) == "mut"sv)
 		{
 			type.is_mutable = true;
 			index++;
 		}
 
 		// Look for pointer type
-		if (tokens[index].source == "*"sv)
+		if (tokens.text(index) == "*"sv)
 		{
 			incomplete::TypeId pointer_type = pointer_type_for(std::move(type));
 			index++;
@@ -304,7 +264,7 @@ namespace parser
 			else
 			{
 				try_call_decl(incomplete::Expression size, parse_expression(tokens, index, type_names));
-				if (tokens[index].type != lex::Token::Type::close_bracket) return make_syntax_error(tokens[index], "Expected ] after array size.");
+				if (tokens[index].type != lex::Token::Type::close_bracket) return make_syntax_error(tokens.text(index), "Expected ] after array size.");
 				index++;
 				incomplete::TypeId array_type = array_type_for(std::move(type), std::move(size));
 				return parse_mutable_pointer_and_array(tokens, index, type_names, std::move(array_type));
@@ -314,13 +274,13 @@ namespace parser
 		return std::move(type);
 	}
 
-	auto parse_mutable_pointer_array_and_reference(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names, incomplete::TypeId type) noexcept 
+	auto parse_mutable_pointer_array_and_reference(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names, incomplete::TypeId type) noexcept 
 		-> expected<incomplete::TypeId, PartialSyntaxError>
 	{
 		try_call(assign_to(type), parse_mutable_pointer_and_array(tokens, index, type_names, std::move(type)));
 
 		// Look for reference qualifier.
-		if (tokens[index].source == "&"sv)
+		if (tokens.text(index) == "&"sv)
 		{
 			type.is_reference = true;
 			index++;
@@ -329,10 +289,10 @@ namespace parser
 		return std::move(type);
 	}
 
-	auto parse_template_instantiation_parameter_list(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
+	auto parse_template_instantiation_parameter_list(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
 		-> expected<std::vector<incomplete::TypeId>, PartialSyntaxError>
 	{
-		if (tokens[index].source != "<") return make_syntax_error(tokens[index], "Expected '<' after template name.");
+		if (tokens.text(index) != "<") return make_syntax_error(tokens.text(index), "Expected '<' after template name.");
 		index++;
 
 		std::vector<incomplete::TypeId> template_parameters;
@@ -340,35 +300,37 @@ namespace parser
 		while (true)
 		{
 			try_call_decl(auto type, parse_type_name(tokens, index, type_names));
-			if (!type.has_value()) return make_syntax_error(tokens[index], "Expected type in template instantiation parameter list.");
+			if (!type.has_value()) return make_syntax_error(tokens.text(index), "Expected type in template instantiation parameter list.");
 			template_parameters.push_back(std::move(*type));
 
-			if (tokens[index].source == ">")
+			if (tokens.text(index) == ">")
 				break;
 
-			if(!(tokens[index].type == lex::Token::Type::comma)) return make_syntax_error(tokens[index], "Expected comma ',' after template parameter.");
+			if(!(tokens[index].type == lex::Token::Type::comma)) return make_syntax_error(tokens.text(index), "Expected comma ',' after template parameter.");
 			index++;
 		}
 
-		if (tokens[index].source != ">") return make_syntax_error(tokens[index], "Expected comma '>' at the end of template parameter list.");
+		if (tokens.text(index) != ">") return make_syntax_error(tokens.text(index), "Expected comma '>' at the end of template parameter list.");
 		index++;
 
 		return template_parameters;
 	}
 
-	auto parse_type_name_namespaces(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
+	auto parse_type_name_namespaces(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
 		-> expected<std::optional<std::pair<TypeName, std::vector<std::string_view>>>, PartialSyntaxError>
 	{
+		// The name may turn out not to be a type after reading any number of namespaces, so the tokens are kept to go back to the start.
 		size_t const index_start = index;
+		lex::TokenStream::Mark const start_mark(tokens, index_start);
 		std::vector<std::string_view> namespaces;
 		TypeName found_type;
 
 		while (true)
 		{
 			if (tokens[index].type != lex::Token::Type::identifier)
-				return make_syntax_error(tokens[index].source, "Expected identifier after \"::\".");
+				return make_syntax_error(tokens.text(index), "Expected identifier after \"::\".");
 
-			std::string_view const name_to_look_up = tokens[index].source;
+			std::string_view const name_to_look_up = tokens.text(index);
 			index++;
 			auto const it = std::find_if(type_names.rbegin(), type_names.rend(), [name_to_look_up](TypeName const & type_name) { return type_name.name == name_to_look_up; });
 
@@ -396,7 +358,7 @@ namespace parser
 		return std::make_pair(found_type, std::move(namespaces));
 	}
 
-	auto parse_type_name(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<std::optional<incomplete::TypeId>, PartialSyntaxError>
+	auto parse_type_name(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<std::optional<incomplete::TypeId>, PartialSyntaxError>
 	{
 		using namespace incomplete;
 		
@@ -430,7 +392,7 @@ namespace parser
 				TypeId type;
 				type.is_mutable = false;
 				type.is_reference = false;
-				type.value = std::move(template_instantiation);
+				type.value = allocate(std::move(template_instantiation));
 
 				return parse_mutable_pointer_array_and_reference(tokens, index, type_names, std::move(type));
 			}
@@ -439,7 +401,7 @@ namespace parser
 		declare_unreachable();
 	}
 
-	auto parse_template_parameter_list(span<lex::Token const> tokens, size_t & index) noexcept -> expected<std::vector<incomplete::TemplateParameter>, PartialSyntaxError>
+	auto parse_template_parameter_list(lex::TokenStream & tokens, size_t & index) noexcept -> expected<std::vector<incomplete::TemplateParameter>, PartialSyntaxError>
 	{
 		// Skip < token.
 		index++;
@@ -449,16 +411,16 @@ namespace parser
 		for (;;)
 		{
 			if (tokens[index].type != lex::Token::Type::identifier) 
-				return make_syntax_error(tokens[index], "Expected identifier.");
+				return make_syntax_error(tokens.text(index), "Expected identifier.");
 
 			incomplete::TemplateParameter param;
-			param.name = tokens[index].source;
+			param.name = tokens.text(index);
 			index++;
 
 			if (tokens[index].type == lex::Token::Type::identifier)
 			{
 				param.concept = param.name;
-				param.name = tokens[index].source;
+				param.name = tokens.text(index);
 				index++;
 			}
 
@@ -469,12 +431,12 @@ namespace parser
 
 			parsed_parameters.push_back(std::move(param));
 
-			if (tokens[index].source == ">")
+			if (tokens.text(index) == ">")
 			{
 				index++;
 				break;
 			}
-			if (tokens[index].type != lex::Token::Type::comma) return make_syntax_error(tokens[index], "Expected '>' or ',' after template parameter.");
+			if (tokens[index].type != lex::Token::Type::comma) return make_syntax_error(tokens.text(index), "Expected '>' or ',' after template parameter.");
 			index++;
 		}
 
@@ -487,12 +449,12 @@ namespace parser
 	//******************************************************************************************************************************************************************
 	//******************************************************************************************************************************************************************
 
-	auto parse_comma_separated_expression_list(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names,
+	auto parse_comma_separated_expression_list(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names,
 		lex::Token::Type opener = lex::Token::Type::open_parenthesis, lex::Token::Type delimiter = lex::Token::Type::close_parenthesis) noexcept -> expected<std::vector<incomplete::Expression>, PartialSyntaxError>
 	{
 		std::vector<incomplete::Expression> parsed_expressions;
 
-		if (tokens[index].type != opener) return make_syntax_error(tokens[index], "Expected '('.");
+		if (tokens[index].type != opener) return make_syntax_error(tokens.text(index), "Expected '('.");
 		index++;
 
 		// Check for empty list.
@@ -518,17 +480,17 @@ namespace parser
 				index++;
 			// Anything else we find is wrong.
 			else
-				return make_syntax_error(tokens[index], "Expected ')' or ',' after expression.");
+				return make_syntax_error(tokens.text(index), "Expected ')' or ',' after expression.");
 		}
 
 		return parsed_expressions;
 	}
 
-	auto parse_designated_initializer_list(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) 
+	auto parse_designated_initializer_list(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) 
 		-> expected<std::vector<incomplete::DesignatedInitializer>, PartialSyntaxError>
 	{
 		// Parameter list starts with (
-		if (tokens[index].type != lex::Token::Type::open_parenthesis) return make_syntax_error(tokens[index], "Expected '(' after type name in struct constructor.");
+		if (tokens[index].type != lex::Token::Type::open_parenthesis) return make_syntax_error(tokens.text(index), "Expected '(' after type name in struct constructor.");
 		index++;
 
 		std::vector<incomplete::DesignatedInitializer> initializers;
@@ -536,18 +498,18 @@ namespace parser
 		for (;;)
 		{
 			// A member initializer by name starts with a period.
-			if (tokens[index].type != lex::Token::Type::period) return make_syntax_error(tokens[index], "Expected '.' in designated initializer.");
+			if (tokens[index].type != lex::Token::Type::period) return make_syntax_error(tokens.text(index), "Expected '.' in designated initializer.");
 			index++;
 
 			incomplete::DesignatedInitializer parameter;
 
 			// Find the member to initialize.
-			if (tokens[index].type != lex::Token::Type::identifier) return make_syntax_error(tokens[index], "Expected member name after '.' in designated initializer.");
-			parameter.member_name = tokens[index].source;
+			if (tokens[index].type != lex::Token::Type::identifier) return make_syntax_error(tokens.text(index), "Expected member name after '.' in designated initializer.");
+			parameter.member_name = tokens.text(index);
 			index++;
 
 			// Next token must be =
-			if (tokens[index].source != "=") return make_syntax_error(tokens[index], "Expected '=' after member name in designated initializer.");
+			if (tokens.text(index) != "=") return make_syntax_error(tokens.text(index), "Expected '=' after member name in designated initializer.");
 			index++;
 
 			// Parse a parameter.
@@ -566,17 +528,17 @@ namespace parser
 				index++;
 			// Anything else we find is wrong.
 			else
-				return make_syntax_error(tokens[index], "Expected ')' or ',' after designated initializer.");
+				return make_syntax_error(tokens.text(index), "Expected ')' or ',' after designated initializer.");
 		}
 
 		return initializers;
 	}
 
-	[[nodiscard]] auto parse_function_prototype(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names, out<incomplete::FunctionPrototype> function) noexcept 
+	[[nodiscard]] auto parse_function_prototype(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names, out<incomplete::FunctionPrototype> function) noexcept 
 		-> expected<void, PartialSyntaxError>
 	{
 		// Parameters must be between parenthesis.
-		if (tokens[index].type != lex::Token::Type::open_parenthesis) return make_syntax_error(tokens[index], "Expected '(' after fn.");
+		if (tokens[index].type != lex::Token::Type::open_parenthesis) return make_syntax_error(tokens.text(index), "Expected '(' after fn.");
 		index++;
 
 		// Parse arguments.
@@ -584,24 +546,24 @@ namespace parser
 		{
 			incomplete::FunctionParameter var;
 			try_call_decl(auto type, parse_type_name(tokens, index, type_names));
-			if (!type.has_value()) return make_syntax_error(tokens[index], "Parameter type not found.");
+			if (!type.has_value()) return make_syntax_error(tokens.text(index), "Parameter type not found.");
 			var.type = std::move(*type);
 
-			if (tokens[index].type != lex::Token::Type::identifier) return make_syntax_error(tokens[index], "Expected identifier after function parameter type.");
-			if (is_keyword(tokens[index].source)) return make_syntax_error(tokens[index], "Cannot use a keyword as function parameter name.");
-			var.name = tokens[index].source;
+			if (tokens[index].type != lex::Token::Type::identifier) return make_syntax_error(tokens.text(index), "Expected identifier after function parameter type.");
+			if (is_keyword(tokens.text(index))) return make_syntax_error(tokens.text(index), "Cannot use a keyword as function parameter name.");
+			var.name = tokens.text(index);
 			function->parameters.push_back(std::move(var));
 			index++;
 
 			if (tokens[index].type == lex::Token::Type::close_parenthesis)
 				break;
 
-			if (tokens[index].type != lex::Token::Type::comma) return make_syntax_error(tokens[index], "Expected ',' or ')' after function parameter.");
+			if (tokens[index].type != lex::Token::Type::comma) return make_syntax_error(tokens.text(index), "Expected ',' or ')' after function parameter.");
 			index++;
 		}
 
 		// After parameters close parenthesis.
-		if (tokens[index].type != lex::Token::Type::close_parenthesis)  return make_syntax_error(tokens[index], "Expected ')' after function parameter list.");
+		if (tokens[index].type != lex::Token::Type::close_parenthesis)  return make_syntax_error(tokens.text(index), "Expected ')' after function parameter list.");
 		index++;
 
 		// Return type is introduced with an arrow (optional).
@@ -614,14 +576,14 @@ namespace parser
 		return success;
 	}
 
-	[[nodiscard]] auto parse_function_contract(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names, out<incomplete::Function> function) noexcept -> expected<void, PartialSyntaxError>
+	[[nodiscard]] auto parse_function_contract(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names, out<incomplete::Function> function) noexcept -> expected<void, PartialSyntaxError>
 	{
-		if (tokens[index].source == "assert")
+		if (tokens.text(index) == "assert")
 		{
 			index++;
 
 			if (tokens[index].type != lex::Token::Type::open_brace)
-				return make_syntax_error(tokens[index].source, "Expected '{' after \"assert\" keyword.");
+				return make_syntax_error(tokens.text(index), "Expected '{' after \"assert\" keyword.");
 			index++;
 
 			while (tokens[index].type != lex::Token::Type::close_brace)
@@ -629,7 +591,7 @@ namespace parser
 				try_call(function->preconditions.push_back, parse_expression(tokens, index, type_names));
 				
 				if (tokens[index].type != lex::Token::Type::semicolon)
-					return make_syntax_error(tokens[index].source, "Expected ';' after expression in assert block.");
+					return make_syntax_error(tokens.text(index), "Expected ';' after expression in assert block.");
 				index++;
 			}
 
@@ -639,10 +601,10 @@ namespace parser
 		return success;
 	}
 
-	[[nodiscard]] auto parse_function_body(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names, out<incomplete::Function> function) noexcept -> expected<void, PartialSyntaxError>
+	[[nodiscard]] auto parse_function_body(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names, out<incomplete::Function> function) noexcept -> expected<void, PartialSyntaxError>
 	{
 		// Body of the function is enclosed by braces.
-		if (tokens[index].type != lex::Token::Type::open_brace) return make_syntax_error(tokens[index], "Expected '{' at start of function body.");
+		if (tokens[index].type != lex::Token::Type::open_brace) return make_syntax_error(tokens.text(index), "Expected '{' at start of function body.");
 		index++;
 
 		// Parse all statements in the function.
@@ -657,7 +619,7 @@ namespace parser
 		return success;
 	}
 
-	auto parse_function_template_expression(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
+	auto parse_function_template_expression(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
 		-> expected<incomplete::expression::Variant, PartialSyntaxError>
 	{
 		incomplete::FunctionTemplate function;
@@ -673,23 +635,23 @@ namespace parser
 
 		type_names.resize(type_name_stack_size);
 
-		return incomplete::expression::FunctionTemplate{std::move(function)};
+		return incomplete::expression::FunctionTemplate{allocate(std::move(function))};
 	}
 
-	auto parse_extern_function_expression(span<lex::Token const> tokens, size_t & index, incomplete::FunctionPrototype function_prototype) noexcept
+	auto parse_extern_function_expression(lex::TokenStream & tokens, size_t & index, incomplete::FunctionPrototype function_prototype) noexcept
 		-> expected<incomplete::expression::Variant, PartialSyntaxError>
 	{
 		if (!function_prototype.return_type) 
-			return make_syntax_error(tokens[index], "Cannot omit return type of imported extern function.");
+			return make_syntax_error(tokens.text(index), "Cannot omit return type of imported extern function.");
 
 		index++;
 		if (tokens[index].type != lex::Token::Type::open_parenthesis)
-			return make_syntax_error(tokens[index], "Expected '(' after extern_symbol.");
+			return make_syntax_error(tokens.text(index), "Expected '(' after extern_symbol.");
 		index++;
-		std::string_view const extern_symbol_name = tokens[index].source;
+		std::string_view const extern_symbol_name = tokens.text(index);
 		index++;
 		if (tokens[index].type != lex::Token::Type::close_parenthesis)
-			return make_syntax_error(tokens[index], "Expected ')' after extern_symbol name.");
+			return make_syntax_error(tokens.text(index), "Expected ')' after extern_symbol name.");
 		index++;
 
 		incomplete::ExternFunction extern_function;
@@ -697,15 +659,15 @@ namespace parser
 		extern_function.ABI_name_source = extern_symbol_name;
 		extern_function.prototype = std::move(function_prototype);
 
-		return incomplete::expression::ExternFunction{std::move(extern_function)};
+		return incomplete::expression::ExternFunction{allocate(std::move(extern_function))};
 	}
 
-	auto parse_function_expression(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::expression::Variant, PartialSyntaxError>
+	auto parse_function_expression(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::expression::Variant, PartialSyntaxError>
 	{
 		// Skip fn token.
 		index++;
 
-		if (tokens[index].source == "<"sv)
+		if (tokens.text(index) == "<"sv)
 		{
 			return parse_function_template_expression(tokens, index, type_names);
 		}
@@ -713,34 +675,34 @@ namespace parser
 		incomplete::Function function;
 		try_call_void(parse_function_prototype(tokens, index, type_names, out(function)));
 
-		if (tokens[index].source == "extern_symbol")
+		if (tokens.text(index) == "extern_symbol")
 			return parse_extern_function_expression(tokens, index, std::move(function));
 
 		try_call_void(parse_function_contract(tokens, index, type_names, out(function)));
 		try_call_void(parse_function_body(tokens, index, type_names, out(function)));
 
-		return incomplete::expression::Function{std::move(function)};
+		return incomplete::expression::Function{allocate(std::move(function))};
 	}
 
-	auto parse_if_expression(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::expression::If, PartialSyntaxError>
+	auto parse_if_expression(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::expression::If, PartialSyntaxError>
 	{
 		// Skip if token
 		index++;
 
 		// Condition goes between parenthesis.
-		if (tokens[index].type != lex::Token::Type::open_parenthesis) return make_syntax_error(tokens[index], "Expected '(' after if.");
+		if (tokens[index].type != lex::Token::Type::open_parenthesis) return make_syntax_error(tokens.text(index), "Expected '(' after if.");
 		index++;
 
 		incomplete::expression::If if_node;
 		try_call(assign_to(if_node.condition), parse_expression(tokens, index, type_names));
 
-		if (tokens[index].type != lex::Token::Type::close_parenthesis) return make_syntax_error(tokens[index], "Expected ')' after if condition.");
+		if (tokens[index].type != lex::Token::Type::close_parenthesis) return make_syntax_error(tokens.text(index), "Expected ')' after if condition.");
 		index++;
 
 		try_call(assign_to(if_node.then_case), parse_expression(tokens, index, type_names));
 
 		// Expect keyword else to separate then and else cases.
-		if (tokens[index].source != "else") return make_syntax_error(tokens[index], "Expected keyword \"else\" after if expression body.");
+		if (tokens.text(index) != "else") return make_syntax_error(tokens.text(index), "Expected keyword \"else\" after if expression body.");
 		index++;
 
 		try_call(assign_to(if_node.else_case), parse_expression(tokens, index, type_names));
@@ -766,7 +728,7 @@ namespace parser
 		return std::visit(visitor, statement);
 	}
 
-	auto parse_statement_block_expression(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
+	auto parse_statement_block_expression(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
 		-> expected<incomplete::expression::StatementBlock, PartialSyntaxError>
 	{
 		// Skip opening brace.
@@ -783,16 +745,16 @@ namespace parser
 		type_names.resize(stack_size);
 
 		// Ensure that all branches return.
-		if (!all_branches_return(node.statements.back().variant)) return make_syntax_error(tokens[index], "Not all branches of statement block expression return.");
+		if (!all_branches_return(node.statements.back().variant)) return make_syntax_error(tokens.text(index), "Not all branches of statement block expression return.");
 
 		// Skip closing brace.
-		if (tokens[index].type != lex::Token::Type::close_brace) return make_syntax_error(tokens[index], "Expected '}' at the end of statement block expression.");
+		if (tokens[index].type != lex::Token::Type::close_brace) return make_syntax_error(tokens.text(index), "Expected '}' at the end of statement block expression.");
 		index++;
 
 		return node;
 	}
 
-	auto parse_compiles_expression(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
+	auto parse_compiles_expression(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
 		-> expected<incomplete::expression::Compiles, PartialSyntaxError>
 	{
 		// Skip compiles token.
@@ -810,10 +772,10 @@ namespace parser
 			{
 				try_call_decl(auto type_expr, parse_expression(tokens, index, type_names));
 
-				if (tokens[index].type != lex::Token::Type::identifier || is_keyword(tokens[index].source))
-					return make_syntax_error(tokens[index].source, "Expected name after type in parameter list of compiles expression.");
+				if (tokens[index].type != lex::Token::Type::identifier || is_keyword(tokens.text(index)))
+					return make_syntax_error(tokens.text(index), "Expected name after type in parameter list of compiles expression.");
 
-				compiles_expr.variables.push_back({std::move(type_expr), tokens[index].source});
+				compiles_expr.variables.push_back({std::move(type_expr), tokens.text(index)});
 				index++;
 
 				if (tokens[index].type == lex::Token::Type::comma)
@@ -827,14 +789,14 @@ namespace parser
 				}
 				else
 				{
-					return make_syntax_error(tokens[index].source, "Expected ')' or ',' after variable name in parameter list of compiles expression.");
+					return make_syntax_error(tokens.text(index), "Expected ')' or ',' after variable name in parameter list of compiles expression.");
 				}
 			}
 		}
 
 		// Expect { after compiles.
 		if (tokens[index].type != lex::Token::Type::open_brace)
-			return make_syntax_error(tokens[index].source, "Expected '{' after \"compiles\" keyword.");
+			return make_syntax_error(tokens.text(index), "Expected '{' after \"compiles\" keyword.");
 		index++;
 
 		while (true)
@@ -847,11 +809,11 @@ namespace parser
 				try_call(assign_to(expr_to_test.expression), parse_expression(tokens, index, type_names));
 
 				if (tokens[index].type != lex::Token::Type::close_brace)
-					return make_syntax_error(tokens[index].source, "Expected '}' after expression in body of compiles expression.");
+					return make_syntax_error(tokens.text(index), "Expected '}' after expression in body of compiles expression.");
 				index++;
 
 				if (tokens[index].type != lex::Token::Type::arrow)
-					return make_syntax_error(tokens[index].source, "Expected \"->\" after '}' in body of compiles expression.");
+					return make_syntax_error(tokens.text(index), "Expected \"->\" after '}' in body of compiles expression.");
 				index++;
 
 				try_call(assign_to(expr_to_test.expected_type), parse_type_name(tokens, index, type_names));
@@ -873,36 +835,36 @@ namespace parser
 			}
 			else
 			{
-				return make_syntax_error(tokens[index].source, "Expected '}' or ';' after expression in body of compiles expression.");
+				return make_syntax_error(tokens.text(index), "Expected '}' or ';' after expression in body of compiles expression.");
 			}
 		}
 
 		return std::move(compiles_expr);
 	}
 
-    auto parse_type_of_expression(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
+    auto parse_type_of_expression(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
         -> expected<incomplete::expression::TypeOf, PartialSyntaxError>
     {
         // Skip type_of token.
         index++;
 
         if (tokens[index].type != lex::Token::Type::open_parenthesis)
-            return make_syntax_error(tokens[index].source, "Expected '(' after \"type_of\" keyword.");
+            return make_syntax_error(tokens.text(index), "Expected '(' after \"type_of\" keyword.");
         index++;
 
         incomplete::expression::TypeOf type_of_expression;
         try_call(assign_to(type_of_expression.parameter), parse_expression(tokens, index, type_names));
 
         if (tokens[index].type != lex::Token::Type::close_parenthesis)
-            return make_syntax_error(tokens[index].source, "Expected ')' after operand of type_of expression.");
+            return make_syntax_error(tokens.text(index), "Expected ')' after operand of type_of expression.");
         index++;
 
         return std::move(type_of_expression);
     }
 
-	auto parse_unary_operator(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::expression::Variant, PartialSyntaxError>
+	auto parse_unary_operator(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::expression::Variant, PartialSyntaxError>
 	{
-		Operator const op = parse_operator(tokens[index].source);
+		Operator const op = parse_operator(tokens.text(index));
 		index++;
 
 		incomplete::Expression operand;
@@ -929,30 +891,30 @@ namespace parser
 		}
 	}
 
-	auto parse_expression_variant(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::expression::Variant, PartialSyntaxError>
+	auto parse_expression_variant(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::expression::Variant, PartialSyntaxError>
 	{
-        if (tokens[index].source == "fn")
+        if (tokens.text(index) == "fn")
             return parse_function_expression(tokens, index, type_names);
-        else if (tokens[index].source == "if")
+        else if (tokens.text(index) == "if")
             return parse_if_expression(tokens, index, type_names);
         else if (tokens[index].type == lex::Token::Type::open_brace)
             return parse_statement_block_expression(tokens, index, type_names);
         else if (tokens[index].type == lex::Token::Type::literal_int)
-            return incomplete::expression::Literal<int>(parse_number_literal<int>(tokens[index++].source));
+            return incomplete::expression::Literal<int>(parse_number_literal<int>(tokens.text(index++)));
         else if (tokens[index].type == lex::Token::Type::literal_float)
-            return incomplete::expression::Literal<float>(parse_number_literal<float>(tokens[index++].source));
+            return incomplete::expression::Literal<float>(parse_number_literal<float>(tokens.text(index++)));
         else if (tokens[index].type == lex::Token::Type::literal_bool)
-            return incomplete::expression::Literal<bool>(tokens[index++].source[0] == 't');
+            return incomplete::expression::Literal<bool>(tokens.text(index++)[0] == 't');
         else if (tokens[index].type == lex::Token::Type::literal_string)
-            return incomplete::expression::Literal<std::string>(parse_string_literal(tokens[index++].source));
+            return incomplete::expression::Literal<std::string>(parse_string_literal(tokens.text(index++)));
         else if (tokens[index].type == lex::Token::Type::literal_char)
-            return incomplete::expression::Literal<char_t>(parse_char_literal(tokens[index++].source));
-        else if (tokens[index].source == "null")
+            return incomplete::expression::Literal<char_t>(parse_char_literal(tokens.text(index++)));
+        else if (tokens.text(index) == "null")
         {
             index++;
             return incomplete::expression::Literal<null_t>();
         }
-        else if (tokens[index].source == "operator")
+        else if (tokens.text(index) == "operator")
         {
             index++;
             try_call_decl(std::string_view const name, parse_operator_tokens(tokens, index));
@@ -960,9 +922,9 @@ namespace parser
             id_node.name = name;
             return std::move(id_node);
         }
-        else if (tokens[index].source == "compiles")
+        else if (tokens.text(index) == "compiles")
             return parse_compiles_expression(tokens, index, type_names);
-        else if (tokens[index].source == "type_of")
+        else if (tokens.text(index) == "type_of")
             return parse_type_of_expression(tokens, index, type_names);
 		else if (tokens[index].type == lex::Token::Type::identifier)
 		{
@@ -974,11 +936,11 @@ namespace parser
 				{
 					index++;
 					if (tokens[index].type != lex::Token::Type::identifier)
-						return make_syntax_error(tokens[index].source, "Expected identifier after ::.");
+						return make_syntax_error(tokens.text(index), "Expected identifier after ::.");
 
 					incomplete::expression::IdentifierInsideStruct id_node;
-					id_node.type = std::move(*type);
-					id_node.name = tokens[index].source;
+					id_node.type = allocate(std::move(*type));
+					id_node.name = tokens.text(index);
 					index++;
 					return std::move(id_node);
 				}
@@ -990,18 +952,18 @@ namespace parser
 				incomplete::expression::Identifier id_node;
 				try_call(assign_to(id_node.namespaces), parse_namespaces(tokens, index));
 
-				id_node.name = tokens[index].source;
+				id_node.name = tokens.text(index);
 				index++;
 				return id_node;
 			}
 		}
-		else if (is_unary_operator(tokens[index]))
+		else if (is_unary_operator(tokens, index))
 			return parse_unary_operator(tokens, index, type_names);
 		else
-			return make_syntax_error(tokens[index], "Unrecognized token. Expected expression.");
+			return make_syntax_error(tokens.text(index), "Unrecognized token. Expected expression.");
 	}
 
-	auto parse_single_expression(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Expression, PartialSyntaxError>
+	auto parse_single_expression(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Expression, PartialSyntaxError>
 	{
 		if (tokens[index].type == lex::Token::Type::open_parenthesis)
 		{
@@ -1009,33 +971,33 @@ namespace parser
 			auto expr = parse_expression(tokens, index, type_names);
 
 			// Next token must be close parenthesis.
-			if (tokens[index].type != lex::Token::Type::close_parenthesis) return make_syntax_error(tokens[index], "Expected ')' after parenthesized expression.");
+			if (tokens[index].type != lex::Token::Type::close_parenthesis) return make_syntax_error(tokens.text(index), "Expected ')' after parenthesized expression.");
 			index++;
 
 			return expr;
 		}
 		else
 		{
-			auto const expr_source_start = begin_ptr(tokens[index].source);
+			auto const expr_source_start = begin_ptr(tokens.text(index));
 			try_call_decl(incomplete::expression::Variant var, parse_expression_variant(tokens, index, type_names));
-			auto const expr_source_end = end_ptr(tokens[index - 1].source);
+			auto const expr_source_end = end_ptr(tokens.text(index - 1));
 			return incomplete::Expression(std::move(var), make_string_view(expr_source_start, expr_source_end));
 		}
 	}
 
-	auto parse_expression_and_trailing_subexpressions(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Expression, PartialSyntaxError>
+	auto parse_expression_and_trailing_subexpressions(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Expression, PartialSyntaxError>
 	{
 		try_call_decl(incomplete::Expression tree, parse_single_expression(tokens, index, type_names));
 
-		while (index < tokens.size())
+		while (!tokens.at_end(index))
 		{
 			// Loop to possibly parse chains of member accesses.
 			if (tokens[index].type == lex::Token::Type::period)
 			{
 				index++;
 
-				if (tokens[index].type != lex::Token::Type::identifier) return make_syntax_error(tokens[index], "Expected member name after '.'.");
-				std::string_view const member_name = tokens[index].source;
+				if (tokens[index].type != lex::Token::Type::identifier) return make_syntax_error(tokens.text(index), "Expected member name after '.'.");
+				std::string_view const member_name = tokens.text(index);
 				index++;
 
 				auto const expr_source_start = begin_ptr(tree.source);
@@ -1052,7 +1014,7 @@ namespace parser
 				try_call_decl(std::vector<incomplete::Expression> params, parse_comma_separated_expression_list(tokens, index, type_names, lex::Token::Type::open_bracket, lex::Token::Type::close_bracket));
 
 				auto const expr_source_start = begin_ptr(tree.source);
-				auto const expr_source_end = end_ptr(tokens[index - 1].source);
+				auto const expr_source_end = end_ptr(tokens.text(index - 1));
 
 				if (params.size() == 1)
 				{
@@ -1082,7 +1044,7 @@ namespace parser
 					try_call(assign_to(ctor_node.parameters), parse_designated_initializer_list(tokens, index, type_names));
 
 					auto const expr_source_start = begin_ptr(tree.source);
-					auto const expr_source_end = end_ptr(tokens[index - 1].source);
+					auto const expr_source_end = end_ptr(tokens.text(index - 1));
 
 					tree = incomplete::Expression(std::move(ctor_node), make_string_view(expr_source_start, expr_source_end));
 				}
@@ -1091,7 +1053,7 @@ namespace parser
 					try_call_decl(std::vector<incomplete::Expression> params, parse_comma_separated_expression_list(tokens, index, type_names));
 
 					auto const expr_source_start = begin_ptr(tree.source);
-					auto const expr_source_end = end_ptr(tokens[index - 1].source);
+					auto const expr_source_end = end_ptr(tokens.text(index - 1));
 
 					incomplete::expression::FunctionCall node;
 					node.parameters.reserve(params.size() + 1);
@@ -1107,25 +1069,53 @@ namespace parser
 		return std::move(tree);
 	}
 
-	auto parse_expression(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Expression, PartialSyntaxError>
+	// Precedence of the binary operator at index, or nullopt if the token isn't one.
+	auto precedence_of_operator_at(lex::TokenStream & tokens, size_t index) noexcept -> std::optional<int>
 	{
-		std::vector<incomplete::Expression> operands;
-		std::vector<std::string_view> operators;
+		if (tokens[index].type != lex::Token::Type::operator_)
+			return std::nullopt;
 
-		while (index < tokens.size())
+		Operator const op = parse_operator(tokens.text(index));
+		if (op == Operator::bitwise_not) // Only unary
+			return std::nullopt;
+		return precedence(op);
+	}
+
+	// Parses the operators that follow left while their precedence is at least min_precedence. Before an operator is applied, the operators
+	// after it that bind tighter are parsed into its right operand, so each node is built once with its final operands. Operators of the
+	// same precedence are left associative.
+	auto parse_binary_operators(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names, incomplete::Expression left, int min_precedence) noexcept 
+		-> expected<incomplete::Expression, PartialSyntaxError>
+	{
+		for (std::optional<int> op_precedence = precedence_of_operator_at(tokens, index); 
+			op_precedence.has_value() && *op_precedence >= min_precedence;
+			op_precedence = precedence_of_operator_at(tokens, index))
 		{
-			try_call(operands.push_back, parse_expression_and_trailing_subexpressions(tokens, index, type_names));
+			std::string_view const op_source = tokens.text(index);
+			index++;
 
-			// If the next token is an operator, parse the operator and repeat. Otherwise end the loop and return the expression.
-			if (index < tokens.size() && tokens[index].type == lex::Token::Type::operator_)
+			try_call_decl(incomplete::Expression right, parse_expression_and_trailing_subexpressions(tokens, index, type_names));
+			for (std::optional<int> next_precedence = precedence_of_operator_at(tokens, index);
+				next_precedence.has_value() && *next_precedence > *op_precedence;
+				next_precedence = precedence_of_operator_at(tokens, index))
 			{
-				operators.push_back(tokens[index].source);
-				index++;
+				try_call(assign_to(right), parse_binary_operators(tokens, index, type_names, std::move(right), *op_precedence + 1));
 			}
-			else break;
+
+			left = incomplete::Expression(incomplete::expression::BinaryOperatorCall{
+				parse_operator(op_source),
+				allocate(std::move(left)),
+				allocate(std::move(right))
+			}, op_source);
 		}
 
-		return resolve_operator_precedence(operands, operators);
+		return left;
+	}
+
+	auto parse_expression(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Expression, PartialSyntaxError>
+	{
+		try_call_decl(incomplete::Expression first_operand, parse_expression_and_trailing_subexpressions(tokens, index, type_names));
+		return parse_binary_operators(tokens, index, type_names, std::move(first_operand), std::numeric_limits<int>::min());
 	}
 
 	//******************************************************************************************************************************************************************
@@ -1134,7 +1124,7 @@ namespace parser
 	//******************************************************************************************************************************************************************
 	//******************************************************************************************************************************************************************
 
-	auto parse_placement_let_statement(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
+	auto parse_placement_let_statement(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
 		-> expected<incomplete::statement::PlacementLet, PartialSyntaxError>
 	{
 		// Skip opening parenthesis.
@@ -1144,11 +1134,11 @@ namespace parser
 		try_call(assign_to(placement_let_statement.address_expression), parse_expression(tokens, index, type_names));
 
 		if (tokens[index].type != lex::Token::Type::close_parenthesis)
-			return make_syntax_error(tokens[index].source, "Expected ')' after address expression in placement let statement.");
+			return make_syntax_error(tokens.text(index), "Expected ')' after address expression in placement let statement.");
 		index++;
 
-		if (tokens[index].source != "=") 
-			return make_syntax_error(tokens[index], "Expected '=' after ')' in placement let statement.");
+		if (tokens.text(index) != "=") 
+			return make_syntax_error(tokens.text(index), "Expected '=' after ')' in placement let statement.");
 		index++;
 
 		try_call(assign_to(placement_let_statement.assigned_expression), parse_expression(tokens, index, type_names));
@@ -1156,7 +1146,7 @@ namespace parser
 		return std::move(placement_let_statement);
 	}
 
-	auto parse_let_statement(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
+	auto parse_let_statement(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
 		-> expected<incomplete::statement::Variant, PartialSyntaxError>
 	{
 		// Skip let token.
@@ -1169,14 +1159,14 @@ namespace parser
 		bool is_reference = false;
 
 		// Look for mutable qualifier.
-		if (tokens[index].source == "mut"sv)
+		if (tokens.text(index) == "mut"sv)
 		{
 			is_mutable = true;
 			index++;
 		}
 
 		// Look for mutable qualifier.
-		if (tokens[index].source == "&"sv)
+		if (tokens.text(index) == "&"sv)
 		{
 			is_reference = true;
 			index++;
@@ -1185,19 +1175,19 @@ namespace parser
 		std::string_view name;
 
 		// Parsing an operator function
-		if (tokens[index].source == "operator"sv)
+		if (tokens.text(index) == "operator"sv)
 		{
 			index++;
 			try_call(assign_to(name), parse_operator_tokens(tokens, index));
 		}
 		else
 		{
-			if (tokens[index].type != lex::Token::Type::identifier) return make_syntax_error(tokens[index], "Expected identifier after let.");
-			name = tokens[index].source;
+			if (tokens[index].type != lex::Token::Type::identifier) return make_syntax_error(tokens.text(index), "Expected identifier after let.");
+			name = tokens.text(index);
 			index++;
 		}
 
-		if (tokens[index].source != "=") return make_syntax_error(tokens[index], "Expected '=' after identifier in let declaration.");
+		if (tokens.text(index) != "=") return make_syntax_error(tokens.text(index), "Expected '=' after identifier in let declaration.");
 		index++;
 
 		// If the expression returns a function, bind it to its name and return a noop.
@@ -1211,12 +1201,12 @@ namespace parser
 		return std::move(statement);
 	}
 
-	auto parse_uninit_statement(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::UninitDeclaration, PartialSyntaxError>
+	auto parse_uninit_statement(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::UninitDeclaration, PartialSyntaxError>
 	{
 		// Skip uninit token.
 		index++;
 
-		std::string_view const type_source = tokens[index].source;
+		std::string_view const type_source = tokens.text(index);
 		try_call_decl(auto type, parse_type_name(tokens, index, type_names));
 		if (!type)
 			return make_syntax_error(type_source, "Expected type after uninit keyword.");
@@ -1229,9 +1219,9 @@ namespace parser
 
 
 		if (tokens[index].type != lex::Token::Type::identifier)
-			return make_syntax_error(tokens[index].source, "Expected identifier after type name.");
+			return make_syntax_error(tokens.text(index), "Expected identifier after type name.");
 
-		std::string_view const variable_name = tokens[index].source;
+		std::string_view const variable_name = tokens.text(index);
 		index++;
 
 		if (is_keyword(variable_name))
@@ -1244,7 +1234,7 @@ namespace parser
 		return std::move(uninit_statement);
 	}
 
-	auto parse_return_statement(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::Return, PartialSyntaxError>
+	auto parse_return_statement(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::Return, PartialSyntaxError>
 	{
 		// Skip return token.
 		index++;
@@ -1255,24 +1245,24 @@ namespace parser
 		return std::move(statement);
 	}
 
-	auto parse_if_statement(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::If, PartialSyntaxError>
+	auto parse_if_statement(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::If, PartialSyntaxError>
 	{
 		// Skip the if
 		index++;
 
-		if (tokens[index].type != lex::Token::Type::open_parenthesis) return make_syntax_error(tokens[index], "Expected '(' after if.");
+		if (tokens[index].type != lex::Token::Type::open_parenthesis) return make_syntax_error(tokens.text(index), "Expected '(' after if.");
 		index++;
 
 		incomplete::statement::If statement;
 		try_call(assign_to(statement.condition), parse_expression(tokens, index, type_names));
 
-		if (tokens[index].type != lex::Token::Type::close_parenthesis) return make_syntax_error(tokens[index], "Expected ')' after condition in if statement.");
+		if (tokens[index].type != lex::Token::Type::close_parenthesis) return make_syntax_error(tokens.text(index), "Expected ')' after condition in if statement.");
 		index++;
 
 		try_call(assign_to(statement.then_case), parse_statement(tokens, index, type_names));
 
 		// For if statement else is optional.
-		if (tokens[index].source == "else")
+		if (tokens.text(index) == "else")
 		{
 			// Skip else token.
 			index++;
@@ -1282,7 +1272,7 @@ namespace parser
 		return std::move(statement);
 	}
 
-	auto parse_statement_block(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::StatementBlock, PartialSyntaxError>
+	auto parse_statement_block(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::StatementBlock, PartialSyntaxError>
 	{
 		// Skip opening }
 		index++;
@@ -1304,13 +1294,13 @@ namespace parser
 		return statement_block;
 	}
 
-	auto parse_while_statement(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::While, PartialSyntaxError>
+	auto parse_while_statement(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::While, PartialSyntaxError>
 	{
 		// Skip while token.
 		index++;
 
 		// Condition goes inside parenthesis.
-		if (tokens[index].type != lex::Token::Type::open_parenthesis) return make_syntax_error(tokens[index], "Expected '(' after while.");
+		if (tokens[index].type != lex::Token::Type::open_parenthesis) return make_syntax_error(tokens.text(index), "Expected '(' after while.");
 		index++;
 
 		incomplete::statement::While statement;
@@ -1318,7 +1308,7 @@ namespace parser
 		// Parse condition. Must return bool.
 		try_call(assign_to(statement.condition), parse_expression(tokens, index, type_names));
 
-		if (tokens[index].type != lex::Token::Type::close_parenthesis) return make_syntax_error(tokens[index], "Expected ')' after condition in while statement.");
+		if (tokens[index].type != lex::Token::Type::close_parenthesis) return make_syntax_error(tokens.text(index), "Expected ')' after condition in while statement.");
 		index++;
 
 		// Parse body
@@ -1327,7 +1317,7 @@ namespace parser
 		return std::move(statement);
 	}
 
-	auto parse_for_statement(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::For, PartialSyntaxError>
+	auto parse_for_statement(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::For, PartialSyntaxError>
 	{
 		// Syntax of for loop
 		// for (declaration-or-expression; condition-expression; end-expression)
@@ -1337,7 +1327,7 @@ namespace parser
 		index++;
 
 		// Condition goes inside parenthesis.
-		if (tokens[index].type != lex::Token::Type::open_parenthesis) return make_syntax_error(tokens[index], "Expected '(' after for.");
+		if (tokens[index].type != lex::Token::Type::open_parenthesis) return make_syntax_error(tokens.text(index), "Expected '(' after for.");
 		index++;
 
 		incomplete::statement::For for_statement;
@@ -1347,20 +1337,20 @@ namespace parser
 		try_call_decl(incomplete::Statement init_statement, parse_statement(tokens, index, type_names));
 		if (!(has_type<incomplete::statement::LetDeclaration>(init_statement.variant) || 
 			  has_type<incomplete::statement::ExpressionStatement>(init_statement.variant)))
-			return make_syntax_error(tokens[index], "init-statement of a for statement must be a variable declaration or an expression.");
+			return make_syntax_error(tokens.text(index), "init-statement of a for statement must be a variable declaration or an expression.");
 		for_statement.init_statement = allocate(std::move(init_statement));
 
 		// Parse condition. Must return bool.
 		try_call(assign_to(for_statement.condition), parse_expression(tokens, index, type_names));
 
 		// Parse ; after condition.
-		if (tokens[index].type != lex::Token::Type::semicolon) return make_syntax_error(tokens[index], "Expected ';' after for statement condition.");
+		if (tokens[index].type != lex::Token::Type::semicolon) return make_syntax_error(tokens.text(index), "Expected ';' after for statement condition.");
 		index++;
 
 		// Parse end expression.
 		try_call(assign_to(for_statement.end_expression), parse_expression(tokens, index, type_names));
 
-		if (tokens[index].type != lex::Token::Type::close_parenthesis) return make_syntax_error(tokens[index], "Expected ')' after for statement end expression.");
+		if (tokens[index].type != lex::Token::Type::close_parenthesis) return make_syntax_error(tokens.text(index), "Expected ')' after for statement end expression.");
 		index++;
 
 		// Parse body
@@ -1372,7 +1362,7 @@ namespace parser
 	}
 
 	template <typename Stmt>
-	auto parse_break_or_continue_statement(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> Stmt
+	auto parse_break_or_continue_statement(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> Stmt
 	{
 		// Should check if parsing a loop and otherwise give an error.
 
@@ -1382,18 +1372,18 @@ namespace parser
 		return Stmt();
 	}
 
-	auto parse_maybe_defaulted_function(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
+	auto parse_maybe_defaulted_function(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
 		-> expected<std::optional<incomplete::Function>, PartialSyntaxError>
 	{
-		if (tokens[index].source == "=")
+		if (tokens.text(index) == "=")
 		{
 			index++;
-			if (tokens[index].source != "default")
-				return make_syntax_error(tokens[index].source, "Expected keyword \"default\" after '='.");
+			if (tokens.text(index) != "default")
+				return make_syntax_error(tokens.text(index), "Expected keyword \"default\" after '='.");
 			index++;
 
 			if (tokens[index].type != lex::Token::Type::semicolon)
-				return make_syntax_error(tokens[index].source, "Expected ';' after keyword \"default\".");
+				return make_syntax_error(tokens.text(index), "Expected ';' after keyword \"default\".");
 			index++;
 
 			return std::nullopt;
@@ -1408,18 +1398,18 @@ namespace parser
 		}
 	}
 
-	auto parse_struct(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Struct, PartialSyntaxError>
+	auto parse_struct(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Struct, PartialSyntaxError>
 	{
 		incomplete::Struct declared_struct;
 
 		// Parse name
-		if (tokens[index].type != lex::Token::Type::identifier) return make_syntax_error(tokens[index], "Expected identifier after struct.");
-		if (is_keyword(tokens[index].source)) return make_syntax_error(tokens[index], "Cannot use a keyword as struct name.");
-		auto const type_name = tokens[index].source;
+		if (tokens[index].type != lex::Token::Type::identifier) return make_syntax_error(tokens.text(index), "Expected identifier after struct.");
+		if (is_keyword(tokens.text(index))) return make_syntax_error(tokens.text(index), "Cannot use a keyword as struct name.");
+		auto const type_name = tokens.text(index);
 		index++;
 
 		// Skip { token.
-		if (tokens[index].type != lex::Token::Type::open_brace) return make_syntax_error(tokens[index], "Expected '{' after struct name.");
+		if (tokens[index].type != lex::Token::Type::open_brace) return make_syntax_error(tokens.text(index), "Expected '{' after struct name.");
 		index++;
 
 		declared_struct.name = type_name;
@@ -1427,22 +1417,22 @@ namespace parser
 		// Parse member variables.
 		while (tokens[index].type != lex::Token::Type::close_brace)
 		{
-			if (tokens[index].source == "constructor")
+			if (tokens.text(index) == "constructor")
 			{
 				index++;
 				
 				if (tokens[index].type != lex::Token::Type::identifier)
-					return make_syntax_error(tokens[index].source, "Expected identifier after keyword \"constructor\".");
-				if (is_keyword(tokens[index].source))
-					return make_syntax_error(tokens[index].source, "Cannot use a keyword as constructor name.");
+					return make_syntax_error(tokens.text(index), "Expected identifier after keyword \"constructor\".");
+				if (is_keyword(tokens.text(index)))
+					return make_syntax_error(tokens.text(index), "Cannot use a keyword as constructor name.");
 
-				std::string_view const constructor_name = tokens[index].source;
+				std::string_view const constructor_name = tokens.text(index);
 				index++;
 				
 				if (constructor_name == "default")
 				{
 					if (!has_type<nothing_t>(declared_struct.default_constructor))
-						return make_syntax_error(tokens[index].source, "Cannot declare more than one default constructor for a struct.");
+						return make_syntax_error(tokens.text(index), "Cannot declare more than one default constructor for a struct.");
 
 					try_call_decl(auto constructor, parse_maybe_defaulted_function(tokens, index, type_names));
 					if (!constructor)
@@ -1460,7 +1450,7 @@ namespace parser
 				else if (constructor_name == "copy")
 				{
 					if (!has_type<nothing_t>(declared_struct.copy_constructor))
-						return make_syntax_error(tokens[index].source, "Cannot declare more than one copy constructor for a struct.");
+						return make_syntax_error(tokens.text(index), "Cannot declare more than one copy constructor for a struct.");
 
 					try_call_decl(auto constructor, parse_maybe_defaulted_function(tokens, index, type_names));
 					if (!constructor)
@@ -1482,7 +1472,7 @@ namespace parser
 				else if (constructor_name == "move")
 				{
 					if (!has_type<nothing_t>(declared_struct.move_constructor))
-						return make_syntax_error(tokens[index].source, "Cannot declare more than one move constructor for a struct.");
+						return make_syntax_error(tokens.text(index), "Cannot declare more than one move constructor for a struct.");
 
 					try_call_decl(auto constructor, parse_maybe_defaulted_function(tokens, index, type_names));
 					if (!constructor)
@@ -1511,12 +1501,12 @@ namespace parser
 					declared_struct.constructors.push_back(std::move(constructor));
 				}
 			}
-			else if (tokens[index].source == "destructor")
+			else if (tokens.text(index) == "destructor")
 			{
 				if (!has_type<nothing_t>(declared_struct.destructor))
-					return make_syntax_error(tokens[index].source, "Cannot declare more than one destructor for a struct.");
+					return make_syntax_error(tokens.text(index), "Cannot declare more than one destructor for a struct.");
 
-				std::string_view const error_source = tokens[index].source;
+				std::string_view const error_source = tokens.text(index);
 
 				index++;
 				try_call_decl(auto destructor, parse_maybe_defaulted_function(tokens, index, type_names));
@@ -1540,25 +1530,25 @@ namespace parser
 			{
 				incomplete::MemberVariable var;
 				try_call_decl(auto var_type, parse_type_name(tokens, index, type_names));
-				if (!var_type.has_value()) return make_syntax_error(tokens[index], "Expected type in struct member declaration.");
+				if (!var_type.has_value()) return make_syntax_error(tokens.text(index), "Expected type in struct member declaration.");
 				var.type = std::move(*var_type);
-				if (var.type.is_reference) return make_syntax_error(tokens[index], "Member variable cannot be reference.");
-				if (var.type.is_mutable) return make_syntax_error(tokens[index], "Member variable cannot be mutable. Mutability of members is inherited from mutability of object that contains them.");
+				if (var.type.is_reference) return make_syntax_error(tokens.text(index), "Member variable cannot be reference.");
+				if (var.type.is_mutable) return make_syntax_error(tokens.text(index), "Member variable cannot be mutable. Mutability of members is inherited from mutability of object that contains them.");
 
-				if (tokens[index].type != lex::Token::Type::identifier) return make_syntax_error(tokens[index], "Expected identifier after type name in member variable declaration.");
-				if (is_keyword(tokens[index].source)) return make_syntax_error(tokens[index], "Cannot use a keyword as member variable name.");
-				if (is_name_locally_taken(tokens[index].source, declared_struct.member_variables)) return make_syntax_error(tokens[index], "More than one member variable with the same name.");
-				var.name = tokens[index].source;
+				if (tokens[index].type != lex::Token::Type::identifier) return make_syntax_error(tokens.text(index), "Expected identifier after type name in member variable declaration.");
+				if (is_keyword(tokens.text(index))) return make_syntax_error(tokens.text(index), "Cannot use a keyword as member variable name.");
+				if (is_name_locally_taken(tokens.text(index), declared_struct.member_variables)) return make_syntax_error(tokens.text(index), "More than one member variable with the same name.");
+				var.name = tokens.text(index);
 				index++;
 
 				// Initialization expression.
-				if (tokens[index].source == "=")
+				if (tokens.text(index) == "=")
 				{
 					index++;
 					try_call(assign_to(var.initializer_expression), parse_expression(tokens, index, type_names));
 				}
 
-				if (tokens[index].type != lex::Token::Type::semicolon) return make_syntax_error(tokens[index], "Expected semicolon after struct member.");
+				if (tokens[index].type != lex::Token::Type::semicolon) return make_syntax_error(tokens.text(index), "Expected semicolon after struct member.");
 				declared_struct.member_variables.push_back(std::move(var));
 				index++;
 			}
@@ -1570,7 +1560,7 @@ namespace parser
 		return declared_struct;
 	}
 
-	auto parse_struct_template_declaration(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
+	auto parse_struct_template_declaration(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
 		-> expected<incomplete::statement::StructTemplateDeclaration, PartialSyntaxError>
 	{
 		incomplete::StructTemplate struct_template;
@@ -1586,38 +1576,38 @@ namespace parser
 
 		type_names.push_back({struct_template.name, TypeName::Type::struct_template});
 
-		return incomplete::statement::StructTemplateDeclaration{struct_template};
+		return incomplete::statement::StructTemplateDeclaration{allocate(std::move(struct_template))};
 	}
 
-	auto parse_struct_declaration(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::Variant, PartialSyntaxError>
+	auto parse_struct_declaration(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::statement::Variant, PartialSyntaxError>
 	{
 		// Skip struct token.
 		index++;
 
-		if (tokens[index].source == "<"sv)
+		if (tokens.text(index) == "<"sv)
 			return parse_struct_template_declaration(tokens, index, type_names);
 
 		try_call_decl(incomplete::Struct declared_struct, parse_struct(tokens, index, type_names));
 		type_names.push_back({declared_struct.name, TypeName::Type::type});
-		return incomplete::statement::StructDeclaration{std::move(declared_struct)};
+		return incomplete::statement::StructDeclaration{allocate(std::move(declared_struct))};
 	}
 
-	auto parse_type_alias(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
+	auto parse_type_alias(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
 		-> expected<incomplete::statement::TypeAliasDeclaration, PartialSyntaxError>
 	{
 		// Skip type token.
 		index++;
 
 		if (tokens[index].type != lex::Token::Type::identifier)
-			return make_syntax_error(tokens[index].source, "Expected identifier after \"type\" keyword.");
+			return make_syntax_error(tokens.text(index), "Expected identifier after \"type\" keyword.");
 
-		std::string_view const alias_name = tokens[index].source;
+		std::string_view const alias_name = tokens.text(index);
 		if (is_keyword(alias_name))
-			return make_syntax_error(tokens[index].source, "Canot use a keyword as type alias name.");
+			return make_syntax_error(tokens.text(index), "Canot use a keyword as type alias name.");
 		index++;
 		
-		if (tokens[index].source != "=")
-			return make_syntax_error(tokens[index].source, "Expected '=' after type alias name.");
+		if (tokens.text(index) != "=")
+			return make_syntax_error(tokens.text(index), "Expected '=' after type alias name.");
 		index++;
 
 		try_call_decl(auto type, parse_expression(tokens, index, type_names));
@@ -1630,7 +1620,7 @@ namespace parser
 		return std::move(type_alias_statement);
 	}
 
-	auto parse_namespace_declaration(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
+	auto parse_namespace_declaration(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
 		-> expected<incomplete::statement::NamespaceDeclaration, PartialSyntaxError>
 	{
 		// Skip namespace token
@@ -1639,16 +1629,16 @@ namespace parser
 		incomplete::statement::NamespaceDeclaration namespace_declaration;
 
 		if (tokens[index].type != lex::Token::Type::identifier)
-			return make_syntax_error(tokens[index].source, "Expected identifier after keyword \"namespace\".");
-		namespace_declaration.names.push_back(tokens[index].source);
+			return make_syntax_error(tokens.text(index), "Expected identifier after keyword \"namespace\".");
+		namespace_declaration.names.push_back(tokens.text(index));
 		index++;
 
 		while (tokens[index].type == lex::Token::Type::scope_resolution)
 		{
 			index++;
 			if (tokens[index].type != lex::Token::Type::identifier)
-				return make_syntax_error(tokens[index].source, "Expected identifier after \"::\".");
-			namespace_declaration.names.push_back(tokens[index].source);
+				return make_syntax_error(tokens.text(index), "Expected identifier after \"::\".");
+			namespace_declaration.names.push_back(tokens.text(index));
 			index++;
 		}
 
@@ -1657,7 +1647,7 @@ namespace parser
 				return make_syntax_error(namespace_name, "Cannot use a keyword as namespace name.");
 
 		if (tokens[index].type != lex::Token::Type::open_brace)
-			return make_syntax_error(tokens[index].source, "Expected '{' after namespace name.");
+			return make_syntax_error(tokens.text(index), "Expected '{' after namespace name.");
 		index++;
 
 		while (tokens[index].type != lex::Token::Type::close_brace)
@@ -1667,7 +1657,7 @@ namespace parser
 		return std::move(namespace_declaration);
 	}
 
-	auto parse_conversion_declaration(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
+	auto parse_conversion_declaration(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
 		-> expected<incomplete::statement::ConversionDeclaration, PartialSyntaxError>
 	{
 		// Skip conversion token
@@ -1678,14 +1668,14 @@ namespace parser
 		return std::move(conversion_decl);
 	}
 
-	auto parse_implicit_conversion_declaration(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
+	auto parse_implicit_conversion_declaration(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept
 		-> expected<incomplete::statement::ConversionDeclaration, PartialSyntaxError>
 	{
 		// Skip conversion token
 		index++;
 
-		if (tokens[index].source != "conversion")
-			return make_syntax_error(tokens[index].source, "Expected keyword \"conversion\" after \"explicit\".");
+		if (tokens.text(index) != "conversion")
+			return make_syntax_error(tokens.text(index), "Expected keyword \"conversion\" after \"explicit\".");
 		index++;
 
 		incomplete::statement::ConversionDeclaration conversion_decl;
@@ -1694,7 +1684,7 @@ namespace parser
 		return std::move(conversion_decl);
 	}
 
-	auto parse_expression_statement(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
+	auto parse_expression_statement(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
 		-> expected<incomplete::statement::ExpressionStatement, PartialSyntaxError>
 	{
 		incomplete::statement::ExpressionStatement statement;
@@ -1702,84 +1692,97 @@ namespace parser
 		return std::move(statement);
 	}
 
-	auto parse_statement_variant(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
+	auto parse_statement_variant(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept 
 		-> expected<incomplete::statement::Variant, PartialSyntaxError>
 	{
 		incomplete::statement::Variant result;
 
-		if (tokens[index].source == "let")
+		if (tokens.text(index) == "let")
 			try_call(assign_to(result), parse_let_statement(tokens, index, type_names))
-		else if (tokens[index].source == "uninit")
+		else if (tokens.text(index) == "uninit")
 			try_call(assign_to(result), parse_uninit_statement(tokens, index, type_names))
-		else if (tokens[index].source == "return")
+		else if (tokens.text(index) == "return")
 			try_call(assign_to(result), parse_return_statement(tokens, index, type_names))
 			// With if, {}, while and for statements, return to avoid checking for final ';' because it is not needed.
-		else if (tokens[index].source == "if")
+		else if (tokens.text(index) == "if")
 			return parse_if_statement(tokens, index, type_names);
 		else if (tokens[index].type == lex::Token::Type::open_brace)
 			return parse_statement_block(tokens, index, type_names);
-		else if (tokens[index].source == "while")
+		else if (tokens.text(index) == "while")
 			return parse_while_statement(tokens, index, type_names);
-		else if (tokens[index].source == "for")
+		else if (tokens.text(index) == "for")
 			return parse_for_statement(tokens, index, type_names);
-		else if (tokens[index].source == "break")
+		else if (tokens.text(index) == "break")
 			result = parse_break_or_continue_statement<incomplete::statement::Break>(tokens, index, type_names);
-		else if (tokens[index].source == "continue")
+		else if (tokens.text(index) == "continue")
 			result = parse_break_or_continue_statement<incomplete::statement::Continue>(tokens, index, type_names);
-		else if (tokens[index].source == "struct")
+		else if (tokens.text(index) == "struct")
 			return parse_struct_declaration(tokens, index, type_names);
-		else if (tokens[index].source == "type")
+		else if (tokens.text(index) == "type")
 			try_call(assign_to(result), parse_type_alias(tokens, index, type_names))
-		else if (tokens[index].source == "namespace")
+		else if (tokens.text(index) == "namespace")
 			return parse_namespace_declaration(tokens, index, type_names);
-		else if (tokens[index].source == "conversion")
+		else if (tokens.text(index) == "conversion")
 			try_call(assign_to(result), parse_conversion_declaration(tokens, index, type_names))
-		else if (tokens[index].source == "implicit")
+		else if (tokens.text(index) == "implicit")
 			try_call(assign_to(result), parse_implicit_conversion_declaration(tokens, index, type_names))
 		else
 			try_call(assign_to(result), parse_expression_statement(tokens, index, type_names));
 
 		// A statement must end with a semicolon.
 		if (tokens[index].type != lex::Token::Type::semicolon)
-			return make_syntax_error(tokens[index], "Expected ';' after statement.");
+			return make_syntax_error(tokens.text(index), "Expected ';' after statement.");
 		index++;
 
 		return std::move(result);
 	}
 
-	auto parse_statement(span<lex::Token const> tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Statement, PartialSyntaxError>
+	auto parse_statement(lex::TokenStream & tokens, size_t & index, std::vector<TypeName> & type_names) noexcept -> expected<incomplete::Statement, PartialSyntaxError>
 	{
-		auto const expr_source_start = begin_ptr(tokens[index].source);
+		auto const expr_source_start = begin_ptr(tokens.text(index));
 		try_call_decl(incomplete::statement::Variant var, parse_statement_variant(tokens, index, type_names));
-		auto const expr_source_end = end_ptr(tokens[index - 1].source);
+		auto const expr_source_end = end_ptr(tokens.text(index - 1));
 		return incomplete::Statement(std::move(var), make_string_view(expr_source_start, expr_source_end));
 	}
 
 	auto parse_global_scope(
-		span<lex::Token const> tokens,
+		lex::TokenStream & tokens,
 		std::vector<TypeName> & type_names,
 		std::vector<incomplete::Statement> global_initialization_statements
 	) noexcept -> expected<std::vector<incomplete::Statement>, PartialSyntaxError>
 	{
 		size_t index = 0;
-		while (index < tokens.size())
+		while (!tokens.at_end(index))
 		{
-			try_call_decl(incomplete::Statement statement, parse_statement(tokens, index, type_names));
+			auto statement = parse_statement(tokens, index, type_names);
+
+			// If the lexer found an error the tokens end there, which is what the parser complains about.
+			if (tokens.error())
+				return Error(*tokens.error());
+			if (!statement.has_value())
+				return Error(std::move(statement.error()));
 
-			if (has_type<incomplete::statement::ExpressionStatement>(statement.variant)) 
-				return make_syntax_error(tokens[index], "An expression statement is not allowed at the global scope.");
+			if (has_type<incomplete::statement::ExpressionStatement>(statement->variant)) 
+				return make_syntax_error(tokens.text(index), "An expression statement is not allowed at the global scope.");
 
-			global_initialization_statements.push_back(std::move(statement));
+			global_initialization_statements.push_back(std::move(*statement));
 		}
 
+		if (tokens.error())
+			return Error(*tokens.error());
+
 		return global_initialization_statements;
 	}
 
-	auto parse_type_names(span<lex::Token const> tokens, std::vector<TypeName> type_names) noexcept -> std::vector<TypeName>
+	// Finds the names of the types declared at the global scope of a file, so that they are known to the parser before their declarations.
+	// Reads all the tokens of the file, so this is where syntax errors of the lexer are found.
+	auto parse_type_names(std::string_view source) noexcept -> expected<std::vector<TypeName>, PartialSyntaxError>
 	{
+		lex::TokenStream tokens(source);
+		std::vector<TypeName> type_names;
 		int brace_level = 0;
 
-		for (size_t i = 0; i < tokens.size(); ++i)
+		for (size_t i = 0; !tokens.at_end(i); ++i)
 		{
 			if (tokens[i].type == lex::Token::Type::open_brace)
 			{
@@ -1789,33 +1792,36 @@ namespace parser
 			{
 				brace_level--;
 			}
-			else if (brace_level == 0 && tokens[i].source == "struct")
+			else if (brace_level == 0 && tokens.text(i) == "struct")
 			{
 				i++;
-				if (i < tokens.size())
+				if (!tokens.at_end(i))
 				{
-					if (tokens[i].source == "<")
+					if (tokens.text(i) == "<")
 					{
-						while (i < tokens.size() && tokens[i].source != ">")
+						while (!tokens.at_end(i) && tokens.text(i) != ">")
 							i++;
 						i++;
 
-						if (i < tokens.size() && tokens[i].type == lex::Token::Type::identifier && !is_keyword(tokens[i].source))
+						if (!tokens.at_end(i) && tokens[i].type == lex::Token::Type::identifier && !is_keyword(tokens.text(i)))
 						{
-							type_names.push_back({tokens[i].source, TypeName::Type::struct_template});
+							type_names.push_back({tokens.text(i), TypeName::Type::struct_template});
 						}
 					}
 					else
 					{
-						if (tokens[i].type == lex::Token::Type::identifier && !is_keyword(tokens[i].source))
+						if (tokens[i].type == lex::Token::Type::identifier && !is_keyword(tokens.text(i)))
 						{
-							type_names.push_back({tokens[i].source, TypeName::Type::type});
+							type_names.push_back({tokens.text(i), TypeName::Type::type});
 						}
 					}
 				}
 			}
 		}
 
+		if (tokens.error())
+			return Error(*tokens.error());
+
 		return type_names;
 	}
 
@@ -1831,44 +1837,154 @@ namespace parser
 			scan_type_names(modules, module_type_names, dependency_index, type_names);
 	}
 
-	[[nodiscard]] auto parse_module(span<incomplete::Module> modules, int index, span<std::vector<TypeName>> module_type_names) noexcept -> expected<void, SyntaxError>
+	auto parse_file_type_names(incomplete::Module::File const & file) noexcept -> expected<std::vector<TypeName>, SyntaxError>
 	{
-		std::vector<lex::Token> tokens;
-		for (auto const & file : modules[index].files)
-		{
-			auto new_tokens = lex::tokenize(file.source, std::move(tokens));
-			if (new_tokens.has_value())
-				tokens = std::move(*new_tokens);
-			else
-				return Error(complete_syntax_error(new_tokens.error(), file.source, file.filename));
-		}
+		auto type_names = parse_type_names(file.source);
+		if (type_names.has_value())
+			return std::move(*type_names);
+		else
+			return Error(complete_syntax_error(type_names.error(), file.source, file.filename));
+	}
+
+	// The types declared by the dependencies of the module must already be in module_type_names.
+	[[nodiscard]] auto parse_module(
+		span<incomplete::Module> modules,
+		int index,
+		span<std::vector<TypeName>> file_type_names,
+		span<std::vector<TypeName>> module_type_names) noexcept -> expected<void, SyntaxError>
+	{
+		incomplete::Module & module = modules[index];
+
+		if (module.arena.resource == nullptr)
+			module.arena.resource = std::make_unique<std::pmr::monotonic_buffer_resource>();
+		ScopedValuePtrResource const allocate_from_arena(module.arena.resource.get());
 
 		std::vector<TypeName> type_names = built_in_type_names();
 		scan_type_names(modules, module_type_names, index, out(type_names));
-		type_names = parse_type_names(tokens, std::move(type_names));
+		for (std::vector<TypeName> const & names : file_type_names)
+			type_names.insert(type_names.end(), names.begin(), names.end());
 		size_t const imported_type_count = type_names.size();
 
-		auto statements = parse_global_scope(tokens, type_names);
-		if (!statements.has_value())
+		// Statements don't span files, so each file is parsed on its own with the types declared in all of them.
+		std::vector<incomplete::Statement> statements;
+		for (incomplete::Module::File const & file : module.files)
 		{
-			incomplete::Module::File const & file = *file_that_contains(modules[index], statements.error().error_in_source);
-			return Error(complete_syntax_error(std::move(statements.error()), file.source, file.filename));
+			lex::TokenStream tokens(file.source);
+			auto file_statements = parse_global_scope(tokens, type_names, std::move(statements));
+			if (!file_statements.has_value())
+				return Error(complete_syntax_error(std::move(file_statements.error()), file.source, file.filename));
+			statements = std::move(*file_statements);
 		}
 
 		type_names.erase(type_names.begin(), type_names.begin() + imported_type_count);
 		module_type_names[index] = std::move(type_names);
-		modules[index].statements = std::move(*statements);
-
+		module.statements = std::move(statements);
 		return success;
 	}
 
-	[[nodiscard]] auto parse_modules(span<incomplete::Module> modules) noexcept -> expected<std::vector<int>, SyntaxError>
+	[[nodiscard]] auto parse_modules(span<incomplete::Module> modules, incomplete::ModuleCache const * cache, int thread_count) noexcept -> expected<std::vector<int>, SyntaxError>
 	{
-		try_call_decl(std::vector<int> const sorted_modules, sort_modules_by_dependencies(modules));
 		std::vector<std::vector<TypeName>> module_type_names(modules.size());
+		std::vector<char> is_parsed(modules.size(), false);
+		return parse_modules(modules, module_type_names, is_parsed, cache, thread_count);
+	}
+
+	[[nodiscard]] auto parse_modules(
+		span<incomplete::Module> modules,
+		span<std::vector<TypeName>> module_type_names,
+		span<char> is_parsed,
+		incomplete::ModuleCache const * cache,
+		int thread_count
+	) noexcept -> expected<std::vector<int>, SyntaxError>
+	{
+		try_call_decl(std::vector<int> const sorted_modules, sort_modules_by_dependencies(modules));
+		std::vector<uint64_t> module_hashes(cache != nullptr ? modules.size() : 0);
+		std::vector<char> is_parsed_already(is_parsed.begin(), is_parsed.end()); // Before the tasks run or by loading it from the cache.
+		std::vector<std::vector<std::vector<TypeName>>> module_file_type_names(modules.size());
+
+		// For each module, in the order in which they are parsed: look it up in the cache, find the types declared in each of its files and parse it.
+		// Files can be scanned before the modules they depend on are parsed, only parsing needs the names of the types declared by them.
+		std::vector<Task> tasks;
+		std::vector<std::optional<SyntaxError>> task_errors;
+		std::vector<int> cache_task_index(modules.size());
+		std::vector<int> parse_task_index(modules.size());
+		auto const add_task = [&](std::function<auto() -> expected<void, SyntaxError>> run, std::vector<int> dependencies)
+		{
+			int const task_index = static_cast<int>(tasks.size());
+			tasks.push_back({[&task_errors, task_index, run = std::move(run)]()
+			{
+				auto result = run();
+				if (!result.has_value())
+					task_errors[task_index] = std::move(result.error());
+				return result.has_value();
+			}, std::move(dependencies)});
+			task_errors.emplace_back();
+			return task_index;
+		};
+
+		for (int const module_index : sorted_modules)
+		{
+			incomplete::Module & module = modules[module_index];
+			module_file_type_names[module_index].resize(module.files.size());
+
+			std::vector<int> file_dependencies;
+			if (cache != nullptr)
+			{
+				std::vector<int> dependencies;
+				for (int const dependency_index : module.dependencies)
+					dependencies.push_back(cache_task_index[dependency_index]);
+
+				cache_task_index[module_index] = add_task([&, module_index]() -> expected<void, SyntaxError>
+				{
+					// The hashes of modules that were already parsed are still needed for the modules that depend on them.
+					module_hashes[module_index] = incomplete::module_hash(modules[module_index], module_hashes);
+					if (is_parsed_already[module_index])
+						return success;
+
+					std::vector<TypeName> type_names;
+					if (incomplete::load_cached_module(*cache, module_hashes[module_index], modules[module_index], out(type_names)))
+					{
+						module_type_names[module_index] = std::move(type_names);
+						is_parsed_already[module_index] = true;
+						is_parsed[module_index] = true;
+					}
+					return success;
+				}, std::move(dependencies));
+				file_dependencies.push_back(cache_task_index[module_index]);
+			}
+
+			std::vector<int> parse_dependencies;
+			for (size_t file_index = 0; file_index < module.files.size(); ++file_index)
+			{
+				parse_dependencies.push_back(add_task([&, module_index, file_index]() -> expected<void, SyntaxError>
+				{
+					if (is_parsed_already[module_index])
+						return success;
+
+					try_call(assign_to(module_file_type_names[module_index][file_index]), parse_file_type_names(modules[module_index].files[file_index]));
+					return success;
+				}, file_dependencies));
+			}
+			for (int const dependency_index : module.dependencies)
+				parse_dependencies.push_back(parse_task_index[dependency_index]);
+
+			parse_task_index[module_index] = add_task([&, module_index]() -> expected<void, SyntaxError>
+			{
+				if (is_parsed_already[module_index])
+					return success;
+
+				try_call_void(parse_module(modules, module_index, module_file_type_names[module_index], module_type_names));
+				module_file_type_names[module_index].clear();
+				if (cache != nullptr)
+					incomplete::save_cached_module(*cache, module_hashes[module_index], modules[module_index], module_type_names[module_index]);
+				is_parsed[module_index] = true;
+				return success;
+			}, std::move(parse_dependencies));
+		}
 
-		for (int i : sorted_modules)
-			try_call_void(parse_module(modules, i, module_type_names));
+		std::optional<int> const failed_task = run_task_graph(tasks, thread_count);
+		if (failed_task.has_value())
+			return Error(std::move(*task_errors[*failed_task]));
 
 		return sorted_modules;
 	}
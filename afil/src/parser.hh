@@ -1,11 +1,12 @@
 #pragma once
 
+#include "lexer.hh"
 #include "syntax_error.hh"
 #include "utils/expected.hh"
 #include "utils/out.hh"
 #include "utils/span.hh"
 #include <vector>
-namespace incomplete { struct Statement; struct Module; }
+namespace incomplete { struct Statement; struct Module; struct ModuleCache; }
 
 namespace parser
 {
@@ -16,10 +17,28 @@ namespace parser
 		enum struct Type { type, struct_template, template_parameter } type;
 	};
 
-	[[nodiscard]] auto parse_modules(span<incomplete::Module> modules) noexcept -> expected<std::vector<int>, SyntaxError>;
+	// If a cache is given, modules that have not changed since they were stored in it are loaded instead of parsed, and the rest are stored.
+	// Files are scanned for type names and modules are parsed on up to thread_count threads (0 means one per hardware thread). A module is parsed as
+	// soon as the modules it depends on are. If there are errors, the one returned is the one that parsing the modules in order would find first.
+	[[nodiscard]] auto parse_modules(
+		span<incomplete::Module> modules,
+		incomplete::ModuleCache const * cache = nullptr,
+		int thread_count = 0
+	) noexcept -> expected<std::vector<int>, SyntaxError>;
+
+	// For callers that keep parsed modules between compilations. The modules that are marked in is_parsed are left as they are, and their element of
+	// module_type_names must hold the names of the types that they declare. The other modules are parsed or loaded from the cache, after which they
+	// are marked in is_parsed and the names of their types stored in module_type_names, even if another module fails to parse.
+	[[nodiscard]] auto parse_modules(
+		span<incomplete::Module> modules,
+		span<std::vector<TypeName>> module_type_names,
+		span<char> is_parsed,
+		incomplete::ModuleCache const * cache = nullptr,
+		int thread_count = 0
+	) noexcept -> expected<std::vector<int>, SyntaxError>;
 
 	[[nodiscard]] auto parse_global_scope(
-		span<lex::Token const> tokens,
+		lex::TokenStream & tokens,
 		std::vector<TypeName> & type_names,
 		std::vector<incomplete::Statement> global_initialization_statements = {}
 	) noexcept -> expected<std::vector<incomplete::Statement>, PartialSyntaxError>;
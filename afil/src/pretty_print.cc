@@ -30,14 +30,18 @@ auto decayed_type_name(TypeId type_id, Program const & program) noexcept -> std:
 	if (is_array_pointer(type))
 		return join(type_name(pointee_type(type), program), "[]");
 
+	for (TypeName const & t : prelude_scope().types)
+		if (t.id == type_id)
+			return to_string(t.name);
+
 	for (TypeName const & t : program.global_scope.types)
 		if (t.id == type_id)
-			return t.name;
+			return to_string(t.name);
 
 	for (Function const & fn : program.functions)
 		for (TypeName const & t : fn.types)
 			if (t.id == type_id)
-				return t.name;
+				return to_string(t.name);
 
 	return "???"s;
 }
@@ -60,14 +64,18 @@ auto function_name(FunctionId fn_id, Program const & program) noexcept -> std::s
 	if (fn_id == program.main_function)
 		return "main"sv;
 
+	for (FunctionName const & t : prelude_scope().functions)
+		if (t.id == fn_id)
+			return symbol_name(t.name);
+
 	for (FunctionName const & t : program.global_scope.functions)
 		if (t.id == fn_id)
-			return t.name;
+			return symbol_name(t.name);
 
 	for (Function const & fn : program.functions)
 		for (FunctionName const & t : fn.functions)
 			if (t.id == fn_id)
-				return t.name;
+				return symbol_name(t.name);
 
 	return "???"sv;
 }
@@ -87,14 +95,18 @@ auto variable_with_offset(ScopeStackView scope_stack, int offset) noexcept -> Va
 
 auto function_template_name(FunctionTemplateId fn_id, Program const & program) noexcept -> std::string_view
 {
+	for (FunctionTemplateName const & t : prelude_scope().function_templates)
+		if (fn_id.is_intrinsic && t.id.index == fn_id.index)
+			return symbol_name(t.name);
+
 	for (FunctionTemplateName const & t : program.global_scope.function_templates)
 		if (t.id.index == fn_id.index)
-			return t.name;
+			return symbol_name(t.name);
 
 	for (Function const & fn : program.functions)
 		for (FunctionTemplateName const & t : fn.function_templates)
 			if (t.id.index == fn_id.index)
-				return t.name;
+				return symbol_name(t.name);
 
 	return "???"sv;
 }
@@ -104,7 +116,7 @@ auto member_variable_name(TypeId owner_type, int variable_offset, Program const
 	Struct const & struct_data = *struct_for_type(program, owner_type);
 	for (MemberVariable const & var : struct_data.member_variables)
 		if (var.offset == variable_offset)
-			return var.name;
+			return symbol_name(var.name);
 
 	return "???"sv;
 }
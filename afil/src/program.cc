@@ -433,50 +433,105 @@ namespace complete
 		intrinsic_function_template_descriptor<Param<0> const &>("size", template_intrinsics::instantiate_size_function_template, {function_id_constants::is_array}),
 	};
 
-	Program::Program()
+	auto built_in_type_table() noexcept -> std::vector<Type> const &
 	{
-		auto const built_in_types_to_add = built_in_types();
-
-		types.reserve(built_in_types_to_add.size());
-		global_scope.types.reserve(built_in_types_to_add.size() + 1);
+		static std::vector<Type> const table = []()
+		{
+			std::vector<Type> types;
+			for (auto & type : built_in_types())
+			{
+				types.push_back(std::move(type.second));
+				types.back().ABI_name = type.first;
+			}
+			return types;
+		}();
+		return table;
+	}
 
-		for (auto const type : built_in_types_to_add)
+	auto prelude_scope() noexcept -> Namespace const &
+	{
+		static Namespace const prelude = []()
 		{
-			global_scope.types.push_back({std::string(type.first), {false, false, false, static_cast<unsigned>(types.size())}});
-			types.push_back(type.second);
-			types.back().ABI_name = type.first;
-		}
-		global_scope.types.push_back({"char", {false, false, false, 5}}); // Add char as typedef for uint8
-		global_scope.types.push_back({"byte", {false, false, false, 5}}); // Add byte as typedef for uint8
+			Namespace scope;
 
-		//*******************************************************************
+			auto const built_in_types_to_add = built_in_types();
+			scope.types.reserve(built_in_types_to_add.size() + 2);
+			for (size_t i = 0; i < built_in_types_to_add.size(); ++i)
+				add_type_to_scope(scope, intern(built_in_types_to_add[i].first), TypeId::with_index(static_cast<unsigned>(i)));
+			add_type_to_scope(scope, intern("char"), TypeId::uint8); // Add char as typedef for uint8
+			add_type_to_scope(scope, intern("byte"), TypeId::uint8); // Add byte as typedef for uint8
 
-		size_t const intrinsic_function_count = std::size(intrinsic_functions);
-		global_scope.functions.reserve(intrinsic_function_count);
+			size_t const intrinsic_function_count = std::size(intrinsic_functions);
+			scope.functions.reserve(intrinsic_function_count);
+			for (size_t i = 0; i < intrinsic_function_count; ++i)
+				add_function_to_scope(scope, intern(intrinsic_functions[i].name), {FunctionId::Type::intrinsic, static_cast<unsigned>(i)});
 
-		for (size_t i = 0; i < intrinsic_function_count; ++i)
-		{
-			auto const & fn = intrinsic_functions[i];
-			global_scope.functions.push_back({std::string(fn.name), {FunctionId::Type::intrinsic, static_cast<unsigned>(i)}});
-		}
+			size_t const intrinsic_function_template_count = std::size(intrinsic_function_templates);
+			scope.function_templates.reserve(intrinsic_function_template_count);
+			for (size_t i = 0; i < intrinsic_function_template_count; ++i)
+				add_function_template_to_scope(scope, intern(intrinsic_function_templates[i].ABI_name), {true, static_cast<unsigned>(i)});
 
-		size_t const intrinsic_function_template_count = std::size(intrinsic_function_templates);
-		global_scope.function_templates.reserve(intrinsic_function_count);
+			return scope;
+		}();
+		return prelude;
+	}
 
-		for (size_t i = 0; i < intrinsic_function_template_count; ++i)
-		{
-			auto const & fn = intrinsic_function_templates[i];
-			global_scope.function_templates.push_back({fn.ABI_name, {true, static_cast<unsigned>(i)}});
-		}
+	Program::Program()
+		: types(built_in_type_table())
+	{}
+
+	auto DerivedTypeKeyHash::operator () (DerivedTypeKey key) const noexcept -> size_t
+	{
+		size_t hash = std::hash<unsigned>()(key.value_type.flat_value);
+		hash = hash * 31 + static_cast<size_t>(key.size);
+		hash = hash * 31 + static_cast<size_t>(key.kind);
+		return hash;
+	}
+
+	auto derived_type_key(Type const & type) noexcept -> std::optional<DerivedTypeKey>
+	{
+		if (auto const pointer = try_get<Type::Pointer>(type.extra_data))
+			return DerivedTypeKey{DerivedTypeKey::Kind::pointer, pointer->value_type, 0};
+		else if (auto const array = try_get<Type::Array>(type.extra_data))
+			return DerivedTypeKey{DerivedTypeKey::Kind::array, array->value_type, array->size};
+		else if (auto const array_pointer = try_get<Type::ArrayPointer>(type.extra_data))
+			return DerivedTypeKey{DerivedTypeKey::Kind::array_pointer, array_pointer->value_type, 0};
+		else
+			return std::nullopt;
+	}
+
+	auto find_derived_type(Program const & program, DerivedTypeKey key) noexcept -> std::optional<TypeId>
+	{
+		auto const it = program.derived_types.find(key);
+		if (it != program.derived_types.end())
+			return it->second;
+		else
+			return std::nullopt;
 	}
 
 	auto add_type(Program & program, Type new_type) noexcept -> TypeId
 	{
 		unsigned const type_index = static_cast<unsigned>(program.types.size());
+		if (auto const key = derived_type_key(new_type))
+			program.derived_types.emplace(*key, TypeId::with_index(type_index));
 		program.types.push_back(std::move(new_type));
 		return TypeId::with_index(type_index);
 	}
 
+	auto remove_types(Program & program, size_t new_type_count) noexcept -> void
+	{
+		for (size_t i = new_type_count; i < program.types.size(); ++i)
+		{
+			if (auto const key = derived_type_key(program.types[i]))
+			{
+				auto const it = program.derived_types.find(*key);
+				if (it != program.derived_types.end() && it->second.index == i)
+					program.derived_types.erase(it);
+			}
+		}
+		program.types.resize(new_type_count);
+	}
+
 	auto type_with_id(Program const & program, TypeId id) noexcept -> Type const &
 	{
 		assert(!id.is_function && id.index < program.types.size());
@@ -689,11 +744,22 @@ namespace complete
 		{
 			for (Constructor const & ctor : struct_data.constructors)
 				if (ctor.name == constructor_name)
-					constructors.push_back(ctor.function);
+					add_if_actual_function(constructors, ctor.function);
 		}
 		return constructors;
 	}
 
+	auto forget_removed_named_constructors(Program & program) noexcept -> void
+	{
+		// Named constructors of struct templates may be instantiated after their struct, so rolling back
+		// the program can remove a constructor whose struct stays. Mark it as not instantiated again.
+		size_t const function_count = program.functions.size();
+		for (Struct & struct_data : program.structs)
+			for (Constructor & ctor : struct_data.constructors)
+				if (ctor.function.type == FunctionId::Type::program && ctor.function.index >= function_count)
+					ctor.function = function_id_constants::invalid;
+	}
+
 	auto add_struct_type(Program & program, Type new_type, Struct new_struct) -> std::pair<TypeId, int>
 	{
 		int const new_struct_id = static_cast<int>(program.structs.size());
@@ -732,7 +798,11 @@ namespace complete
 
 	auto find_member_variable(Struct const & type, std::string_view member_name) noexcept -> int
 	{
-		auto const it = std::find_if(type.member_variables, [member_name](MemberVariable const & var) { return var.name == member_name; });
+		std::optional<Symbol> const symbol = find_symbol(member_name);
+		if (!symbol)
+			return -1;
+
+		auto const it = std::find_if(type.member_variables, [symbol](MemberVariable const & var) { return var.name == *symbol; });
 
 		if (it == type.member_variables.end())
 			return -1;
@@ -750,10 +820,8 @@ namespace complete
 		assert(!pointee_type.is_reference); // A pointer can't point at a reference.
 
 		// If a pointer type for this type has already been created, return that.
-		for (Type const & type : program.types)
-			if (auto const pointer = try_get<Type::Pointer>(type.extra_data))
-				if (pointer->value_type == pointee_type)
-					return TypeId::with_index(static_cast<unsigned>(&type - program.types.data()));
+		if (auto const existing_type = find_derived_type(program, {DerivedTypeKey::Kind::pointer, pointee_type, 0}))
+			return *existing_type;
 
 		// Otherwise create one.
 		Type new_type;
@@ -788,10 +856,8 @@ namespace complete
 		assert(!value_type.is_mutable); // An array can't contain mutable stuff.
 
 		// If an array type for this type has already been created, return that.
-		for (Type const & type : program.types)
-			if (auto const array = try_get<Type::Array>(type.extra_data))
-				if (array->value_type == value_type && array->size == size)
-					return TypeId::with_index(static_cast<unsigned>(&type - program.types.data()));
+		if (auto const existing_type = find_derived_type(program, {DerivedTypeKey::Kind::array, value_type, size}))
+			return *existing_type;
 
 		Type const & value_type_data = type_with_id(program, value_type);
 
@@ -868,10 +934,8 @@ namespace complete
 		assert(!pointee_type.is_reference); // A pointer can't point at a reference.
 
 		// If a pointer type for this type has already been created, return that.
-		for (Type const & type : program.types)
-			if (auto const pointer = try_get<Type::ArrayPointer>(type.extra_data))
-				if (pointer->value_type == pointee_type)
-					return TypeId::with_index(static_cast<unsigned>(&type - program.types.data()));
+		if (auto const existing_type = find_derived_type(program, {DerivedTypeKey::Kind::array_pointer, pointee_type, 0}))
+			return *existing_type;
 
 		// Otherwise create one.
 		Type new_type;
@@ -881,8 +945,17 @@ namespace complete
 		return add_type(program, std::move(new_type));
 	}
 
+	auto intrinsic_function_count() noexcept -> size_t
+	{
+		return std::size(intrinsic_functions);
+	}
+
 	auto add_function(Program & program, Function new_function) noexcept -> FunctionId
 	{
+		new_function.parameter_types.resize(new_function.parameter_count);
+		for (int i = 0; i < new_function.parameter_count; ++i)
+			new_function.parameter_types[i] = new_function.variables[i].type;
+
 		FunctionId const function_id = FunctionId{FunctionId::Type::program, static_cast<unsigned>(program.functions.size())};
 		program.functions.push_back(std::move(new_function));
 		return function_id;
@@ -895,7 +968,7 @@ namespace complete
 		return function_template_id;
 	}
 
-	auto parameter_types_of(Program const & program, FunctionId id) noexcept -> std::vector<TypeId>
+	auto parameter_types_of(Program const & program, FunctionId id) noexcept -> span<TypeId const>
 	{
 		if (id.type == FunctionId::Type::intrinsic)
 		{
@@ -907,11 +980,7 @@ namespace complete
 		}
 		else
 		{
-			Function const & fn = program.functions[id.index];
-			std::vector<TypeId> types(fn.parameter_count);
-			for (int i = 0; i < fn.parameter_count; ++i)
-				types[i] = fn.variables[i].type;
-			return types;
+			return program.functions[id.index].parameter_types;
 		}
 	}
 
@@ -993,6 +1062,39 @@ namespace complete
 			return program.functions[id.index].is_callable_at_runtime;
 	}
 
+	auto has_analyzed_body(Program const & program, Function const & function) noexcept -> bool
+	{
+		return function.deferred_body == -1 || program.deferred_function_bodies[function.deferred_body].is_analyzed;
+	}
+
+	auto function_to_run(Program const & program, FunctionId id) noexcept -> Function const &
+	{
+		if (program.base && id.index < program.base->functions.size())
+		{
+			Function const & base_function = program.base->functions[id.index];
+			if (has_analyzed_body(*program.base, base_function))
+				return base_function;
+		}
+		return program.functions[id.index];
+	}
+
+	auto remove_deferred_function_body(Function & function, DeferredFunctionBody const & deferred_body) noexcept -> void
+	{
+		// The prototype only declares the parameters.
+		remove_names_from_scope(function, NameKind::variable, static_cast<size_t>(function.parameter_count));
+		remove_names_from_scope(function, NameKind::constant, 0);
+		remove_names_from_scope(function, NameKind::function, 0);
+		remove_names_from_scope(function, NameKind::type, 0);
+		remove_names_from_scope(function, NameKind::function_template, 0);
+		remove_names_from_scope(function, NameKind::struct_template, 0);
+		function.stack_frame_size = function.parameter_size;
+		function.stack_frame_alignment = deferred_body.prototype_stack_frame_alignment;
+		function.preconditions.clear();
+		function.statements.clear();
+		function.is_callable_at_compile_time = true;
+		function.is_callable_at_runtime = true;
+	}
+
 	auto find_namespace(Namespace & current_namespace, std::string_view name) noexcept -> Namespace *
 	{
 		auto const it = std::find_if(current_namespace.nested_namespaces, [name](Namespace const & ns) { return ns.name == name; });
@@ -1086,45 +1188,55 @@ namespace complete
 		return program.overload_set_types[overload_set_type.index];
 	}
 
+	auto analyze_function_template_instantiation(Program & program, FunctionTemplateId template_id, span<TypeId const> parameters, instantiation::TemplateCache & template_cache) noexcept
+		-> expected<Function, PartialSyntaxError>
+	{
+		FunctionTemplate & function_template = program.function_templates[template_id.index];
+		assert(parameters.size() == function_template.incomplete_function->template_parameters.size());
+
+		std::vector<ResolvedTemplateParameter> all_template_parameters;
+		all_template_parameters.reserve(function_template.scope_template_parameters.size() + parameters.size());
+		for (ResolvedTemplateParameter const id : function_template.scope_template_parameters)
+			all_template_parameters.push_back(id);
+
+		for (size_t i = 0; i < parameters.size(); ++i)
+			all_template_parameters.push_back({ intern(function_template.incomplete_function->template_parameters[i].name), parameters[i] });
+
+		instantiation::ScopeStack scope_stack = *function_template.scope_stack;
+		std::shared_ptr<incomplete::FunctionTemplate const> const incomplete_function = function_template.incomplete_function;
+
+		try_call_decl(Function instantiated_function, instantiation::instantiate_function_template(*incomplete_function,
+			{all_template_parameters, scope_stack, out(program), template_cache, instantiation::FunctionBodyAnalysis::eager, incomplete_function}));
+
+		instantiated_function.ABI_name = function_template.ABI_name;
+		return instantiated_function;
+	}
+
 	auto instantiate_function_template(Program & program, FunctionTemplateId template_id, span<TypeId const> parameters, instantiation::TemplateCache & template_cache) noexcept -> expected<FunctionId, PartialSyntaxError>
 	{
-		instantiation::TemplateInstantiation<FunctionTemplateId> search;
-		search.id = template_id;
-		search.parameters.assign(parameters.begin(), parameters.end());
-		auto const cached_instantiation = template_cache.functions.find(search);
-		if (cached_instantiation != template_cache.functions.end())
-			return cached_instantiation->second;
+		if (FunctionId const * const cached_instantiation = template_cache.find_function(template_id, parameters))
+			return *cached_instantiation;
 
 		if (template_id.is_intrinsic)
 		{
 			Function instantiated_function = intrinsic_function_templates[template_id.index].instantiation_function(parameters, program);
 			FunctionId const instantiated_function_id = add_function(program, std::move(instantiated_function));
-			template_cache.functions.emplace(std::move(search), instantiated_function_id);
+			template_cache.functions.insert(template_id, parameters, instantiated_function_id);
 			return instantiated_function_id;
 		}
 		else
 		{
-			FunctionTemplate & function_template = program.function_templates[template_id.index];
-			assert(parameters.size() == function_template.incomplete_function.template_parameters.size());
-
-			std::vector<ResolvedTemplateParameter> all_template_parameters;
-			all_template_parameters.reserve(function_template.scope_template_parameters.size() + parameters.size());
-			for (ResolvedTemplateParameter const id : function_template.scope_template_parameters)
-				all_template_parameters.push_back(id);
-
-			for (size_t i = 0; i < parameters.size(); ++i)
-				all_template_parameters.push_back({ std::string(function_template.incomplete_function.template_parameters[i].name), parameters[i] });
-
-			instantiation::ScopeStack scope_stack = function_template.scope_stack;
-
-			try_call_decl(Function instantiated_function,
-				instantiation::instantiate_function_template(function_template.incomplete_function, {all_template_parameters, scope_stack, out(program), template_cache}));
+			if (std::optional<Function> shared_instantiation = instantiation::instantiate_layout_generic_function_template(template_id, parameters, out(program), template_cache))
+			{
+				FunctionId const instantiated_function_id = add_function(program, std::move(*shared_instantiation));
+				template_cache.functions.insert(template_id, parameters, instantiated_function_id);
+				return instantiated_function_id;
+			}
 
-			instantiated_function.ABI_name = function_template.ABI_name;
+			try_call_decl(Function instantiated_function, analyze_function_template_instantiation(program, template_id, parameters, template_cache));
 			FunctionId const instantiated_function_id = add_function(program, std::move(instantiated_function));
 
-			auto parameters_to_insert = std::vector<TypeId>(parameters.begin(), parameters.end());
-			template_cache.functions.emplace(std::move(search), instantiated_function_id);
+			template_cache.functions.insert(template_id, parameters, instantiated_function_id);
 
 			return instantiated_function_id;
 		}
@@ -1133,14 +1245,21 @@ namespace complete
 	auto check_concepts(
 		span<FunctionId const> concepts, 
 		span<TypeId const> parameters, 
-		std::vector<ResolvedTemplateParameter> template_parameters,
-		instantiation::ScopeStack scope_stack,
+		span<ResolvedTemplateParameter const> scope_template_parameters,
+		instantiation::ScopeStackView scope_stack_view,
 		Program& program,
 		instantiation::TemplateCache & template_cache
 	) noexcept -> size_t
 	{
 		assert(concepts.size() == parameters.size());
 
+		if (std::all_of(concepts.begin(), concepts.end(), [](FunctionId concept_id) { return concept_id == function_id_constants::invalid; }))
+			return concepts.size();
+
+		// Evaluating a concept may add templates to the program, so copy what it needs out of the template first.
+		std::vector<ResolvedTemplateParameter> template_parameters(scope_template_parameters.begin(), scope_template_parameters.end());
+		instantiation::ScopeStack scope_stack(scope_stack_view.begin(), scope_stack_view.end());
+
 		expression::FunctionCall function_call;
 		for (size_t i = 0; i < concepts.size(); ++i)
 		{
@@ -1158,39 +1277,45 @@ namespace complete
 		return concepts.size();
 	}
 
+	auto resolved_struct_template_parameters(StructTemplate const & struct_template, span<TypeId const> parameters) -> std::vector<ResolvedTemplateParameter>
+	{
+		std::vector<ResolvedTemplateParameter> all_template_parameters;
+		all_template_parameters.reserve(struct_template.scope_template_parameters.size() + parameters.size());
+		for (ResolvedTemplateParameter const id : struct_template.scope_template_parameters)
+			all_template_parameters.push_back(id);
+
+		for (size_t i = 0; i < parameters.size(); ++i)
+			all_template_parameters.push_back({intern(struct_template.incomplete_struct->template_parameters[i].name), parameters[i]});
+
+		return all_template_parameters;
+	}
+
 	auto instantiate_struct_template(Program & program, StructTemplateId template_id, span<TypeId const> parameters, instantiation::TemplateCache & template_cache, std::string_view instantiation_in_source) noexcept
 		-> expected<TypeId, PartialSyntaxError>
 	{
-		instantiation::TemplateInstantiation<StructTemplateId> search;
-		search.id = template_id;
-		search.parameters.assign(parameters.begin(), parameters.end());
-		auto const cached_instantiation = template_cache.structs.find(search);
-		if (cached_instantiation != template_cache.structs.end())
-			return cached_instantiation->second;
+		if (TypeId const * const cached_instantiation = template_cache.find_struct(template_id, parameters))
+			return *cached_instantiation;
+
+		if (instantiation::depends_on_layout_placeholders(parameters, program, template_cache))
+			return make_syntax_error(instantiation_in_source, "Struct templates can not be instantiated for layout placeholders.");
 
 		StructTemplate & struct_template = program.struct_templates[template_id.index];
 
-		if (parameters.size() != struct_template.incomplete_struct.template_parameters.size())
+		if (parameters.size() != struct_template.incomplete_struct->template_parameters.size())
 			return make_syntax_error(instantiation_in_source, "Incorrect number of parameters for function template instantiation.");
 
-		size_t const failed_concept = check_concepts(struct_template.concepts, parameters, struct_template.scope_template_parameters, struct_template.scope_stack, program, template_cache);
+		size_t const failed_concept = check_concepts(struct_template.concepts, parameters, struct_template.scope_template_parameters, *struct_template.scope_stack, program, template_cache);
 		if (failed_concept != parameters.size())
 			return make_syntax_error(
 				instantiation_in_source, 
-				join("Struct template parameter does not satisfy concept \"", struct_template.incomplete_struct.template_parameters[failed_concept].concept, "\"."));
-
-		std::vector<ResolvedTemplateParameter> all_template_parameters;
-		all_template_parameters.reserve(struct_template.scope_template_parameters.size() + parameters.size());
-		for (ResolvedTemplateParameter const id : struct_template.scope_template_parameters)
-			all_template_parameters.push_back(id);
+				join("Struct template parameter does not satisfy concept \"", struct_template.incomplete_struct->template_parameters[failed_concept].concept, "\"."));
 
-		for (size_t i = 0; i < parameters.size(); ++i)
-			all_template_parameters.push_back({std::string(struct_template.incomplete_struct.template_parameters[i].name), parameters[i]});
-
-		instantiation::ScopeStack scope_stack = struct_template.scope_stack;
+		std::vector<ResolvedTemplateParameter> all_template_parameters = resolved_struct_template_parameters(struct_template, parameters);
+		instantiation::ScopeStack scope_stack = *struct_template.scope_stack;
+		std::shared_ptr<incomplete::StructTemplate const> const incomplete_struct = struct_template.incomplete_struct;
 
-		try_call_decl(instantiation::InstantiatedStruct new_struct,
-			instantiation::instantiate_incomplete_struct_variables(struct_template.incomplete_struct, {all_template_parameters, scope_stack, out(program), template_cache}));
+		try_call_decl(instantiation::InstantiatedStruct new_struct, instantiation::instantiate_incomplete_struct_variables(*incomplete_struct,
+			{all_template_parameters, scope_stack, out(program), template_cache, instantiation::FunctionBodyAnalysis::eager, incomplete_struct}));
 
 		Type new_type;
 		new_type.size = new_struct.size;
@@ -1203,13 +1328,49 @@ namespace complete
 		new_type.template_instantiation = std::move(template_instantiation);
 
 		auto const[new_type_id, new_struct_id] = add_struct_type(program, std::move(new_type), std::move(new_struct.complete_struct));
-		template_cache.structs.emplace(std::move(search), new_type_id);
+		template_cache.structs.insert(template_id, parameters, new_type_id);
 
-		try_call_void(instantiation::instantiate_incomplete_struct_functions(struct_template.incomplete_struct, new_type_id, new_struct_id, {all_template_parameters, scope_stack, out(program), template_cache}));
+		bool const defer_named_constructors = true;
+		try_call_void(instantiation::instantiate_incomplete_struct_functions(*incomplete_struct, new_type_id, new_struct_id,
+			{all_template_parameters, scope_stack, out(program), template_cache, instantiation::FunctionBodyAnalysis::eager, incomplete_struct}, defer_named_constructors));
 
 		return new_type_id;
 	}
 
+	auto instantiate_named_constructors(Program & program, TypeId struct_type, std::string_view constructor_name, instantiation::TemplateCache & template_cache) noexcept
+		-> expected<void, PartialSyntaxError>
+	{
+		Type const & type = type_with_id(program, struct_type);
+		Type::Struct const * const struct_extra_data = try_get<Type::Struct>(type.extra_data);
+		if (struct_extra_data == nullptr || !type.template_instantiation.has_value())
+			return success;
+
+		int const struct_index = struct_extra_data->struct_index;
+		TypeId const new_type_id = decay(struct_type);
+		StructTemplateId const template_id = type.template_instantiation->template_id;
+		std::vector<TypeId> const parameters = type.template_instantiation->parameters;
+
+		// Instantiating a constructor may add structs and types, so nothing is kept by reference across the loop.
+		size_t const constructor_count = program.structs[struct_index].constructors.size();
+		for (size_t i = 0; i < constructor_count; ++i)
+		{
+			Constructor const & ctor = program.structs[struct_index].constructors[i];
+			if (ctor.function != function_id_constants::invalid || ctor.name != constructor_name)
+				continue;
+
+			StructTemplate const & struct_template = program.struct_templates[template_id.index];
+			std::vector<ResolvedTemplateParameter> all_template_parameters = resolved_struct_template_parameters(struct_template, parameters);
+			instantiation::ScopeStack scope_stack = *struct_template.scope_stack;
+			std::shared_ptr<incomplete::StructTemplate const> const incomplete_struct = struct_template.incomplete_struct;
+
+			try_call_decl(FunctionId const function_id, instantiation::instantiate_struct_constructor(incomplete_struct->constructors[i], new_type_id,
+				{all_template_parameters, scope_stack, out(program), template_cache, instantiation::FunctionBodyAnalysis::eager, incomplete_struct}));
+			program.structs[struct_index].constructors[i].function = function_id;
+		}
+
+		return success;
+	}
+
 	namespace template_intrinsics
 	{
 		auto instantiate_destroy_function_template(span<TypeId const> parameters, Program & program) noexcept -> Function
@@ -1531,23 +1692,31 @@ namespace complete
 
 	auto resolve_function_overloading(OverloadSetView overload_set, span<TypeId const> parameters, Program & program, instantiation::TemplateCache & template_cache) noexcept -> FunctionId
 	{
+		// A placeholder has no operations, so the function chosen for it says nothing about the one for the actual types.
+		if (!is_empty(overload_set) && instantiation::depends_on_layout_placeholders(parameters, program, template_cache))
+			return function_id_constants::invalid;
+
+		if (FunctionId const * const cached_resolution = template_cache.find_overload_resolution(overload_set, parameters))
+			return *cached_resolution;
+
 		struct Candidate
 		{
 			int conversions;
 			FunctionId function_id;
 		};
-		Candidate candidates[64];
-		int candidate_count = 0;
+		std::vector<Candidate> candidates;
 
 		struct TemplateCandidate
 		{
 			int conversions;
 			FunctionTemplateId id;
-			std::array<TypeId, 32> resolved_dependent_types;
-			size_t dependent_type_count;
+			std::vector<TypeId> resolved_dependent_types;
 		};
-		TemplateCandidate template_candidates[64];
-		int template_candidate_count = 0;
+		std::vector<TemplateCandidate> template_candidates;
+
+		// The result of checking concepts depends on what is in scope at the point where they are checked,
+		// so resolutions that needed to check any cannot be reused.
+		bool checked_concepts = false;
 
 		for (FunctionId function_id : overload_set.function_ids)
 		{
@@ -1567,7 +1736,7 @@ namespace complete
 
 				if (!discard)
 				{
-					candidates[candidate_count++] = Candidate{ conversions, function_id };
+					candidates.push_back(Candidate{conversions, function_id});
 				}
 			}
 		}
@@ -1577,8 +1746,8 @@ namespace complete
 			span<FunctionTemplateParameterType const> fn_parameters;
 			size_t function_template_parameter_count;
 			span<FunctionId const> concepts;
-			std::vector<ResolvedTemplateParameter> scope_template_parameters;
-			instantiation::ScopeStack scope_stack;
+			span<ResolvedTemplateParameter const> scope_template_parameters;
+			instantiation::ScopeStackView scope_stack;
 
 			if (template_id.is_intrinsic)
 			{
@@ -1590,18 +1759,15 @@ namespace complete
 			{
 				FunctionTemplate const & fn = program.function_templates[template_id.index];
 				fn_parameters = fn.parameter_types;
-				function_template_parameter_count = fn.incomplete_function.template_parameters.size();
+				function_template_parameter_count = fn.incomplete_function->template_parameters.size();
 				concepts = fn.concepts;
 				scope_template_parameters = fn.scope_template_parameters;
-				scope_stack = fn.scope_stack;
+				scope_stack = *fn.scope_stack;
 			}
 
 			if (fn_parameters.size() == parameters.size())
 			{
-				std::array<TypeId, 32> resolved_dependent_types;
-				size_t const dependent_type_count = function_template_parameter_count;
-
-				std::fill(resolved_dependent_types.begin(), resolved_dependent_types.begin() + dependent_type_count, TypeId::none);
+				std::vector<TypeId> resolved_dependent_types(function_template_parameter_count, TypeId::none);
 
 				int conversions = 0;
 				bool discard = false;
@@ -1622,59 +1788,61 @@ namespace complete
 				}
 
 				if (!concepts.empty())
-					if (check_concepts(concepts, {resolved_dependent_types.data(), dependent_type_count}, std::move(scope_template_parameters), std::move(scope_stack), program, template_cache) != concepts.size())
+				{
+					checked_concepts = true;
+					if (check_concepts(concepts, resolved_dependent_types, scope_template_parameters, scope_stack, program, template_cache) != concepts.size())
 						discard = true;
+				}
 
 				if (!discard)
 				{
-					template_candidates[template_candidate_count++] = TemplateCandidate{conversions, template_id, resolved_dependent_types, dependent_type_count};
+					template_candidates.push_back(TemplateCandidate{conversions, template_id, std::move(resolved_dependent_types)});
 				}
 			}
 		}
 
-		if (candidate_count == 0 && template_candidate_count == 0)
+		auto const resolve = [&]() -> FunctionId
 		{
-			return function_id_constants::invalid;
-		}
-		else
-		{
-			Candidate best_candidate;
-			TemplateCandidate best_template_candidate;
+			if (candidates.empty() && template_candidates.empty())
+				return function_id_constants::invalid;
 
-			if (candidate_count > 1)
+			if (candidates.size() > 1)
 			{
-				std::partial_sort(candidates, candidates + 2, candidates + candidate_count, [](Candidate a, Candidate b) { return a.conversions < b.conversions; });
+				std::partial_sort(candidates.begin(), candidates.begin() + 2, candidates.end(), [](Candidate const & a, Candidate const & b) { return a.conversions < b.conversions; });
 				assert(candidates[0].conversions < candidates[1].conversions); // Ambiguous call.
 			}
-			best_candidate = candidates[0];
 
-			if (template_candidate_count > 1)
+			if (template_candidates.size() > 1)
 			{
-				std::partial_sort(template_candidates, template_candidates + 2, template_candidates + template_candidate_count,
-					[](TemplateCandidate a, TemplateCandidate b) { return a.conversions < b.conversions; });
+				std::partial_sort(template_candidates.begin(), template_candidates.begin() + 2, template_candidates.end(),
+					[](TemplateCandidate const & a, TemplateCandidate const & b) { return a.conversions < b.conversions; });
 				assert(template_candidates[0].conversions < template_candidates[1].conversions); // Ambiguous call.
 			}
-			best_template_candidate = template_candidates[0];
 
-			if (template_candidate_count == 0 || (candidate_count > 0 && best_candidate.conversions < best_template_candidate.conversions))
-				return best_candidate.function_id;
+			if (template_candidates.empty() || (!candidates.empty() && candidates[0].conversions < template_candidates[0].conversions))
+				return candidates[0].function_id;
 			else
 			{
+				TemplateCandidate const & best_template_candidate = template_candidates[0];
 				auto const & resolved_dependent_types = best_template_candidate.resolved_dependent_types;
-				size_t const dependent_type_count = best_template_candidate.dependent_type_count;
 
 				// Ensure that all template parameters have been resolved.
-				assert(std::find(resolved_dependent_types.begin(), resolved_dependent_types.begin() + dependent_type_count, TypeId::none) == resolved_dependent_types.begin() + dependent_type_count);
-				auto function_id = instantiate_function_template(program, best_template_candidate.id, {resolved_dependent_types.data(), dependent_type_count}, template_cache);
+				assert(std::find(resolved_dependent_types, TypeId::none) == resolved_dependent_types.end());
+				auto function_id = instantiate_function_template(program, best_template_candidate.id, resolved_dependent_types, template_cache);
 				assert(function_id.has_value());
 				return *function_id;
 			}
-		}
+		};
+
+		FunctionId const resolved_function = resolve();
+		if (!checked_concepts)
+			template_cache.overload_resolutions.insert(overload_set, parameters, resolved_function);
+		return resolved_function;
 	}
 
 	auto check_function_template_as_conversion_candidate(
 		FunctionTemplateId template_id, TypeId from, TypeId to, 
-		size_t & dependent_type_count, span<TypeId> resolved_dependent_types, int & conversions,
+		std::vector<TypeId> & resolved_dependent_types, int & conversions,
 		Program & program, instantiation::TemplateCache & template_cache
 	) -> bool
 	{
@@ -1682,8 +1850,7 @@ namespace complete
 		span<FunctionTemplateParameterType const> const fn_parameters = fn.parameter_types;
 		assert(fn_parameters.size() == 2);
 
-		dependent_type_count = fn.incomplete_function.template_parameters.size();
-		std::fill(resolved_dependent_types.begin(), resolved_dependent_types.begin() + dependent_type_count, TypeId::none);
+		resolved_dependent_types.assign(fn.incomplete_function->template_parameters.size(), TypeId::none);
 
 		TypeId const expected_type_from = expected_type_according_to_pattern(from, fn_parameters[0], resolved_dependent_types, program);
 		if (expected_type_from == TypeId::none)
@@ -1699,7 +1866,7 @@ namespace complete
 		if (!check_type_validness_as_overload_candidate(to, expected_type_to, program, conversions))
 			return false;
 
-		if (check_concepts(fn.concepts, resolved_dependent_types.subspan(0, dependent_type_count), fn.scope_template_parameters, fn.scope_stack, program, template_cache) != fn.concepts.size())
+		if (check_concepts(fn.concepts, resolved_dependent_types, fn.scope_template_parameters, *fn.scope_stack, program, template_cache) != fn.concepts.size())
 			return false;
 
 		return true;
@@ -1707,20 +1874,23 @@ namespace complete
 
 	auto resolve_function_overloading_for_conversions(OverloadSetView overload_set, TypeId from, TypeId to, Program & program, instantiation::TemplateCache & template_cache) noexcept -> FunctionId
 	{
+		TypeId const conversion_types[] = {from, to};
+		if (!is_empty(overload_set) && instantiation::depends_on_layout_placeholders(conversion_types, program, template_cache))
+			return function_id_constants::invalid;
+
 		struct Candidate
 		{
 			int conversions;
 			FunctionId function_id;
 		};
-		Candidate candidates[64];
-		int candidate_count = 0;
+		std::vector<Candidate> candidates;
 
 		for (FunctionId function_id : overload_set.function_ids)
 		{
 			auto const param_types = parameter_types_of(program, function_id);
 			assert(param_types.size() == 1);
 			TypeId const input_types[] = {from, return_type(program, function_id) };
-			TypeId const expected_types[] = {parameter_types_of(program, function_id)[0], to};
+			TypeId const expected_types[] = {param_types[0], to};
 			{
 				int conversions = 0;
 				bool discard = false;
@@ -1735,7 +1905,7 @@ namespace complete
 
 				if (!discard)
 				{
-					candidates[candidate_count++] = Candidate{conversions, function_id};
+					candidates.push_back(Candidate{conversions, function_id});
 				}
 			}
 		}
@@ -1744,52 +1914,49 @@ namespace complete
 		{
 			int conversions;
 			FunctionTemplateId id;
+			std::vector<TypeId> resolved_dependent_types;
 		};
-		TemplateCandidate template_candidates[64];
-		int template_candidate_count = 0;
-		TypeId resolved_dependent_types[32];
-		size_t dependent_type_count = 0;
+		std::vector<TemplateCandidate> template_candidates;
 
 		for (FunctionTemplateId template_id : overload_set.function_template_ids)
 		{
 			int conversions = 0;
-			if (check_function_template_as_conversion_candidate(template_id, from, to, dependent_type_count, resolved_dependent_types, conversions, program, template_cache))
+			std::vector<TypeId> resolved_dependent_types;
+			if (check_function_template_as_conversion_candidate(template_id, from, to, resolved_dependent_types, conversions, program, template_cache))
 			{
-				template_candidates[template_candidate_count++] = TemplateCandidate{conversions, template_id};
+				template_candidates.push_back(TemplateCandidate{conversions, template_id, std::move(resolved_dependent_types)});
 			}
 		}
 
-		if (candidate_count == 0 && template_candidate_count == 0)
+		if (candidates.empty() && template_candidates.empty())
 		{
 			return function_id_constants::invalid;
 		}
 		else
 		{
-			Candidate best_candidate;
-			TemplateCandidate best_template_candidate;
-
-			if (candidate_count > 1)
+			if (candidates.size() > 1)
 			{
-				std::partial_sort(candidates, candidates + 2, candidates + candidate_count, [](Candidate a, Candidate b) { return a.conversions < b.conversions; });
+				std::partial_sort(candidates.begin(), candidates.begin() + 2, candidates.end(), [](Candidate const & a, Candidate const & b) { return a.conversions < b.conversions; });
 				assert(candidates[0].conversions < candidates[1].conversions); // Ambiguous call.
 			}
-			best_candidate = candidates[0];
 
-			if (template_candidate_count > 1)
+			if (template_candidates.size() > 1)
 			{
-				std::partial_sort(template_candidates, template_candidates + 2, template_candidates + template_candidate_count,
-					[](TemplateCandidate a, TemplateCandidate b) { return a.conversions < b.conversions; });
+				std::partial_sort(template_candidates.begin(), template_candidates.begin() + 2, template_candidates.end(),
+					[](TemplateCandidate const & a, TemplateCandidate const & b) { return a.conversions < b.conversions; });
 				assert(template_candidates[0].conversions < template_candidates[1].conversions); // Ambiguous call.
 			}
-			best_template_candidate = template_candidates[0];
 
-			if (template_candidate_count == 0 || (candidate_count > 0 && best_candidate.conversions < best_template_candidate.conversions))
-				return best_candidate.function_id;
+			if (template_candidates.empty() || (!candidates.empty() && candidates[0].conversions < template_candidates[0].conversions))
+				return candidates[0].function_id;
 			else
 			{
+				TemplateCandidate const & best_template_candidate = template_candidates[0];
+				auto const & resolved_dependent_types = best_template_candidate.resolved_dependent_types;
+
 				// Ensure that all template parameters have been resolved.
-				assert(std::find(resolved_dependent_types, resolved_dependent_types + dependent_type_count, TypeId::none) == resolved_dependent_types + dependent_type_count);
-				auto function_id = instantiate_function_template(program, best_template_candidate.id, {resolved_dependent_types, dependent_type_count}, template_cache);
+				assert(std::find(resolved_dependent_types, TypeId::none) == resolved_dependent_types.end());
+				auto function_id = instantiate_function_template(program, best_template_candidate.id, resolved_dependent_types, template_cache);
 				assert(function_id.has_value());
 				return *function_id;
 			}
@@ -7,10 +7,13 @@
 #include "function_id.hh"
 #include "scope_stack.hh"
 #include "syntax_error.hh"
+#include "utils/arena.hh"
 #include "utils/callc.hh"
 #include "utils/function_ptr.hh"
 #include <optional>
 #include <map>
+#include <memory>
+#include <unordered_map>
 
 namespace instantiation
 {
@@ -61,12 +64,14 @@ namespace complete
 	{
 		int parameter_count = 0;     // From the variables, how many are arguments. The rest are locals.
 		int parameter_size = 0;	     // Size in bytes needed for parameters.
+		std::vector<TypeId> parameter_types; // Types of the first parameter_count variables, stored contiguously so they can be viewed without copying.
 		TypeId return_type;
 		std::vector<Expression> preconditions;
 		std::vector<Statement> statements;
 		std::string ABI_name;
 		bool is_callable_at_compile_time;
 		bool is_callable_at_runtime;
+		int deferred_body = -1; // Index in Program::deferred_function_bodies if the body is analyzed when the function is first used.
 	};
 
 	struct ExternFunction
@@ -90,7 +95,7 @@ namespace complete
 
 	struct ResolvedTemplateParameter
 	{
-		std::string name;
+		Symbol name;
 		complete::TypeId type;
 	};
 
@@ -137,13 +142,15 @@ namespace complete
 		int template_parameter_count;
 	};
 
+	// The incomplete template and its scope stack are immutable and shared by the template, its instantiations
+	// and the templates declared inside of them, which point into the incomplete template of their parent.
 	struct FunctionTemplate
 	{
-		incomplete::FunctionTemplate incomplete_function;
+		std::shared_ptr<incomplete::FunctionTemplate const> incomplete_function;
 		std::vector<FunctionId> concepts;
 		std::vector<FunctionTemplateParameterType> parameter_types;
 		std::vector<ResolvedTemplateParameter> scope_template_parameters;
-		instantiation::ScopeStack scope_stack;
+		std::shared_ptr<instantiation::ScopeStack const> scope_stack;
 		std::string ABI_name;
 	};
 
@@ -153,7 +160,7 @@ namespace complete
 	};
 	struct Constructor
 	{
-		FunctionId function;
+		FunctionId function; // function_id_constants::invalid until instantiated for instantiations of struct templates.
 		std::string name;
 	};
 	struct Struct
@@ -164,15 +171,16 @@ namespace complete
 		FunctionId default_constructor = function_id_constants::invalid;
 		FunctionId copy_constructor = function_id_constants::invalid;
 		FunctionId move_constructor = function_id_constants::invalid;
-		bool has_compiler_generated_constructors;
+		bool has_compiler_generated_constructors = true; // Until its member functions are instantiated, a struct's own constructors may use the generated ones.
 	};
 
+	// Shares its incomplete template and scope stack like FunctionTemplate.
 	struct StructTemplate
 	{
-		incomplete::StructTemplate incomplete_struct;
+		std::shared_ptr<incomplete::StructTemplate const> incomplete_struct;
 		std::vector<FunctionId> concepts;
 		std::vector<ResolvedTemplateParameter> scope_template_parameters;
-		instantiation::ScopeStack scope_stack;
+		std::shared_ptr<instantiation::ScopeStack const> scope_stack;
 		std::string ABI_name;
 	};
 
@@ -182,6 +190,40 @@ namespace complete
 		std::vector<Namespace> nested_namespaces;
 	};
 
+	// Identifies a pointer, array or array pointer type by what it is built from, so that each one is only created once.
+	struct DerivedTypeKey
+	{
+		enum struct Kind : unsigned char { pointer, array, array_pointer };
+
+		Kind kind;
+		TypeId value_type;
+		int size; // Only used by arrays.
+	};
+	constexpr auto operator == (DerivedTypeKey a, DerivedTypeKey b) noexcept -> bool { return a.kind == b.kind && a.value_type == b.value_type && a.size == b.size; }
+	constexpr auto operator != (DerivedTypeKey a, DerivedTypeKey b) noexcept -> bool { return !(a == b); }
+
+	struct DerivedTypeKeyHash
+	{
+		auto operator () (DerivedTypeKey key) const noexcept -> size_t;
+	};
+
+	auto derived_type_key(Type const & type) noexcept -> std::optional<DerivedTypeKey>; // nullopt if the type is not a pointer, array or array pointer.
+
+	// Body of a global function that will only be analyzed once a call to it is analyzed.
+	// incomplete_function and scope_stack point into the incomplete program and the module scopes, which only live during semantic analysis,
+	// so they are cleared when it ends.
+	struct DeferredFunctionBody
+	{
+		FunctionId function_id;
+		incomplete::Function const * incomplete_function;
+		instantiation::ScopeStack scope_stack;
+		bool is_analyzed = false;
+		int prototype_stack_frame_alignment = 1; // Alignment of the parameters, to go back to the prototype if the analysis of the body is rolled back.
+	};
+
+	// Removes the body of a function whose body was deferred, leaving its prototype.
+	auto remove_deferred_function_body(Function & function, DeferredFunctionBody const & deferred_body) noexcept -> void;
+
 	struct Program
 	{
 		Program();
@@ -190,19 +232,30 @@ namespace complete
 		Program & operator = (Program const &) = delete;
 		Program & operator = (Program &&) = default;
 
+		Arena arena; // First so that it is destroyed after everything allocated from it.
 		std::vector<Type> types;
+		std::unordered_map<DerivedTypeKey, TypeId, DerivedTypeKeyHash> derived_types; // Index of the pointer, array and array pointer types in types.
 		std::vector<Struct> structs;
 		std::vector<StructTemplate> struct_templates;
 		std::vector<OverloadSet> overload_set_types;
 		std::vector<Function> functions;
 		std::vector<ExternFunction> extern_functions;
 		std::vector<FunctionTemplate> function_templates;
+		std::vector<DeferredFunctionBody> deferred_function_bodies;
+		std::vector<int> analyzed_deferred_function_bodies; // Indices in deferred_function_bodies in the order in which they were analyzed.
 		std::vector<Statement> global_initialization_statements;
 		Namespace global_scope;
 		FunctionId main_function = function_id_constants::invalid;
+		// Program that a shard was made from. The shard copies its functions without the bodies that it had already analyzed.
+		Program const * base = nullptr;
 	};
 
+	// Names of the built-in types, intrinsic functions and intrinsic function templates. Built once and shared by every program instead of
+	// being added to the global scope of each one. Semantic analysis searches it below the global scope, so nothing is ever added to it.
+	auto prelude_scope() noexcept -> Namespace const &;
+
 	auto add_type(Program & program, Type new_type) noexcept -> TypeId;
+	auto remove_types(Program & program, size_t new_type_count) noexcept -> void; // Removes the types added after the first new_type_count ones.
 	auto type_with_id(Program const & program, TypeId id) noexcept -> Type const &;
 	auto type_size(Program const & program, TypeId id) noexcept -> int;
 	auto type_alignment(Program const & program, TypeId id) noexcept -> int;
@@ -227,6 +280,7 @@ namespace complete
 	auto is_move_constructible_at_compile_time(Program const & program, TypeId id) noexcept -> bool;
 	auto move_constructor_for(Program const & program, TypeId id) noexcept -> FunctionId;
 	auto constructor_overload_set(Struct const & struct_data, std::string_view constructor_name) noexcept -> std::vector<FunctionId>;
+	auto forget_removed_named_constructors(Program & program) noexcept -> void;
 
 	auto add_struct_type(Program & program, Type new_type, Struct new_struct) -> std::pair<TypeId, int>;
 	auto add_struct_template(Program & program, StructTemplate new_template) noexcept -> StructTemplateId;
@@ -250,15 +304,19 @@ namespace complete
 	auto is_pointer_or_array_pointer(Type const & type) noexcept -> bool;
 	auto array_pointer_type_for(TypeId value_type, Program & program) noexcept -> TypeId;
 
+	auto intrinsic_function_count() noexcept -> size_t;
 	auto add_function(Program & program, Function new_function) noexcept -> FunctionId;
 	auto add_function_template(Program & program, FunctionTemplate new_function_template) noexcept -> FunctionTemplateId;
-	auto parameter_types_of(Program const & program, FunctionId id) noexcept -> std::vector<TypeId>;
+	auto parameter_types_of(Program const & program, FunctionId id) noexcept -> span<TypeId const>;
 	auto parameter_size(Program const & program, FunctionId id) noexcept -> int;
 	auto parameter_alignment(Program const & program, FunctionId id) noexcept -> int;
 	auto stack_frame_size(Program const & program, FunctionId id) noexcept -> int;
 	auto return_type(Program const & program, FunctionId id) noexcept -> TypeId;
 	auto is_callable_at_compile_time(Program const & program, FunctionId id) noexcept -> bool;
 	auto is_callable_at_runtime(Program const & program, FunctionId id) noexcept -> bool;
+	auto has_analyzed_body(Program const & program, Function const & function) noexcept -> bool;
+	// Function whose body runs when the function is called. In a shard it may be the one of the base program.
+	auto function_to_run(Program const & program, FunctionId id) noexcept -> Function const &;
 
 	auto find_namespace(Namespace & current_namespace, std::string_view name) noexcept -> Namespace *;
 	auto find_namespace(Namespace & current_namespace, span<std::string_view const> names) noexcept -> Namespace *;
@@ -272,8 +330,14 @@ namespace complete
 	auto ABI_name(Program const & program, StructTemplateId id) noexcept -> std::string_view;
 
 	auto instantiate_function_template(Program & program, FunctionTemplateId template_id, span<TypeId const> parameters, instantiation::TemplateCache & template_cache) noexcept -> expected<FunctionId, PartialSyntaxError>;
+	// Analyzes the instantiation of a function template without adding it to the program or to the template cache.
+	auto analyze_function_template_instantiation(Program & program, FunctionTemplateId template_id, span<TypeId const> parameters, instantiation::TemplateCache & template_cache) noexcept
+		-> expected<Function, PartialSyntaxError>;
 	auto instantiate_struct_template(Program & program, StructTemplateId template_id, span<TypeId const> parameters, instantiation::TemplateCache & template_cache, std::string_view instantiation_in_source) noexcept
 		-> expected<TypeId, PartialSyntaxError>;
+	// Instantiates the constructors called constructor_name of a struct template instantiation that have not been instantiated yet.
+	auto instantiate_named_constructors(Program & program, TypeId struct_type, std::string_view constructor_name, instantiation::TemplateCache & template_cache) noexcept
+		-> expected<void, PartialSyntaxError>;
 
 	namespace template_intrinsics
 	{
@@ -308,6 +372,7 @@ namespace complete
 		span<FunctionId const> function_ids;
 		span<FunctionTemplateId const> function_template_ids;
 	};
+	inline auto is_empty(OverloadSetView overload_set) noexcept -> bool { return overload_set.function_ids.empty() && overload_set.function_template_ids.empty(); }
 	auto resolve_function_overloading(
 		OverloadSetView overload_set, 
 		span<TypeId const> parameters, 
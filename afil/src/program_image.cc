@@ -0,0 +1,354 @@
+#include "program_image.hh"
+#include "program.hh"
+#include "template_instantiation.hh"
+#include "utils/mapped_file.hh"
+#include "utils/serialization.hh"
+#include "utils/string.hh"
+#include <algorithm>
+
+namespace complete
+{
+
+	namespace program_image_locals
+	{
+
+		constexpr char magic[8] = {'a', 'f', 'i', 'l', 'p', 'r', 'o', 'g'};
+		constexpr uint32_t format_version = 2; // Must be incremented whenever the nodes of the complete tree change.
+
+		struct Writer : ArchiveWriter<Writer>
+		{
+			using ArchiveWriter::write;
+
+			bool has_compile_time_nodes = false;
+
+			auto write(Symbol & symbol) noexcept -> void
+			{
+				std::string name(symbol_name(symbol));
+				write(name);
+			}
+
+			auto write(span<char const> & bytes_to_write) noexcept -> void
+			{
+				bytes.write(static_cast<uint32_t>(bytes_to_write.size()));
+				bytes.write_bytes(bytes_to_write.data(), bytes_to_write.size());
+			}
+
+			auto compile_time_node() noexcept -> void { has_compile_time_nodes = true; }
+
+			// Ids are only checked when reading.
+			template <typename Id> auto check_id(Id) noexcept -> void {}
+			auto check_struct_index(int) noexcept -> void {}
+			auto check_relational_operator(Operator) noexcept -> void {}
+
+			// A body with nodes that can only be evaluated during compilation is left out, and only the prototype of its function is stored.
+			auto function_body(Function & function) noexcept -> void
+			{
+				size_t const start = bytes.bytes.size();
+				bool const had_compile_time_nodes = std::exchange(has_compile_time_nodes, false);
+
+				bytes.write<uint8_t>(1);
+				(*this)(function.preconditions, function.statements);
+				if (has_compile_time_nodes)
+				{
+					bytes.bytes.resize(start);
+					bytes.write<uint8_t>(0);
+				}
+
+				has_compile_time_nodes = had_compile_time_nodes;
+			}
+		};
+
+		struct Reader : ArchiveReader<Reader>
+		{
+			using ArchiveReader::read;
+
+			Reader(std::string_view bytes_, std::pmr::memory_resource * constant_resource_) noexcept
+				: ArchiveReader(bytes_)
+				, constant_resource(constant_resource_)
+			{}
+
+			std::pmr::memory_resource * constant_resource; // Holds the values of constant expressions.
+
+			auto read(Symbol & symbol) noexcept -> void
+			{
+				std::string name;
+				read(name);
+				symbol = intern(name);
+			}
+
+			auto read(span<char const> & bytes_read) noexcept -> void
+			{
+				uint32_t const size = bytes.read<uint32_t>();
+				char const * const data = bytes.read_bytes(size);
+				if (data == nullptr || size == 0)
+				{
+					bytes_read = span<char const>();
+					return;
+				}
+
+				char * const copy = static_cast<char *>(constant_resource->allocate(size, 1));
+				memcpy(copy, data, size);
+				bytes_read = span<char const>(copy, size);
+			}
+
+			auto compile_time_node() noexcept -> void { bytes.fail(); }
+
+			// The tables that the ids index into are read before and after the ids themselves, so the ids are only checked once everything
+			// has been read. Until then, keep how big each table must be for every id read to be in range.
+			size_t min_type_count = 0;
+			size_t min_overload_set_type_count = 0;
+			size_t min_struct_count = 0;
+			size_t min_function_count = 0;
+			size_t min_extern_function_count = 0;
+
+			auto check_id(TypeId id) noexcept -> void
+			{
+				if (id.index == TypeId::none.index)
+					return;
+
+				size_t & min_count = id.is_function ? min_overload_set_type_count : min_type_count;
+				min_count = std::max<size_t>(min_count, id.index + 1);
+			}
+
+			auto check_id(FunctionId id) noexcept -> void
+			{
+				switch (id.type)
+				{
+					case FunctionId::Type::program: min_function_count = std::max<size_t>(min_function_count, id.index + 1); break;
+					case FunctionId::Type::imported: min_extern_function_count = std::max<size_t>(min_extern_function_count, id.index + 1); break;
+					case FunctionId::Type::intrinsic:
+						if (id != function_id_constants::invalid && id != function_id_constants::deleted && id.index >= intrinsic_function_count())
+							bytes.fail();
+						break;
+					default: bytes.fail();
+				}
+			}
+
+			auto check_struct_index(int index) noexcept -> void
+			{
+				if (index < 0)
+					bytes.fail();
+				else
+					min_struct_count = std::max<size_t>(min_struct_count, static_cast<size_t>(index) + 1);
+			}
+
+			// Enums are read as their bytes, so any value that the interpreter does not handle must be rejected like an id out of range.
+			// Relational operator calls only exist for the operators that are evaluated by calling operator == or operator <=>.
+			auto check_relational_operator(Operator op) noexcept -> void
+			{
+				if (op != Operator::not_equal && op != Operator::less && op != Operator::less_equal && op != Operator::greater && op != Operator::greater_equal)
+					bytes.fail();
+			}
+
+			auto ids_are_in_range(Program const & program, std::vector<Type> const & types) const noexcept -> bool
+			{
+				return min_type_count <= types.size()
+					&& min_overload_set_type_count <= program.overload_set_types.size()
+					&& min_struct_count <= program.structs.size()
+					&& min_function_count <= program.functions.size()
+					&& min_extern_function_count <= program.extern_functions.size();
+			}
+
+			auto function_body(Function & function) noexcept -> void
+			{
+				if (bytes.read<uint8_t>() != 0)
+					(*this)(function.preconditions, function.statements);
+			}
+		};
+
+		template <typename Archive> auto serialize(Archive & archive, TypeId & id) noexcept -> void { archive.raw(id); archive.check_id(id); }
+		template <typename Archive> auto serialize(Archive & archive, FunctionId & id) noexcept -> void { archive.raw(id); archive.check_id(id); }
+		template <typename Archive> auto serialize(Archive &, null_t &) noexcept -> void {}
+
+		template <typename Archive> auto serialize(Archive &, Type::BuiltIn &) noexcept -> void {}
+		template <typename Archive> auto serialize(Archive & archive, Type::Pointer & node) noexcept -> void { archive(node.value_type); }
+		template <typename Archive> auto serialize(Archive & archive, Type::Array & node) noexcept -> void
+		{
+			archive(node.value_type, node.size, node.destructor, node.copy_constructor, node.move_constructor);
+		}
+		template <typename Archive> auto serialize(Archive & archive, Type::ArrayPointer & node) noexcept -> void { archive(node.value_type); }
+		template <typename Archive> auto serialize(Archive & archive, Type::Struct & node) noexcept -> void
+		{
+			archive(node.struct_index);
+			archive.check_struct_index(node.struct_index);
+		}
+		// The built-in types are at the start of every program, which is where the ids of the built-in types point to.
+		auto built_in_types_are_in_place(std::vector<Type> const & types, std::vector<Type> const & built_in_types) noexcept -> bool
+		{
+			if (types.size() < built_in_types.size())
+				return false;
+
+			for (size_t i = 0; i < types.size(); ++i)
+			{
+				bool const is_built_in = std::holds_alternative<Type::BuiltIn>(types[i].extra_data);
+				if (is_built_in != (i < built_in_types.size()))
+					return false;
+				if (is_built_in && (types[i].size != built_in_types[i].size || types[i].alignment != built_in_types[i].alignment))
+					return false;
+			}
+			return true;
+		}
+
+		// Which template a type was instantiated from is not stored because templates are not stored.
+		template <typename Archive> auto serialize(Archive & archive, Type & node) noexcept -> void { archive(node.size, node.alignment, node.ABI_name, node.extra_data); }
+
+		template <typename Archive> auto serialize(Archive & archive, Variable & node) noexcept -> void { archive(node.name, node.type, node.offset); }
+		// Only what is needed to allocate and destroy the variables of a scope is stored.
+		template <typename Archive> auto serialize(Archive & archive, Scope & node) noexcept -> void
+		{
+			archive(node.stack_frame_size, node.stack_frame_alignment, node.variables);
+		}
+		template <typename Archive> auto serialize(Archive & archive, MemberVariable & node) noexcept -> void
+		{
+			archive(static_cast<Variable &>(node), node.initializer_expression);
+		}
+		template <typename Archive> auto serialize(Archive & archive, Constructor & node) noexcept -> void { archive(node.function, node.name); }
+		template <typename Archive> auto serialize(Archive & archive, Struct & node) noexcept -> void
+		{
+			archive(node.member_variables, node.destructor, node.constructors, node.default_constructor, node.copy_constructor, node.move_constructor,
+				node.has_compiler_generated_constructors);
+		}
+		// Function templates are not stored, so neither are the ids of the ones in overload sets.
+		template <typename Archive> auto serialize(Archive & archive, OverloadSet & node) noexcept -> void { archive(node.function_ids); }
+
+		template <typename Archive> auto serialize(Archive & archive, Function & node) noexcept -> void
+		{
+			archive(static_cast<Scope &>(node), node.parameter_count, node.parameter_size, node.parameter_types, node.return_type, node.ABI_name,
+				node.is_callable_at_compile_time, node.is_callable_at_runtime);
+			archive.function_body(node);
+		}
+		template <typename Archive> auto serialize(Archive & archive, ExternFunction & node) noexcept -> void
+		{
+			archive(node.parameter_size, node.parameter_alignment, node.return_type, node.parameter_types, node.ABI_name);
+		}
+
+		template <typename Archive, typename T> auto serialize(Archive & archive, expression::Literal<T> & node) noexcept -> void { archive(node.value); }
+		template <typename Archive> auto serialize(Archive & archive, expression::StringLiteral & node) noexcept -> void { archive(node.value, node.type); }
+		template <typename Archive> auto serialize(Archive & archive, expression::LocalVariable & node) noexcept -> void { archive(node.variable_type, node.variable_offset); }
+		template <typename Archive> auto serialize(Archive & archive, expression::GlobalVariable & node) noexcept -> void { archive(node.variable_type, node.variable_offset); }
+		template <typename Archive> auto serialize(Archive & archive, expression::MemberVariable & node) noexcept -> void
+		{
+			archive(node.variable_type, node.variable_offset, node.owner);
+		}
+		template <typename Archive> auto serialize(Archive & archive, expression::Constant & node) noexcept -> void { archive(node.type, node.value); }
+		template <typename Archive> auto serialize(Archive & archive, expression::ConstantTemporary & node) noexcept -> void { archive(node.type, node.value); }
+		template <typename Archive> auto serialize(Archive & archive, expression::FunctionCall & node) noexcept -> void { archive(node.function_id, node.parameters); }
+		template <typename Archive> auto serialize(Archive & archive, expression::RelationalOperatorCall & node) noexcept -> void
+		{
+			archive(node.op, node.function_id, node.parameters);
+			archive.check_relational_operator(node.op);
+		}
+		template <typename Archive> auto serialize(Archive & archive, expression::Assignment & node) noexcept -> void { archive(node.destination, node.source); }
+		template <typename Archive> auto serialize(Archive & archive, expression::Constructor & node) noexcept -> void { archive(node.constructed_type, node.parameters); }
+		template <typename Archive> auto serialize(Archive & archive, expression::Dereference & node) noexcept -> void { archive(node.expression, node.return_type); }
+		template <typename Archive> auto serialize(Archive & archive, expression::ReinterpretCast & node) noexcept -> void { archive(node.operand, node.return_type); }
+		template <typename Archive> auto serialize(Archive & archive, expression::Subscript & node) noexcept -> void { archive(node.array, node.index, node.return_type); }
+		template <typename Archive> auto serialize(Archive & archive, expression::PointerPlusInt & node) noexcept -> void { archive(node.pointer, node.index, node.return_type); }
+		template <typename Archive> auto serialize(Archive & archive, expression::PointerMinusInt & node) noexcept -> void { archive(node.pointer, node.index, node.return_type); }
+		template <typename Archive> auto serialize(Archive & archive, expression::PointerMinusPointer & node) noexcept -> void { archive(node.left, node.right); }
+		template <typename Archive> auto serialize(Archive & archive, expression::If & node) noexcept -> void { archive(node.condition, node.then_case, node.else_case); }
+		template <typename Archive> auto serialize(Archive & archive, expression::StatementBlock & node) noexcept -> void { archive(node.scope, node.statements, node.return_type); }
+		// Compiles expressions contain incomplete expressions that are analyzed when they are evaluated.
+		template <typename Archive> auto serialize(Archive & archive, expression::Compiles &) noexcept -> void { archive.compile_time_node(); }
+		template <typename Archive> auto serialize(Archive & archive, Expression & node) noexcept -> void { archive(node.as_variant()); }
+
+		template <typename Archive> auto serialize(Archive & archive, statement::VariableDeclaration & node) noexcept -> void
+		{
+			archive(node.variable_offset, node.assigned_expression);
+		}
+		template <typename Archive> auto serialize(Archive & archive, statement::PlacementLet & node) noexcept -> void { archive(node.address_expression, node.assigned_expression); }
+		template <typename Archive> auto serialize(Archive & archive, statement::ExpressionStatement & node) noexcept -> void { archive(node.expression); }
+		template <typename Archive> auto serialize(Archive & archive, statement::Return & node) noexcept -> void
+		{
+			archive(node.returned_expression, node.destroyed_stack_frame_size);
+		}
+		template <typename Archive> auto serialize(Archive & archive, statement::If & node) noexcept -> void { archive(node.condition, node.then_case, node.else_case); }
+		template <typename Archive> auto serialize(Archive & archive, statement::StatementBlock & node) noexcept -> void { archive(node.scope, node.statements); }
+		template <typename Archive> auto serialize(Archive & archive, statement::While & node) noexcept -> void { archive(node.condition, node.body); }
+		template <typename Archive> auto serialize(Archive & archive, statement::For & node) noexcept -> void
+		{
+			archive(node.scope, node.init_statement, node.condition, node.end_expression, node.body);
+		}
+		template <typename Archive> auto serialize(Archive & archive, statement::Break & node) noexcept -> void { archive(node.destroyed_stack_frame_size); }
+		template <typename Archive> auto serialize(Archive & archive, statement::Continue & node) noexcept -> void { archive(node.destroyed_stack_frame_size); }
+		template <typename Archive> auto serialize(Archive & archive, Statement & node) noexcept -> void { archive(node.as_variant()); }
+
+		// Types are added through add_type so that the index of derived types is built again.
+		template <typename Archive> auto serialize_program(Archive & archive, Program & program, std::vector<Type> & types) noexcept -> void
+		{
+			Scope & global_variables = program.global_scope;
+			archive(types, program.structs, program.overload_set_types, program.functions, program.extern_functions,
+				program.global_initialization_statements, global_variables, program.main_function);
+		}
+
+	} // namespace program_image_locals
+
+	auto write_program_image(Program const & program) noexcept -> std::optional<std::string>
+	{
+		using namespace program_image_locals;
+
+		Writer writer;
+		writer.bytes.write_bytes(magic, sizeof(magic));
+		writer.bytes.write(format_version);
+		writer.bytes.write(static_cast<uint32_t>(sizeof(void *)));
+
+		// The writer only reads the program, but serialize takes the nodes as mutable so that it can be shared with the reader.
+		Program & program_to_write = const_cast<Program &>(program);
+		serialize_program(writer, program_to_write, program_to_write.types);
+
+		if (writer.has_compile_time_nodes)
+			return std::nullopt;
+
+		return std::string(writer.bytes.bytes.data(), writer.bytes.bytes.size());
+	}
+
+	auto read_program_image(std::string_view image) noexcept -> expected<Program, std::string>
+	{
+		using namespace program_image_locals;
+
+		Program program;
+		program.arena.resource = std::make_unique<std::pmr::monotonic_buffer_resource>();
+		ScopedValuePtrResource const allocate_from_arena(program.arena.resource.get());
+
+		Reader reader(image, program.arena.resource.get());
+		char const * const image_magic = reader.bytes.read_bytes(sizeof(magic));
+		if (image_magic == nullptr || memcmp(image_magic, magic, sizeof(magic)) != 0)
+			return Error(std::string("Not a program image."));
+		if (reader.bytes.read<uint32_t>() != format_version || reader.bytes.read<uint32_t>() != sizeof(void *))
+			return Error(std::string("The program image was written by an incompatible version of afil."));
+
+		std::vector<Type> types;
+		serialize_program(reader, program, types);
+		// Ids out of range would make the interpreter index past the end of the tables of the program,
+		// and built-in types that are not where their ids point to would make it treat values as the wrong type.
+		if (reader.bytes.has_failed() || !reader.bytes.is_at_end() || !reader.ids_are_in_range(program, types)
+			|| !built_in_types_are_in_place(types, program.types))
+			return Error(std::string("The program image is corrupted."));
+
+		program.types.clear();
+		program.derived_types.clear();
+		for (Type & type : types)
+			add_type(program, std::move(type));
+
+		for (ExternFunction & extern_function : program.extern_functions)
+			if (!instantiation::bind_extern_function(extern_function, program))
+				return Error(join("Cannot find extern symbol \"", extern_function.ABI_name, "\"."));
+
+		return program;
+	}
+
+	auto save_program_image(Program const & program, std::filesystem::path const & path) noexcept -> bool
+	{
+		std::optional<std::string> const image = write_program_image(program);
+		return image.has_value() && write_whole_binary_file(path, *image);
+	}
+
+	auto load_program_image(std::filesystem::path const & path) noexcept -> expected<Program, std::string>
+	{
+		std::optional<MappedFile> const image = map_whole_file(path);
+		if (!image.has_value())
+			return Error(join("Cannot open program image ", path));
+		return read_program_image(image->contents());
+	}
+
+} // namespace complete
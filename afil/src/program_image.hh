@@ -0,0 +1,27 @@
+#pragma once
+
+#include "utils/expected.hh"
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace complete
+{
+
+	struct Program;
+
+	// Binary image of an analyzed program with everything interpreter::run needs: types, structs, functions, extern functions,
+	// constants and the initialization of globals. Templates, deferred bodies and the names of the global scope are not stored,
+	// so a loaded program can be run but not analyzed further. Extern functions are stored by ABI name and bound again when loaded.
+	// The image is one position-independent block that is decoded in a single pass, so it can be read directly from a mapped file.
+
+	// Functions whose body contains expressions that can only be evaluated during compilation are stored without it.
+	// Returns nullopt if the initialization of globals contains such expressions.
+	auto write_program_image(Program const & program) noexcept -> std::optional<std::string>;
+	auto read_program_image(std::string_view image) noexcept -> expected<Program, std::string>;
+
+	[[nodiscard]] auto save_program_image(Program const & program, std::filesystem::path const & path) noexcept -> bool;
+	auto load_program_image(std::filesystem::path const & path) noexcept -> expected<Program, std::string>;
+
+} // namespace complete
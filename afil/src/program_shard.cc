@@ -0,0 +1,749 @@
+#include "program_shard.hh"
+#include "utils/overload.hh"
+#include "utils/variant.hh"
+#include <cstring>
+
+namespace instantiation
+{
+
+	namespace program_shard_locals
+	{
+
+		// Where the elements added by a shard end up in the merged program. Elements that the program already had when the shard was
+		// copied keep their index. Types, structs and functions may be replaced by ones of the program, the rest is appended in order.
+		struct IdMap
+		{
+			ProgramShard::Base const & base;
+			complete::Program const & program;
+			std::vector<unsigned> types = {};
+			std::vector<unsigned> structs = {};
+			std::vector<FunctionId> functions = {};
+			size_t first_new_type = 0;
+			size_t first_new_struct = 0;
+			size_t first_new_function = 0;
+			size_t first_overload_set_type = 0;
+			size_t first_struct_template = 0;
+			size_t first_extern_function = 0;
+			size_t first_function_template = 0;
+			size_t first_deferred_function_body = 0;
+
+			auto operator () (complete::TypeId & id) const noexcept -> void
+			{
+				if (id.index == complete::TypeId::none.index)
+					return;
+
+				if (id.is_function)
+				{
+					if (id.index >= base.overload_set_types)
+						id.index = static_cast<unsigned>(first_overload_set_type + (id.index - base.overload_set_types));
+				}
+				else if (id.index >= base.types)
+				{
+					id.index = types[id.index - base.types];
+				}
+			}
+
+			auto operator () (FunctionId & id) const noexcept -> void
+			{
+				if (id.type == FunctionId::Type::program && id.index >= base.functions)
+					id = functions[id.index - base.functions];
+				else if (id.type == FunctionId::Type::imported && id.index >= base.extern_functions)
+					id.index = static_cast<unsigned>(first_extern_function + (id.index - base.extern_functions));
+			}
+
+			auto operator () (FunctionTemplateId & id) const noexcept -> void
+			{
+				if (!id.is_intrinsic && id.index >= base.function_templates)
+					id.index = static_cast<unsigned>(first_function_template + (id.index - base.function_templates));
+			}
+
+			auto operator () (complete::StructTemplateId & id) const noexcept -> void
+			{
+				if (id.index >= base.struct_templates)
+					id.index = static_cast<unsigned>(first_struct_template + (id.index - base.struct_templates));
+			}
+
+			auto struct_index(int & index) const noexcept -> void
+			{
+				if (static_cast<size_t>(index) >= base.structs)
+					index = static_cast<int>(structs[index - base.structs]);
+			}
+
+			auto deferred_body_index(int & index) const noexcept -> void
+			{
+				if (index != -1 && static_cast<size_t>(index) >= base.deferred_function_bodies)
+					index = static_cast<int>(first_deferred_function_body + (index - base.deferred_function_bodies));
+			}
+
+			template <typename T>
+			auto operator () (std::vector<T> & elements) const -> void
+			{
+				for (T & element : elements)
+					(*this)(element);
+			}
+
+			// Translates the types stored in a value. Its type must already be translated, and its layout be the one of the merged program.
+			auto value(complete::TypeId type, char * value) const noexcept -> void
+			{
+				if (type.is_function || type.index == complete::TypeId::none.index)
+					return;
+
+				if (decay(type) == complete::TypeId::type)
+				{
+					complete::TypeId id;
+					memcpy(&id, value, sizeof(id));
+					(*this)(id);
+					memcpy(value, &id, sizeof(id));
+					return;
+				}
+
+				complete::Type const & type_data = type_with_id(program, type);
+				if (auto const array = try_get<complete::Type::Array>(type_data.extra_data))
+				{
+					int const value_size = type_size(program, array->value_type);
+					for (int i = 0; i < array->size; ++i)
+						this->value(array->value_type, value + i * value_size);
+				}
+				else if (complete::Struct const * const struct_data = struct_for_type(program, type_data))
+				{
+					for (complete::MemberVariable const & member : struct_data->member_variables)
+						this->value(member.type, value + member.offset);
+				}
+			}
+
+			auto operator () (complete::Type & type) const noexcept -> void
+			{
+				auto const visitor = overload(
+					[](complete::Type::BuiltIn &) {},
+					[&](complete::Type::Pointer & pointer) { (*this)(pointer.value_type); },
+					[&](complete::Type::Array & array)
+					{
+						(*this)(array.value_type);
+						(*this)(array.destructor);
+						(*this)(array.copy_constructor);
+						(*this)(array.move_constructor);
+					},
+					[&](complete::Type::ArrayPointer & array_pointer) { (*this)(array_pointer.value_type); },
+					[&](complete::Type::Struct & struct_data) { struct_index(struct_data.struct_index); }
+				);
+				std::visit(visitor, type.extra_data);
+
+				if (type.template_instantiation.has_value())
+				{
+					(*this)(type.template_instantiation->template_id);
+					(*this)(type.template_instantiation->parameters);
+				}
+			}
+
+			// Only what the layout of values depends on, so that values can be translated before the initializers of members are.
+			auto struct_layout(complete::Struct & struct_data) const noexcept -> void
+			{
+				for (complete::MemberVariable & member : struct_data.member_variables)
+					(*this)(member.type);
+				(*this)(struct_data.destructor);
+				for (complete::Constructor & constructor : struct_data.constructors)
+					(*this)(constructor.function);
+				(*this)(struct_data.default_constructor);
+				(*this)(struct_data.copy_constructor);
+				(*this)(struct_data.move_constructor);
+			}
+
+			auto struct_initializers(complete::Struct & struct_data) const -> void
+			{
+				for (complete::MemberVariable & member : struct_data.member_variables)
+					if (member.initializer_expression.has_value())
+						(*this)(*member.initializer_expression);
+			}
+
+			auto operator () (complete::Scope & scope) const -> void
+			{
+				for (complete::Variable & variable : scope.variables)
+					(*this)(variable.type);
+				// Constant expressions point to the values in their scope, so they are translated here and only here.
+				for (complete::Constant & constant : scope.constants)
+				{
+					(*this)(constant.type);
+					value(constant.type, constant.value.data());
+				}
+				for (complete::FunctionName & function : scope.functions)
+					(*this)(function.id);
+				for (complete::TypeName & type : scope.types)
+					(*this)(type.id);
+				for (complete::FunctionTemplateName & function_template : scope.function_templates)
+					(*this)(function_template.id);
+				for (complete::StructTemplateName & struct_template : scope.struct_templates)
+					(*this)(struct_template.id);
+			}
+
+			auto operator () (complete::Namespace & scope) const -> void
+			{
+				(*this)(static_cast<complete::Scope &>(scope));
+				for (complete::Namespace & nested_namespace : scope.nested_namespaces)
+					(*this)(nested_namespace);
+			}
+
+			auto operator () (complete::Expression & expression) const -> void
+			{
+				auto const visitor = overload(
+					[&](complete::expression::Literal<complete::TypeId> & literal) { (*this)(literal.value); },
+					[&](complete::expression::StringLiteral & literal) { (*this)(literal.type); },
+					[&](complete::expression::LocalVariable & variable) { (*this)(variable.variable_type); },
+					[&](complete::expression::GlobalVariable & variable) { (*this)(variable.variable_type); },
+					[&](complete::expression::MemberVariable & variable) { (*this)(variable.variable_type); (*this)(*variable.owner); },
+					[&](complete::expression::Constant & constant) { (*this)(constant.type); },
+					[&](complete::expression::ConstantTemporary & constant) { (*this)(constant.type); value(constant.type, constant.value.data()); },
+					[&](complete::expression::FunctionCall & call) { (*this)(call.function_id); (*this)(call.parameters); },
+					[&](complete::expression::RelationalOperatorCall & call) { (*this)(call.function_id); (*this)(call.parameters); },
+					[&](complete::expression::Constructor & constructor) { (*this)(constructor.constructed_type); (*this)(constructor.parameters); },
+					[&](complete::expression::Assignment & assignment) { (*this)(*assignment.destination); (*this)(*assignment.source); },
+					[&](complete::expression::Dereference & dereference) { (*this)(*dereference.expression); (*this)(dereference.return_type); },
+					[&](complete::expression::ReinterpretCast & cast) { (*this)(*cast.operand); (*this)(cast.return_type); },
+					[&](complete::expression::Subscript & subscript)
+					{
+						(*this)(*subscript.array);
+						(*this)(*subscript.index);
+						(*this)(subscript.return_type);
+					},
+					[&](complete::expression::PointerPlusInt & arithmetic)
+					{
+						(*this)(*arithmetic.pointer);
+						(*this)(*arithmetic.index);
+						(*this)(arithmetic.return_type);
+					},
+					[&](complete::expression::PointerMinusInt & arithmetic)
+					{
+						(*this)(*arithmetic.pointer);
+						(*this)(*arithmetic.index);
+						(*this)(arithmetic.return_type);
+					},
+					[&](complete::expression::PointerMinusPointer & arithmetic) { (*this)(*arithmetic.left); (*this)(*arithmetic.right); },
+					[&](complete::expression::If & if_node) { (*this)(*if_node.condition); (*this)(*if_node.then_case); (*this)(*if_node.else_case); },
+					[&](complete::expression::StatementBlock & block) { (*this)(block.scope); (*this)(block.statements); (*this)(block.return_type); },
+					[&](complete::expression::Compiles & compiles)
+					{
+						for (complete::CompilesFakeVariable & variable : compiles.variables)
+							(*this)(variable.type);
+					},
+					[](auto &) {}
+				);
+				std::visit(visitor, expression.as_variant());
+			}
+
+			auto operator () (complete::Statement & statement) const -> void
+			{
+				auto const optional = [&](value_ptr<complete::Statement> & substatement) { if (substatement != nullptr) (*this)(*substatement); };
+				auto const visitor = overload(
+					[&](complete::statement::VariableDeclaration & declaration) { (*this)(declaration.assigned_expression); },
+					[&](complete::statement::PlacementLet & placement) { (*this)(placement.address_expression); (*this)(placement.assigned_expression); },
+					[&](complete::statement::ExpressionStatement & expression_statement) { (*this)(expression_statement.expression); },
+					[&](complete::statement::If & if_node) { (*this)(if_node.condition); optional(if_node.then_case); optional(if_node.else_case); },
+					[&](complete::statement::StatementBlock & block) { (*this)(block.scope); (*this)(block.statements); },
+					[&](complete::statement::While & while_node) { (*this)(while_node.condition); optional(while_node.body); },
+					[&](complete::statement::For & for_node)
+					{
+						(*this)(for_node.scope);
+						optional(for_node.init_statement);
+						(*this)(for_node.condition);
+						(*this)(for_node.end_expression);
+						optional(for_node.body);
+					},
+					[&](complete::statement::Return & return_node) { (*this)(return_node.returned_expression); },
+					[](complete::statement::Break &) {},
+					[](complete::statement::Continue &) {}
+				);
+				std::visit(visitor, statement.as_variant());
+			}
+
+			auto operator () (complete::Function & function) const -> void
+			{
+				(*this)(static_cast<complete::Scope &>(function));
+				(*this)(function.parameter_types);
+				(*this)(function.return_type);
+				(*this)(function.preconditions);
+				(*this)(function.statements);
+				deferred_body_index(function.deferred_body);
+			}
+
+			auto operator () (complete::OverloadSet & overload_set) const noexcept -> void
+			{
+				(*this)(overload_set.function_ids);
+				(*this)(overload_set.function_template_ids);
+			}
+
+			auto operator () (complete::ExternFunction & extern_function) const noexcept -> void
+			{
+				(*this)(extern_function.return_type);
+				(*this)(extern_function.parameter_types);
+			}
+
+			auto operator () (complete::ResolvedTemplateParameter & parameter) const noexcept -> void
+			{
+				(*this)(parameter.type);
+			}
+
+			auto operator () (complete::FunctionTemplateParameterType & parameter_type) const noexcept -> void
+			{
+				auto const visitor = overload(
+					[&](complete::FunctionTemplateParameterType::BaseCase & base_case) { (*this)(base_case.type); },
+					[](complete::FunctionTemplateParameterType::TemplateParameter &) {},
+					[&](complete::FunctionTemplateParameterType::Pointer & pointer) { (*this)(*pointer.pointee); },
+					[&](complete::FunctionTemplateParameterType::Array & array) { (*this)(*array.value_type); },
+					[&](complete::FunctionTemplateParameterType::ArrayPointer & array_pointer) { (*this)(*array_pointer.pointee); },
+					[&](complete::FunctionTemplateParameterType::TemplateInstantiation & instantiation)
+					{
+						(*this)(instantiation.template_id);
+						(*this)(instantiation.parameters);
+					}
+				);
+				std::visit(visitor, parameter_type.value);
+			}
+
+			auto operator () (complete::FunctionTemplate & function_template) const noexcept -> void
+			{
+				(*this)(function_template.concepts);
+				(*this)(function_template.parameter_types);
+				(*this)(function_template.scope_template_parameters);
+			}
+
+			auto operator () (complete::StructTemplate & struct_template) const noexcept -> void
+			{
+				(*this)(struct_template.concepts);
+				(*this)(struct_template.scope_template_parameters);
+			}
+		};
+
+		// Bodies are run from the program, so they don't need to be copied.
+		auto function_without_body(complete::Function const & function) -> complete::Function
+		{
+			complete::Function copy;
+			static_cast<complete::Scope &>(copy) = function;
+			copy.parameter_count = function.parameter_count;
+			copy.parameter_size = function.parameter_size;
+			copy.parameter_types = function.parameter_types;
+			copy.return_type = function.return_type;
+			copy.ABI_name = function.ABI_name;
+			copy.is_callable_at_compile_time = function.is_callable_at_compile_time;
+			copy.is_callable_at_runtime = function.is_callable_at_runtime;
+			copy.deferred_body = function.deferred_body;
+			return copy;
+		}
+
+		// A type added by the shard is one that the program already has if it is built from the same type, if it instantiates
+		// the same struct template with the same parameters, or if it is the layout placeholder of the same layout.
+		auto existing_type(
+			complete::Type const & type,
+			complete::TypeId shard_id,
+			ProgramShard const & shard,
+			complete::Program const & program,
+			TemplateCache const & template_cache,
+			IdMap const & ids
+		) -> std::optional<complete::TypeId>
+		{
+			if (auto key = complete::derived_type_key(type))
+			{
+				ids(key->value_type);
+				auto const it = program.derived_types.find(*key);
+				if (it != program.derived_types.end())
+					return it->second;
+			}
+			else if (type.template_instantiation.has_value())
+			{
+				complete::StructTemplateId template_id = type.template_instantiation->template_id;
+				std::vector<complete::TypeId> parameters = type.template_instantiation->parameters;
+				ids(template_id);
+				ids(parameters);
+				if (complete::TypeId const * const instantiation = template_cache.structs.find(template_id, parameters))
+					return *instantiation;
+			}
+			else
+			{
+				// Only the placeholders of the shard itself, since the base of its cache may already have others from shards merged before.
+				for (LayoutPlaceholder const & shard_placeholder : shard.template_cache.layout_placeholders)
+					if (shard_placeholder.type.index == shard_id.index)
+						if (LayoutPlaceholder const * const placeholder = template_cache.find_layout_placeholder(shard_placeholder.size, shard_placeholder.alignment))
+							return placeholder->type;
+			}
+			return std::nullopt;
+		}
+
+		auto map_types(ProgramShard const & shard, complete::Program const & program, TemplateCache const & template_cache, IdMap & ids) -> void
+		{
+			complete::Program const & added = shard.program;
+			ids.types.resize(added.types.size() - shard.base.types);
+			ids.structs.assign(added.structs.size() - shard.base.structs, unsigned(-1));
+
+			// Types are only built from types that were added before them, so those are already mapped.
+			unsigned next_type = static_cast<unsigned>(program.types.size());
+			for (size_t i = shard.base.types; i < added.types.size(); ++i)
+			{
+				complete::Type const & type = added.types[i];
+				auto const existing = existing_type(type, complete::TypeId::with_index(static_cast<unsigned>(i)), shard, program, template_cache, ids);
+				if (existing.has_value())
+				{
+					ids.types[i - shard.base.types] = existing->index;
+					if (auto const struct_data = try_get<complete::Type::Struct>(type.extra_data))
+						ids.structs[struct_data->struct_index - shard.base.structs] = std::get<complete::Type::Struct>(program.types[existing->index].extra_data).struct_index;
+				}
+				else
+				{
+					ids.types[i - shard.base.types] = next_type++;
+				}
+			}
+
+			unsigned next_struct = static_cast<unsigned>(program.structs.size());
+			for (unsigned & struct_index : ids.structs)
+				if (struct_index == unsigned(-1))
+					struct_index = next_struct++;
+		}
+
+		auto function_slots(complete::Struct & struct_data) -> std::vector<FunctionId *>
+		{
+			std::vector<FunctionId *> slots = {&struct_data.destructor, &struct_data.default_constructor, &struct_data.copy_constructor, &struct_data.move_constructor};
+			for (complete::Constructor & constructor : struct_data.constructors)
+				slots.push_back(&constructor.function);
+			return slots;
+		}
+
+		auto function_slots(complete::Type & type) -> std::vector<FunctionId *>
+		{
+			if (auto const array = try_get<complete::Type::Array>(type.extra_data))
+				return {&array->destructor, &array->copy_constructor, &array->move_constructor};
+			else
+				return {};
+		}
+
+		// Maps the functions added by the shard, and fills the slots of the types and structs that the program already had which the shard
+		// instantiated, like the named constructors of struct template instantiations. Must be called after map_types.
+		auto map_functions(ProgramShard & shard, complete::Program & program, TemplateCache const & template_cache, IdMap & ids) -> void
+		{
+			complete::Program & added = shard.program;
+			size_t const base_functions = shard.base.functions;
+			ids.functions.assign(added.functions.size() - base_functions, function_id_constants::invalid);
+
+			auto const is_added = [&](FunctionId id) { return id.type == FunctionId::Type::program && id.index >= base_functions; };
+
+			// Instantiations of function templates that the program already has.
+			auto const map_instantiations = [&](
+				TemplateInstantiationTable<FunctionTemplateId, FunctionId> const & shard_table,
+				TemplateInstantiationTable<FunctionTemplateId, FunctionId> const & table)
+			{
+				shard_table.for_each([&](FunctionTemplateId template_id, span<complete::TypeId const> parameters, FunctionId function_id)
+				{
+					if (!is_added(function_id))
+						return;
+
+					std::vector<complete::TypeId> mapped_parameters(parameters.begin(), parameters.end());
+					ids(template_id);
+					ids(mapped_parameters);
+					if (FunctionId const * const instantiation = table.find(template_id, mapped_parameters))
+						if (*instantiation != function_id_constants::invalid)
+							ids.functions[function_id.index - base_functions] = *instantiation;
+				});
+			};
+			map_instantiations(shard.template_cache.functions, template_cache.functions);
+
+			// Functions of types and structs that the program already has. If the program has not instantiated one yet, it takes the one of the shard.
+			std::vector<std::pair<FunctionId *, FunctionId>> adopted_slots;
+			auto const map_slots = [&](std::vector<FunctionId *> const & shard_slots, std::vector<FunctionId *> const & slots)
+			{
+				for (size_t i = 0; i < std::min(shard_slots.size(), slots.size()); ++i)
+				{
+					FunctionId const shard_function = *shard_slots[i];
+					if (!is_added(shard_function) || ids.functions[shard_function.index - base_functions] != function_id_constants::invalid)
+						continue;
+
+					if (*slots[i] != function_id_constants::invalid)
+						ids.functions[shard_function.index - base_functions] = *slots[i];
+					else
+						adopted_slots.push_back({slots[i], shard_function});
+				}
+			};
+
+			for (size_t i = 0; i < added.types.size(); ++i)
+			{
+				unsigned const index = (i < shard.base.types) ? static_cast<unsigned>(i) : ids.types[i - shard.base.types];
+				if (index < ids.first_new_type)
+					map_slots(function_slots(added.types[i]), function_slots(program.types[index]));
+			}
+
+			for (size_t i = 0; i < added.structs.size(); ++i)
+			{
+				unsigned const index = (i < shard.base.structs) ? static_cast<unsigned>(i) : ids.structs[i - shard.base.structs];
+				if (index < ids.first_new_struct)
+					map_slots(function_slots(added.structs[i]), function_slots(program.structs[index]));
+			}
+
+			unsigned next_function = static_cast<unsigned>(program.functions.size());
+			for (FunctionId & function_id : ids.functions)
+				if (function_id == function_id_constants::invalid)
+					function_id = FunctionId(FunctionId::Type::program, next_function++);
+
+			for (auto [slot, shard_function] : adopted_slots)
+			{
+				ids(shard_function);
+				*slot = shard_function;
+			}
+		}
+
+		template <typename Id, typename Value>
+		auto merge_instantiations(
+			TemplateInstantiationTable<Id, Value> const & shard_table,
+			TemplateInstantiationTable<Id, Value> & table,
+			IdMap const & ids
+		) -> void
+		{
+			shard_table.for_each([&](Id template_id, span<complete::TypeId const> parameters, Value value)
+			{
+				std::vector<complete::TypeId> mapped_parameters(parameters.begin(), parameters.end());
+				ids(template_id);
+				ids(mapped_parameters);
+				ids(value);
+				table.insert(template_id, mapped_parameters, value);
+			});
+		}
+
+		template <typename T>
+		auto adopt_ABI_names(std::vector<T> const & shard_elements, std::vector<T> & elements, size_t count) -> void
+		{
+			for (size_t i = 0; i < count; ++i)
+				if (elements[i].ABI_name.empty() && !shard_elements[i].ABI_name.empty())
+					elements[i].ABI_name = shard_elements[i].ABI_name;
+		}
+
+	} // namespace program_shard_locals
+
+	auto make_program_shard(complete::Program const & program, TemplateCache const & template_cache, ProgramAllocation program_allocation) -> ProgramShard
+	{
+		using namespace program_shard_locals;
+
+		ProgramShard shard;
+		if (program_allocation == ProgramAllocation::arena)
+			shard.program.arena.resource = std::make_unique<std::pmr::monotonic_buffer_resource>();
+		ScopedValuePtrResource const allocate_from_shard(shard.program.arena.resource.get());
+
+		shard.program.types = program.types;
+		shard.program.derived_types = program.derived_types;
+		shard.program.structs = program.structs;
+		shard.program.struct_templates = program.struct_templates;
+		shard.program.overload_set_types = program.overload_set_types;
+		shard.program.functions.reserve(program.functions.size());
+		for (complete::Function const & function : program.functions)
+			shard.program.functions.push_back(function_without_body(function));
+		shard.program.extern_functions = program.extern_functions;
+		shard.program.function_templates = program.function_templates;
+		shard.program.deferred_function_bodies = program.deferred_function_bodies;
+		shard.program.analyzed_deferred_function_bodies = program.analyzed_deferred_function_bodies;
+		shard.program.main_function = program.main_function;
+		shard.program.base = &program;
+		shard.template_cache.base = &template_cache;
+
+		shard.base.types = program.types.size();
+		shard.base.structs = program.structs.size();
+		shard.base.struct_templates = program.struct_templates.size();
+		shard.base.overload_set_types = program.overload_set_types.size();
+		shard.base.functions = program.functions.size();
+		shard.base.extern_functions = program.extern_functions.size();
+		shard.base.function_templates = program.function_templates.size();
+		shard.base.deferred_function_bodies = program.deferred_function_bodies.size();
+		shard.base.analyzed_deferred_function_bodies = program.analyzed_deferred_function_bodies.size();
+		shard.base.main_function = program.main_function;
+		shard.base.layout_generic_functions = template_cache.layout_generic_function_count();
+
+		return shard;
+	}
+
+	auto merge_program_shard(
+		ProgramShard && shard,
+		out<complete::Program> program,
+		TemplateCache & template_cache,
+		span<complete::Namespace> module_global_scopes,
+		span<std::vector<complete::Statement>> module_initialization_statements
+	) -> bool
+	{
+		using namespace program_shard_locals;
+
+		complete::Program & added = shard.program;
+		ProgramShard::Base const & base = shard.base;
+
+		bool const declares_main = added.main_function != base.main_function;
+		if (declares_main && program->main_function != base.main_function)
+			return false;
+
+		IdMap ids{base, *program};
+		ids.first_new_type = program->types.size();
+		ids.first_new_struct = program->structs.size();
+		ids.first_new_function = program->functions.size();
+		ids.first_overload_set_type = program->overload_set_types.size();
+		ids.first_struct_template = program->struct_templates.size();
+		ids.first_extern_function = program->extern_functions.size();
+		ids.first_function_template = program->function_templates.size();
+		ids.first_deferred_function_body = program->deferred_function_bodies.size();
+
+		map_types(shard, *program, template_cache, ids);
+		map_functions(shard, *program, template_cache, ids);
+
+		// Types and the layout of structs go first, since translating the values of constants walks them.
+		for (size_t i = base.types; i < added.types.size(); ++i)
+		{
+			if (ids.types[i - base.types] < ids.first_new_type)
+				continue;
+
+			complete::Type & type = added.types[i];
+			ids(type);
+			add_type(*program, std::move(type));
+		}
+
+		for (size_t i = base.structs; i < added.structs.size(); ++i)
+		{
+			if (ids.structs[i - base.structs] < ids.first_new_struct)
+				continue;
+
+			complete::Struct & struct_data = added.structs[i];
+			ids.struct_layout(struct_data);
+			program->structs.push_back(std::move(struct_data));
+		}
+
+		for (size_t i = base.overload_set_types; i < added.overload_set_types.size(); ++i)
+		{
+			ids(added.overload_set_types[i]);
+			program->overload_set_types.push_back(std::move(added.overload_set_types[i]));
+		}
+
+		for (size_t i = base.struct_templates; i < added.struct_templates.size(); ++i)
+		{
+			ids(added.struct_templates[i]);
+			program->struct_templates.push_back(std::move(added.struct_templates[i]));
+		}
+
+		for (size_t i = base.function_templates; i < added.function_templates.size(); ++i)
+		{
+			ids(added.function_templates[i]);
+			program->function_templates.push_back(std::move(added.function_templates[i]));
+		}
+
+		for (size_t i = base.extern_functions; i < added.extern_functions.size(); ++i)
+		{
+			ids(added.extern_functions[i]);
+			program->extern_functions.push_back(std::move(added.extern_functions[i]));
+		}
+
+		// Conversion declarations add the return type of function templates as a parameter.
+		for (size_t i = 0; i < base.function_templates; ++i)
+		{
+			std::vector<complete::FunctionTemplateParameterType> & shard_parameter_types = added.function_templates[i].parameter_types;
+			std::vector<complete::FunctionTemplateParameterType> & parameter_types = program->function_templates[i].parameter_types;
+			for (size_t j = parameter_types.size(); j < shard_parameter_types.size(); ++j)
+			{
+				ids(shard_parameter_types[j]);
+				parameter_types.push_back(std::move(shard_parameter_types[j]));
+			}
+		}
+
+		adopt_ABI_names(added.types, program->types, base.types);
+		adopt_ABI_names(added.functions, program->functions, base.functions);
+		adopt_ABI_names(added.function_templates, program->function_templates, base.function_templates);
+		adopt_ABI_names(added.struct_templates, program->struct_templates, base.struct_templates);
+
+		for (size_t i = base.structs; i < added.structs.size(); ++i)
+			if (ids.structs[i - base.structs] >= ids.first_new_struct)
+				ids.struct_initializers(program->structs[ids.structs[i - base.structs]]);
+
+		for (size_t i = base.functions; i < added.functions.size(); ++i)
+		{
+			if (ids.functions[i - base.functions].index < ids.first_new_function)
+				continue;
+
+			complete::Function & function = added.functions[i];
+			ids(function);
+			program->functions.push_back(std::move(function));
+		}
+
+		for (size_t i = base.deferred_function_bodies; i < added.deferred_function_bodies.size(); ++i)
+		{
+			complete::DeferredFunctionBody & deferred_body = added.deferred_function_bodies[i];
+			ids(deferred_body.function_id);
+			program->deferred_function_bodies.push_back(std::move(deferred_body));
+		}
+
+		// Bodies of functions that the program already had which the shard analyzed. If other shard already analyzed one, that one is kept.
+		std::vector<bool> adopted_bodies(base.deferred_function_bodies, false);
+		for (size_t i = 0; i < base.deferred_function_bodies; ++i)
+		{
+			complete::DeferredFunctionBody & deferred_body = program->deferred_function_bodies[i];
+			if (deferred_body.is_analyzed || !added.deferred_function_bodies[i].is_analyzed)
+				continue;
+
+			complete::Function & function = program->functions[deferred_body.function_id.index];
+			complete::Function & analyzed_function = added.functions[deferred_body.function_id.index];
+			ids(analyzed_function);
+			if (analyzed_function.ABI_name.empty())
+				analyzed_function.ABI_name = function.ABI_name;
+
+			deferred_body.is_analyzed = true;
+			function = std::move(analyzed_function);
+			adopted_bodies[i] = true;
+		}
+
+		for (size_t i = base.analyzed_deferred_function_bodies; i < added.analyzed_deferred_function_bodies.size(); ++i)
+		{
+			int deferred_body_index = added.analyzed_deferred_function_bodies[i];
+			if (static_cast<size_t>(deferred_body_index) < base.deferred_function_bodies && !adopted_bodies[deferred_body_index])
+				continue;
+
+			ids.deferred_body_index(deferred_body_index);
+			program->analyzed_deferred_function_bodies.push_back(deferred_body_index);
+		}
+
+		if (declares_main)
+		{
+			ids(added.main_function);
+			program->main_function = added.main_function;
+		}
+
+		merge_instantiations(shard.template_cache.functions, template_cache.functions, ids);
+		merge_instantiations(shard.template_cache.structs, template_cache.structs, ids);
+		for (LayoutPlaceholder placeholder : shard.template_cache.layout_placeholders)
+		{
+			if (template_cache.find_layout_placeholder(placeholder.size, placeholder.alignment) != nullptr)
+				continue;
+
+			ids(placeholder.type);
+			template_cache.layout_placeholders.push_back(placeholder);
+		}
+
+		// Layout generic instantiations are keyed by layouts, which are the same in every program.
+		shard.template_cache.layout_generic_instantiations.for_each([&](FunctionTemplateId template_id, span<complete::TypeId const> layout_keys, int index)
+		{
+			ids(template_id);
+			if (template_cache.layout_generic_instantiations.find(template_id, layout_keys) != nullptr)
+				return;
+
+			if (index != -1)
+			{
+				LayoutGenericFunction generic_function = std::move(shard.template_cache.layout_generic_functions[index - base.layout_generic_functions]);
+				ids(generic_function.placeholders);
+				ids(generic_function.function);
+				index = static_cast<int>(template_cache.layout_generic_functions.size());
+				template_cache.layout_generic_functions.push_back(std::move(generic_function));
+			}
+			template_cache.layout_generic_instantiations.insert(template_id, layout_keys, index);
+		});
+
+		for (int module_index : shard.modules)
+		{
+			ids(module_global_scopes[module_index]);
+			ids(module_initialization_statements[module_index]);
+		}
+
+		// What is left of the shard is destroyed while the arena it was allocated from still exists, and then the program keeps the arena
+		// alive for the nodes that were moved into it.
+		Arena shard_arena = std::move(added.arena);
+		{
+			ProgramShard const discarded_shard = std::move(shard);
+		}
+		program->arena.adopt(std::move(shard_arena));
+
+		return true;
+	}
+
+} // namespace instantiation
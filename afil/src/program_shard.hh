@@ -0,0 +1,57 @@
+#pragma once
+
+#include "program.hh"
+#include "template_instantiation.hh"
+#include "utils/out.hh"
+#include "utils/span.hh"
+#include <vector>
+
+namespace instantiation
+{
+
+	// Program into which a thread analyzes a module without synchronizing with other threads. It copies the tables of the program that
+	// it adds to, but runs the function bodies that the program already analyzed from it, and reads the template cache of the program
+	// through its own, which only holds what the shard adds. Everything the shard adds goes after the elements that the program had
+	// when the shard was made, so it can be told apart when merging.
+	struct ProgramShard
+	{
+		// What the program had when the shard was made from it.
+		struct Base
+		{
+			size_t types;
+			size_t structs;
+			size_t struct_templates;
+			size_t overload_set_types;
+			size_t functions;
+			size_t extern_functions;
+			size_t function_templates;
+			size_t deferred_function_bodies;
+			size_t analyzed_deferred_function_bodies;
+			size_t layout_generic_functions;
+			FunctionId main_function;
+		};
+
+		complete::Program program;
+		TemplateCache template_cache;
+		Base base;
+		std::vector<int> modules; // Modules analyzed into the shard, in the order in which they are analyzed.
+	};
+
+	// The copy is allocated from the arena of the shard, so this must be called on the thread that analyzes into it, and the shard must not
+	// outlive the incomplete modules. Neither the program nor the template cache may change while modules are analyzed into the shard.
+	// The global scope of the program is not copied, the shard is meant to be analyzed with the one of the program.
+	auto make_program_shard(complete::Program const & program, TemplateCache const & template_cache, ProgramAllocation program_allocation) -> ProgramShard;
+
+	// Appends what the shard added to program. Derived types, template instantiations and layout placeholders that program already has are
+	// used instead of the ones of the shard, and the ids in the global scopes and global initialization statements of the modules of the shard
+	// are translated to the ones of program. Merging shards in the same order always gives the same program.
+	// Returns false without changing program if the shard declares a main function and program already got one from another shard.
+	[[nodiscard]] auto merge_program_shard(
+		ProgramShard && shard,
+		out<complete::Program> program,
+		TemplateCache & template_cache,
+		span<complete::Namespace> module_global_scopes,
+		span<std::vector<complete::Statement>> module_initialization_statements
+	) -> bool;
+
+} // namespace instantiation
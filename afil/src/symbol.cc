@@ -0,0 +1,157 @@
+#include "symbol.hh"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Lookups don't take a lock, since every identifier that is analyzed is looked up, from several threads at once.
+// Names are stored in chunks that are never moved, and slots of the hash table are only ever filled, so a reader sees either
+// an empty slot or the id of a name that is already stored. Only adding a name takes the lock.
+namespace symbol_locals
+{
+	constexpr int first_chunk_bits = 10;
+	constexpr int chunk_count = 32 - first_chunk_bits + 1; // Enough for every 32-bit id.
+
+	struct HashTable
+	{
+		explicit HashTable(size_t capacity_) : capacity(capacity_), slots(new std::atomic<unsigned>[capacity_]())
+		{
+			assert((capacity & (capacity - 1)) == 0);
+		}
+
+		size_t capacity;
+		std::unique_ptr<std::atomic<unsigned>[]> slots; // Id of the name plus one, or 0 if the slot is empty.
+	};
+
+	struct SymbolTable
+	{
+		std::mutex mutex; // Taken to add names.
+		std::atomic<std::string *> chunks[chunk_count] = {}; // Chunk i holds 2^(first_chunk_bits + i) names.
+		std::atomic<HashTable *> table = nullptr;
+		std::vector<std::unique_ptr<HashTable>> tables; // Tables that were replaced are kept for the readers that may still be probing them.
+		std::vector<std::unique_ptr<std::string[]>> chunk_storage;
+		unsigned size = 0;
+	};
+
+	auto symbol_table() noexcept -> SymbolTable &
+	{
+		static SymbolTable table;
+		return table;
+	}
+
+	struct NameLocation
+	{
+		int chunk;
+		size_t index;
+	};
+
+	auto location_of(unsigned id) noexcept -> NameLocation
+	{
+		uint64_t const position = uint64_t(id) + (uint64_t(1) << first_chunk_bits);
+		int chunk = 0;
+		while ((position >> (first_chunk_bits + chunk + 1)) != 0)
+			++chunk;
+		return {chunk, static_cast<size_t>(position - (uint64_t(1) << (first_chunk_bits + chunk)))};
+	}
+
+	auto name_with_id(SymbolTable const & table, unsigned id) noexcept -> std::string_view
+	{
+		NameLocation const location = location_of(id);
+		return table.chunks[location.chunk].load(std::memory_order_acquire)[location.index];
+	}
+
+	auto find_id(SymbolTable const & symbols, HashTable const & table, std::string_view name, size_t hash) noexcept -> std::optional<unsigned>
+	{
+		size_t const mask = table.capacity - 1;
+		for (size_t i = hash & mask;; i = (i + 1) & mask)
+		{
+			unsigned const slot = table.slots[i].load(std::memory_order_acquire);
+			if (slot == 0)
+				return std::nullopt;
+			if (name_with_id(symbols, slot - 1) == name)
+				return slot - 1;
+		}
+	}
+
+	auto insert_id(SymbolTable const & symbols, HashTable & table, unsigned id) noexcept -> void
+	{
+		size_t const mask = table.capacity - 1;
+		size_t i = std::hash<std::string_view>()(name_with_id(symbols, id)) & mask;
+		while (table.slots[i].load(std::memory_order_relaxed) != 0)
+			i = (i + 1) & mask;
+		table.slots[i].store(id + 1, std::memory_order_release);
+	}
+
+	// Must be called with the lock taken.
+	auto add_name(SymbolTable & symbols, std::string_view name) noexcept -> unsigned
+	{
+		unsigned const id = symbols.size;
+		NameLocation const location = location_of(id);
+		if (location.index == 0)
+		{
+			symbols.chunk_storage.push_back(std::make_unique<std::string[]>(size_t(1) << (first_chunk_bits + location.chunk)));
+			symbols.chunks[location.chunk].store(symbols.chunk_storage.back().get(), std::memory_order_release);
+		}
+		symbols.chunk_storage.back()[location.index] = std::string(name);
+		++symbols.size;
+
+		// Grow at half capacity so that probe sequences stay short. The new table is filled before it is published.
+		HashTable * table = symbols.table.load(std::memory_order_relaxed);
+		if (table == nullptr || 2 * size_t(symbols.size) > table->capacity)
+		{
+			auto new_table = std::make_unique<HashTable>(table ? 2 * table->capacity : size_t(1) << (first_chunk_bits + 1));
+			for (unsigned i = 0; i < id; ++i)
+				insert_id(symbols, *new_table, i);
+			table = new_table.get();
+			symbols.tables.push_back(std::move(new_table));
+			symbols.table.store(table, std::memory_order_release);
+		}
+		insert_id(symbols, *table, id);
+		return id;
+	}
+
+} // namespace symbol_locals
+
+auto intern(std::string_view name) noexcept -> Symbol
+{
+	using namespace symbol_locals;
+	SymbolTable & symbols = symbol_table();
+	size_t const hash = std::hash<std::string_view>()(name);
+
+	if (HashTable const * const table = symbols.table.load(std::memory_order_acquire))
+		if (std::optional<unsigned> const id = find_id(symbols, *table, name, hash))
+			return Symbol{*id};
+
+	std::lock_guard<std::mutex> const lock(symbols.mutex);
+
+	// Another thread may have added it since it was looked up.
+	if (HashTable const * const table = symbols.table.load(std::memory_order_relaxed))
+		if (std::optional<unsigned> const id = find_id(symbols, *table, name, hash))
+			return Symbol{*id};
+
+	return Symbol{add_name(symbols, name)};
+}
+
+auto find_symbol(std::string_view name) noexcept -> std::optional<Symbol>
+{
+	using namespace symbol_locals;
+	SymbolTable const & symbols = symbol_table();
+
+	HashTable const * const table = symbols.table.load(std::memory_order_acquire);
+	if (table == nullptr)
+		return std::nullopt;
+
+	std::optional<unsigned> const id = find_id(symbols, *table, name, std::hash<std::string_view>()(name));
+	if (id.has_value())
+		return Symbol{*id};
+	else
+		return std::nullopt;
+}
+
+auto symbol_name(Symbol symbol) noexcept -> std::string_view
+{
+	return symbol_locals::name_with_id(symbol_locals::symbol_table(), symbol.id);
+}
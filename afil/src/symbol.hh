@@ -0,0 +1,28 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Names are interned in a global table so that they can be stored and compared as 32-bit ids. The table only grows with new
+// distinct names, so compiling the same sources again in a long running process doesn't grow it. Lookups don't take a lock.
+struct Symbol
+{
+	unsigned id;
+};
+
+constexpr auto operator == (Symbol a, Symbol b) noexcept -> bool { return a.id == b.id; }
+constexpr auto operator != (Symbol a, Symbol b) noexcept -> bool { return !(a == b); }
+
+// Returns the symbol for the name, adding it to the table if it was not there already.
+auto intern(std::string_view name) noexcept -> Symbol;
+
+// Returns the symbol for the name only if it has already been interned. A name that was never interned cannot name anything.
+auto find_symbol(std::string_view name) noexcept -> std::optional<Symbol>;
+
+auto symbol_name(Symbol symbol) noexcept -> std::string_view;
+
+inline auto to_string(Symbol symbol) noexcept -> std::string
+{
+	return std::string(symbol_name(symbol));
+}
@@ -1,5 +1,4 @@
 #include "syntax_error.hh"
-#include "lexer.hh"
 #include "utils/string.hh"
 #include <cstdlib>
 #include <cassert>
@@ -15,13 +14,6 @@ auto make_syntax_error(
 	return error;
 }
 
-auto make_syntax_error(
-	lex::Token token,
-	std::string_view msg) noexcept -> Error<PartialSyntaxError>
-{
-	return make_syntax_error(token.source, msg);
-}
-
 auto complete_syntax_error(PartialSyntaxError const & partial_error, std::string_view source, std::string_view filename) noexcept -> SyntaxError
 {
 	if (partial_error.error_in_source.empty())
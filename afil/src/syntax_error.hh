@@ -4,8 +4,6 @@
 #include <string>
 #include <iosfwd>
 
-namespace lex { struct Token; }
-
 struct PartialSyntaxError
 {
 	std::string error_message;
@@ -26,10 +24,6 @@ auto make_syntax_error(
 	std::string_view error_in_source,
 	std::string_view msg) noexcept -> Error<PartialSyntaxError>;
 
-auto make_syntax_error(
-	lex::Token token,
-	std::string_view msg) noexcept -> Error<PartialSyntaxError>;
-
 auto complete_syntax_error(PartialSyntaxError const & partial_error, std::string_view source, std::string_view filename = "<source>") noexcept->SyntaxError;
 auto make_complete_syntax_error(
 	std::string_view error_in_source,
@@ -1,4 +1,5 @@
 #include "template_instantiation.hh"
+#include "code_folding.hh"
 #include "program.hh"
 #include "syntax_error.hh"
 #include "incomplete_statement.hh"
@@ -6,6 +7,7 @@
 #include "complete_expression.hh"
 #include "interpreter.hh"
 #include "constexpr.hh"
+#include "program_shard.hh"
 #include "utils/algorithm.hh"
 #include "utils/intcmp.hh"
 #include "utils/load_dll.hh"
@@ -13,11 +15,13 @@
 #include "utils/out.hh"
 #include "utils/overload.hh"
 #include "utils/string.hh"
+#include "utils/task_graph.hh"
 #include "utils/utils.hh"
 #include "utils/unreachable.hh"
 #include "utils/variant.hh"
 #include "utils/warning_macro.hh"
 #include <cassert>
+#include <thread>
 
 using namespace std::literals;
 
@@ -45,6 +49,12 @@ namespace instantiation
 		return StackGuard<ScopeStack>(scope_stack);
 	}
 
+	// The prelude goes at the bottom of every scope stack. Declarations are added to the scopes above it, so it is only ever read.
+	auto push_prelude_scope(ScopeStack & scope_stack) noexcept -> void
+	{
+		scope_stack.push_back({ const_cast<complete::Namespace *>(&complete::prelude_scope()), ScopeType::global, 0 });
+	}
+
 	auto push_block_scope(ScopeStack & scope_stack, complete::Scope & scope) noexcept -> StackGuard<ScopeStack>
 	{
 		int const offset = next_block_scope_offset(scope_stack);
@@ -52,9 +62,19 @@ namespace instantiation
 		return StackGuard<ScopeStack>(scope_stack);
 	}
 
+	// Templates declared inside of an instantiated template point into its storage instead of copying their part of it.
+	template <typename IncompleteTemplate>
+	auto shared_incomplete_template(IncompleteTemplate const & incomplete_template, SemanticAnalysisArgs const & args) -> std::shared_ptr<IncompleteTemplate const>
+	{
+		if (args.incomplete_template != nullptr)
+			return std::shared_ptr<IncompleteTemplate const>(args.incomplete_template, &incomplete_template);
+		else
+			return std::make_shared<IncompleteTemplate const>(incomplete_template);
+	}
+
 	auto bind_function_name(std::string_view name, FunctionId function_id, complete::Program & program, ScopeStack & scope_stack) -> void
 	{
-		top(scope_stack).functions.push_back({ std::string(name), function_id });
+		add_function_to_scope(top(scope_stack), intern(name), function_id);
 		std::string & function_ABI_name = ABI_name(program, function_id);
 		if (function_ABI_name.empty())
 			function_ABI_name = name;
@@ -62,7 +82,7 @@ namespace instantiation
 
 	auto bind_function_template_name(std::string_view name, FunctionTemplateId function_template_id, complete::Program & program, ScopeStack & scope_stack) -> void
 	{
-		top(scope_stack).function_templates.push_back({ std::string(name), function_template_id });
+		add_function_template_to_scope(top(scope_stack), intern(name), function_template_id);
 		std::string & function_ABI_name = ABI_name(program, function_template_id);
 		if (function_ABI_name.empty())
 			function_ABI_name = name;
@@ -70,7 +90,7 @@ namespace instantiation
 
 	auto bind_type_name(std::string_view name, complete::TypeId type_id, complete::Program & program, ScopeStack & scope_stack)
 	{
-		top(scope_stack).types.push_back({ std::string(name), type_id });
+		add_type_to_scope(top(scope_stack), intern(name), type_id);
 		std::string & type_ABI_name = ABI_name(program, type_id);
 		if (type_ABI_name.empty())
 			type_ABI_name = name;
@@ -78,7 +98,7 @@ namespace instantiation
 
 	auto bind_struct_template_name(std::string_view name, complete::StructTemplateId template_id, complete::Program & program, ScopeStack & scope_stack)
 	{
-		top(scope_stack).struct_templates.push_back({ std::string(name), template_id });
+		add_struct_template_to_scope(top(scope_stack), intern(name), template_id);
 		std::string & type_ABI_name = ABI_name(program, template_id);
 		if (type_ABI_name.empty())
 			type_ABI_name = name;
@@ -198,12 +218,34 @@ namespace instantiation
         return std::nullopt;
     }
 
+	// An implicit conversion fails either because there is no conversion between the types
+	// or because the body of the implicit conversion function does not compile.
+	using ImplicitConversionError = std::variant<complete::ConversionNotFound, PartialSyntaxError>;
+
+	auto to_implicit_conversion_result(expected<complete::Expression, complete::ConversionNotFound> && conversion) noexcept
+		-> expected<complete::Expression, ImplicitConversionError>
+	{
+		if (conversion.has_value())
+			return std::move(*conversion);
+		else
+			return Error<ImplicitConversionError>(conversion.error());
+	}
+
+	// A conversion function whose body does not compile is an error even where the caller could fall back to something else.
+	auto conversion_body_error(expected<complete::Expression, ImplicitConversionError> const & conversion) noexcept -> PartialSyntaxError const *
+	{
+		if (conversion.has_value())
+			return nullptr;
+		else
+			return std::get_if<PartialSyntaxError>(&conversion.error());
+	}
+
 	auto insert_implicit_conversion_node(
 		complete::Expression && expr, 
 		complete::TypeId from, 
 		complete::TypeId to,
 		SemanticAnalysisArgs args
-	) noexcept -> expected<complete::Expression, complete::ConversionNotFound>
+	) noexcept -> expected<complete::Expression, ImplicitConversionError>
 	{
 		out<complete::Program> program = args.program;
 
@@ -212,13 +254,15 @@ namespace instantiation
 			complete::expression::Constant constant_null_pointer;
 			constant_null_pointer.type = decay(to);
 			constant_null_pointer.value = null;
-			return insert_mutref_conversion_node(constant_null_pointer, to, *program);
+			return to_implicit_conversion_result(insert_mutref_conversion_node(constant_null_pointer, to, *program));
 		}
 
 		if (auto const implicit_conversion_functions = named_overload_set("implicit", args.scope_stack))
 		{
 			FunctionId const conversion_function = resolve_function_overloading_for_conversions(
 				*implicit_conversion_functions, from, to, *program, args.template_cache);
+			if (auto body = analyze_deferred_function_body(conversion_function, program, args.template_cache); !body.has_value())
+				return Error<ImplicitConversionError>(std::move(body.error()));
 
 			if (conversion_function != function_id_constants::invalid)
 			{
@@ -227,8 +271,11 @@ namespace instantiation
 
 				complete::TypeId const expected_type = parameter_types_of(*program, conversion_function)[0];
 
-				try_call(conversion_call.parameters.push_back, insert_mutref_conversion_node(std::move(expr), expected_type, *program));
-				return insert_mutref_conversion_node(std::move(conversion_call), to, *program);
+				auto parameter = insert_mutref_conversion_node(std::move(expr), expected_type, *program);
+				if (!parameter.has_value())
+					return Error<ImplicitConversionError>(parameter.error());
+				conversion_call.parameters.push_back(std::move(*parameter));
+				return to_implicit_conversion_result(insert_mutref_conversion_node(std::move(conversion_call), to, *program));
 			}
 		}
         
@@ -276,14 +323,14 @@ namespace instantiation
             }
         }
 
-		return insert_mutref_conversion_node(std::move(expr), from, to, *program);
+		return to_implicit_conversion_result(insert_mutref_conversion_node(std::move(expr), from, to, *program));
 	}
 
 	auto insert_implicit_conversion_node(
 		complete::Expression && expr,
 		complete::TypeId to,
 		SemanticAnalysisArgs args
-	) noexcept -> expected<complete::Expression, complete::ConversionNotFound>
+	) noexcept -> expected<complete::Expression, ImplicitConversionError>
 	{
 		complete::TypeId const from = expression_type_id(expr, *args.program);
 		return insert_implicit_conversion_node(std::move(expr), from, to, args);
@@ -297,11 +344,17 @@ namespace instantiation
 		std::string_view source
 	) noexcept -> expected<complete::Expression, PartialSyntaxError>
 	{
-		if (auto conversion = insert_implicit_conversion_node(std::move(expr), from, to, args))
+		auto conversion = insert_implicit_conversion_node(std::move(expr), from, to, args);
+		if (conversion.has_value())
 			return std::move(*conversion);
+		else if (auto const body_error = conversion_body_error(conversion))
+			return Error(*body_error);
 		else
+		{
+			complete::ConversionNotFound const & not_found = std::get<complete::ConversionNotFound>(conversion.error());
 			return make_syntax_error(source, join("Error in conversion from ",
-				ABI_name(*args.program, conversion.error().from), " to ", ABI_name(*args.program, conversion.error().to), ": ", conversion.error().why));
+				ABI_name(*args.program, not_found.from), " to ", ABI_name(*args.program, not_found.to), ": ", not_found.why));
+		}
 	}
 
 	auto insert_implicit_conversion_node(
@@ -382,8 +435,9 @@ namespace instantiation
 				try_call_decl(complete::TypeId const pointee, resolve_dependent_type(*array_pointer.pointee, args));
 				return array_pointer_type_for(pointee, *args.program);
 			},
-			[&](incomplete::TypeId::TemplateInstantiation const & template_instantiation) -> expected<complete::TypeId, PartialSyntaxError>
+			[&](value_ptr<incomplete::TypeId::TemplateInstantiation> const & boxed_template_instantiation) -> expected<complete::TypeId, PartialSyntaxError>
 			{
+				incomplete::TypeId::TemplateInstantiation const & template_instantiation = *boxed_template_instantiation;
 				auto const visitor = overload(
 					[](lookup_result::StructTemplate result) -> complete::StructTemplateId { return result.template_id; },
 					[](auto const &) -> complete::StructTemplateId { declare_unreachable(); }
@@ -461,8 +515,9 @@ namespace instantiation
 					resolve_function_template_parameter_type(*array_pointer.pointee, unresolved_template_parameters, args));
 				return complete::FunctionTemplateParameterType{std::move(array_pointer_type), false, false};
 			},
-			[&](incomplete::TypeId::TemplateInstantiation const & template_instantiation) -> expected<complete::FunctionTemplateParameterType, PartialSyntaxError>
+			[&](value_ptr<incomplete::TypeId::TemplateInstantiation> const & boxed_template_instantiation) -> expected<complete::FunctionTemplateParameterType, PartialSyntaxError>
 			{
+				incomplete::TypeId::TemplateInstantiation const & template_instantiation = *boxed_template_instantiation;
 				auto const template_id = struct_template_with_name(template_instantiation.template_name, args.scope_stack, template_instantiation.namespaces);
 				if (!template_id.has_value())
 					return make_syntax_error(template_instantiation.template_name, "Struct template not found");
@@ -503,6 +558,11 @@ namespace instantiation
 		using namespace complete;
 		lookup_result::OverloadSet overload_set;
 
+		// A name that was never interned cannot have been declared.
+		std::optional<Symbol> const symbol = find_symbol(name);
+		if (!symbol)
+			return lookup_result::Nothing();
+
 		bool stop_looking_for_variables = false;
 
 		// Search the scopes in reverse order.
@@ -516,39 +576,30 @@ namespace instantiation
 			{
 				if (scope_stack[i].type == ScopeType::global)
 				{
-					auto const var = std::find_if(scope.variables, [name](Variable const & var) { return var.name == name; });
-					if (var != scope.variables.end())
+					if (Variable const * const var = find_variable(scope, *symbol))
 						return lookup_result::GlobalVariable{var->type, var->offset};
 				}
 				else if (!stop_looking_for_variables)
 				{
-					auto const var = std::find_if(scope.variables, [name](Variable const & var) { return var.name == name; });
-					if (var != scope.variables.end())
+					if (Variable const * const var = find_variable(scope, *symbol))
 						return lookup_result::Variable{var->type, var->offset};
 				}
 
-				auto const type = std::find_if(scope.types, [name](TypeName const & var) { return var.name == name; });
-				if (type != scope.types.end())
+				if (TypeName const * const type = find_type(scope, *symbol))
 					return lookup_result::Type{type->id};
 
-				auto const struct_template = std::find_if(scope.struct_templates, [name](StructTemplateName const & var) { return var.name == name; });
-				if (struct_template != scope.struct_templates.end())
+				if (StructTemplateName const * const struct_template = find_struct_template(scope, *symbol))
 					return lookup_result::StructTemplate{struct_template->id};
 
-				auto const constant = std::find_if(scope.constants, [name](Constant const & var) { return var.name == name; });
-				if (constant != scope.constants.end())
-					return lookup_result::Constant{&*constant};
+				if (Constant const * const constant = find_constant(scope, *symbol))
+					return lookup_result::Constant{constant};
 			}
 
 			// Functions.
-			for (FunctionName const & fn : scope.functions)
-				if (fn.name == name)
-					overload_set.function_ids.push_back(fn.id);
+			find_functions(scope, *symbol, overload_set.function_ids);
 
 			// Function templates.
-			for (FunctionTemplateName const & fn : scope.function_templates)
-				if (fn.name == name)
-					overload_set.function_template_ids.push_back(fn.id);
+			find_function_templates(scope, *symbol, overload_set.function_template_ids);
 
 			// After we leave a function, stop looking for variables.
 			if (i < start && scope_stack[i].type == ScopeType::function)
@@ -576,29 +627,24 @@ namespace instantiation
 		using namespace complete;
 		lookup_result::OverloadSet overload_set;
 
-		auto const var = std::find_if(scope.variables, [name](Variable const & var) { return var.name == name; });
-		if (var != scope.variables.end())
+		std::optional<Symbol> const symbol = find_symbol(name);
+		if (!symbol)
+			return lookup_result::Nothing();
+
+		if (Variable const * const var = find_variable(scope, *symbol))
 			return lookup_result::GlobalVariable{var->type, var->offset};
 
-		auto const type = std::find_if(scope.types, [name](TypeName const & var) { return var.name == name; });
-		if (type != scope.types.end())
+		if (TypeName const * const type = find_type(scope, *symbol))
 			return lookup_result::Type{type->id};
 
-		auto const struct_template = std::find_if(scope.struct_templates, [name](StructTemplateName const & var) { return var.name == name; });
-		if (struct_template != scope.struct_templates.end())
+		if (StructTemplateName const * const struct_template = find_struct_template(scope, *symbol))
 			return lookup_result::StructTemplate{struct_template->id};
 
-		auto const constant = std::find_if(scope.constants, [name](Constant const & var) { return var.name == name; });
-		if (constant != scope.constants.end())
-			return lookup_result::Constant{&*constant};
+		if (Constant const * const constant = find_constant(scope, *symbol))
+			return lookup_result::Constant{constant};
 
-		for (FunctionName const & fn : scope.functions)
-			if (fn.name == name)
-				overload_set.function_ids.push_back(fn.id);
-
-		for (FunctionTemplateName const & fn : scope.function_templates)
-			if (fn.name == name)
-				overload_set.function_template_ids.push_back(fn.id);
+		find_functions(scope, *symbol, overload_set.function_ids);
+		find_function_templates(scope, *symbol, overload_set.function_template_ids);
 
 		if (overload_set.function_ids.empty() && overload_set.function_template_ids.empty())
 			return lookup_result::Nothing();
@@ -697,9 +743,13 @@ namespace instantiation
 		if (type != complete::TypeId::none)
 			return type;
 
-		auto const it = std::find_if(template_parameters, [name](complete::ResolvedTemplateParameter const & param)
+		std::optional<Symbol> const symbol = find_symbol(name);
+		if (!symbol)
+			return complete::TypeId::none;
+
+		auto const it = std::find_if(template_parameters, [symbol](complete::ResolvedTemplateParameter const & param)
 		{
-			return param.name == name;
+			return param.name == *symbol;
 		});
 		if (it != template_parameters.end())
 			return it->type;
@@ -738,6 +788,164 @@ namespace instantiation
 		return {type.size, is_float};
 	}
 
+	auto bind_extern_function(complete::ExternFunction & extern_function, complete::Program const & program) noexcept -> bool
+	{
+		extern_function.function_pointer = load_symbol(extern_function.ABI_name);
+		if (!extern_function.function_pointer)
+			return false;
+
+		if (extern_function.parameter_types.size() > 4)
+			mark_as_to_do("Extern functions with more than 4 parameters");
+
+		callc::TypeDescriptor parameter_type_descriptors[4];
+		for (size_t i = 0; i < extern_function.parameter_types.size(); ++i)
+			parameter_type_descriptors[i] = type_descriptor_for(extern_function.parameter_types[i], program);
+
+		callc::TypeDescriptor const return_type_descriptor = type_descriptor_for(extern_function.return_type, program);
+
+		extern_function.caller = callc::c_function_caller({parameter_type_descriptors, extern_function.parameter_types.size()}, return_type_descriptor);
+		return true;
+	}
+
+	template <typename T>
+	auto key_word(T value) noexcept -> unsigned
+	{
+		static_assert(sizeof(T) == sizeof(unsigned));
+		unsigned word;
+		memcpy(&word, &value, sizeof(word));
+		return word;
+	}
+
+	template <typename F>
+	auto for_each_key_word(complete::OverloadSetView overload_set, span<complete::TypeId const> parameters, F f) noexcept -> void
+	{
+		for (FunctionId const function_id : overload_set.function_ids)
+			f(key_word(function_id));
+		for (FunctionTemplateId const function_template_id : overload_set.function_template_ids)
+			f(key_word(function_template_id));
+		for (complete::TypeId const parameter : parameters)
+			f(parameter.flat_value);
+	}
+
+	auto hash_overload_resolution_key(complete::OverloadSetView overload_set, span<complete::TypeId const> parameters) noexcept -> size_t
+	{
+		// FNV-1a over the key. Sizes are included so that words cannot shift between the three parts of the key.
+		size_t hash = 2166136261u;
+		auto const combine = [&hash](unsigned word) { hash = (hash ^ word) * 16777619u; };
+		combine(static_cast<unsigned>(overload_set.function_ids.size()));
+		combine(static_cast<unsigned>(overload_set.function_template_ids.size()));
+		for_each_key_word(overload_set, parameters, combine);
+		return hash;
+	}
+
+	auto OverloadResolutionCache::find(complete::OverloadSetView overload_set, span<complete::TypeId const> parameters) const noexcept -> FunctionId const *
+	{
+		auto const [first, last] = entries.equal_range(hash_overload_resolution_key(overload_set, parameters));
+		for (auto it = first; it != last; ++it)
+		{
+			Entry const & entry = it->second;
+			if (entry.function_count != overload_set.function_ids.size() ||
+				entry.function_template_count != overload_set.function_template_ids.size() ||
+				entry.parameter_count != parameters.size())
+				continue;
+
+			size_t i = entry.key_offset;
+			bool matches = true;
+			for_each_key_word(overload_set, parameters, [&](unsigned word) { matches = matches && keys[i++] == word; });
+			if (matches)
+				return &entry.result;
+		}
+
+		return nullptr;
+	}
+
+	auto OverloadResolutionCache::insert(complete::OverloadSetView overload_set, span<complete::TypeId const> parameters, FunctionId result) -> void
+	{
+		Entry entry;
+		entry.key_offset = keys.size();
+		entry.function_count = static_cast<unsigned>(overload_set.function_ids.size());
+		entry.function_template_count = static_cast<unsigned>(overload_set.function_template_ids.size());
+		entry.parameter_count = static_cast<unsigned>(parameters.size());
+		entry.result = result;
+
+		size_t const hash = hash_overload_resolution_key(overload_set, parameters);
+		for_each_key_word(overload_set, parameters, [this](unsigned word) { keys.push_back(word); });
+		entries.emplace(hash, entry);
+		inserted_hashes.push_back(hash);
+	}
+
+	auto OverloadResolutionCache::truncate(size_t new_size) noexcept -> void
+	{
+		assert(new_size <= inserted_hashes.size());
+		while (inserted_hashes.size() > new_size)
+		{
+			// The last entry is the one whose key was stored last.
+			auto const [first, last] = entries.equal_range(inserted_hashes.back());
+			auto const it = std::max_element(first, last, [](auto const & a, auto const & b) { return a.second.key_offset < b.second.key_offset; });
+			assert(it != last);
+			keys.resize(it->second.key_offset);
+			entries.erase(it);
+			inserted_hashes.pop_back();
+		}
+	}
+
+	auto TemplateCache::find_function(FunctionTemplateId template_id, span<complete::TypeId const> parameters) const noexcept -> FunctionId const *
+	{
+		if (FunctionId const * const function = functions.find(template_id, parameters))
+			return function;
+		return base ? base->find_function(template_id, parameters) : nullptr;
+	}
+
+	auto TemplateCache::find_struct(complete::StructTemplateId template_id, span<complete::TypeId const> parameters) const noexcept -> complete::TypeId const *
+	{
+		if (complete::TypeId const * const type = structs.find(template_id, parameters))
+			return type;
+		return base ? base->find_struct(template_id, parameters) : nullptr;
+	}
+
+	auto TemplateCache::find_overload_resolution(complete::OverloadSetView overload_set, span<complete::TypeId const> parameters) const noexcept -> FunctionId const *
+	{
+		if (FunctionId const * const function = overload_resolutions.find(overload_set, parameters))
+			return function;
+		return base ? base->find_overload_resolution(overload_set, parameters) : nullptr;
+	}
+
+	auto TemplateCache::find_layout_placeholder(int size, int alignment) const noexcept -> LayoutPlaceholder const *
+	{
+		for (LayoutPlaceholder const & placeholder : layout_placeholders)
+			if (placeholder.size == size && placeholder.alignment == alignment)
+				return &placeholder;
+		return base ? base->find_layout_placeholder(size, alignment) : nullptr;
+	}
+
+	auto TemplateCache::find_layout_placeholder(complete::TypeId type) const noexcept -> LayoutPlaceholder const *
+	{
+		for (LayoutPlaceholder const & placeholder : layout_placeholders)
+			if (placeholder.type.index == type.index)
+				return &placeholder;
+		return base ? base->find_layout_placeholder(type) : nullptr;
+	}
+
+	auto TemplateCache::find_layout_generic_instantiation(FunctionTemplateId template_id, span<complete::TypeId const> layout_keys) const noexcept -> int const *
+	{
+		if (int const * const index = layout_generic_instantiations.find(template_id, layout_keys))
+			return index;
+		return base ? base->find_layout_generic_instantiation(template_id, layout_keys) : nullptr;
+	}
+
+	auto TemplateCache::layout_generic_function(int index) const noexcept -> LayoutGenericFunction const &
+	{
+		size_t const base_count = base ? base->layout_generic_function_count() : 0;
+		if (static_cast<size_t>(index) < base_count)
+			return base->layout_generic_function(index);
+		return layout_generic_functions[index - base_count];
+	}
+
+	auto TemplateCache::layout_generic_function_count() const noexcept -> size_t
+	{
+		return (base ? base->layout_generic_function_count() : 0) + layout_generic_functions.size();
+	}
+
 	struct ProgramState
 	{
 		size_t types;
@@ -747,8 +955,19 @@ namespace instantiation
 		size_t functions;
 		size_t extern_functions;
 		size_t function_templates;
+		size_t deferred_function_bodies;
+		size_t analyzed_deferred_function_bodies;
 		FunctionId main_function;
 	};
+	struct TemplateCacheState
+	{
+		size_t functions;
+		size_t structs;
+		size_t overload_resolutions;
+		size_t layout_placeholders;
+		size_t layout_generic_functions;
+		size_t layout_generic_instantiations;
+	};
 	struct ScopeState
 	{
 		int stack_frame_size;
@@ -771,10 +990,25 @@ namespace instantiation
 		program_state.functions = program.functions.size();
 		program_state.extern_functions = program.extern_functions.size();
 		program_state.function_templates = program.function_templates.size();
+		program_state.deferred_function_bodies = program.deferred_function_bodies.size();
+		program_state.analyzed_deferred_function_bodies = program.analyzed_deferred_function_bodies.size();
 		program_state.main_function = program.main_function;
 
 		return program_state;
 	}
+	auto capture_state(TemplateCache const & template_cache) noexcept -> TemplateCacheState
+	{
+		TemplateCacheState template_cache_state;
+
+		template_cache_state.functions = template_cache.functions.size();
+		template_cache_state.structs = template_cache.structs.size();
+		template_cache_state.overload_resolutions = template_cache.overload_resolutions.size();
+		template_cache_state.layout_placeholders = template_cache.layout_placeholders.size();
+		template_cache_state.layout_generic_functions = template_cache.layout_generic_functions.size();
+		template_cache_state.layout_generic_instantiations = template_cache.layout_generic_instantiations.size();
+
+		return template_cache_state;
+	}
 	auto capture_state(complete::Scope const & scope) noexcept -> ScopeState
 	{
 		ScopeState scope_state;
@@ -793,25 +1027,51 @@ namespace instantiation
 
 	auto restore_state(out<complete::Program> program, ProgramState const & program_state) noexcept -> void
 	{
-		program->types.resize(program_state.types);
+		// Bodies analyzed after the state was captured go back to being deferred.
+		while (program->analyzed_deferred_function_bodies.size() > program_state.analyzed_deferred_function_bodies)
+		{
+			int const deferred_body_index = program->analyzed_deferred_function_bodies.back();
+			program->analyzed_deferred_function_bodies.pop_back();
+
+			complete::DeferredFunctionBody & deferred_body = program->deferred_function_bodies[deferred_body_index];
+			if (deferred_body.function_id.index < program_state.functions)
+				complete::remove_deferred_function_body(program->functions[deferred_body.function_id.index], deferred_body);
+			deferred_body.is_analyzed = false;
+		}
+		program->deferred_function_bodies.resize(program_state.deferred_function_bodies);
+
+		remove_types(*program, program_state.types);
 		program->structs.resize(program_state.structs);
 		program->struct_templates.resize(program_state.struct_templates);
 		program->overload_set_types.resize(program_state.overload_set_types);
 		program->functions.resize(program_state.functions);
+		forget_removed_named_constructors(*program);
 		program->extern_functions.resize(program_state.extern_functions);
 		program->function_templates.resize(program_state.function_templates);
 		program->main_function = program_state.main_function;
 	}
+	auto restore_state(out<TemplateCache> template_cache, TemplateCacheState const & template_cache_state) noexcept -> void
+	{
+		template_cache->functions.truncate(template_cache_state.functions);
+		template_cache->structs.truncate(template_cache_state.structs);
+		template_cache->overload_resolutions.truncate(template_cache_state.overload_resolutions);
+		template_cache->layout_placeholders.resize(template_cache_state.layout_placeholders);
+		template_cache->layout_generic_functions.resize(template_cache_state.layout_generic_functions);
+		template_cache->layout_generic_instantiations.truncate(template_cache_state.layout_generic_instantiations);
+	}
 	auto restore_state(out<complete::Scope> scope, ScopeState const & scope_state) noexcept -> void
 	{
-		scope->stack_frame_size = scope_state.stack_frame_size;
-		scope->stack_frame_alignment = scope_state.stack_frame_alignment;
-		scope->variables.resize(scope_state.variables);
-		scope->constants.resize(scope_state.constants);
-		scope->functions.resize(scope_state.functions);
-		scope->types.resize(scope_state.types);
-		scope->function_templates.resize(scope_state.function_templates);
-		scope->struct_templates.resize(scope_state.struct_templates);
+		// Only written if they changed, since the scope may be the global scope of a module that other threads are reading.
+		if (scope->stack_frame_size != scope_state.stack_frame_size)
+			scope->stack_frame_size = scope_state.stack_frame_size;
+		if (scope->stack_frame_alignment != scope_state.stack_frame_alignment)
+			scope->stack_frame_alignment = scope_state.stack_frame_alignment;
+		remove_names_from_scope(*scope, complete::NameKind::variable, scope_state.variables);
+		remove_names_from_scope(*scope, complete::NameKind::constant, scope_state.constants);
+		remove_names_from_scope(*scope, complete::NameKind::function, scope_state.functions);
+		remove_names_from_scope(*scope, complete::NameKind::type, scope_state.types);
+		remove_names_from_scope(*scope, complete::NameKind::function_template, scope_state.function_templates);
+		remove_names_from_scope(*scope, complete::NameKind::struct_template, scope_state.struct_templates);
 	}
 
 	auto test_if_expression_compiles(
@@ -822,7 +1082,7 @@ namespace instantiation
 	{
 		ProgramState const program_state = capture_state(*args.program);
 		ScopeState const top_scope_state = capture_state(top(args.scope_stack));
-		TemplateCache const template_cache_state = args.template_cache;
+		TemplateCacheState const template_cache_state = capture_state(args.template_cache);
 		size_t const scope_stack_size = args.scope_stack.size();
 
 		auto expr = instantiate_expression(expression_to_test.expression, args, current_scope_return_type);
@@ -831,7 +1091,7 @@ namespace instantiation
 			args.scope_stack.resize(scope_stack_size);
 			restore_state(args.program, program_state);
 			restore_state(out(top(args.scope_stack)), top_scope_state);
-			args.template_cache = template_cache_state;
+			restore_state(out(args.template_cache), template_cache_state);
 			return false;
 		}
 
@@ -863,6 +1123,7 @@ namespace instantiation
 					return make_syntax_error(param.concept, "Name does not name a concept. A concept is a function type -> bool");
 
 				FunctionId const concept_function = resolve_function_overloading(*set, {complete::TypeId::type}, *args.program, args.template_cache);
+				try_call_void(analyze_deferred_function_body(concept_function, args.program, args.template_cache));
 				if (concept_function == function_id_constants::invalid || return_type(*args.program, concept_function) != complete::TypeId::bool_)
 					return make_syntax_error(param.concept, "Name does not name a concept. A concept is a function type -> bool");
 
@@ -895,6 +1156,8 @@ namespace instantiation
 
 			// Implicit conversion
 			auto const implicit_conversion = insert_implicit_conversion_node(std::move(parameters[0]), param_type_id, constructed_type_id, args);
+			if (auto const body_error = conversion_body_error(implicit_conversion))
+				return Error(*body_error);
 			if (implicit_conversion.has_value())
 				return std::move(*implicit_conversion);
 
@@ -902,6 +1165,7 @@ namespace instantiation
 			{
 				FunctionId const conversion_function = resolve_function_overloading_for_conversions(
 					*explicit_conversion_functions, param_type_id, constructed_type_id, *args.program, args.template_cache);
+				try_call_void(analyze_deferred_function_body(conversion_function, args.program, args.template_cache));
 
 				if (conversion_function != function_id_constants::invalid)
 				{
@@ -1015,6 +1279,7 @@ namespace instantiation
 		{
 			try_call_decl(complete::TypeId const parameter_type, resolve_dependent_type(parameter.type, args));
 			add_variable_to_scope(*function, parameter.name, parameter_type, 0, *args.program);
+			function->parameter_types.push_back(parameter_type);
 		}
 
 		function->parameter_count = static_cast<int>(incomplete_function.parameters.size());
@@ -1374,14 +1639,39 @@ namespace instantiation
 		return std::move(new_struct);
 	}
 
+	auto instantiate_struct_constructor(
+		incomplete::Constructor const & incomplete_constructor,
+		complete::TypeId new_type_id,
+		SemanticAnalysisArgs args
+	) -> expected<FunctionId, PartialSyntaxError>
+	{
+		try_call_decl(complete::Function constructor_function,
+			instantiate_function_template(incomplete_constructor, args));
+
+		if (constructor_function.return_type != new_type_id)
+			return make_syntax_error(incomplete_constructor.name, "Return type of constructor must be constructed type.");
+
+		return add_function(*args.program, std::move(constructor_function));
+	}
+
 	auto instantiate_incomplete_struct_functions(
 		incomplete::Struct const & incomplete_struct,
 		complete::TypeId new_type_id, int new_struct_id,
-		SemanticAnalysisArgs args
+		SemanticAnalysisArgs args,
+		bool defer_named_constructors
 	) -> expected<void, PartialSyntaxError>
 	{
 		out<complete::Program> program = args.program;
 
+		// Deferred constructors are registered up front so that the bodies of the other member functions can already name them.
+		if (defer_named_constructors)
+		{
+			std::vector<complete::Constructor> & constructors = program->structs[new_struct_id].constructors;
+			constructors.reserve(incomplete_struct.constructors.size());
+			for (incomplete::Constructor const & incomplete_constructor : incomplete_struct.constructors)
+				constructors.push_back({function_id_constants::invalid, std::string(incomplete_constructor.name)});
+		}
+
 		bool const custom_destructor_declared = !has_type<nothing_t>(incomplete_struct.destructor);
 		if (incomplete::Function const * incomplete_destructor = try_get<incomplete::Function>(incomplete_struct.destructor))
 		{
@@ -1453,22 +1743,19 @@ namespace instantiation
 		}
 	
 		std::vector<complete::Constructor> constructors;
-		constructors.reserve(incomplete_struct.constructors.size());
-
-		for (incomplete::Constructor const & incomplete_constructor : incomplete_struct.constructors)
+		if (!defer_named_constructors)
 		{
-			try_call_decl(complete::Function constructor_function,
-				instantiate_function_template(incomplete_constructor, args));
-
-			if (constructor_function.return_type != new_type_id)
-				return make_syntax_error(incomplete_constructor.name, "Return type of constructor must be constructed type.");
+			constructors.reserve(incomplete_struct.constructors.size());
 
-			FunctionId const constructor_function_id = add_function(*program, std::move(constructor_function));
+			for (incomplete::Constructor const & incomplete_constructor : incomplete_struct.constructors)
+			{
+				try_call_decl(FunctionId const constructor_function_id, instantiate_struct_constructor(incomplete_constructor, new_type_id, args));
 
-			complete::Constructor constructor;
-			constructor.function = constructor_function_id;
-			constructor.name = incomplete_constructor.name;
-			constructors.push_back(std::move(constructor));
+				complete::Constructor constructor;
+				constructor.function = constructor_function_id;
+				constructor.name = incomplete_constructor.name;
+				constructors.push_back(std::move(constructor));
+			}
 		}
 
 		complete::Struct & new_struct = program->structs[new_struct_id];
@@ -1530,7 +1817,8 @@ namespace instantiation
 			}
 		}
 
-		new_struct.constructors = std::move(constructors);
+		if (!defer_named_constructors)
+			new_struct.constructors = std::move(constructors);
 		new_struct.copy_constructor = copy_constructor;
 		new_struct.move_constructor = move_constructor;
 		new_struct.default_constructor = default_constructor;
@@ -1538,6 +1826,558 @@ namespace instantiation
 		return success;
 	}
 
+	auto is_trivially_copyable_value(complete::Program const & program, complete::TypeId type) noexcept -> bool
+	{
+		return !type.is_function && !type.is_reference
+			&& type.index != complete::TypeId::void_.index && type.index != complete::TypeId::type.index
+			&& is_trivially_destructible(program, type)
+			&& is_trivially_copy_constructible(program, type)
+			&& move_constructor_for(program, type) == function_id_constants::invalid;
+	}
+
+	auto layout_placeholder_for(complete::TypeId type, out<complete::Program> program, TemplateCache & template_cache) noexcept -> complete::TypeId
+	{
+		int const size = type_size(*program, type);
+		int const alignment = type_alignment(*program, type);
+
+		LayoutPlaceholder const * const existing_placeholder = template_cache.find_layout_placeholder(size, alignment);
+
+		complete::TypeId placeholder_type;
+		if (existing_placeholder != nullptr)
+		{
+			placeholder_type = existing_placeholder->type;
+		}
+		else
+		{
+			complete::Type new_type;
+			new_type.size = size;
+			new_type.alignment = alignment;
+			new_type.ABI_name = join("layout_placeholder_", size, "_", alignment);
+
+			complete::Struct new_struct;
+			new_struct.default_constructor = function_id_constants::deleted;
+			new_struct.has_compiler_generated_constructors = false;
+
+			placeholder_type = add_struct_type(*program, std::move(new_type), std::move(new_struct)).first;
+			template_cache.layout_placeholders.push_back({size, alignment, placeholder_type});
+		}
+
+		placeholder_type.is_mutable = type.is_mutable;
+		return placeholder_type;
+	}
+
+	enum struct LayoutDependency : unsigned char { none, substitutable, unsupported };
+
+	// Checks that an instantiation for layout placeholders only uses them in ways that do not depend on the actual type,
+	// and builds the instantiation for actual types from it.
+	struct LayoutGenericBody
+	{
+		span<complete::TypeId const> placeholders;
+		complete::Program & program;
+		size_t first_new_struct; // Structs and struct templates declared while analyzing the placeholder instantiation may refer to the placeholders.
+		size_t first_new_struct_template;
+		size_t first_new_function;
+		std::unordered_map<unsigned, LayoutDependency> type_dependencies;
+		std::vector<bool> checked_functions;
+
+		auto dependency(complete::TypeId id) -> LayoutDependency
+		{
+			if (id.is_function)
+				return LayoutDependency::none;
+
+			for (complete::TypeId const placeholder : placeholders)
+				if (id.index == placeholder.index)
+					return LayoutDependency::substitutable;
+
+			auto const [it, inserted] = type_dependencies.emplace(static_cast<unsigned>(id.index), LayoutDependency::none);
+			if (!inserted)
+				return it->second;
+
+			// Stays none while the type is visited so that types that point to themselves terminate.
+			LayoutDependency result = LayoutDependency::none;
+			auto const visitor = overload(
+				[](complete::Type::BuiltIn) { return LayoutDependency::none; },
+				[&](complete::Type::Pointer pointer) { return dependency(pointer.value_type); },
+				[&](complete::Type::ArrayPointer pointer) { return dependency(pointer.value_type); },
+				[&](complete::Type::Array const & array) { return dependency(array.value_type); },
+				[&](complete::Type::Struct struct_type)
+				{
+					complete::Type const & type = program.types[id.index];
+					if (type.template_instantiation)
+					{
+						if (type.template_instantiation->template_id.index >= first_new_struct_template)
+							return LayoutDependency::unsupported;
+						for (complete::TypeId const parameter : type.template_instantiation->parameters)
+							if (dependency(parameter) != LayoutDependency::none)
+								return LayoutDependency::unsupported;
+					}
+					else if (static_cast<size_t>(struct_type.struct_index) >= first_new_struct)
+					{
+						return LayoutDependency::unsupported;
+					}
+					return LayoutDependency::none;
+				}
+			);
+			result = std::visit(visitor, program.types[id.index].extra_data);
+			type_dependencies[id.index] = result;
+			return result;
+		}
+
+		auto is_independent(complete::TypeId id) -> bool { return dependency(id) == LayoutDependency::none; }
+
+		// Functions called from the placeholder instantiation must not depend on the placeholders at all.
+		// Only the ones analyzed along with it need to be checked, since the ones that already existed cannot refer to them.
+		auto is_independent_function(FunctionId id) -> bool
+		{
+			if (id.type != FunctionId::Type::program || id.index < first_new_function)
+				return true;
+
+			size_t const checked_index = id.index - first_new_function;
+			if (checked_index < checked_functions.size() && checked_functions[checked_index])
+				return true;
+			if (checked_index >= checked_functions.size())
+				checked_functions.resize(checked_index + 1, false);
+			checked_functions[checked_index] = true;
+
+			complete::Function const & function = program.functions[id.index];
+			return is_layout_generic(function) && is_independent(function.return_type)
+				&& std::all_of(function.variables.begin(), function.variables.end(), [this](complete::Variable const & var) { return is_independent(var.type); });
+		}
+
+		auto is_layout_generic(complete::Scope const & scope) -> bool
+		{
+			for (complete::Variable const & variable : scope.variables)
+				if (dependency(variable.type) == LayoutDependency::unsupported)
+					return false;
+			return true;
+		}
+
+		auto is_layout_generic(complete::Expression const & expression) -> bool
+		{
+			if (dependency(expression_type_id(expression, program)) == LayoutDependency::unsupported)
+				return false;
+
+			auto const all_layout_generic = [this](std::vector<complete::Expression> const & expressions)
+			{
+				return std::all_of(expressions.begin(), expressions.end(), [this](complete::Expression const & expr) { return is_layout_generic(expr); });
+			};
+			// Overload resolution on a placeholder may choose a different function than on the actual type, so
+			// arguments may not depend on them. This also rejects conversions, which are calls to conversion functions.
+			auto const is_independent_call = [&](FunctionId function_id, std::vector<complete::Expression> const & parameters)
+			{
+				for (complete::Expression const & parameter : parameters)
+					if (!is_independent(expression_type_id(parameter, program)))
+						return false;
+				return is_independent_function(function_id) && all_layout_generic(parameters);
+			};
+
+			auto const visitor = overload(
+				[&](complete::expression::Literal<complete::TypeId> literal) { return is_independent(literal.value); },
+				[&](complete::expression::Constant const & constant) { return constant.type.index != complete::TypeId::type.index; },
+				[&](complete::expression::ConstantTemporary const & constant) { return constant.type.index != complete::TypeId::type.index; },
+				[&](complete::expression::MemberVariable const & variable) { return is_layout_generic(*variable.owner); },
+				[&](complete::expression::FunctionCall const & call) { return is_independent_call(call.function_id, call.parameters); },
+				[&](complete::expression::RelationalOperatorCall const & call) { return is_independent_call(call.function_id, call.parameters); },
+				[&](complete::expression::Constructor const & constructor) { return is_independent(constructor.constructed_type) && all_layout_generic(constructor.parameters); },
+				[&](complete::expression::Assignment const & assignment) { return is_layout_generic(*assignment.destination) && is_layout_generic(*assignment.source); },
+				[&](complete::expression::Dereference const & dereference) { return is_layout_generic(*dereference.expression); },
+				[&](complete::expression::ReinterpretCast const & cast) { return is_layout_generic(*cast.operand); },
+				[&](complete::expression::Subscript const & subscript) { return is_layout_generic(*subscript.array) && is_layout_generic(*subscript.index); },
+				[&](complete::expression::PointerPlusInt const & arithmetic) { return is_layout_generic(*arithmetic.pointer) && is_layout_generic(*arithmetic.index); },
+				[&](complete::expression::PointerMinusInt const & arithmetic) { return is_layout_generic(*arithmetic.pointer) && is_layout_generic(*arithmetic.index); },
+				[&](complete::expression::PointerMinusPointer const & arithmetic) { return is_layout_generic(*arithmetic.left) && is_layout_generic(*arithmetic.right); },
+				[&](complete::expression::If const & if_node)
+				{
+					return is_layout_generic(*if_node.condition) && is_layout_generic(*if_node.then_case) && is_layout_generic(*if_node.else_case);
+				},
+				[&](complete::expression::StatementBlock const & block) { return is_layout_generic(block.scope) && is_layout_generic(block.statements); },
+				[](complete::expression::Compiles const &) { return false; },
+				[](auto const &) { return true; }
+			);
+			return std::visit(visitor, expression.as_variant());
+		}
+
+		auto is_layout_generic(std::vector<complete::Statement> const & statements) -> bool
+		{
+			return std::all_of(statements.begin(), statements.end(), [this](complete::Statement const & statement) { return is_layout_generic(statement); });
+		}
+
+		auto is_layout_generic(complete::Statement const & statement) -> bool
+		{
+			auto const optional = [this](value_ptr<complete::Statement> const & substatement) { return substatement == nullptr || is_layout_generic(*substatement); };
+			auto const visitor = overload(
+				[&](complete::statement::VariableDeclaration const & declaration) { return is_layout_generic(declaration.assigned_expression); },
+				[&](complete::statement::PlacementLet const & placement)
+				{
+					return is_layout_generic(placement.address_expression) && is_layout_generic(placement.assigned_expression);
+				},
+				[&](complete::statement::ExpressionStatement const & expression_statement) { return is_layout_generic(expression_statement.expression); },
+				[&](complete::statement::If const & if_node)
+				{
+					return is_layout_generic(if_node.condition) && optional(if_node.then_case) && optional(if_node.else_case);
+				},
+				[&](complete::statement::StatementBlock const & block) { return is_layout_generic(block.scope) && is_layout_generic(block.statements); },
+				[&](complete::statement::While const & while_node) { return is_layout_generic(while_node.condition) && optional(while_node.body); },
+				[&](complete::statement::For const & for_node)
+				{
+					return is_layout_generic(for_node.scope) && optional(for_node.init_statement) && is_layout_generic(for_node.condition)
+						&& is_layout_generic(for_node.end_expression) && optional(for_node.body);
+				},
+				[&](complete::statement::Return const & return_node) { return is_layout_generic(return_node.returned_expression); },
+				[](complete::statement::Break const &) { return true; },
+				[](complete::statement::Continue const &) { return true; }
+			);
+			return std::visit(visitor, statement.as_variant());
+		}
+
+		auto is_layout_generic(complete::Function const & function) -> bool
+		{
+			return dependency(function.return_type) != LayoutDependency::unsupported
+				&& is_layout_generic(static_cast<complete::Scope const &>(function))
+				&& std::all_of(function.preconditions.begin(), function.preconditions.end(), [this](complete::Expression const & expr) { return is_layout_generic(expr); })
+				&& is_layout_generic(function.statements);
+		}
+	};
+
+	// Replaces the layout placeholders in the types of a function by actual types. Pointers and arrays of placeholders
+	// become pointers and arrays of the actual types.
+	struct LayoutSubstitution
+	{
+		span<complete::TypeId const> placeholders;
+		span<complete::TypeId const> parameters;
+		complete::Program & program;
+
+		auto substitute(complete::TypeId id) -> complete::TypeId
+		{
+			if (id.is_function)
+				return id;
+
+			for (size_t i = 0; i < placeholders.size(); ++i)
+			{
+				if (id.index == placeholders[i].index)
+				{
+					complete::TypeId substituted = parameters[i];
+					substituted.is_mutable = id.is_mutable;
+					substituted.is_reference = id.is_reference;
+					return substituted;
+				}
+			}
+
+			complete::TypeId substituted = id;
+			auto const extra_data = program.types[id.index].extra_data;
+			if (complete::Type::Pointer const * const pointer = try_get<complete::Type::Pointer>(extra_data))
+			{
+				complete::TypeId const value_type = substitute(pointer->value_type);
+				if (value_type != pointer->value_type)
+					substituted = pointer_type_for(value_type, program);
+			}
+			else if (complete::Type::ArrayPointer const * const array_pointer = try_get<complete::Type::ArrayPointer>(extra_data))
+			{
+				complete::TypeId const value_type = substitute(array_pointer->value_type);
+				if (value_type != array_pointer->value_type)
+					substituted = array_pointer_type_for(value_type, program);
+			}
+			else if (complete::Type::Array const * const array = try_get<complete::Type::Array>(extra_data))
+			{
+				complete::TypeId const value_type = substitute(array->value_type);
+				if (value_type != array->value_type)
+					substituted = array_type_for(value_type, array->size, program);
+			}
+			substituted.is_mutable = id.is_mutable;
+			substituted.is_reference = id.is_reference;
+			return substituted;
+		}
+
+		auto substitute(complete::Scope & scope) -> void
+		{
+			for (complete::Variable & variable : scope.variables)
+				variable.type = substitute(variable.type);
+		}
+
+		auto substitute(std::vector<complete::Expression> & expressions) -> void
+		{
+			for (complete::Expression & expression : expressions)
+				substitute(expression);
+		}
+
+		auto substitute(complete::Expression & expression) -> void
+		{
+			auto const visitor = overload(
+				[&](complete::expression::LocalVariable & variable) { variable.variable_type = substitute(variable.variable_type); },
+				[&](complete::expression::GlobalVariable & variable) { variable.variable_type = substitute(variable.variable_type); },
+				[&](complete::expression::MemberVariable & variable)
+				{
+					variable.variable_type = substitute(variable.variable_type);
+					substitute(*variable.owner);
+				},
+				// The value has the layout of the placeholder, which is the same as the one of the actual type.
+				[&](complete::expression::Constant & constant) { constant.type = substitute(constant.type); },
+				[&](complete::expression::ConstantTemporary & constant) { constant.type = substitute(constant.type); },
+				[&](complete::expression::FunctionCall & call) { substitute(call.parameters); },
+				[&](complete::expression::RelationalOperatorCall & call) { substitute(call.parameters); },
+				[&](complete::expression::Constructor & constructor) { substitute(constructor.parameters); },
+				[&](complete::expression::Assignment & assignment) { substitute(*assignment.destination); substitute(*assignment.source); },
+				[&](complete::expression::Dereference & dereference)
+				{
+					dereference.return_type = substitute(dereference.return_type);
+					substitute(*dereference.expression);
+				},
+				[&](complete::expression::ReinterpretCast & cast)
+				{
+					cast.return_type = substitute(cast.return_type);
+					substitute(*cast.operand);
+				},
+				[&](complete::expression::Subscript & subscript)
+				{
+					subscript.return_type = substitute(subscript.return_type);
+					substitute(*subscript.array);
+					substitute(*subscript.index);
+				},
+				[&](complete::expression::PointerPlusInt & arithmetic)
+				{
+					arithmetic.return_type = substitute(arithmetic.return_type);
+					substitute(*arithmetic.pointer);
+					substitute(*arithmetic.index);
+				},
+				[&](complete::expression::PointerMinusInt & arithmetic)
+				{
+					arithmetic.return_type = substitute(arithmetic.return_type);
+					substitute(*arithmetic.pointer);
+					substitute(*arithmetic.index);
+				},
+				[&](complete::expression::PointerMinusPointer & arithmetic) { substitute(*arithmetic.left); substitute(*arithmetic.right); },
+				[&](complete::expression::If & if_node)
+				{
+					substitute(*if_node.condition);
+					substitute(*if_node.then_case);
+					substitute(*if_node.else_case);
+				},
+				[&](complete::expression::StatementBlock & block)
+				{
+					block.return_type = substitute(block.return_type);
+					substitute(block.scope);
+					substitute(block.statements);
+				},
+				[](auto &) {}
+			);
+			std::visit(visitor, expression.as_variant());
+		}
+
+		auto substitute(std::vector<complete::Statement> & statements) -> void
+		{
+			for (complete::Statement & statement : statements)
+				substitute(statement);
+		}
+
+		auto substitute(complete::Statement & statement) -> void
+		{
+			auto const optional = [this](value_ptr<complete::Statement> & substatement) { if (substatement != nullptr) substitute(*substatement); };
+			auto const visitor = overload(
+				[&](complete::statement::VariableDeclaration & declaration) { substitute(declaration.assigned_expression); },
+				[&](complete::statement::PlacementLet & placement) { substitute(placement.address_expression); substitute(placement.assigned_expression); },
+				[&](complete::statement::ExpressionStatement & expression_statement) { substitute(expression_statement.expression); },
+				[&](complete::statement::If & if_node) { substitute(if_node.condition); optional(if_node.then_case); optional(if_node.else_case); },
+				[&](complete::statement::StatementBlock & block) { substitute(block.scope); substitute(block.statements); },
+				[&](complete::statement::While & while_node) { substitute(while_node.condition); optional(while_node.body); },
+				[&](complete::statement::For & for_node)
+				{
+					substitute(for_node.scope);
+					optional(for_node.init_statement);
+					substitute(for_node.condition);
+					substitute(for_node.end_expression);
+					optional(for_node.body);
+				},
+				[&](complete::statement::Return & return_node) { substitute(return_node.returned_expression); },
+				[](complete::statement::Break &) {},
+				[](complete::statement::Continue &) {}
+			);
+			std::visit(visitor, statement.as_variant());
+		}
+
+		auto substitute(complete::Function & function) -> void
+		{
+			substitute(static_cast<complete::Scope &>(function));
+			for (complete::TypeId & parameter_type : function.parameter_types)
+				parameter_type = substitute(parameter_type);
+			function.return_type = substitute(function.return_type);
+			substitute(function.preconditions);
+			substitute(function.statements);
+		}
+	};
+
+	// Size and alignment of a type, encoded as a type id to be used as the key of a template instantiation table.
+	auto layout_key(complete::TypeId type, complete::Program const & program) noexcept -> std::optional<complete::TypeId>
+	{
+		constexpr int alignment_bits = 5;
+		unsigned const size = static_cast<unsigned>(type_size(program, type));
+		unsigned const alignment = static_cast<unsigned>(type_alignment(program, type));
+		if (size >= (1u << (29 - alignment_bits)))
+			return std::nullopt;
+
+		unsigned alignment_log2 = 0;
+		while ((1u << alignment_log2) < alignment)
+			++alignment_log2;
+
+		complete::TypeId key = complete::TypeId::with_index((size << alignment_bits) | alignment_log2);
+		key.is_mutable = type.is_mutable;
+		return key;
+	}
+
+	auto depends_on_layout_placeholder(complete::TypeId type, complete::Program const & program, TemplateCache const & template_cache) noexcept -> bool
+	{
+		if (type.is_function)
+			return false;
+
+		if (template_cache.find_layout_placeholder(type) != nullptr)
+			return true;
+
+		complete::Type const & type_data = program.types[type.index];
+		if (type_data.template_instantiation)
+			return std::any_of(type_data.template_instantiation->parameters.begin(), type_data.template_instantiation->parameters.end(),
+				[&](complete::TypeId parameter) { return depends_on_layout_placeholder(parameter, program, template_cache); });
+
+		auto const visitor = overload(
+			[&](complete::Type::Pointer pointer) { return depends_on_layout_placeholder(pointer.value_type, program, template_cache); },
+			[&](complete::Type::ArrayPointer pointer) { return depends_on_layout_placeholder(pointer.value_type, program, template_cache); },
+			[&](complete::Type::Array const & array) { return depends_on_layout_placeholder(array.value_type, program, template_cache); },
+			[](auto const &) { return false; }
+		);
+		return std::visit(visitor, type_data.extra_data);
+	}
+
+	auto depends_on_layout_placeholders(span<complete::TypeId const> types, complete::Program const & program, TemplateCache & template_cache) noexcept -> bool
+	{
+		if (!template_cache.is_analyzing_layout_placeholders)
+			return false;
+
+		for (complete::TypeId const type : types)
+		{
+			if (depends_on_layout_placeholder(type, program, template_cache))
+			{
+				template_cache.analysis_depends_on_actual_types = true;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Literals evaluate to the same value whatever the types that the placeholders stand for.
+	// Any other expression may depend on them, like a comparison of type_of(x) with a type.
+	auto note_compile_time_evaluation(complete::Expression const & expression, TemplateCache & template_cache) noexcept -> void
+	{
+		if (!template_cache.is_analyzing_layout_placeholders)
+			return;
+
+		auto const visitor = overload(
+			[](complete::expression::Literal<int> const &) { return true; },
+			[](complete::expression::Literal<float> const &) { return true; },
+			[](complete::expression::Literal<bool> const &) { return true; },
+			[](complete::expression::Literal<char_t> const &) { return true; },
+			[](complete::expression::Literal<complete::TypeId> const &) { return true; },
+			[](complete::expression::StringLiteral const &) { return true; },
+			[](complete::expression::Literal<null_t> const &) { return true; },
+			[](complete::expression::Constant const &) { return true; },
+			[](complete::expression::ConstantTemporary const &) { return true; },
+			[](auto const &) { return false; }
+		);
+		if (!std::visit(visitor, expression.as_variant()))
+			template_cache.analysis_depends_on_actual_types = true;
+	}
+
+	auto instantiate_layout_generic_function_template(FunctionTemplateId template_id, span<complete::TypeId const> parameters, out<complete::Program> program, TemplateCache & template_cache) noexcept
+		-> std::optional<complete::Function>
+	{
+		// Placeholder instantiations are analyzed normally, as is anything they instantiate.
+		if (template_cache.is_analyzing_layout_placeholders)
+			return std::nullopt;
+
+		std::vector<complete::TypeId> layout_keys;
+		layout_keys.reserve(parameters.size());
+		for (complete::TypeId const parameter : parameters)
+		{
+			if (!is_trivially_copyable_value(*program, parameter))
+				return std::nullopt;
+
+			std::optional<complete::TypeId> const key = layout_key(parameter, *program);
+			if (!key)
+				return std::nullopt;
+			layout_keys.push_back(*key);
+		}
+
+		int generic_function_index;
+		if (int const * const cached_index = template_cache.find_layout_generic_instantiation(template_id, layout_keys))
+		{
+			generic_function_index = *cached_index;
+		}
+		else
+		{
+			// Placeholders are created inside the rolled back region, so nothing is left behind if the template is not layout generic.
+			ProgramState const program_state = capture_state(*program);
+			TemplateCacheState const template_cache_state = capture_state(template_cache);
+
+			std::vector<complete::TypeId> placeholders;
+			placeholders.reserve(parameters.size());
+			for (complete::TypeId const parameter : parameters)
+				placeholders.push_back(layout_placeholder_for(parameter, program, template_cache));
+
+			template_cache.is_analyzing_layout_placeholders = true;
+			template_cache.analysis_depends_on_actual_types = false;
+			auto placeholder_instantiation = complete::analyze_function_template_instantiation(*program, template_id, placeholders, template_cache);
+			template_cache.is_analyzing_layout_placeholders = false;
+
+			LayoutGenericBody check{placeholders, *program, program_state.structs, program_state.struct_templates, program_state.functions, {}, {}};
+			if (placeholder_instantiation && !template_cache.analysis_depends_on_actual_types && check.is_layout_generic(*placeholder_instantiation))
+			{
+				generic_function_index = static_cast<int>(template_cache.layout_generic_function_count());
+				template_cache.layout_generic_functions.push_back({std::move(placeholders), std::move(*placeholder_instantiation)});
+			}
+			else
+			{
+				// The body depends on more than the layout of the parameters, or does not compile for placeholders.
+				restore_state(program, program_state);
+				restore_state(out(template_cache), template_cache_state);
+				generic_function_index = -1;
+			}
+			template_cache.layout_generic_instantiations.insert(template_id, layout_keys, generic_function_index);
+		}
+
+		if (generic_function_index == -1)
+			return std::nullopt;
+
+		LayoutGenericFunction const & generic_function = template_cache.layout_generic_function(generic_function_index);
+		complete::Function function = generic_function.function;
+		LayoutSubstitution{generic_function.placeholders, parameters, *program}.substitute(function);
+		return function;
+	}
+
+	auto analyze_deferred_function_body(FunctionId function_id, out<complete::Program> program, TemplateCache & template_cache)
+		-> expected<void, PartialSyntaxError>
+	{
+		if (function_id.type != FunctionId::Type::program || function_id == function_id_constants::invalid || function_id == function_id_constants::deleted)
+			return success;
+
+		int const deferred_body_index = program->functions[function_id.index].deferred_body;
+		if (deferred_body_index == -1 || program->deferred_function_bodies[deferred_body_index].is_analyzed)
+			return success;
+
+		// Marked as analyzed before analyzing it so that recursive calls do not try to analyze it again.
+		complete::DeferredFunctionBody & deferred_body = program->deferred_function_bodies[deferred_body_index];
+		assert(deferred_body.incomplete_function != nullptr);
+		deferred_body.is_analyzed = true;
+		program->analyzed_deferred_function_bodies.push_back(deferred_body_index);
+
+		// Analyzing the body may add functions, so work on a copy of the prototype and move it into place at the end.
+		incomplete::Function const & incomplete_function = *deferred_body.incomplete_function;
+		ScopeStack scope_stack = deferred_body.scope_stack;
+		std::vector<complete::ResolvedTemplateParameter> template_parameters;
+		complete::Function function = program->functions[function_id.index];
+
+		try_call_void(instantiate_function_body(incomplete_function, {template_parameters, scope_stack, program, template_cache}, out(function)));
+		program->functions[function_id.index] = std::move(function);
+
+		return success;
+	}
+
 	auto instantiate_function_template(
 		incomplete::Function const & incomplete_function,
 		SemanticAnalysisArgs args
@@ -1640,7 +2480,9 @@ namespace instantiation
 			[&](incomplete::expression::IdentifierInsideStruct const & incomplete_expression) -> expected<complete::Expression, PartialSyntaxError>
 			{
 				try_call_decl(complete::TypeId const struct_type,
-					resolve_dependent_type(incomplete_expression.type, args));
+					resolve_dependent_type(*incomplete_expression.type, args));
+
+				try_call_void(instantiate_named_constructors(*program, struct_type, incomplete_expression.name, args.template_cache));
 
 				complete::Struct const * struct_data = struct_for_type(*program, struct_type);
 
@@ -1713,6 +2555,7 @@ namespace instantiation
 				{
 					FunctionId const function = resolve_function_overloading_and_insert_conversions(
 						operator_overload_set(Operator::dereference, scope_stack), {&operand, 1}, {&operand_type_id, 1}, *program, args.template_cache);
+					try_call_void(analyze_deferred_function_body(function, program, args.template_cache));
 
 					if (function == function_id_constants::invalid)
 						return make_syntax_error(incomplete_expression_.source, "Overload not found for dereference operator.");
@@ -1768,6 +2611,7 @@ namespace instantiation
 					complete::Expression params[] = { std::move(array), std::move(index) };
 
 					FunctionId const function = resolve_function_overloading_and_insert_conversions(*named_overload_set("[]"sv, scope_stack), params, param_types, *program, args.template_cache);
+					try_call_void(analyze_deferred_function_body(function, program, args.template_cache));
 
 					if (function == function_id_constants::invalid)
 						return make_syntax_error(incomplete_expression_.source, "Overload not found for subscript operator.");
@@ -1782,7 +2626,7 @@ namespace instantiation
 			},
 			[&](incomplete::expression::Function const & incomplete_expression) -> expected<complete::Expression, PartialSyntaxError>
 			{
-				try_call_decl(complete::Function complete_function, instantiate_function_template(incomplete_expression.function, args));
+				try_call_decl(complete::Function complete_function, instantiate_function_template(*incomplete_expression.function, args));
 				FunctionId const function_id = add_function(*program, std::move(complete_function));
 
 				complete::OverloadSet overload_set;
@@ -1796,19 +2640,19 @@ namespace instantiation
 			{
 				complete::FunctionTemplate new_function_template;
 				new_function_template.scope_template_parameters = args.template_parameters;
-				new_function_template.incomplete_function = incomplete_expression.function_template;
-				new_function_template.scope_stack = scope_stack;
-				new_function_template.parameter_types.reserve(incomplete_expression.function_template.parameters.size());
-				for (incomplete::FunctionParameter const & param : incomplete_expression.function_template.parameters)
+				new_function_template.incomplete_function = shared_incomplete_template(*incomplete_expression.function_template, args);
+				new_function_template.scope_stack = std::make_shared<ScopeStack const>(scope_stack);
+				new_function_template.parameter_types.reserve(incomplete_expression.function_template->parameters.size());
+				for (incomplete::FunctionParameter const & param : incomplete_expression.function_template->parameters)
 				{
 					try_call(new_function_template.parameter_types.push_back, resolve_function_template_parameter_type(
 						param.type,
-						incomplete_expression.function_template.template_parameters,
+						incomplete_expression.function_template->template_parameters,
 						args
 					));
 				}
 
-				try_call(assign_to(new_function_template.concepts), resolve_concepts(incomplete_expression.function_template.template_parameters, args));
+				try_call(assign_to(new_function_template.concepts), resolve_concepts(incomplete_expression.function_template->template_parameters, args));
 
 				FunctionTemplateId const template_id = add_function_template(*program, std::move(new_function_template));
 
@@ -1821,12 +2665,9 @@ namespace instantiation
 			},
 			[&](incomplete::expression::ExternFunction const & incomplete_expression) -> expected<complete::Expression, PartialSyntaxError>
 			{
-				incomplete::ExternFunction const & incomplete_extern_function = incomplete_expression.function;
+				incomplete::ExternFunction const & incomplete_extern_function = *incomplete_expression.function;
 
 				complete::ExternFunction extern_function;
-				extern_function.function_pointer = load_symbol(incomplete_extern_function.ABI_name);
-				if (!extern_function.function_pointer)
-					return make_syntax_error(incomplete_extern_function.ABI_name_source, join("Cannot find extern symbol \"", incomplete_extern_function.ABI_name, "\"."));
 				extern_function.ABI_name = incomplete_extern_function.ABI_name;
 
 				complete::Function function;
@@ -1835,20 +2676,10 @@ namespace instantiation
 				extern_function.parameter_alignment = function.stack_frame_alignment;
 				extern_function.return_type = function.return_type;
 
-				extern_function.parameter_types.reserve(function.parameter_count);
-				for (int i = 0; i < function.parameter_count; ++i)
-					extern_function.parameter_types.push_back(function.variables[i].type);
-
-				if (function.parameter_count > 4)
-					mark_as_to_do("Extern functions with more than 4 parameters");
+				extern_function.parameter_types = function.parameter_types;
 
-				callc::TypeDescriptor parameter_type_descriptors[4];
-				for (int i = 0; i < function.parameter_count; ++i)
-					parameter_type_descriptors[i] = type_descriptor_for(extern_function.parameter_types[i], *program);
-
-				callc::TypeDescriptor const return_type_descriptor = type_descriptor_for(extern_function.return_type, *program);
-
-				extern_function.caller = callc::c_function_caller({parameter_type_descriptors, extern_function.parameter_types.size()}, return_type_descriptor);
+				if (!bind_extern_function(extern_function, *program))
+					return make_syntax_error(incomplete_extern_function.ABI_name_source, join("Cannot find extern symbol \"", incomplete_extern_function.ABI_name, "\"."));
 
 				FunctionId function_id;
 				function_id.type = FunctionId::Type::imported;
@@ -1881,6 +2712,7 @@ namespace instantiation
 
 					FunctionId const function = 
 						resolve_function_overloading_and_insert_conversions(overload_set, {parameters.data() + 1, parameter_types.size()}, parameter_types, *program, args.template_cache);
+					try_call_void(analyze_deferred_function_body(function, program, args.template_cache));
 
 					if (function == function_id_constants::invalid)
 						return make_syntax_error(incomplete_expression.parameters[0].source, "Overload not found.");
@@ -1915,6 +2747,7 @@ namespace instantiation
 				complete::TypeId const operand_type = expression_type_id(operand, *program);
 				FunctionId const function = resolve_function_overloading_and_insert_conversions(
 					operator_overload_set(incomplete_expression.op, scope_stack), {&operand, 1}, {&operand_type, 1}, *program, args.template_cache);
+				try_call_void(analyze_deferred_function_body(function, program, args.template_cache));
 
 				if (function == function_id_constants::invalid)
 					return make_syntax_error(incomplete_expression_.source, "Operator overload not found.");
@@ -1934,6 +2767,7 @@ namespace instantiation
 
 				complete::TypeId const operand_types[] = { expression_type_id(operands[0], *program), expression_type_id(operands[1], *program) };
 				FunctionId function = resolve_function_overloading_and_insert_conversions(operator_overload_set(op, scope_stack), operands, operand_types, *program, args.template_cache);
+				try_call_void(analyze_deferred_function_body(function, program, args.template_cache));
 
 				// Special case for built in assignment.
 				if (function == function_id_constants::invalid && op == Operator::assign && is_trivially_copy_constructible(*program, decay(operand_types[0])))
@@ -1956,6 +2790,8 @@ namespace instantiation
 					if (is_pointer_or_array_pointer(type_with_id(*program, operand_types[0])))
 					{
 						auto conversion = insert_implicit_conversion_node(std::move(operands[1]), decay(operand_types[0]), args);
+						if (auto const body_error = conversion_body_error(conversion))
+							return Error(*body_error);
 						if (conversion.has_value())
 						{
 							function = (op == Operator::equal || op == Operator::not_equal) ? function_id_constants::pointer_equal_intrinsic : function_id_constants::pointer_three_way_compare_intrinsic;
@@ -1967,6 +2803,8 @@ namespace instantiation
 					if (function == function_id_constants::invalid && is_pointer_or_array_pointer(type_with_id(*program, operand_types[1])))
 					{
 						auto conversion = insert_implicit_conversion_node(std::move(operands[0]), decay(operand_types[1]), args);
+						if (auto const body_error = conversion_body_error(conversion))
+							return Error(*body_error);
 						if (conversion.has_value())
 						{
 							function = (op == Operator::equal || op == Operator::not_equal) ? function_id_constants::pointer_equal_intrinsic : function_id_constants::pointer_three_way_compare_intrinsic;
@@ -1983,6 +2821,8 @@ namespace instantiation
 					if (is_array_pointer(type_with_id(*program, operand_types[0])))
 					{
 						auto conversion = insert_implicit_conversion_node(std::move(operands[1]), complete::TypeId::int32, args);
+						if (auto const body_error = conversion_body_error(conversion))
+							return Error(*body_error);
 						if (conversion.has_value())
 						{
 							complete::TypeId const pointer_type = decay(operand_types[0]);
@@ -1999,6 +2839,8 @@ namespace instantiation
 					else if (is_array_pointer(type_with_id(*program, operand_types[1])))
 					{
 						auto conversion = insert_implicit_conversion_node(std::move(operands[0]), complete::TypeId::int32, args);
+						if (auto const body_error = conversion_body_error(conversion))
+							return Error(*body_error);
 						{
 							complete::TypeId const pointer_type = decay(operand_types[1]);
 							try_call(assign_to(operands[1]), insert_implicit_conversion_node(
@@ -2018,6 +2860,8 @@ namespace instantiation
 					// Pointer minus pointer
 					complete::TypeId const pointer_type = decay(operand_types[0]);
 					auto conversion = insert_implicit_conversion_node(std::move(operands[1]), pointer_type, args);
+					if (auto const body_error = conversion_body_error(conversion))
+						return Error(*body_error);
 					if (conversion.has_value())
 					{
 						complete::expression::PointerMinusPointer complete_expression;
@@ -2030,6 +2874,8 @@ namespace instantiation
 					else
 					{
 						conversion = insert_implicit_conversion_node(std::move(operands[1]), complete::TypeId::int32, args);
+						if (auto const body_error = conversion_body_error(conversion))
+							return Error(*body_error);
 						if (conversion.has_value())
 						{
 							try_call(assign_to(operands[0]), insert_implicit_conversion_node(
@@ -2171,6 +3017,10 @@ namespace instantiation
 			},
 			[&](incomplete::expression::Compiles const & incomplete_expression) -> expected<complete::Expression, PartialSyntaxError>
 			{
+				// Whether an expression compiles for a placeholder says nothing about whether it does for the actual types.
+				if (args.template_cache.is_analyzing_layout_placeholders)
+					args.template_cache.analysis_depends_on_actual_types = true;
+
 				std::vector<complete::CompilesFakeVariable> complete_fake_variables;
 				complete_fake_variables.reserve(incomplete_expression.variables.size());
 				for (incomplete::CompilesFakeVariable const & fake_var : incomplete_expression.variables)
@@ -2261,7 +3111,7 @@ namespace instantiation
 				// Hack for recursive functions
 				if (has_type<incomplete::expression::Function>(incomplete_statement.assigned_expression.variant) && incomplete_statement.variable_name != "main")
 				{
-					incomplete::Function const & incomplete_function = try_get<incomplete::expression::Function>(incomplete_statement.assigned_expression.variant)->function;
+					incomplete::Function const & incomplete_function = *try_get<incomplete::expression::Function>(incomplete_statement.assigned_expression.variant)->function;
 
 					complete::Function function;
 					try_call_void(instantiate_function_prototype(incomplete_function, args, out(function)));
@@ -2273,6 +3123,30 @@ namespace instantiation
 					bind_function_name(incomplete_statement.variable_name, function_id, *program, scope_stack);
 					function.ABI_name = incomplete_statement.variable_name;
 
+					// Functions whose return type is deduced need their body to be usable at all, so only the others may be deferred.
+					bool const defer_body =
+						args.function_body_analysis == FunctionBodyAnalysis::lazy &&
+						scope_stack.back().type == ScopeType::global &&
+						args.template_parameters.empty() &&
+						incomplete_function.return_type;
+					if (defer_body)
+					{
+						// Until the body is analyzed nothing is known that would make the function not callable.
+						function.is_callable_at_compile_time = true;
+						function.is_callable_at_runtime = true;
+						function.deferred_body = static_cast<int>(program->deferred_function_bodies.size());
+
+						complete::DeferredFunctionBody deferred_body;
+						deferred_body.function_id = function_id;
+						deferred_body.incomplete_function = &incomplete_function;
+						deferred_body.scope_stack = scope_stack;
+						deferred_body.prototype_stack_frame_alignment = function.stack_frame_alignment;
+						program->deferred_function_bodies.push_back(std::move(deferred_body));
+
+						program->functions[function_id.index] = std::move(function);
+						return std::nullopt;
+					}
+
 					try_call_void(instantiate_function_body(incomplete_function, args, out(function)));
 					program->functions[function_id.index] = std::move(function);
 
@@ -2332,7 +3206,7 @@ namespace instantiation
 					complete::Constant constant;
 					constant.type = var_type;
 					constant.value.resize(type_size(*program, var_type));
-					constant.name = incomplete_statement.variable_name;
+					constant.name = intern(incomplete_statement.variable_name);
 
 					try_call(assign_to(expression), 
 						insert_implicit_conversion_node(std::move(expression), assigned_expression_type, var_type, args, incomplete_statement.assigned_expression.source));
@@ -2343,7 +3217,7 @@ namespace instantiation
 					if (does_name_collide(scope_stack, incomplete_statement.variable_name)) 
 						return make_syntax_error(incomplete_statement.variable_name, "Constant name collides with another name.");
 
-					top(scope_stack).constants.push_back(std::move(constant));
+					add_constant_to_scope(top(scope_stack), std::move(constant));
 
 					return std::nullopt;
 				}
@@ -2552,35 +3426,35 @@ namespace instantiation
 			},
 			[&](incomplete::statement::StructDeclaration const & incomplete_statement) -> expected<std::optional<complete::Statement>, PartialSyntaxError>
 			{
-				if (does_name_collide(scope_stack, incomplete_statement.declared_struct.name))
-					return make_syntax_error(incomplete_statement.declared_struct.name, "Struct name collides with another name.");
+				if (does_name_collide(scope_stack, incomplete_statement.declared_struct->name))
+					return make_syntax_error(incomplete_statement.declared_struct->name, "Struct name collides with another name.");
 
-				try_call_decl(InstantiatedStruct new_struct, instantiate_incomplete_struct_variables(incomplete_statement.declared_struct, args));
+				try_call_decl(InstantiatedStruct new_struct, instantiate_incomplete_struct_variables(*incomplete_statement.declared_struct, args));
 
 				complete::Type new_type;
 				new_type.size = new_struct.size;
 				new_type.alignment = new_struct.alignment;
-				new_type.ABI_name = incomplete_statement.declared_struct.name;
+				new_type.ABI_name = incomplete_statement.declared_struct->name;
 				
 				auto const[new_type_id, new_struct_id] = add_struct_type(*program, std::move(new_type), std::move(new_struct.complete_struct));
-				bind_type_name(incomplete_statement.declared_struct.name, new_type_id, *program, scope_stack);
+				bind_type_name(incomplete_statement.declared_struct->name, new_type_id, *program, scope_stack);
 
-				try_call_void(instantiate_incomplete_struct_functions(incomplete_statement.declared_struct, new_type_id, new_struct_id, args));
+				try_call_void(instantiate_incomplete_struct_functions(*incomplete_statement.declared_struct, new_type_id, new_struct_id, args));
 
 				return std::nullopt;
 			},
 			[&](incomplete::statement::StructTemplateDeclaration const & incomplete_statement) -> expected<std::optional<complete::Statement>, PartialSyntaxError>
 			{
-				if (does_name_collide(scope_stack, incomplete_statement.declared_struct_template.name)) 
-					return make_syntax_error(incomplete_statement.declared_struct_template.name, "Struct template name collides with another name.");
+				if (does_name_collide(scope_stack, incomplete_statement.declared_struct_template->name)) 
+					return make_syntax_error(incomplete_statement.declared_struct_template->name, "Struct template name collides with another name.");
 
 				complete::StructTemplate new_template;
-				new_template.incomplete_struct = incomplete_statement.declared_struct_template;
+				new_template.incomplete_struct = shared_incomplete_template(*incomplete_statement.declared_struct_template, args);
 				new_template.scope_template_parameters = args.template_parameters;
-				new_template.scope_stack = scope_stack;
-				try_call(assign_to(new_template.concepts), resolve_concepts(incomplete_statement.declared_struct_template.template_parameters, args));
+				new_template.scope_stack = std::make_shared<ScopeStack const>(scope_stack);
+				try_call(assign_to(new_template.concepts), resolve_concepts(incomplete_statement.declared_struct_template->template_parameters, args));
 				auto const id = add_struct_template(*program, std::move(new_template));
-				bind_struct_template_name(incomplete_statement.declared_struct_template.name, id, *program, scope_stack);
+				bind_struct_template_name(incomplete_statement.declared_struct_template->name, id, *program, scope_stack);
 
 				return std::nullopt;
 			},
@@ -2609,9 +3483,13 @@ namespace instantiation
 					scope_stack.push_back({current_namespace, ScopeType::global, 0});
 				}
 
+				// Namespaces are stored by value in their parent, so a deferred body could not keep pointing to their scope.
+				SemanticAnalysisArgs namespace_args = args;
+				namespace_args.function_body_analysis = FunctionBodyAnalysis::eager;
+
 				for (incomplete::Statement const & incomplete_substatement : incomplete_statement.statements)
 				{
-					try_call_decl(auto complete_substatement, instantiate_statement(incomplete_substatement, args, current_scope_return_type));
+					try_call_decl(auto complete_substatement, instantiate_statement(incomplete_substatement, namespace_args, current_scope_return_type));
 					if (complete_substatement.has_value())
 						program->global_initialization_statements.push_back(std::move(*complete_substatement));
 				}
@@ -2650,14 +3528,14 @@ namespace instantiation
 					complete::FunctionTemplate & function_template = program->function_templates[function_id.index];
 					if (function_template.parameter_types.size() != 1)
 						return make_syntax_error(incomplete_statement.conversion_function.source, "A conversion function must take exactly one parameter.");
-					if (!function_template.incomplete_function.return_type)
+					if (!function_template.incomplete_function->return_type)
 						return make_syntax_error(incomplete_statement.conversion_function.source, "A conversion function template must define its return type explicitly.");
-                    if (!has_type<incomplete::expression::Literal<incomplete::TypeId>>(function_template.incomplete_function.return_type->variant))
+                    if (!has_type<incomplete::expression::Literal<incomplete::TypeId>>(function_template.incomplete_function->return_type->variant))
                         return make_syntax_error(incomplete_statement.conversion_function.source, "The return type of a conversion function template must be a type literal.");
 
 					try_call(function_template.parameter_types.push_back, resolve_function_template_parameter_type(
-						try_get<incomplete::expression::Literal<incomplete::TypeId>>(function_template.incomplete_function.return_type->variant)->value,
-						function_template.incomplete_function.template_parameters,
+						try_get<incomplete::expression::Literal<incomplete::TypeId>>(function_template.incomplete_function->return_type->variant)->value,
+						function_template.incomplete_function->template_parameters,
 						args
 					));
 					
@@ -2675,7 +3553,8 @@ namespace instantiation
 		span<incomplete::Statement const> incomplete_program, 
 		out<complete::Program> complete_program, 
 		ScopeStack & scope_stack,
-		TemplateCache & template_cache
+		TemplateCache & template_cache,
+		FunctionBodyAnalysis function_body_analysis
 	) noexcept -> expected<void, PartialSyntaxError>
 	{
 		std::vector<complete::ResolvedTemplateParameter> template_parameters;
@@ -2693,9 +3572,9 @@ namespace instantiation
 			{
 				ProgramState const program_state = capture_state(*complete_program);
 				ScopeState const global_scope_state = capture_state(top(scope_stack));
-				TemplateCache const template_cache_state = template_cache;
+				TemplateCacheState const template_cache_state = capture_state(template_cache);
 
-				auto complete_statement = instantiate_statement(incomplete_program[i], SemanticAnalysisArgs{template_parameters, scope_stack, out(complete_program), template_cache}, nullptr);
+				auto complete_statement = instantiate_statement(incomplete_program[i], SemanticAnalysisArgs{template_parameters, scope_stack, out(complete_program), template_cache, function_body_analysis}, nullptr);
 				if (complete_statement.has_value())
 				{
 					if (complete_statement->has_value())
@@ -2713,7 +3592,7 @@ namespace instantiation
 					template_parameters.clear();
 					restore_state(complete_program, program_state);
 					restore_state(out(top(scope_stack)), global_scope_state);
-					template_cache = template_cache_state;
+					restore_state(out(template_cache), template_cache_state);
 					return false;
 				}
 			});
@@ -2744,11 +3623,12 @@ namespace instantiation
 	auto semantic_analysis(span<incomplete::Statement const> incomplete_program, out<complete::Program> complete_program) noexcept -> expected<void, PartialSyntaxError>
 	{
 		ScopeStack scope_stack;
+		push_prelude_scope(scope_stack);
 		scope_stack.push_back({&complete_program->global_scope, ScopeType::global, 0});
 
 		TemplateCache template_cache;
 
-		return semantic_analysis(incomplete_program, complete_program, scope_stack, template_cache);
+		return semantic_analysis(incomplete_program, complete_program, scope_stack, template_cache, FunctionBodyAnalysis::eager);
 	}
 
 	auto push_global_scopes_of_dependent_modules(
@@ -2764,36 +3644,162 @@ namespace instantiation
 		scope_stack->push_back({&module_global_scopes[module_index], ScopeType::global, 0});
 	}
 
-	auto semantic_analysis(
+	[[nodiscard]] auto analyze_module(
+		span<incomplete::Module const> incomplete_modules,
+		int module_index,
+		complete::Namespace & global_scope,
+		span<complete::Namespace> module_global_scopes,
+		out<complete::Program> program,
+		TemplateCache & template_cache,
+		FunctionBodyAnalysis function_body_analysis
+	) noexcept -> expected<void, PartialSyntaxError>
+	{
+		ScopeStack scope_stack;
+		push_prelude_scope(scope_stack);
+		scope_stack.push_back({&global_scope, ScopeType::global, 0});
+		push_global_scopes_of_dependent_modules(incomplete_modules, module_index, module_global_scopes, out(scope_stack));
+		return semantic_analysis(incomplete_modules[module_index].statements, program, scope_stack, template_cache, function_body_analysis);
+	}
+
+	// Groups the modules by how deep they are in the dependency graph, in parse order within each group.
+	// The modules of a group don't depend on each other, so they can be analyzed at the same time.
+	auto modules_by_dependency_depth(span<incomplete::Module const> incomplete_modules, span<int const> parse_order) -> std::vector<std::vector<int>>
+	{
+		std::vector<int> depths(incomplete_modules.size(), 0);
+		std::vector<std::vector<int>> groups;
+		for (int i : parse_order)
+		{
+			for (int dependency_index : incomplete_modules[i].dependencies)
+				depths[i] = std::max(depths[i], depths[dependency_index] + 1);
+
+			if (static_cast<size_t>(depths[i]) >= groups.size())
+				groups.resize(depths[i] + 1);
+			groups[depths[i]].push_back(i);
+		}
+		return groups;
+	}
+
+	// Analyzes the modules of each group into one shard of the program per thread, up to thread_count, and merges the shards in order.
+	// Returns false if the analysis of a module fails, without saying why, since the modules may have been analyzed in a different order than
+	// when they are analyzed one at a time.
+	[[nodiscard]] auto analyze_modules_in_parallel(
+		span<incomplete::Module const> incomplete_modules,
+		span<int const> parse_order,
+		span<std::vector<int> const> module_groups,
+		span<complete::Namespace> module_global_scopes,
+		out<complete::Program> program,
+		TemplateCache & template_cache,
+		FunctionBodyAnalysis function_body_analysis,
+		ProgramAllocation program_allocation,
+		int thread_count
+	) noexcept -> bool
+	{
+		std::vector<std::vector<complete::Statement>> module_initialization_statements(incomplete_modules.size());
+
+		for (std::vector<int> const & module_group : module_groups)
+		{
+			if (module_group.size() == 1)
+			{
+				int const module_index = module_group[0];
+				if (!analyze_module(incomplete_modules, module_index, program->global_scope, module_global_scopes, program, template_cache, function_body_analysis))
+					return false;
+				module_initialization_statements[module_index] = std::move(program->global_initialization_statements);
+				program->global_initialization_statements.clear();
+				continue;
+			}
+
+			// Each shard is a copy of the tables of the program, so there are only as many as threads. Each one analyzes a contiguous part of the group
+			// and they are merged in the order of the group, so that the ids do not depend on which thread finishes first.
+			size_t const shard_count = std::min(module_group.size(), static_cast<size_t>(thread_count));
+			std::vector<ProgramShard> shards(shard_count);
+			std::vector<Task> tasks(shard_count);
+			for (size_t i = 0; i < shard_count; ++i)
+			{
+				size_t const first_module = i * module_group.size() / shard_count;
+				size_t const last_module = (i + 1) * module_group.size() / shard_count;
+				tasks[i].run = [&, i, first_module, last_module]
+				{
+					shards[i] = make_program_shard(*program, template_cache, program_allocation);
+					ProgramShard & shard = shards[i];
+					ScopedValuePtrResource const allocate_from_shard(shard.program.arena.resource.get());
+
+					for (size_t j = first_module; j < last_module; ++j)
+					{
+						int const module_index = module_group[j];
+						shard.modules.push_back(module_index);
+						if (!analyze_module(incomplete_modules, module_index, program->global_scope, module_global_scopes, out(shard.program), shard.template_cache, function_body_analysis))
+							return false;
+						module_initialization_statements[module_index] = std::move(shard.program.global_initialization_statements);
+						shard.program.global_initialization_statements.clear();
+					}
+					return true;
+				};
+			}
+
+			if (run_task_graph(tasks, thread_count).has_value())
+				return false;
+
+			for (ProgramShard & shard : shards)
+				if (!merge_program_shard(std::move(shard), program, template_cache, module_global_scopes, module_initialization_statements))
+					return false;
+		}
+
+		for (int i : parse_order)
+			for (complete::Statement & statement : module_initialization_statements[i])
+				program->global_initialization_statements.push_back(std::move(statement));
+
+		return true;
+	}
+
+	// With one thread, the modules are analyzed into the program one at a time without shards, which is also what finds the error to report.
+	auto analyze_program(
 		span<incomplete::Module const> incomplete_modules,
-		span<int const> parse_order
+		span<int const> parse_order,
+		FunctionBodyAnalysis function_body_analysis,
+		ProgramAllocation program_allocation,
+		int thread_count,
+		FunctionFolding function_folding
 	) noexcept -> expected<complete::Program, SyntaxError>
 	{
 		complete::Program program;
-		std::vector<complete::Namespace> module_global_scopes(incomplete_modules.size());
+		if (program_allocation == ProgramAllocation::arena)
+			program.arena.resource = std::make_unique<std::pmr::monotonic_buffer_resource>();
+		ScopedValuePtrResource const allocate_from_arena(program.arena.resource.get());
 
-		ScopeStack scope_stack;
-		scope_stack.push_back({&program.global_scope, ScopeType::global, 0});
+		std::vector<complete::Namespace> module_global_scopes(incomplete_modules.size());
 
 		TemplateCache template_cache;
 
-		for (int i : parse_order)
+		std::vector<std::vector<int>> const module_groups = (thread_count > 1)
+			? modules_by_dependency_depth(incomplete_modules, parse_order)
+			: std::vector<std::vector<int>>();
+		bool const has_independent_modules = std::any_of(module_groups.begin(), module_groups.end(), [](std::vector<int> const & group) { return group.size() > 1; });
+
+		if (has_independent_modules)
 		{
-			scope_stack.resize(1);
-			push_global_scopes_of_dependent_modules(incomplete_modules, i, module_global_scopes, out(scope_stack));
-			auto analysis_result = semantic_analysis(incomplete_modules[i].statements, out(program), scope_stack, template_cache);
-			if (!analysis_result)
+			// If the analysis fails, the modules are analyzed again one at a time, so that the error is the one that would be found without shards.
+			if (!analyze_modules_in_parallel(incomplete_modules, parse_order, module_groups, module_global_scopes, out(program), template_cache,
+				function_body_analysis, program_allocation, thread_count))
+				return analyze_program(incomplete_modules, parse_order, function_body_analysis, program_allocation, 1, function_folding);
+		}
+		else
+		{
+			for (int i : parse_order)
 			{
-				if (analysis_result.error().error_in_source.empty())
-				{
-					return Error(complete_syntax_error(std::move(analysis_result.error()), "", "<source>"));
-				}
-				else
+				auto analysis_result = analyze_module(incomplete_modules, i, program.global_scope, module_global_scopes, out(program), template_cache, function_body_analysis);
+				if (!analysis_result)
 				{
-					for (int j : parse_order)
-						if (incomplete::Module::File const * file = file_that_contains(incomplete_modules[j], analysis_result.error().error_in_source))
-							return Error(complete_syntax_error(std::move(analysis_result.error()), file->source, file->filename));
-					declare_unreachable();
+					if (analysis_result.error().error_in_source.empty())
+					{
+						return Error(complete_syntax_error(std::move(analysis_result.error()), "", "<source>"));
+					}
+					else
+					{
+						for (int j : parse_order)
+							if (incomplete::Module::File const * file = file_that_contains(incomplete_modules[j], analysis_result.error().error_in_source))
+								return Error(complete_syntax_error(std::move(analysis_result.error()), file->source, file->filename));
+						declare_unreachable();
+					}
 				}
 			}
 		}
@@ -2802,19 +3808,19 @@ namespace instantiation
 		for (complete::Namespace & module_global_scope : module_global_scopes)
 		{
 			for (complete::Constant & constant : module_global_scope.constants)
-				program.global_scope.constants.push_back(std::move(constant));
+				add_constant_to_scope(program.global_scope, std::move(constant));
 
-			for (complete::FunctionName & function : module_global_scope.functions)
-				program.global_scope.functions.push_back(std::move(function));
+			for (complete::FunctionName const & function : module_global_scope.functions)
+				add_function_to_scope(program.global_scope, function.name, function.id);
 
-			for (complete::FunctionTemplateName & function_template : module_global_scope.function_templates)
-				program.global_scope.function_templates.push_back(std::move(function_template));
+			for (complete::FunctionTemplateName const & function_template : module_global_scope.function_templates)
+				add_function_template_to_scope(program.global_scope, function_template.name, function_template.id);
 
-			for (complete::TypeName & type : module_global_scope.types)
-				program.global_scope.types.push_back(std::move(type));
+			for (complete::TypeName const & type : module_global_scope.types)
+				add_type_to_scope(program.global_scope, type.name, type.id);
 
-			for (complete::StructTemplateName & struct_template : module_global_scope.struct_templates)
-				program.global_scope.struct_templates.push_back(std::move(struct_template));
+			for (complete::StructTemplateName const & struct_template : module_global_scope.struct_templates)
+				add_struct_template_to_scope(program.global_scope, struct_template.name, struct_template.id);
 
 			for (complete::Variable const & var : module_global_scope.variables)
 				add_variable_to_scope(program.global_scope, var.name, var.type, 0, program);
@@ -2824,7 +3830,32 @@ namespace instantiation
 				program.global_scope.nested_namespaces.push_back(std::move(nested_namespace));
 		}
 
+		// Deferred bodies point into the incomplete program and the module scopes, which are gone once the analysis ends.
+		for (complete::DeferredFunctionBody & deferred_body : program.deferred_function_bodies)
+		{
+			deferred_body.incomplete_function = nullptr;
+			deferred_body.scope_stack = ScopeStack();
+		}
+
+		if (function_folding == FunctionFolding::fold)
+			complete::fold_identical_functions(program);
+
 		return std::move(program);
 	}
 
+	auto semantic_analysis(
+		span<incomplete::Module const> incomplete_modules,
+		span<int const> parse_order,
+		FunctionBodyAnalysis function_body_analysis,
+		ProgramAllocation program_allocation,
+		int thread_count,
+		FunctionFolding function_folding
+	) noexcept -> expected<complete::Program, SyntaxError>
+	{
+		if (thread_count == 0)
+			thread_count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+		return analyze_program(incomplete_modules, parse_order, function_body_analysis, program_allocation, thread_count, function_folding);
+	}
+
 } // namespace instantiation
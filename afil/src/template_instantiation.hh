@@ -5,8 +5,11 @@
 #include "utils/span.hh"
 #include "scope_stack.hh"
 #include "syntax_error.hh"
+#include <unordered_map>
 #include <vector>
 #include <variant>
+#include <algorithm>
+#include <cassert>
 #include <cstring>
 
 namespace incomplete { struct Module; }
@@ -17,39 +20,268 @@ namespace instantiation
 	
 	//[[nodiscard]] auto semantic_analysis(span<incomplete::Statement const> incomplete_program, out<complete::Program> complete_program) noexcept -> expected<void, PartialSyntaxError>;
 
-	template <typename Id>
-	struct TemplateInstantiation
+	// Open addressing hash table from a template and its parameters to its instantiation.
+	// Keys of up to inline_parameter_count parameters are stored in the instantiation itself and longer ones in a shared
+	// buffer, so looking up an instantiation from a span of parameters never allocates.
+	// Instantiations are kept in insertion order so that rolling back semantic analysis only has to remove the last ones.
+	template <typename Id, typename Value>
+	struct TemplateInstantiationTable
 	{
-		Id id;
-		std::vector<complete::TypeId> parameters;
+		static constexpr size_t inline_parameter_count = 3;
 
-		bool operator < (TemplateInstantiation const & other) const noexcept
+		struct Instantiation
 		{
-			int const a_cmp = memcmp(&id, &other.id, sizeof(Id));
-			if (a_cmp == 0)
-				return memcmp(parameters.data(), other.parameters.data(), parameters.size() * sizeof(complete::TypeId)) < 0;
+			size_t hash;
+			Id id;
+			Value value;
+			unsigned parameter_count;
+			unsigned overflow_offset; // Index in overflow_parameters if parameter_count > inline_parameter_count.
+			complete::TypeId inline_parameters[inline_parameter_count];
+		};
+
+		std::vector<Instantiation> instantiations;
+		std::vector<unsigned> slots; // Index in instantiations plus one, or 0 if the slot is empty.
+		std::vector<complete::TypeId> overflow_parameters;
+
+		auto size() const noexcept -> size_t { return instantiations.size(); }
+
+		auto find(Id id, span<complete::TypeId const> parameters) const noexcept -> Value const *
+		{
+			if (slots.empty())
+				return nullptr;
+
+			size_t const hash = hash_key(id, parameters);
+			size_t const mask = slots.size() - 1;
+			for (size_t i = hash & mask; slots[i] != 0; i = (i + 1) & mask)
+			{
+				Instantiation const & instantiation = instantiations[slots[i] - 1];
+				if (instantiation.hash == hash && matches(instantiation, id, parameters))
+					return &instantiation.value;
+			}
+
+			return nullptr;
+		}
+
+		// Like std::map::emplace, does nothing if the key is already in the table.
+		auto insert(Id id, span<complete::TypeId const> parameters, Value value) -> void
+		{
+			if (find(id, parameters) != nullptr)
+				return;
+
+			// Keep the load factor under 1/2 so that probe sequences stay short.
+			if ((instantiations.size() + 1) * 2 > slots.size())
+				grow();
+
+			Instantiation new_instantiation;
+			new_instantiation.hash = hash_key(id, parameters);
+			new_instantiation.id = id;
+			new_instantiation.value = value;
+			new_instantiation.parameter_count = static_cast<unsigned>(parameters.size());
+			new_instantiation.overflow_offset = 0;
+			if (parameters.size() <= inline_parameter_count)
+			{
+				std::copy(parameters.begin(), parameters.end(), new_instantiation.inline_parameters);
+			}
 			else
-				return a_cmp < 0;
+			{
+				new_instantiation.overflow_offset = static_cast<unsigned>(overflow_parameters.size());
+				overflow_parameters.insert(overflow_parameters.end(), parameters.begin(), parameters.end());
+			}
+
+			instantiations.push_back(new_instantiation);
+			place(instantiations.size() - 1);
+		}
+
+		// Removes the instantiations inserted after the first new_size ones.
+		auto truncate(size_t new_size) noexcept -> void
+		{
+			assert(new_size <= instantiations.size());
+			while (instantiations.size() > new_size)
+			{
+				Instantiation const & last = instantiations.back();
+				size_t const mask = slots.size() - 1;
+				size_t hole = last.hash & mask;
+				while (slots[hole] != instantiations.size())
+					hole = (hole + 1) & mask;
+
+				// Shift back the instantiations after the hole in its probe sequence that can not be reached without it.
+				for (size_t i = (hole + 1) & mask; slots[i] != 0; i = (i + 1) & mask)
+				{
+					size_t const home = instantiations[slots[i] - 1].hash & mask;
+					if (((i - home) & mask) >= ((i - hole) & mask))
+					{
+						slots[hole] = slots[i];
+						hole = i;
+					}
+				}
+				slots[hole] = 0;
+
+				if (last.parameter_count > inline_parameter_count)
+					overflow_parameters.resize(last.overflow_offset);
+				instantiations.pop_back();
+			}
+		}
+
+		// Calls function(id, parameters, value) for every instantiation in the table in insertion order.
+		template <typename Function>
+		auto for_each(Function && function) const -> void
+		{
+			for (Instantiation const & instantiation : instantiations)
+				function(instantiation.id, parameters_of(instantiation), instantiation.value);
+		}
+
+		static auto hash_key(Id id, span<complete::TypeId const> parameters) noexcept -> size_t
+		{
+			static_assert(sizeof(Id) == sizeof(unsigned));
+			unsigned id_bits;
+			memcpy(&id_bits, &id, sizeof(id_bits));
+
+			// FNV-1a over the id and the parameters.
+			size_t hash = 2166136261u;
+			auto const combine = [&hash](unsigned value) { hash = (hash ^ value) * 16777619u; };
+			combine(id_bits);
+			for (complete::TypeId const parameter : parameters)
+				combine(parameter.flat_value);
+			return hash;
+		}
+
+	private:
+		auto parameters_of(Instantiation const & instantiation) const noexcept -> span<complete::TypeId const>
+		{
+			if (instantiation.parameter_count <= inline_parameter_count)
+				return {instantiation.inline_parameters, instantiation.parameter_count};
+			else
+				return {overflow_parameters.data() + instantiation.overflow_offset, instantiation.parameter_count};
+		}
+
+		auto matches(Instantiation const & instantiation, Id id, span<complete::TypeId const> parameters) const noexcept -> bool
+		{
+			if (memcmp(&instantiation.id, &id, sizeof(Id)) != 0 || instantiation.parameter_count != parameters.size())
+				return false;
+
+			span<complete::TypeId const> const instantiation_parameters = parameters_of(instantiation);
+			return std::equal(instantiation_parameters.begin(), instantiation_parameters.end(), parameters.begin());
+		}
+
+		auto place(size_t index) noexcept -> void
+		{
+			size_t const mask = slots.size() - 1;
+			size_t i = instantiations[index].hash & mask;
+			while (slots[i] != 0)
+				i = (i + 1) & mask;
+			slots[i] = static_cast<unsigned>(index + 1);
 		}
+
+		auto grow() -> void
+		{
+			slots.assign(slots.empty() ? 16 : slots.size() * 2, 0);
+			for (size_t i = 0; i < instantiations.size(); ++i)
+				place(i);
+		}
+	};
+
+	// Results of complete::resolve_function_overloading keyed by the contents of the overload set and the argument types.
+	// Since every candidate is part of the key, binding a new overload to a name produces a different key instead of a stale hit.
+	struct OverloadResolutionCache
+	{
+		struct Entry
+		{
+			size_t key_offset; // Function ids, function template ids and argument types, in that order, stored in keys.
+			unsigned function_count;
+			unsigned function_template_count;
+			unsigned parameter_count;
+			FunctionId result;
+		};
+
+		std::unordered_multimap<size_t, Entry> entries;
+		std::vector<unsigned> keys;
+		std::vector<size_t> inserted_hashes; // Hash of every entry in insertion order.
+
+		auto size() const noexcept -> size_t { return inserted_hashes.size(); }
+		auto find(complete::OverloadSetView overload_set, span<complete::TypeId const> parameters) const noexcept -> FunctionId const *;
+		auto insert(complete::OverloadSetView overload_set, span<complete::TypeId const> parameters, FunctionId result) -> void;
+		// Removes the entries inserted after the first new_size ones.
+		auto truncate(size_t new_size) noexcept -> void;
+	};
+
+	// Type without members or operations that stands for every trivially copyable type of the same size and alignment.
+	// Its type and struct stay in the program, because the ids of the types added after it cannot change, but the functions
+	// of the program never refer to it, since every instantiation substitutes the actual types for the placeholders.
+	struct LayoutPlaceholder
+	{
+		int size;
+		int alignment;
+		complete::TypeId type;
 	};
 
+	// Instantiation of a function template for layout placeholders. It is not part of the program, the instantiations for actual types are copied from it.
+	struct LayoutGenericFunction
+	{
+		std::vector<complete::TypeId> placeholders;
+		complete::Function function;
+	};
+
+	// Rolled back along with the program by removing what was added after a captured state, which also discards
+	// the overload resolutions that refer to rolled back types and functions.
+	// The cache of a shard of a program reads the one of the program through base, and only holds what the shard adds.
+	// Lookups go through the functions below so that they see both.
 	struct TemplateCache
 	{
-		std::map<TemplateInstantiation<FunctionTemplateId>, FunctionId> functions;
-		std::map<TemplateInstantiation<complete::StructTemplateId>, complete::TypeId> structs;
+		TemplateCache const * base = nullptr; // Must not change while this cache is used.
+		TemplateInstantiationTable<FunctionTemplateId, FunctionId> functions;
+		TemplateInstantiationTable<complete::StructTemplateId, complete::TypeId> structs;
+		OverloadResolutionCache overload_resolutions;
+		std::vector<LayoutPlaceholder> layout_placeholders;
+		std::vector<LayoutGenericFunction> layout_generic_functions;
+		// Index in layout_generic_functions of the instantiation of a function template for the layouts of its parameters, or -1 if its body
+		// depends on more than their layout. Keyed by the layouts, since the placeholders are only kept if an instantiation for them is.
+		TemplateInstantiationTable<FunctionTemplateId, int> layout_generic_instantiations;
+		bool is_analyzing_layout_placeholders = false;
+		bool analysis_depends_on_actual_types = false; // Whether the analysis for layout placeholders did something that may not hold for the actual types.
+
+		auto find_function(FunctionTemplateId template_id, span<complete::TypeId const> parameters) const noexcept -> FunctionId const *;
+		auto find_struct(complete::StructTemplateId template_id, span<complete::TypeId const> parameters) const noexcept -> complete::TypeId const *;
+		auto find_overload_resolution(complete::OverloadSetView overload_set, span<complete::TypeId const> parameters) const noexcept -> FunctionId const *;
+		auto find_layout_placeholder(int size, int alignment) const noexcept -> LayoutPlaceholder const *;
+		auto find_layout_placeholder(complete::TypeId type) const noexcept -> LayoutPlaceholder const *;
+		auto find_layout_generic_instantiation(FunctionTemplateId template_id, span<complete::TypeId const> layout_keys) const noexcept -> int const *;
+		// Indices of layout generic functions count the ones of base first.
+		auto layout_generic_function(int index) const noexcept -> LayoutGenericFunction const &;
+		auto layout_generic_function_count() const noexcept -> size_t;
 	};
 
+	// Whether the bodies of functions declared at the global scope of a module are analyzed when they are declared,
+	// or only when a call to them is analyzed. Functions that are never used from main, from a global initializer or
+	// from a compile time evaluation are then never analyzed. Eager analysis is useful to validate libraries.
+	enum struct FunctionBodyAnalysis { lazy, eager };
+
+	// Whether the nodes of the analyzed program are allocated from an arena owned by the program or one by one from the heap.
+	enum struct ProgramAllocation { heap, arena };
+
+	// Whether functions with identical code are merged once the program is analyzed. Keeping them apart helps to debug the analysis.
+	enum struct FunctionFolding { fold, keep };
+
 	struct SemanticAnalysisArgs
 	{
 		std::vector<complete::ResolvedTemplateParameter> & template_parameters;
 		ScopeStack & scope_stack;
 		out<complete::Program> program;
 		TemplateCache & template_cache;
+		FunctionBodyAnalysis function_body_analysis = FunctionBodyAnalysis::eager;
+		std::shared_ptr<void const> incomplete_template = nullptr; // Storage of the incomplete template being instantiated, if any.
 	};
 
+	// Modules that don't depend on each other are analyzed on up to thread_count threads (0 means one per hardware thread), each thread into its own
+	// shard of the program, and the shards are merged afterwards in the order of the modules. With one thread, the modules are analyzed one at a time
+	// into the program. Ids don't depend on which thread finishes first, and are the same for any number of threads if the parse order goes by depth
+	// in the dependency graph. If there are errors, the one returned is the one that analyzing the modules one at a time would find first.
 	auto semantic_analysis(
 		span<incomplete::Module const> incomplete_modules,
-		span<int const> parse_order
+		span<int const> parse_order,
+		FunctionBodyAnalysis function_body_analysis = FunctionBodyAnalysis::lazy,
+		ProgramAllocation program_allocation = ProgramAllocation::arena,
+		int thread_count = 0,
+		FunctionFolding function_folding = FunctionFolding::fold
 	) noexcept -> expected<complete::Program, SyntaxError>;
 
 	auto instantiate_function_template(
@@ -57,6 +289,25 @@ namespace instantiation
 		SemanticAnalysisArgs args
 	) -> expected<complete::Function, PartialSyntaxError>;
 
+	// If every parameter is trivially copyable and the body of the template only depends on their size and alignment,
+	// builds the instantiation from the one for layout placeholders, which is only analyzed once per layout.
+	// Returns nullopt if the template has to be analyzed for these parameters.
+	auto instantiate_layout_generic_function_template(FunctionTemplateId template_id, span<complete::TypeId const> parameters, out<complete::Program> program, TemplateCache & template_cache) noexcept
+		-> std::optional<complete::Function>;
+
+	// While a function template is analyzed for layout placeholders, returns whether any of the types is built from a placeholder, and if so
+	// marks the analysis as depending on the actual types. Overload resolution, conversions and struct template instantiations check this.
+	auto depends_on_layout_placeholders(span<complete::TypeId const> types, complete::Program const & program, TemplateCache & template_cache) noexcept -> bool;
+	// Marks the analysis for layout placeholders as depending on the actual types if an expression that is not a literal is evaluated at compile time.
+	auto note_compile_time_evaluation(complete::Expression const & expression, TemplateCache & template_cache) noexcept -> void;
+
+	// Finds the address of an extern function by its ABI name and builds the caller for its signature. Returns false if the symbol can't be found.
+	[[nodiscard]] auto bind_extern_function(complete::ExternFunction & extern_function, complete::Program const & program) noexcept -> bool;
+
+	// Analyzes the body of function_id if it was deferred and has not been analyzed yet.
+	[[nodiscard]] auto analyze_deferred_function_body(FunctionId function_id, out<complete::Program> program, TemplateCache & template_cache)
+		-> expected<void, PartialSyntaxError>;
+
 	auto instantiate_expression(
 		incomplete::Expression const & incomplete_expression_,
 		SemanticAnalysisArgs args,
@@ -157,10 +408,19 @@ namespace instantiation
 		SemanticAnalysisArgs args
 	) -> expected<InstantiatedStruct, PartialSyntaxError>;
 
+	// If defer_named_constructors is true, named constructors are left as complete::function_id_constants::invalid
+	// and are only instantiated by complete::instantiate_named_constructors when they are looked up.
 	[[nodiscard]] auto instantiate_incomplete_struct_functions(
 		incomplete::Struct const & incomplete_struct,
 		complete::TypeId new_type_id, int new_struct_id,
-		SemanticAnalysisArgs args
+		SemanticAnalysisArgs args,
+		bool defer_named_constructors = false
 	) -> expected<void, PartialSyntaxError>;
 
+	[[nodiscard]] auto instantiate_struct_constructor(
+		incomplete::Constructor const & incomplete_constructor,
+		complete::TypeId new_type_id,
+		SemanticAnalysisArgs args
+	) -> expected<FunctionId, PartialSyntaxError>;
+
 } // namespace instantiation
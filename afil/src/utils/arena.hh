@@ -0,0 +1,38 @@
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+// Monotonic memory resource owned by a tree of value_ptr nodes, like a program or a module.
+// The resource is kept on the heap so that moving the owner does not invalidate the nodes allocated from it.
+// Memory is only released when the arena is destroyed. Every node allocated while the arena is the resource of the thread
+// stays until then, including temporaries and the nodes of analyses that are rolled back, like failed overload attempts
+// or compiles expressions. A program therefore uses memory proportional to all the work done to analyze it, not only to
+// what it keeps, and owners that live long, like the modules kept by the daemon, should be replaced rather than reused.
+struct Arena
+{
+	std::unique_ptr<std::pmr::monotonic_buffer_resource> resource; // nullptr if the nodes are allocated from the heap.
+	std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> adopted_resources; // Resources of other owners whose nodes were moved into this one.
+
+	Arena() noexcept = default;
+	Arena(Arena &&) noexcept = default;
+	// Swaps so that the nodes destroyed by the move assignment of the owner can still be released into their resource.
+	auto operator = (Arena && other) noexcept -> Arena &
+	{
+		std::swap(resource, other.resource);
+		std::swap(adopted_resources, other.adopted_resources);
+		return *this;
+	}
+
+	// Keeps the resources of other alive as long as this arena, so that nodes allocated from them can be moved into the owner of this one.
+	auto adopt(Arena && other) -> void
+	{
+		if (other.resource != nullptr)
+			adopted_resources.push_back(std::move(other.resource));
+		for (auto & adopted_resource : other.adopted_resources)
+			adopted_resources.push_back(std::move(adopted_resource));
+		other.adopted_resources.clear();
+	}
+};
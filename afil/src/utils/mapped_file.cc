@@ -0,0 +1,95 @@
+#include "mapped_file.hh"
+#include "compatibility.hh"
+
+#if AFIL_WINDOWS
+#	include <Windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() noexcept
+{
+	if (data)
+	{
+#if AFIL_WINDOWS
+		UnmapViewOfFile(data);
+#else
+		munmap(const_cast<char *>(data), size);
+#endif
+	}
+}
+
+auto map_whole_file(std::filesystem::path const & path) noexcept -> std::optional<MappedFile>
+{
+#if AFIL_WINDOWS
+	HANDLE const file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return std::nullopt;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size))
+	{
+		CloseHandle(file);
+		return std::nullopt;
+	}
+
+	// Windows can't map empty files.
+	if (file_size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return MappedFile();
+	}
+
+	// The view keeps the mapping and the file open, so the handles can be closed right away.
+	HANDLE const mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (mapping == nullptr)
+		return std::nullopt;
+
+	void const * const view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (view == nullptr)
+		return std::nullopt;
+
+	return MappedFile(static_cast<char const *>(view), static_cast<size_t>(file_size.QuadPart));
+#else
+	int const file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file == -1)
+		return std::nullopt;
+
+	struct stat file_status;
+	if (fstat(file, &file_status) != 0 || !S_ISREG(file_status.st_mode))
+	{
+		close(file);
+		return std::nullopt;
+	}
+
+	// mmap fails for empty files.
+	if (file_status.st_size == 0)
+	{
+		close(file);
+		return MappedFile();
+	}
+
+	// The mapping keeps the file open, so it can be closed right away.
+	size_t const file_size = static_cast<size_t>(file_status.st_size);
+	void * const view = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (view == MAP_FAILED)
+		return std::nullopt;
+
+	madvise(view, file_size, MADV_SEQUENTIAL);
+	return MappedFile(static_cast<char const *>(view), file_size);
+#endif
+}
+
+auto load_source_file(std::filesystem::path const & path) noexcept -> std::optional<SourceBuffer>
+{
+	std::optional<MappedFile> mapped_file = map_whole_file(path);
+	if (!mapped_file.has_value())
+		return std::nullopt;
+	return SourceBuffer(std::move(*mapped_file));
+}
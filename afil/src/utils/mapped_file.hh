@@ -0,0 +1,49 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Read only mapping of a whole file into memory. Pages are loaded by the OS as they are accessed, so the contents are never copied.
+// The file must not be modified while it is mapped.
+struct MappedFile
+{
+	MappedFile() noexcept = default;
+	MappedFile(char const * data_, size_t size_) noexcept : data(data_), size(size_) {}
+	MappedFile(MappedFile const & other) = delete;
+	MappedFile & operator = (MappedFile const & other) = delete;
+	MappedFile(MappedFile && other) noexcept : data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)) {}
+	MappedFile & operator = (MappedFile && other) noexcept { std::swap(data, other.data); std::swap(size, other.size); return *this; }
+	~MappedFile() noexcept;
+
+	auto contents() const noexcept -> std::string_view { return std::string_view(data, size); }
+
+	char const * data = nullptr; // Null for empty files.
+	size_t size = 0;
+};
+
+auto map_whole_file(std::filesystem::path const & path) noexcept -> std::optional<MappedFile>;
+
+// Text of a source file. Either a mapping of the file or a string owned by the buffer for sources that don't come from a file.
+// Copies of a mapped buffer share the mapping, so a file that is loaded once can be the source of modules that outlive the buffer.
+// The text stays at the same address when the buffer is moved if it is mapped, but not if it is a short string.
+struct SourceBuffer
+{
+	SourceBuffer() noexcept = default;
+	SourceBuffer(std::string text) noexcept : owned_text(std::move(text)) {}
+	SourceBuffer(char const * text) noexcept : owned_text(text) {}
+	SourceBuffer(MappedFile mapped_file) noexcept : mapping(std::make_shared<MappedFile const>(std::move(mapped_file))) {}
+
+	auto is_mapped() const noexcept -> bool { return mapping != nullptr && mapping->data != nullptr; }
+	auto data() const noexcept -> char const * { return is_mapped() ? mapping->data : owned_text.data(); }
+	auto size() const noexcept -> size_t { return is_mapped() ? mapping->size : owned_text.size(); }
+	operator std::string_view() const noexcept { return std::string_view(data(), size()); }
+
+	std::string owned_text;
+	std::shared_ptr<MappedFile const> mapping;
+};
+
+auto load_source_file(std::filesystem::path const & path) noexcept -> std::optional<SourceBuffer>;
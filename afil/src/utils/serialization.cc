@@ -0,0 +1,31 @@
+#include "serialization.hh"
+#include <fstream>
+#include <random>
+
+auto write_whole_binary_file(std::filesystem::path const & path, std::string_view bytes) noexcept -> bool
+{
+	std::filesystem::path temporary_path = path;
+	temporary_path += std::to_string(std::random_device()());
+	temporary_path += ".tmp";
+
+	bool written;
+	{
+		std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+		file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+		file.close();
+		written = file.good();
+	}
+
+	std::error_code error;
+	if (written)
+		std::filesystem::rename(temporary_path, path, error);
+
+	if (!written || error)
+	{
+		std::filesystem::remove(temporary_path, error);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include "value_ptr.hh"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+// Appends values to a buffer as their bytes in memory. Data written with it is only meant to be read back by the same build.
+struct ByteWriter
+{
+	std::vector<char> bytes;
+
+	template <typename T>
+	auto write(T value) noexcept -> void
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		write_bytes(&value, sizeof(T));
+	}
+
+	auto write_bytes(void const * data, size_t size) noexcept -> void
+	{
+		char const * const first = static_cast<char const *>(data);
+		bytes.insert(bytes.end(), first, first + size);
+	}
+};
+
+// Reads values written by ByteWriter. Reading past the end does not read anything and marks the reader as failed.
+struct ByteReader
+{
+	ByteReader(std::string_view bytes) noexcept : position(bytes.data()), end(bytes.data() + bytes.size()) {}
+
+	template <typename T>
+	auto read() noexcept -> T
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		T value{};
+		if (char const * const data = read_bytes(sizeof(T)))
+			memcpy(&value, data, sizeof(T));
+		return value;
+	}
+
+	// Returns nullptr if there are less than size bytes left.
+	auto read_bytes(size_t size) noexcept -> char const *
+	{
+		if (failed || static_cast<size_t>(end - position) < size)
+		{
+			failed = true;
+			return nullptr;
+		}
+
+		char const * const data = position;
+		position += size;
+		return data;
+	}
+
+	// For malformed data detected by the caller.
+	auto fail() noexcept -> void { failed = true; }
+
+	auto has_failed() const noexcept -> bool { return failed; }
+	auto is_at_end() const noexcept -> bool { return position == end; }
+	auto remaining_size() const noexcept -> size_t { return static_cast<size_t>(end - position); }
+
+private:
+	char const * position;
+	char const * end;
+	bool failed = false;
+};
+
+// Bases of archives that write and read trees of nodes. Each node type lists its members once in a function
+// serialize(archive, node) that both archives use, and that is found by argument dependent lookup in the namespace of Derived.
+// Derived archives can add overloads of write and read for types that they store in their own way.
+template <typename Derived>
+struct ArchiveWriter
+{
+	static constexpr bool is_reader = false;
+
+	ByteWriter bytes;
+
+	template <typename ... Ts>
+	auto operator () (Ts & ... values) noexcept -> void
+	{
+		(derived().write(values), ...);
+	}
+
+	// For trivially copyable values such as ids, which are stored as their bytes in memory.
+	template <typename T>
+	auto raw(T & value) noexcept -> void
+	{
+		bytes.write(value);
+	}
+
+	template <typename T>
+	auto write(T & value) noexcept -> void
+	{
+		if constexpr (std::is_same_v<T, bool>)
+			bytes.write<uint8_t>(value ? 1 : 0);
+		else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+			bytes.write(value);
+		else
+			serialize(derived(), value);
+	}
+
+	auto write(std::string & string) noexcept -> void
+	{
+		bytes.write(static_cast<uint32_t>(string.size()));
+		bytes.write_bytes(string.data(), string.size());
+	}
+
+	template <typename T>
+	auto write(std::vector<T> & vector) noexcept -> void
+	{
+		bytes.write(static_cast<uint32_t>(vector.size()));
+		for (T & element : vector)
+			derived().write(element);
+	}
+
+	template <typename T>
+	auto write(std::optional<T> & optional) noexcept -> void
+	{
+		bytes.write<uint8_t>(optional.has_value() ? 1 : 0);
+		if (optional.has_value())
+			derived().write(*optional);
+	}
+
+	template <typename T>
+	auto write(value_ptr<T> & pointer) noexcept -> void
+	{
+		bytes.write<uint8_t>(pointer != nullptr ? 1 : 0);
+		if (pointer != nullptr)
+			derived().write(*pointer);
+	}
+
+	template <typename ... Ts>
+	auto write(std::variant<Ts...> & variant) noexcept -> void
+	{
+		bytes.write(static_cast<uint32_t>(variant.index()));
+		std::visit([this](auto & alternative) { derived().write(alternative); }, variant);
+	}
+
+private:
+	auto derived() noexcept -> Derived & { return static_cast<Derived &>(*this); }
+};
+
+// Nodes are allocated from the memory resource of the current thread. Malformed data makes the reader fail instead of reading out of bounds.
+template <typename Derived>
+struct ArchiveReader
+{
+	static constexpr bool is_reader = true;
+
+	ArchiveReader(std::string_view bytes_) noexcept : bytes(bytes_) {}
+
+	ByteReader bytes;
+
+	template <typename ... Ts>
+	auto operator () (Ts & ... values) noexcept -> void
+	{
+		(derived().read(values), ...);
+	}
+
+	template <typename T>
+	auto raw(T & value) noexcept -> void
+	{
+		value = bytes.read<T>();
+	}
+
+	template <typename T>
+	auto read(T & value) noexcept -> void
+	{
+		if constexpr (std::is_same_v<T, bool>)
+			value = bytes.read<uint8_t>() != 0;
+		else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+			value = bytes.read<T>();
+		else
+			serialize(derived(), value);
+	}
+
+	auto read(std::string & string) noexcept -> void
+	{
+		uint32_t const size = bytes.read<uint32_t>();
+		if (char const * const characters = bytes.read_bytes(size))
+			string.assign(characters, size);
+	}
+
+	template <typename T>
+	auto read(std::vector<T> & vector) noexcept -> void
+	{
+		uint32_t const size = bytes.read<uint32_t>();
+		// Every element takes at least one byte, so a bigger size can only come from malformed data.
+		if (bytes.has_failed() || size > bytes.remaining_size())
+		{
+			bytes.fail();
+			return;
+		}
+
+		vector.clear();
+		vector.resize(size);
+		for (T & element : vector)
+			derived().read(element);
+	}
+
+	template <typename T>
+	auto read(std::optional<T> & optional) noexcept -> void
+	{
+		if (bytes.read<uint8_t>() != 0)
+			derived().read(optional.emplace());
+	}
+
+	template <typename T>
+	auto read(value_ptr<T> & pointer) noexcept -> void
+	{
+		if (bytes.read<uint8_t>() != 0)
+		{
+			pointer = make_value<T>();
+			derived().read(*pointer);
+		}
+	}
+
+	template <typename ... Ts>
+	auto read(std::variant<Ts...> & variant) noexcept -> void
+	{
+		uint32_t const index = bytes.read<uint32_t>();
+		if (index >= sizeof...(Ts))
+			bytes.fail();
+		else
+			read_alternative<0>(index, variant);
+	}
+
+private:
+	auto derived() noexcept -> Derived & { return static_cast<Derived &>(*this); }
+
+	template <size_t I, typename ... Ts>
+	auto read_alternative(uint32_t index, std::variant<Ts...> & variant) noexcept -> void
+	{
+		if constexpr (I < sizeof...(Ts))
+		{
+			if (index == I)
+				derived().read(variant.template emplace<I>());
+			else
+				read_alternative<I + 1>(index, variant);
+		}
+	}
+};
+
+// Writes to a temporary file that is then renamed, so that other processes reading the path never see a partial file.
+[[nodiscard]] auto write_whole_binary_file(std::filesystem::path const & path, std::string_view bytes) noexcept -> bool;
@@ -80,7 +80,7 @@ auto is_contained_in(std::string_view string, std::string_view substr) noexcept
 
 auto indent(int indentation_level) noexcept -> std::string;
 
-constexpr auto is_whitespace = [](char c) noexcept -> bool { return c == ' ' || c == '\t'; };
+constexpr auto is_whitespace = [](char c) noexcept -> bool { return c == ' ' || c == '\t' || c == '\r'; };
 constexpr auto is_whitespace_or_newline = [](char c) noexcept -> bool { return c == ' ' || c == '\t' || c == '\n'; };
 constexpr auto is_number = [](char c) noexcept -> bool { return (c >= '0' && c <= '9'); };
 constexpr auto is_letter = [](char c) noexcept -> bool { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); };
@@ -0,0 +1,118 @@
+#include "task_graph.hh"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace task_graph_locals
+{
+
+	struct Scheduler
+	{
+		span<Task> tasks;
+		std::vector<std::vector<int>> dependents;
+		std::vector<int> remaining_dependency_count;
+		std::vector<bool> is_cancelled; // Set for tasks with a dependency that failed or did not run.
+		std::vector<int> ready_tasks; // Min heap, so that tasks are started in the order in which they would run sequentially.
+		int finished_task_count = 0;
+		int first_failed_task = INT_MAX;
+
+		std::mutex mutex;
+		std::condition_variable task_ready_or_all_finished;
+
+		// The mutex must be locked. A task that did not run has not succeeded.
+		auto finish(int task_index, bool succeeded) noexcept -> void
+		{
+			for (int const dependent : dependents[task_index])
+			{
+				if (!succeeded)
+					is_cancelled[dependent] = true;
+
+				if (--remaining_dependency_count[dependent] == 0)
+				{
+					ready_tasks.push_back(dependent);
+					std::push_heap(ready_tasks.begin(), ready_tasks.end(), std::greater<int>());
+				}
+			}
+
+			++finished_task_count;
+			task_ready_or_all_finished.notify_all();
+		}
+
+		auto work() noexcept -> void
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			for (;;)
+			{
+				task_ready_or_all_finished.wait(lock, [&] { return !ready_tasks.empty() || finished_task_count == static_cast<int>(tasks.size()); });
+				if (ready_tasks.empty())
+					return;
+
+				std::pop_heap(ready_tasks.begin(), ready_tasks.end(), std::greater<int>());
+				int const task_index = ready_tasks.back();
+				ready_tasks.pop_back();
+
+				// Tasks after one that failed would not have run sequentially.
+				if (is_cancelled[task_index] || task_index > first_failed_task)
+				{
+					finish(task_index, false);
+					continue;
+				}
+
+				lock.unlock();
+				bool const succeeded = tasks[task_index].run();
+				lock.lock();
+				if (!succeeded)
+					first_failed_task = std::min(first_failed_task, task_index);
+				finish(task_index, succeeded);
+			}
+		}
+	};
+
+} // namespace task_graph_locals
+
+auto run_task_graph(span<Task> tasks, int thread_count) noexcept -> std::optional<int>
+{
+	using namespace task_graph_locals;
+
+	if (thread_count <= 0)
+		thread_count = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+	int const task_count = static_cast<int>(tasks.size());
+	thread_count = std::min(thread_count, task_count);
+
+	Scheduler scheduler;
+	scheduler.tasks = tasks;
+	scheduler.dependents.resize(tasks.size());
+	scheduler.remaining_dependency_count.resize(tasks.size());
+	scheduler.is_cancelled.resize(tasks.size(), false);
+
+	for (int i = 0; i < task_count; ++i)
+	{
+		for (int const dependency : tasks[i].dependencies)
+		{
+			assert(dependency < i);
+			scheduler.dependents[dependency].push_back(i);
+		}
+
+		scheduler.remaining_dependency_count[i] = static_cast<int>(tasks[i].dependencies.size());
+		if (tasks[i].dependencies.empty())
+			scheduler.ready_tasks.push_back(i); // Pushed in increasing order, so it is already a heap.
+	}
+
+	std::vector<std::thread> threads;
+	threads.reserve(std::max(thread_count - 1, 0));
+	for (int i = 1; i < thread_count; ++i)
+		threads.emplace_back([&scheduler] { scheduler.work(); });
+
+	scheduler.work();
+	for (std::thread & thread : threads)
+		thread.join();
+
+	if (scheduler.first_failed_task == INT_MAX)
+		return std::nullopt;
+	else
+		return scheduler.first_failed_task;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "span.hh"
+#include <functional>
+#include <optional>
+#include <vector>
+
+struct Task
+{
+	std::function<auto() -> bool> run; // Returns false if the task failed.
+	std::vector<int> dependencies; // Indices of tasks that must finish before this one starts. They must come before it.
+};
+
+// Runs the tasks on up to thread_count threads, including the calling one. 0 means one per hardware thread.
+// Tasks that depend on a task that failed are not run. Returns the index of the first task that failed, so that the result
+// is the same as running the tasks one after another in order and stopping at the first failure.
+auto run_task_graph(span<Task> tasks, int thread_count = 0) noexcept -> std::optional<int>;
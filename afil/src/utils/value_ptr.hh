@@ -2,31 +2,89 @@
 
 #include "compatibility.hh"
 #include <memory>
+#include <memory_resource>
+#include <new>
+
+// Memory resource from which value_ptr allocates on this thread. nullptr means new and delete.
+inline thread_local std::pmr::memory_resource * current_value_ptr_resource = nullptr;
+
+// Makes value_ptr allocate from a memory resource on this thread while it is alive.
+struct ScopedValuePtrResource
+{
+	explicit ScopedValuePtrResource(std::pmr::memory_resource * resource) noexcept
+		: previous_resource(current_value_ptr_resource)
+	{
+		current_value_ptr_resource = resource;
+	}
+	~ScopedValuePtrResource() { current_value_ptr_resource = previous_resource; }
+
+	ScopedValuePtrResource(ScopedValuePtrResource const &) = delete;
+	ScopedValuePtrResource & operator = (ScopedValuePtrResource const &) = delete;
+
+private:
+	std::pmr::memory_resource * previous_resource;
+};
+
+template <typename T>
+struct value_ptr_deleter
+{
+	std::pmr::memory_resource * resource = nullptr; // Where the object was allocated, or nullptr if it was allocated with new.
+
+	auto operator () (T * ptr) const noexcept -> void
+	{
+		if (resource == nullptr)
+		{
+			delete ptr;
+		}
+		else
+		{
+			ptr->~T();
+			resource->deallocate(ptr, sizeof(T), alignof(T));
+		}
+	}
+};
+
+template <typename T> struct value_ptr;
+
+// Constructs a T in the memory resource of the current thread.
+template <typename T, typename ... Args>
+auto make_value(Args && ... args) -> value_ptr<T>
+{
+	std::pmr::memory_resource * const resource = current_value_ptr_resource;
+	if (resource == nullptr)
+		return value_ptr<T>(new T(std::forward<Args>(args)...));
+
+	void * const memory = resource->allocate(sizeof(T), alignof(T));
+	return value_ptr<T>(new (memory) T(std::forward<Args>(args)...), value_ptr_deleter<T>{resource});
+}
 
 // unique_ptr but it's copyable and does deep copy.
+// Copies are allocated from the memory resource of the current thread, not from the one of the original.
 template <typename T>
-struct value_ptr : public std::unique_ptr<T>
+struct value_ptr : public std::unique_ptr<T, value_ptr_deleter<T>>
 {
 	static_assert(!std::is_array_v<T>, "T can't be an array type because we cannot copy it. If the array is of a size known in compile-time, you can use std::array");
 
-	using std::unique_ptr<T>::unique_ptr;
+	using Base = std::unique_ptr<T, value_ptr_deleter<T>>;
+
+	using Base::Base;
 	value_ptr() noexcept = default;
 	value_ptr(value_ptr &&) noexcept = default;
 	value_ptr & operator = (value_ptr &&) noexcept = default;
 
-	value_ptr(std::unique_ptr<T> && ptr) noexcept : std::unique_ptr<T>(std::move(ptr)) {}
+	value_ptr(std::unique_ptr<T> && ptr) noexcept : Base(ptr.release()) {}
 
 	value_ptr(value_ptr const & other)
-		: std::unique_ptr<T>() // Silence gcc warning 'base class should be explicitly initialized in the copy constructor'
+		: Base() // Silence gcc warning 'base class should be explicitly initialized in the copy constructor'
 	{
 		if (other)
-			this->reset(new T(*other));
+			Base::operator = (make_value<T>(*other));
 	}
 
 	value_ptr & operator = (value_ptr const & other)
 	{
 		if (other)
-			this->reset(new T(*other));
+			Base::operator = (make_value<T>(*other));
 		else
 			this->reset(nullptr);
 
@@ -37,7 +95,7 @@ struct value_ptr : public std::unique_ptr<T>
 template <typename T>
 auto allocate(T t) -> value_ptr<T>
 {
-	return std::make_unique<T>(std::move(t));
+	return make_value<T>(std::move(t));
 }
 
 template <typename T>
@@ -1,34 +1,130 @@
 #include "afil.hh"
+#include "compiler_daemon.hh"
 #include "interpreter.hh"
+#include "module_cache.hh"
 #include "pretty_print.hh"
+#include "program_image.hh"
 #include "utils/compatibility.hh"
 #include <iostream>
+#include <string_view>
+
+auto run_program(complete::Program const & program) -> int
+{
+	auto result = interpreter::run(program);
+	if (result.has_value())
+	{
+		system_pause();
+		return *result;
+	}
+	else
+	{
+		std::cout << "Unmet precondition: " << reinterpret_cast<int &>(result.error().function) << ", " << result.error().precondition << '\n';
+		system_pause();
+		return -1;
+	}
+}
 
 auto main(int argc, char const * const argv[]) -> int
 {
-	(void)(argc);
-	(void)(argv);
-	
-	auto program = afil::parse_module("main");
-	if (program.has_value())
+	// afil [--cache <directory>] [--save-image <file.afilc>] [--function-bodies lazy|eager] [--fold-functions yes|no]
+	// afil --run-image <file.afilc>
+	// afil --daemon <socket> [--cache <directory>]
+	incomplete::ModuleCache cache;
+	bool use_cache = false;
+	char const * save_image_path = nullptr;
+	char const * run_image_path = nullptr;
+	char const * daemon_socket_path = nullptr;
+	auto function_body_analysis = instantiation::FunctionBodyAnalysis::lazy;
+	auto function_folding = instantiation::FunctionFolding::fold;
+	for (int i = 1; i < argc; i += 2)
 	{
-		auto result = interpreter::run(*program);
-		if (result.has_value())
+		std::string_view const option = argv[i];
+		if (i + 1 == argc)
 		{
-			system_pause();
-			return *result;
+			std::cout << "Expected a value after " << option << '\n';
+			return -1;
+		}
+
+		if (option == "--cache")
+		{
+			cache.directory = argv[i + 1];
+			use_cache = true;
+		}
+		else if (option == "--save-image")
+			save_image_path = argv[i + 1];
+		else if (option == "--run-image")
+			run_image_path = argv[i + 1];
+		else if (option == "--daemon")
+			daemon_socket_path = argv[i + 1];
+		else if (option == "--function-bodies")
+		{
+			std::string_view const value = argv[i + 1];
+			if (value != "lazy" && value != "eager")
+			{
+				std::cout << "Expected lazy or eager after --function-bodies\n";
+				return -1;
+			}
+			function_body_analysis = (value == "eager") ? instantiation::FunctionBodyAnalysis::eager : instantiation::FunctionBodyAnalysis::lazy;
+		}
+		else if (option == "--fold-functions")
+		{
+			std::string_view const value = argv[i + 1];
+			if (value != "yes" && value != "no")
+			{
+				std::cout << "Expected yes or no after --fold-functions\n";
+				return -1;
+			}
+			function_folding = (value == "no") ? instantiation::FunctionFolding::keep : instantiation::FunctionFolding::fold;
 		}
 		else
 		{
-			std::cout << "Unmet precondition: " << reinterpret_cast<int &>(result.error().function) << ", " << result.error().precondition << '\n';
+			std::cout << "Unknown option " << option << '\n';
+			return -1;
+		}
+	}
+
+	if (daemon_socket_path)
+	{
+		afil::CompilerDaemon daemon;
+		if (use_cache)
+			daemon.cache = std::move(cache);
+		auto const result = afil::run_compiler_daemon(daemon, daemon_socket_path);
+		if (!result.has_value())
+		{
+			std::cout << result.error() << '\n';
+			return -1;
+		}
+		return 0;
+	}
+
+	if (run_image_path)
+	{
+		auto program = complete::load_program_image(run_image_path);
+		if (!program.has_value())
+		{
+			std::cout << program.error() << '\n';
 			system_pause();
 			return -1;
 		}
+		return run_program(*program);
 	}
-	else
+
+	auto program = afil::parse_module("main", use_cache ? &cache : nullptr, nullptr, function_body_analysis, function_folding);
+	if (!program.has_value())
 	{
 		std::cout << program.error() << '\n';
 		system_pause();
 		return -1;
 	}
+
+	if (save_image_path)
+	{
+		if (complete::save_program_image(*program, save_image_path))
+			return 0;
+
+		std::cout << "Cannot save program image " << save_image_path << '\n';
+		return -1;
+	}
+
+	return run_program(*program);
 }
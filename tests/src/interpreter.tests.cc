@@ -2,13 +2,21 @@
 #include "utils/compatibility.hh"
 #include "interpreter.hh"
 #include "incomplete_module.hh"
+#include "module_cache.hh"
 #include "parser.hh"
 #include "template_instantiation.hh"
 #include "afil.hh"
+#include "compiler_daemon.hh"
 #include "program.hh"
+#include "program_image.hh"
 #include "pretty_print.hh"
+#include "utils/mapped_file.hh"
+#include "utils/serialization.hh"
+#include "utils/string.hh"
 #include "utils/warning_macro.hh"
+#include <algorithm>
 #include <iostream>
+#include <numeric>
 
 using namespace std::literals;
 
@@ -40,12 +48,12 @@ namespace tests
 		}
 	}
 
-	auto parse_source(std::string_view src) -> expected<complete::Program, SyntaxError>
+	auto parse_source(std::string_view src, instantiation::FunctionBodyAnalysis function_body_analysis = instantiation::FunctionBodyAnalysis::lazy) -> expected<complete::Program, SyntaxError>
 	{
 		incomplete::Module module_for_source;
 		module_for_source.files.push_back({"<source>", std::string(src)});
 		try_call_void(parser::parse_modules({&module_for_source, 1}));
-		return instantiation::semantic_analysis({&module_for_source, 1}, {0});
+		return instantiation::semantic_analysis({&module_for_source, 1}, {0}, function_body_analysis);
 	}
 
 	auto parse_and_run(std::string_view src) -> int
@@ -54,9 +62,10 @@ namespace tests
 		return assert_get(interpreter::run(program));
 	}
 
+	// Analyzes every function, including the ones that are never called.
 	auto source_compiles(std::string_view src) noexcept -> bool
 	{
-		return parse_source(src).has_value();
+		return parse_source(src, instantiation::FunctionBodyAnalysis::eager).has_value();
 	}
 
 	auto parse_and_print(std::string_view src) -> void
@@ -497,6 +506,45 @@ TEST_CASE("Negation operator")
 	REQUIRE(tests::parse_and_run(src) == -5);
 }
 
+TEST_CASE("Binary operators bind by precedence, left to right within the same precedence, and a parenthesized operand is kept whole")
+{
+	auto const src = R"(
+		let main = fn () -> int32
+		{
+			return 10 - (2 + 3) * 2 + 20 / 2 / 5 - 1 * 2 * 3 + (1 << 3) % 5;
+		};
+	)"sv;
+
+	REQUIRE(tests::parse_and_run(src) == -1);
+}
+
+TEST_CASE("Expressions with hundreds of operators are parsed into left associative trees")
+{
+	std::string expression = "0";
+	for (int i = 1; i <= 500; ++i)
+		expression += " + " + std::to_string(i) + " * 2 - " + std::to_string(i);
+
+	incomplete::Module module_for_source;
+	module_for_source.files.push_back({"<source>", "let x = " + expression + ";"});
+	REQUIRE(parser::parse_modules({&module_for_source, 1}).has_value());
+	REQUIRE(module_for_source.statements.size() == 1);
+
+	// (((0 + 1 * 2) - 1) + 2 * 2) - 2...: The left spine alternates - and +, and the right operand of each + is a multiplication.
+	using incomplete::expression::BinaryOperatorCall;
+	incomplete::Expression const * node = &std::get<incomplete::statement::LetDeclaration>(module_for_source.statements[0].variant).assigned_expression;
+	int spine_length = 0;
+	while (has_type<BinaryOperatorCall>(node->variant))
+	{
+		BinaryOperatorCall const & op = std::get<BinaryOperatorCall>(node->variant);
+		REQUIRE(op.op == (spine_length % 2 == 0 ? Operator::subtract : Operator::add));
+		if (op.op == Operator::add)
+			REQUIRE(std::get<BinaryOperatorCall>(op.right->variant).op == Operator::multiply);
+		node = op.left.get();
+		++spine_length;
+	}
+	REQUIRE(spine_length == 1000);
+}
+
 TEST_CASE("Struct")
 {
 	auto const src = R"(
@@ -587,6 +635,25 @@ TEST_CASE("Mutating a member")
 	REQUIRE(tests::parse_and_run(src) == 5 + -7);
 }
 
+TEST_CASE("A new program starts with the built-in types and finds the intrinsics in the shared prelude")
+{
+	complete::Program program;
+	REQUIRE(program.types.size() == size_t(complete::TypeId::null_t.index) + 1);
+	REQUIRE(program.global_scope.types.empty());
+	REQUIRE(program.global_scope.functions.empty());
+	REQUIRE(program.global_scope.function_templates.empty());
+
+	complete::Namespace const & prelude = complete::prelude_scope();
+	REQUIRE(&prelude == &complete::prelude_scope());
+	REQUIRE(find_type(prelude, intern("int32"))->id == complete::TypeId::int32);
+	REQUIRE(find_type(prelude, intern("char"))->id == complete::TypeId::uint8);
+
+	std::vector<FunctionId> functions;
+	find_functions(prelude, intern("+"), functions);
+	REQUIRE(!functions.empty());
+	REQUIRE(functions[0].type == FunctionId::Type::intrinsic);
+}
+
 TEST_CASE("Conversions between reference types of different mutability")
 {
 	complete::Program program;
@@ -1855,6 +1922,20 @@ TEST_CASE("Forgetting a variable name will result in a compiler error")
 	REQUIRE(!program.has_value());
 }
 
+TEST_CASE("A source that ends in the middle of a statement is a syntax error")
+{
+	auto const src = R"(
+		let main = fn() -> int32
+		{
+			return 5;
+		};
+		let x = 
+	)"sv;
+
+	expected<complete::Program, SyntaxError> program = tests::parse_source(src);
+	REQUIRE(!program.has_value());
+}
+
 TEST_CASE("There is no operator + for booleans")
 {
 	auto const src = R"(
@@ -2069,6 +2150,160 @@ TEST_CASE("A module cannot access symbols from a module it does not depend on")
 	REQUIRE(!program.has_value());
 }
 
+TEST_CASE("Modules are parsed in parallel and the first error in parse order is reported")
+{
+	constexpr int module_count = 12;
+
+	// Module i declares a type and uses the ones of the modules before it, which it imports.
+	auto const make_modules = [](int first_module_with_syntax_error, int first_module_with_token_error)
+	{
+		std::vector<incomplete::Module> modules(module_count);
+		for (int i = 0; i < module_count; ++i)
+		{
+			std::string const index = std::to_string(i);
+			std::string const previous = std::to_string(i - 1);
+			std::string types = join("struct Type", index, " { int32 value; }\n");
+			std::string functions = (i == 0)
+				? "let value0 = fn() -> int32 { return Type0(0).value; };\n"
+				: join("let value", index, " = fn() -> int32 { let previous = Type", previous, "(value", previous, "()); return previous.value + ", index, "; };\n");
+
+			if (i >= first_module_with_syntax_error)
+				functions += "let broken = fn() -> int32 { return 1 +; };\n";
+			if (i >= first_module_with_token_error)
+				types += "let x = 1abc;\n";
+
+			modules[i].files.push_back({join("types", index, ".afil"), std::move(types)});
+			modules[i].files.push_back({join("functions", index, ".afil"), std::move(functions)});
+			for (int j = 0; j < i; ++j)
+				modules[i].dependencies.push_back(j);
+		}
+		modules.back().files.push_back({"main.afil", join("let main = fn() -> int32 { return value", std::to_string(module_count - 1), "(); };")});
+		return modules;
+	};
+
+	for (int const thread_count : {1, 8})
+	{
+		std::vector<incomplete::Module> modules = make_modules(module_count, module_count);
+		auto const parse_order = tests::assert_get(parser::parse_modules(modules, nullptr, thread_count));
+		complete::Program const program = tests::assert_get(instantiation::semantic_analysis(modules, parse_order));
+		REQUIRE(tests::assert_get(interpreter::run(program)) == module_count * (module_count - 1) / 2);
+	}
+
+	// The module that fails first in order is reported even if a later one fails first in time.
+	for (int attempt = 0; attempt < 20; ++attempt)
+	{
+		std::vector<incomplete::Module> modules = make_modules(3, 5);
+		auto const result = parser::parse_modules(modules, nullptr, 8);
+		REQUIRE(!result.has_value());
+		REQUIRE(result.error().filename == "functions3.afil");
+	}
+
+	std::vector<incomplete::Module> modules = make_modules(5, 3);
+	auto const result = parser::parse_modules(modules, nullptr, 8);
+	REQUIRE(!result.has_value());
+	REQUIRE(result.error().filename == "types3.afil");
+}
+
+TEST_CASE("Modules that don't depend on each other are analyzed in parallel and give the same program as analyzing them in order")
+{
+	constexpr int module_count = 6;
+
+	// Every module in the middle instantiates the same templates, named constructors and derived types, and uses the same function of the first module.
+	// The first module already evaluated identity(Box<int32>) at compile time, so the middle ones find it in its cache and run its body.
+	auto const make_modules = [](std::string_view extra_source)
+	{
+		std::vector<incomplete::Module> modules(module_count + 2);
+		modules[0].files.push_back({"base.afil", R"(
+			struct<T> Box
+			{
+				T value;
+				constructor from(T x) { return Box<T>(x); }
+			}
+			let twice = fn<T>(T x) { return x + x; };
+			let identity = fn<T>(T t) { return t; };
+			let triple = fn(int32 x) -> int32 { return x * 3; };
+			type base_box = identity(Box<int32>);
+		)"});
+
+		std::string main_body = "0";
+		for (int i = 1; i <= module_count; ++i)
+		{
+			std::string const index = std::to_string(i);
+			modules[i].files.push_back({join("middle", index, ".afil"), join(
+				"struct Local", index, " { int32 x; }\n"
+				"type boxed", index, " = identity(Box<int32>);\n"
+				"let value", index, " = fn() -> int32\n"
+				"{\n"
+				"	let b = boxed", index, "::from(", index, ");\n"
+				"	let p = &b;\n"
+				"	let a = int32[3](", index, ", ", index, ", ", index, ");\n"
+				"	let l = Local", index, "(1);\n"
+				"	return twice((*p).value) + triple(", index, ") + a[1] + size(a) + l.x;\n"
+				"};\n"
+			)});
+			modules[i].dependencies.push_back(0);
+			modules[module_count + 1].dependencies.push_back(i);
+			main_body += join(" + value", index, "()");
+		}
+		modules[module_count + 1].files.push_back({"main.afil", join("let main = fn() -> int32 { return ", main_body, "; };")});
+		modules[2].files.push_back({"extra2.afil", std::string(extra_source)});
+		modules[3].files.push_back({"extra3.afil", std::string(extra_source)});
+		return modules;
+	};
+
+	auto const analyze = [](span<incomplete::Module const> modules, int thread_count)
+	{
+		std::vector<int> parse_order(modules.size());
+		std::iota(parse_order.begin(), parse_order.end(), 0);
+		return instantiation::semantic_analysis(modules, parse_order, instantiation::FunctionBodyAnalysis::lazy, instantiation::ProgramAllocation::arena, thread_count);
+	};
+
+	std::vector<incomplete::Module> modules = make_modules("");
+	REQUIRE(parser::parse_modules(modules).has_value());
+	complete::Program const serial_program = tests::assert_get(analyze(modules, 1));
+	complete::Program const parallel_program = tests::assert_get(analyze(modules, 4));
+	REQUIRE(tests::assert_get(interpreter::run(serial_program)) == 6 * 21 + 4 * module_count);
+	REQUIRE(tests::assert_get(interpreter::run(parallel_program)) == 6 * 21 + 4 * module_count);
+	// The instantiations and derived types of different threads are merged.
+	REQUIRE(parallel_program.types.size() == serial_program.types.size());
+	REQUIRE(parallel_program.structs.size() == serial_program.structs.size());
+
+	// The parse order goes by dependency depth, so ids don't depend on the number of threads.
+	auto const type_names = [](complete::Program const & program)
+	{
+		std::vector<std::string> names;
+		for (complete::Type const & type : program.types)
+			names.push_back(type.ABI_name);
+		return names;
+	};
+	auto const function_names = [](complete::Program const & program)
+	{
+		std::vector<std::string> names;
+		for (complete::Function const & function : program.functions)
+			names.push_back(function.ABI_name);
+		return names;
+	};
+	for (int const thread_count : {2, 3, 8})
+	{
+		complete::Program const program = tests::assert_get(analyze(modules, thread_count));
+		REQUIRE(type_names(program) == type_names(serial_program));
+		REQUIRE(function_names(program) == function_names(serial_program));
+		REQUIRE(program.main_function == serial_program.main_function);
+	}
+	REQUIRE(type_names(parallel_program) == type_names(serial_program));
+	REQUIRE(function_names(parallel_program) == function_names(serial_program));
+
+	// Errors are the same as when the modules are analyzed in order, even if the shard of a later module fails first.
+	std::vector<incomplete::Module> modules_with_error = make_modules("let broken = undeclared + 1;");
+	REQUIRE(parser::parse_modules(modules_with_error).has_value());
+	auto const serial_result = analyze(modules_with_error, 1);
+	auto const parallel_result = analyze(modules_with_error, 4);
+	REQUIRE(!serial_result.has_value());
+	REQUIRE(!parallel_result.has_value());
+	REQUIRE(parallel_result.error().filename == "extra2.afil");
+	REQUIRE(parallel_result.error().error_message == serial_result.error().error_message);
+}
+
 TEST_CASE("Order of declarations doesn't matter for types either")
 {
 	auto const src = R"(
@@ -2553,6 +2788,24 @@ TEST_CASE("Nested namespace declaration")
 	REQUIRE(tests::parse_and_run(src) == 7);
 }
 
+TEST_CASE("Names may be preceded by more namespaces than the parser keeps tokens to look back at")
+{
+	// Every namespace is read as part of a type name before the parser goes back to read an expression.
+	std::string src;
+	for (int i = 0; i < 100; ++i)
+		src += "namespace n { ";
+	src += "let f = fn() -> int32 { return 3; }; ";
+	for (int i = 0; i < 100; ++i)
+		src += "} ";
+
+	src += "let main = fn() -> int32 { return ";
+	for (int i = 0; i < 100; ++i)
+		src += "n::";
+	src += "f(); };";
+
+	REQUIRE(tests::parse_and_run(src) == 3);
+}
+
 TEST_CASE("Types inside namespaces")
 {
 	auto const src = R"(
@@ -2775,6 +3028,34 @@ TEST_CASE("User defined implicit conversions")
 	REQUIRE(tests::parse_and_run(src) == 1);
 }
 
+TEST_CASE("An error in the body of an implicit conversion is reported instead of a missing conversion")
+{
+	auto const src = R"(
+		struct TestStruct
+		{
+			int32 value;
+		}
+
+		implicit conversion fn(TestStruct s) -> bool
+		{
+			return s.value != this_name_does_not_exist;
+		};
+
+		let main = fn() -> int32
+		{
+			let s = TestStruct(5);
+			if (s)
+				return 1;
+			else
+				return 0;
+		};
+	)"sv;
+
+	expected<complete::Program, SyntaxError> program = tests::parse_source(src);
+	REQUIRE(!program.has_value());
+	REQUIRE(program.error().error_message.find("this_name_does_not_exist") != std::string::npos);
+}
+
 TEST_CASE("Pointer comparisons")
 {
 	auto const src = R"(
@@ -3282,6 +3563,31 @@ TEST_CASE("A struct may define named constructors, which are invoked with struct
 	REQUIRE(tests::parse_and_run(src) == 1);
 }
 
+TEST_CASE("Named constructors of struct templates are only instantiated when used")
+{
+	auto const src = R"(
+		struct<T> Wrapper
+		{
+			T value;
+
+			constructor from(T x) { return Wrapper<T>(x); }
+			constructor doubled(T x) { return Wrapper<T>(x * 2); }
+		}
+
+		let main = fn() -> int32
+		{
+			let b = Wrapper<bool>::from(true);
+			let i = Wrapper<int32>::doubled(3);
+
+			if (b.value)
+				return i.value;
+			return 0;
+		};
+	)"sv;
+
+	REQUIRE(tests::parse_and_run(src) == 6);
+}
+
 TEST_CASE("Move constructor of a type can be explicitly called")
 {
 	auto const src = R"(
@@ -4068,6 +4374,762 @@ TEST_CASE("type_of can be used to return references from function templates")
     REQUIRE(tests::parse_and_run(src) == 6);
 }
 
+TEST_CASE("A shadowed name resolves to its innermost declaration and names of a rolled back compiles block are forgotten")
+{
+	auto const src = R"(
+		let x = 1;
+		let f = fn(int32 x) -> int32 { return x * 10; };
+		let g = fn<T>(T x) -> T { return x * 100; };
+
+		let main = fn() -> int32
+		{
+			let ok = compiles(int32 y){ y + 1; *y };
+			let y = 5;
+			return if (ok) 0 else x + f(2) + g(3) + y * 1000;
+		};
+	)"sv;
+
+	REQUIRE(tests::parse_and_run(src) == 1 + 20 + 300 + 5000);
+}
+
+TEST_CASE("Derived types created in a rolled back compiles block are created again when they are used later")
+{
+	auto const src = R"(
+		let main = fn() -> int32
+		{
+			let ok = compiles(int32 i, float32 f){ &f; float32[2](f, f); i[0] };
+			let a = float32[2](2.5, 0.5);
+			let x = 1.0;
+			let p = &x;
+			return if (ok) 0 else int32(*p + a[0] + a[1]);
+		};
+	)"sv;
+
+	complete::Program const program = tests::assert_get(tests::parse_source(src));
+	for (auto const & [key, type_id] : program.derived_types)
+	{
+		REQUIRE(type_id.index < program.types.size());
+		REQUIRE(complete::derived_type_key(program.types[type_id.index]) == key);
+	}
+	REQUIRE(tests::assert_get(interpreter::run(program)) == 4);
+}
+
+TEST_CASE("The parameter types of a function are the types of its parameters after instantiations are rolled back")
+{
+	auto const src = R"(
+		struct Pair
+		{
+			int32 a;
+			float32 b;
+		}
+		let add = fn<T>(T x, T y) -> T { return x + y; };
+		let second = fn(Pair p, float32 mut & out) -> void { out = p.b; };
+
+		let main = fn() -> int32
+		{
+			let ok = compiles(Pair p, float32 f){ add(f, f); p + p };
+			let mut b = 0.0;
+			second(Pair(1, 2.0), b);
+			return if (ok) 0 else add(1, 2) + int32(add(b, 0.5));
+		};
+	)"sv;
+
+	complete::Program const program = tests::assert_get(tests::parse_source(src, instantiation::FunctionBodyAnalysis::eager));
+	for (complete::Function const & function : program.functions)
+	{
+		REQUIRE(function.parameter_types.size() == static_cast<size_t>(function.parameter_count));
+		for (int i = 0; i < function.parameter_count; ++i)
+			REQUIRE(function.parameter_types[i] == function.variables[i].type);
+	}
+	REQUIRE(tests::assert_get(interpreter::run(program)) == 3 + 2);
+}
+
+TEST_CASE("Cached overload resolutions are not reused after an overload is added or a compiles block is rolled back")
+{
+	auto const src = R"(
+		let twice = fn<T>(T x) -> T { return x + x; };
+
+		let main = fn() -> int32
+		{
+			let ok = compiles(float32 f, int32 i){ twice(f); i[0] };
+			let g = fn(float32 x) -> int32 { return 1; };
+			let a = g(2.0);
+			let g = fn<T>(T x) -> int32 { return 10; };
+			let b = g(2.0);
+			let c = int32(twice(1.5));
+			return if (ok) 0 else a + b * 10 + c * 100;
+		};
+	)"sv;
+
+	// The template overload of g is added after g(2.0) was resolved to the function, and is preferred over it.
+	// The functions declared after the compiles block may take the ids of the instantiations that were rolled back.
+	REQUIRE(tests::parse_and_run(src) == 1 + 100 + 300);
+}
+
+TEST_CASE("Bodies of global functions are only analyzed if they are used")
+{
+	auto const src = R"(
+		let unused = fn(int32 x) -> int32
+		{
+			return x + this_name_does_not_exist;
+		};
+
+		let square = fn(int32 x) -> int32
+		{
+			return x * x;
+		};
+
+		let main = fn() -> int32
+		{
+			return square(4);
+		};
+	)"sv;
+
+	REQUIRE(tests::parse_and_run(src) == 16);
+	REQUIRE(!tests::source_compiles(src));
+}
+
+TEST_CASE("Modules analyzed with eager function body analysis report errors in functions that are never used")
+{
+	std::filesystem::path const directory = std::filesystem::temp_directory_path() / "afil_function_body_analysis_tests";
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory);
+	std::string const module_name = directory.string() + "/main";
+
+	REQUIRE(write_whole_binary_file(module_name + ".afilm", join("file ", module_name, ".afil\n")));
+	REQUIRE(write_whole_binary_file(module_name + ".afil", R"(
+		let unused = fn(int32 x) -> int32
+		{
+			return x + this_name_does_not_exist;
+		};
+
+		let main = fn() -> int32
+		{
+			return 4;
+		};
+	)"sv));
+
+	{
+		complete::Program const program = tests::assert_get(afil::parse_module(module_name));
+		REQUIRE(tests::assert_get(interpreter::run(program)) == 4);
+
+		// The body of unused was never analyzed, and nothing is left pointing into the modules, which are gone.
+		REQUIRE(program.deferred_function_bodies.size() == 1);
+		REQUIRE(!program.deferred_function_bodies[0].is_analyzed);
+		for (complete::DeferredFunctionBody const & deferred_body : program.deferred_function_bodies)
+		{
+			REQUIRE(deferred_body.incomplete_function == nullptr);
+			REQUIRE(deferred_body.scope_stack.empty());
+		}
+
+		REQUIRE(!afil::parse_module(module_name, nullptr, nullptr, instantiation::FunctionBodyAnalysis::eager).has_value());
+	}
+
+	std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Overload sets may have more than 64 candidates")
+{
+	std::string src;
+	for (int i = 0; i < 100; ++i)
+	{
+		src += "struct S" + std::to_string(i) + " { int32 value = " + std::to_string(i) + "; }\n";
+		src += "let f = fn(S" + std::to_string(i) + " s) -> int32 { return s.value; };\n";
+	}
+	src += R"(
+		let main = fn() -> int32
+		{
+			return f(S99()) + f(S99()) - f(S3());
+		};
+	)";
+
+	REQUIRE(tests::parse_and_run(src) == 99 + 99 - 3);
+}
+
+TEST_CASE("Instantiations of a template for types with the same layout share their code")
+{
+	auto const src = R"(
+		struct A { int32 value; }
+		struct B { int32 value; }
+		struct C { int32 padding; int32 value; }
+
+		let value_of = fn<T>(T t) -> int32
+		{
+			let value = t.value;
+			return value;
+		};
+
+		let main = fn() -> int32
+		{
+			return value_of(A(1)) + value_of(B(20)) + value_of(C(0, 300));
+		};
+	)"sv;
+
+	complete::Program const program = tests::assert_get(tests::parse_source(src));
+	REQUIRE(tests::assert_get(interpreter::run(program)) == 321);
+
+	// A and B share one instantiation, while the one for C has a different member offset.
+	auto const has_body = [](complete::Function const & function) { return !function.statements.empty(); };
+	REQUIRE(std::count_if(program.functions.begin(), program.functions.end(), has_body) == 3);
+
+	// Folding can be turned off to keep every body.
+	incomplete::Module module_for_source;
+	module_for_source.files.push_back({"<source>", std::string(src)});
+	REQUIRE(parser::parse_modules({&module_for_source, 1}).has_value());
+	complete::Program const unfolded_program = tests::assert_get(instantiation::semantic_analysis({&module_for_source, 1}, {0},
+		instantiation::FunctionBodyAnalysis::lazy, instantiation::ProgramAllocation::arena, 0, instantiation::FunctionFolding::keep));
+	REQUIRE(tests::assert_get(interpreter::run(unfolded_program)) == 321);
+	REQUIRE(std::count_if(unfolded_program.functions.begin(), unfolded_program.functions.end(), has_body) == 4);
+
+	// The local variables of the functions that were folded away are removed from the name index of their scope too.
+	for (complete::Function const & function : program.functions)
+		for (auto const & [name, entries] : function.name_index.entries)
+			for (complete::ScopeNameIndex::Entry const & entry : entries)
+				REQUIRE((entry.kind != complete::NameKind::variable || entry.index < function.variables.size()));
+}
+
+TEST_CASE("Function templates that only depend on the layout of their parameters are analyzed once per layout")
+{
+	auto const src = R"(
+		let exchange = fn<T>(T mut & variable, T new_value) -> T
+		{
+			let old_value = variable;
+			variable = new_value;
+			return old_value;
+		};
+
+		struct S { int32 value; }
+
+		let main = fn() -> int32
+		{
+			let mut i = 1;
+			let mut s = S(20);
+			let mut f = 0.5;
+
+			let old_i = exchange(i, 300);
+			let old_s = exchange(s, S(4000));
+			exchange(f, 2.5);
+
+			if (f == 2.5)
+				return old_i + old_s.value + i + s.value;
+			return 0;
+		};
+	)"sv;
+
+	complete::Program const program = tests::assert_get(tests::parse_source(src));
+	REQUIRE(tests::assert_get(interpreter::run(program)) == 4321);
+
+	// The instantiations for int32, S and float are built from a single one for a placeholder of 4 bytes,
+	// which is kept by the template cache and is not part of the program.
+	auto const is_placeholder = [](complete::Type const & type) { return type.ABI_name.rfind("layout_placeholder_", 0) == 0; };
+	auto const placeholder = std::find_if(program.types.begin(), program.types.end(), is_placeholder);
+	REQUIRE(placeholder != program.types.end());
+	auto const placeholder_index = static_cast<unsigned>(placeholder - program.types.begin());
+	auto const uses_placeholder = [=](complete::Function const & function)
+	{
+		return function.return_type.index == placeholder_index || std::any_of(function.parameter_types.begin(), function.parameter_types.end(),
+			[=](complete::TypeId parameter_type) { return parameter_type.index == placeholder_index; });
+	};
+	REQUIRE(std::none_of(program.functions.begin(), program.functions.end(), uses_placeholder));
+}
+
+TEST_CASE("Constants in instantiations that share their code have the actual types")
+{
+	auto const src = R"(
+		let clear = fn<T>(T mut & x) -> int32
+		{
+			let mut p = &x;
+			p = null;
+			return 1;
+		};
+
+		struct S { int32 value; }
+
+		let main = fn() -> int32
+		{
+			let mut i = 3;
+			let mut s = S(4);
+			return clear(i) + clear(s);
+		};
+	)"sv;
+
+	complete::Program const program = tests::assert_get(tests::parse_source(src));
+	REQUIRE(tests::assert_get(interpreter::run(program)) == 2);
+
+	// The null pointer assigned to p is a pointer to the actual type, not to the placeholder.
+	int instantiations = 0;
+	for (complete::Function const & function : program.functions)
+	{
+		if (function.ABI_name != "clear" || function.statements.empty())
+			continue;
+
+		auto const & statement = std::get<complete::statement::ExpressionStatement>(function.statements[1].as_variant());
+		auto const & assignment = std::get<complete::expression::Assignment>(statement.expression.as_variant());
+		auto const & destination = std::get<complete::expression::LocalVariable>(assignment.destination->as_variant());
+		auto const & dereference = std::get<complete::expression::Dereference>(assignment.source->as_variant());
+		auto const & constant = std::get<complete::expression::Constant>(dereference.expression->as_variant());
+		REQUIRE(constant.type.index == destination.variable_type.index);
+		++instantiations;
+	}
+	REQUIRE(instantiations == 2);
+}
+
+TEST_CASE("Function templates whose body depends on more than the layout of their parameters are analyzed for each type")
+{
+	auto const src = R"(
+		let f = fn<T>(T x) -> int32
+		{
+			return if (compiles(T a){a + a}) 2 else 1;
+		};
+		let g = fn<T>(T x) -> int32
+		{
+			let twice = fn<U>(U y) -> U { return y + y; };
+			return twice(x);
+		};
+
+		struct S { int32 value; }
+
+		let main = fn() -> int32
+		{
+			return f(5) + f(S(1)) * 10 + g(50) * 100;
+		};
+	)"sv;
+
+	complete::Program const program = tests::assert_get(tests::parse_source(src));
+	REQUIRE(tests::assert_get(interpreter::run(program)) == 2 + 10 + 10000);
+
+	// Nothing is left behind from the attempts to analyze them for placeholders.
+	auto const is_placeholder = [](complete::Type const & type) { return type.ABI_name.rfind("layout_placeholder_", 0) == 0; };
+	REQUIRE(std::none_of(program.types.begin(), program.types.end(), is_placeholder));
+}
+
+TEST_CASE("Templates declared inside an instantiated template can be instantiated after the modules are gone")
+{
+	auto const src = R"(
+		let outer = fn<T>(T x) -> T
+		{
+			let twice = fn<U>(U y) -> U { return y + y; };
+			return twice(x) + x;
+		};
+
+		let main = fn() -> int32
+		{
+			return outer(3) + int32(outer(1.5));
+		};
+	)"sv;
+
+	complete::Program const program = tests::assert_get(tests::parse_source(src));
+	for (complete::FunctionTemplate const & function_template : program.function_templates)
+	{
+		REQUIRE(function_template.incomplete_function != nullptr);
+		REQUIRE(function_template.scope_stack != nullptr);
+	}
+	REQUIRE(tests::assert_get(interpreter::run(program)) == 9 + 4);
+}
+
+TEST_CASE("Programs may be allocated from an arena or from the heap")
+{
+	auto const src = R"(
+		let sum_of_squares = fn(int32 n) -> int32
+		{
+			let mut sum = 0;
+			for (let mut i = 1; i <= n; i = i + 1)
+				sum = sum + i * i;
+			return sum;
+		};
+
+		let main = fn() -> int32
+		{
+			return sum_of_squares(4);
+		};
+	)"sv;
+
+	for (auto const allocation : {instantiation::ProgramAllocation::arena, instantiation::ProgramAllocation::heap})
+	{
+		incomplete::Module module_for_source;
+		module_for_source.files.push_back({"<source>", std::string(src)});
+		REQUIRE(parser::parse_modules({&module_for_source, 1}).has_value());
+
+		// Move assign over a program that has its own nodes, which must be released into its own arena.
+		complete::Program program = tests::assert_get(instantiation::semantic_analysis({&module_for_source, 1}, {0}, instantiation::FunctionBodyAnalysis::eager, allocation));
+		program = tests::assert_get(instantiation::semantic_analysis({&module_for_source, 1}, {0}, instantiation::FunctionBodyAnalysis::lazy, allocation));
+		REQUIRE((program.arena.resource != nullptr) == (allocation == instantiation::ProgramAllocation::arena));
+		REQUIRE(tests::assert_get(interpreter::run(program)) == 30);
+	}
+}
+
+TEST_CASE("The nodes of a parsed module stay valid when the module is moved")
+{
+	auto const src = R"(
+		struct<T> Pair
+		{
+			T first;
+			T second;
+		}
+
+		let sum = fn<T>(Pair<T> pair) -> T
+		{
+			return pair.first + pair.second;
+		};
+
+		let main = fn() -> int32
+		{
+			let pair = Pair<int32>(20, 22);
+			return sum(pair);
+		};
+	)"sv;
+
+	std::vector<incomplete::Module> modules(1);
+	modules[0].files.push_back({"<source>", std::string(src)});
+	REQUIRE(parser::parse_modules(modules).has_value());
+	REQUIRE(modules[0].arena.resource != nullptr);
+
+	// Grow the vector so that the module is moved, and then move it again into a module that was parsed too.
+	modules.resize(16);
+	incomplete::Module other_module;
+	other_module.files.push_back({"<source>", "let main = fn() -> int32 { return 0; };"});
+	REQUIRE(parser::parse_modules({&other_module, 1}).has_value());
+	other_module = std::move(modules[0]);
+
+	complete::Program const program = tests::assert_get(instantiation::semantic_analysis({&other_module, 1}, {0}));
+	REQUIRE(tests::assert_get(interpreter::run(program)) == 42);
+}
+
+TEST_CASE("Modules that have not changed are loaded from the module cache instead of parsed")
+{
+	auto const library = R"(
+		struct ivec2
+		{
+			int32 x;
+			int32 y;
+		}
+
+		let operator+ = fn(ivec2 a, ivec2 b) -> ivec2
+		{
+			return ivec2(a.x + b.x, a.y + b.y);
+		};
+	)"sv;
+
+	auto const main = R"(
+		let main = fn() -> int32
+		{
+			let v = ivec2(4, 5) + ivec2(-1, 3);
+			return v.x * 10 + v.y;
+		};
+	)"sv;
+
+	incomplete::ModuleCache cache;
+	cache.directory = std::filesystem::temp_directory_path() / "afil_module_cache_tests";
+	std::filesystem::remove_all(cache.directory);
+
+	auto const compile_and_run = [&](std::string_view library_source) -> int
+	{
+		incomplete::Module modules[2];
+		modules[0].files.push_back({"ivec2.afil", std::string(library_source)});
+		modules[1].files.push_back({"main.afil", std::string(main)});
+		modules[1].dependencies.push_back(0);
+		auto const parse_order = tests::assert_get(parser::parse_modules(modules, &cache));
+		complete::Program const program = tests::assert_get(instantiation::semantic_analysis(modules, parse_order));
+		return tests::assert_get(interpreter::run(program));
+	};
+
+	auto const count_cache_entries = [&]()
+	{
+		return std::distance(std::filesystem::directory_iterator(cache.directory), std::filesystem::directory_iterator());
+	};
+
+	// Entries are only written when a module is parsed, so entries that keep their time were loaded instead of parsed.
+	auto const cache_entry_times = [&]()
+	{
+		std::vector<std::pair<std::filesystem::path, std::filesystem::file_time_type>> entry_times;
+		for (std::filesystem::directory_entry const & entry : std::filesystem::directory_iterator(cache.directory))
+			entry_times.push_back({entry.path(), entry.last_write_time()});
+		std::sort(entry_times.begin(), entry_times.end());
+		return entry_times;
+	};
+
+	REQUIRE(compile_and_run(library) == 38);
+	REQUIRE(count_cache_entries() == 2);
+	for (std::filesystem::directory_entry const & entry : std::filesystem::directory_iterator(cache.directory))
+		std::filesystem::last_write_time(entry.path(), entry.last_write_time() - std::chrono::hours(1));
+	auto const first_entry_times = cache_entry_times();
+
+	// Everything comes from the cache the second time.
+	REQUIRE(compile_and_run(library) == 38);
+	REQUIRE(cache_entry_times() == first_entry_times);
+
+	// Changing a module changes the hash of the modules that import it.
+	REQUIRE(compile_and_run(replace(library, "a.y + b.y", "a.y - b.y")) == 32);
+	REQUIRE(count_cache_entries() == 4);
+
+	incomplete::Module module;
+	module.files.push_back({"main.afil", std::string(main)});
+	std::vector<parser::TypeName> type_names;
+	REQUIRE(!incomplete::load_cached_module(cache, 0, module, out(type_names)));
+	REQUIRE(module.statements.empty());
+
+	std::filesystem::remove_all(cache.directory);
+}
+
+TEST_CASE("Source files are mapped from disk and compiled without being copied")
+{
+	std::filesystem::path const directory = std::filesystem::temp_directory_path() / "afil_mapped_file_tests";
+	std::filesystem::create_directories(directory);
+	std::filesystem::path const source_path = directory / "main.afil";
+	std::filesystem::path const empty_path = directory / "empty.afil";
+
+	// Windows line endings are not translated when a file is mapped.
+	REQUIRE(write_whole_binary_file(source_path, "let main = fn() -> int32\r\n{\r\n\treturn 3 * 7;\r\n};\r\n"sv));
+	REQUIRE(write_whole_binary_file(empty_path, ""sv));
+
+	{
+		std::optional<SourceBuffer> source = load_source_file(source_path);
+		REQUIRE(source.has_value());
+		char const * const mapped_text = source->data();
+
+		std::vector<incomplete::Module> modules(1);
+		modules[0].files.push_back({"main.afil", std::move(*source)});
+		REQUIRE(modules[0].files[0].source.data() == mapped_text);
+
+		auto const parse_order = tests::assert_get(parser::parse_modules(modules));
+		modules.reserve(16); // The tokens still point to the mapped file after the modules are moved.
+		complete::Program const program = tests::assert_get(instantiation::semantic_analysis(modules, parse_order));
+		REQUIRE(tests::assert_get(interpreter::run(program)) == 21);
+
+		std::optional<SourceBuffer> const empty = load_source_file(empty_path);
+		REQUIRE(empty.has_value());
+		REQUIRE(std::string_view(*empty).empty());
+
+		REQUIRE(!load_source_file(directory / "missing.afil").has_value());
+		REQUIRE(!load_source_file(directory).has_value());
+	}
+
+	std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("A module resolver loads the files that modules share once and loads them again when they change")
+{
+	std::filesystem::path const directory = std::filesystem::temp_directory_path() / "afil_module_resolver_tests";
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory);
+	std::string const prefix = directory.string() + '/';
+
+	std::filesystem::path const library_path = directory / "library.afil";
+	REQUIRE(write_whole_binary_file(directory / "library.afilm", join("file ", prefix, "library.afil\n")));
+	REQUIRE(write_whole_binary_file(library_path, "let twice = fn(int32 x) -> int32 { return x * 2; };\n"sv));
+	for (std::string_view const name : {"a"sv, "b"sv})
+	{
+		REQUIRE(write_whole_binary_file(directory / join(name, ".afilm"), join("import ", prefix, "library\nfile ", prefix, name, ".afil\n")));
+		REQUIRE(write_whole_binary_file(directory / join(name, ".afil"), join("let main = fn() -> int32 { return twice(", name == "a" ? 3 : 5, "); };\n")));
+	}
+
+	{
+		incomplete::ModuleResolver resolver;
+		auto const run_module = [&](std::string_view name)
+		{
+			complete::Program const program = tests::assert_get(afil::parse_module(join(prefix, name), nullptr, &resolver));
+			return tests::assert_get(interpreter::run(program));
+		};
+
+		REQUIRE(run_module("a") == 6);
+		std::filesystem::path const * const canonical_library_path = incomplete::resolve_canonical_path(resolver, library_path);
+		REQUIRE(canonical_library_path != nullptr);
+		char const * const library_text = incomplete::load_source(resolver, *canonical_library_path)->data();
+
+		// The library is shared with the first module instead of being loaded again.
+		REQUIRE(run_module("b") == 10);
+		REQUIRE(incomplete::resolve_canonical_path(resolver, library_path) == canonical_library_path);
+		REQUIRE(incomplete::load_source(resolver, *canonical_library_path)->data() == library_text);
+
+		// Written right after it was loaded, possibly within the resolution of the write time, but the size changes.
+		REQUIRE(write_whole_binary_file(library_path, "let twice = fn(int32 x) -> int32 { return x + x + 1; };\n"sv));
+		REQUIRE(run_module("b") == 11);
+
+		std::filesystem::remove(library_path);
+		REQUIRE(!afil::parse_module(join(prefix, "a"), nullptr, &resolver).has_value());
+		REQUIRE(!afil::parse_module(join(prefix, "missing"), nullptr, &resolver).has_value());
+	}
+
+	std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("A compiler daemon analyzes a module again only when one of its files changes")
+{
+	std::filesystem::path const directory = std::filesystem::temp_directory_path() / "afil_compiler_daemon_tests";
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory);
+	std::string const prefix = directory.string() + '/';
+	std::string const module_name = prefix + "main";
+
+	std::filesystem::path const library_path = directory / "library.afil";
+	REQUIRE(write_whole_binary_file(directory / "library.afilm", join("file ", prefix, "library.afil\n")));
+	REQUIRE(write_whole_binary_file(library_path, "let twice = fn(int32 x) -> int32 { return x * 2; };\n"sv));
+	REQUIRE(write_whole_binary_file(directory / "main.afilm", join("import ", prefix, "library\nfile ", prefix, "main.afil\n")));
+	REQUIRE(write_whole_binary_file(directory / "main.afil", "let main = fn() -> int32 { return twice(3); };\n"sv));
+
+	{
+		afil::CompilerDaemon daemon;
+		REQUIRE(afil::serve_request(daemon, join("check ", module_name)) == "ok\n");
+		complete::Program const * const program = tests::assert_get(afil::analyzed_program(daemon, module_name));
+		complete::Type const * const analyzed_types = program->types.data();
+
+		// Nothing changed, so the program that was analyzed for the first request is reused.
+		REQUIRE(afil::serve_request(daemon, join("run ", module_name, '\n')) == "ok\n6\n");
+		REQUIRE(tests::assert_get(afil::analyzed_program(daemon, module_name)) == program);
+		REQUIRE(program->types.data() == analyzed_types);
+
+		// Written right after it was loaded, possibly within the resolution of the write time, but the size changes.
+		REQUIRE(write_whole_binary_file(library_path, "let twice = fn(int32 x) -> int32 { return x + x + 1; };\n"sv));
+		REQUIRE(afil::serve_request(daemon, join("run ", module_name)) == "ok\n7\n");
+		REQUIRE(program->types.data() != analyzed_types);
+
+		std::filesystem::path const image_path = directory / "main.afilc";
+		REQUIRE(afil::serve_request(daemon, join("compile ", module_name, ' ', image_path)) == "ok\n");
+		auto const image = complete::load_program_image(image_path);
+		REQUIRE(image.has_value());
+		REQUIRE(tests::assert_get(interpreter::run(*image)) == 7);
+
+		// The files may be truncated while the daemon keeps them, which would make reading a mapping of them raise SIGBUS.
+		for (auto const & [path, loaded_source] : daemon.resolver.sources)
+			REQUIRE(!loaded_source.source.is_mapped());
+
+		// The parsed modules stay in memory without a module cache, and only the ones that changed are parsed again.
+		auto const parsed_library = [&]() -> incomplete::Module const *
+		{
+			for (auto const & [hash, parsed_module] : daemon.parsed_modules)
+				if (parsed_module.module.files[0].filename == library_path.string())
+					return &parsed_module.module;
+			return nullptr;
+		};
+		REQUIRE(daemon.parsed_modules.size() == 2);
+		REQUIRE(parsed_library() != nullptr);
+		incomplete::Statement const * const library_statements = parsed_library()->statements.data();
+
+		// Programs that don't finish are killed.
+		REQUIRE(write_whole_binary_file(directory / "main.afil", "let main = fn() -> int32 { let mut i = 0; while (i >= 0) i = i * 1; return i; };\n"sv));
+		daemon.run_time_limit_milliseconds = 100;
+		REQUIRE(afil::serve_request(daemon, join("run ", module_name)) == "error\nThe program did not finish in 100 milliseconds.\n");
+		REQUIRE(daemon.parsed_modules.size() == 2);
+		REQUIRE(parsed_library() != nullptr);
+		REQUIRE(parsed_library()->statements.data() == library_statements);
+
+		REQUIRE(starts_with(afil::serve_request(daemon, join("build ", module_name)), "error\nUnknown command build"));
+		REQUIRE(starts_with(afil::serve_request(daemon, "run"), "error\n"));
+		REQUIRE(starts_with(afil::serve_request(daemon, join("run ", prefix, "missing")), "error\n"));
+	}
+
+	std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("An analyzed program can be saved as an image and run again without being analyzed")
+{
+	auto const src = R"(
+		let mut global = 3;
+
+		struct DestructorTest
+		{
+			int32 value;
+
+			constructor default () { return DestructorTest(7); }
+
+			destructor(DestructorTest mut & this)
+			{
+				global = global * 10 + this.value;
+			}
+		}
+
+		let sum = fn<T>(T a, T b) -> T
+		{
+			return a + b;
+		};
+
+		let main = fn() -> int32
+		{
+			{
+				let x = DestructorTest();
+				let numbers = int32[3](1, 2, 3);
+				global = global + sum(numbers[1], 1);
+			}
+			return global;
+		};
+	)"sv;
+
+	complete::Program const program = tests::assert_get(tests::parse_source(src));
+	std::optional<std::string> const image = complete::write_program_image(program);
+	REQUIRE(image.has_value());
+
+	auto loaded_program = complete::read_program_image(*image);
+	REQUIRE(loaded_program.has_value());
+	REQUIRE(tests::assert_get(interpreter::run(*loaded_program)) == 67);
+	REQUIRE(tests::assert_get(interpreter::run(program)) == 67);
+
+	// Truncated or modified images are rejected.
+	REQUIRE(!complete::read_program_image(std::string_view(*image).substr(0, image->size() / 2)).has_value());
+	std::string corrupted_image = *image;
+	corrupted_image[0] = 'x';
+	REQUIRE(!complete::read_program_image(corrupted_image).has_value());
+
+	// So are images whose ids are out of range. The id of the main function is the last thing in the image.
+	std::string image_with_bad_id = *image;
+	FunctionId const out_of_range_main = {FunctionId::Type::program, static_cast<unsigned>(program.functions.size())};
+	memcpy(image_with_bad_id.data() + image_with_bad_id.size() - sizeof(FunctionId), &out_of_range_main, sizeof(FunctionId));
+	REQUIRE(!complete::read_program_image(image_with_bad_id).has_value());
+}
+
+TEST_CASE("Program images with enums or built-in types that the interpreter does not handle are rejected")
+{
+	auto const src = R"(
+		struct Number
+		{
+			int32 value;
+		}
+
+		let operator<=> = fn(Number a, Number b) -> int32
+		{
+			return a.value - b.value;
+		};
+
+		let less = fn(Number a, Number b) -> bool
+		{
+			return a < b;
+		};
+
+		let main = fn() -> int32
+		{
+			if (less(Number(3), Number(5)))
+				return 1;
+			else
+				return 0;
+		};
+	)"sv;
+
+	auto const comparison_in_less = [](complete::Program & program) -> complete::expression::RelationalOperatorCall &
+	{
+		auto const less = std::find_if(program.functions.begin(), program.functions.end(), [](complete::Function const & function) { return function.ABI_name == "less"; });
+		REQUIRE(less != program.functions.end());
+		auto & return_statement = std::get<complete::statement::Return>(less->statements[0].as_variant());
+		return std::get<complete::expression::RelationalOperatorCall>(return_statement.returned_expression.as_variant());
+	};
+
+	complete::Program program = tests::assert_get(tests::parse_source(src));
+	auto const image_can_be_read = [&program]()
+	{
+		std::optional<std::string> const image = complete::write_program_image(program);
+		REQUIRE(image.has_value());
+		return complete::read_program_image(*image).has_value();
+	};
+	REQUIRE(image_can_be_read());
+
+	Operator const op = comparison_in_less(program).op;
+	comparison_in_less(program).op = Operator::add;
+	REQUIRE(!image_can_be_read());
+	comparison_in_less(program).op = op;
+	REQUIRE(image_can_be_read());
+
+	program.types[complete::TypeId::int32.index].extra_data = complete::Type::Pointer{complete::TypeId::int32};
+	REQUIRE(!image_can_be_read());
+}
+
 #if 0
 TEST_CASE("A function pointer type may point to any function with its signature and dispatch at runtime")
 {
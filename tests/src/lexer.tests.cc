@@ -0,0 +1,182 @@
+#include <catch2/catch.hpp>
+#include "lexer.hh"
+#include <chrono>
+#include <string>
+
+using namespace std::literals;
+using lex::Token;
+
+namespace
+{
+	auto token_types(std::vector<Token> const & tokens) -> std::vector<Token::Type>
+	{
+		std::vector<Token::Type> types;
+		for (Token const & token : tokens)
+			types.push_back(token.type);
+		return types;
+	}
+
+	auto token_sources(std::vector<Token> const & tokens, std::string_view source) -> std::vector<std::string_view>
+	{
+		std::vector<std::string_view> sources;
+		for (Token const & token : tokens)
+			sources.push_back(token.text(source));
+		return sources;
+	}
+}
+
+TEST_CASE("The lexer classifies every kind of token")
+{
+	std::string_view const source = "let x = a::b(1, 2.5e-3)[0].c -> true and not 'c' <=> \"s\"; { x != y } // end";
+	auto const tokens = lex::tokenize(source);
+	REQUIRE(tokens.has_value());
+	REQUIRE(token_sources(*tokens, source) == std::vector<std::string_view>{
+		"let", "x", "=", "a", "::", "b", "(", "1", ",", "2.5e-3", ")", "[", "0", "]", ".", "c", "->", "true", "and", "not", "'c'", "<=>", "\"s\"", ";", "{", "x", "!=", "y", "}"
+	});
+	REQUIRE(token_types(*tokens) == std::vector<Token::Type>{
+		Token::Type::identifier, Token::Type::identifier, Token::Type::operator_, Token::Type::identifier, Token::Type::scope_resolution,
+		Token::Type::identifier, Token::Type::open_parenthesis, Token::Type::literal_int, Token::Type::comma, Token::Type::literal_float,
+		Token::Type::close_parenthesis, Token::Type::open_bracket, Token::Type::literal_int, Token::Type::close_bracket, Token::Type::period,
+		Token::Type::identifier, Token::Type::arrow, Token::Type::literal_bool, Token::Type::operator_, Token::Type::operator_,
+		Token::Type::literal_char, Token::Type::operator_, Token::Type::literal_string, Token::Type::semicolon, Token::Type::open_brace,
+		Token::Type::identifier, Token::Type::operator_, Token::Type::identifier, Token::Type::close_brace
+	});
+}
+
+TEST_CASE("Whitespace, comments and identifiers longer than a vector register are tokenized whole")
+{
+	std::string const long_name = "a_" + std::string(70, 'x') + "'#" + std::string(40, 'Y') + "9";
+	std::string const keyword_prefixed_name = "and_" + std::string(50, 'z');
+	std::string const source =
+		std::string(100, ' ') + "\t\r\n" + long_name + std::string(37, '\n') +
+		"/*" + std::string(90, '*') + " * / */" +
+		"//" + std::string(80, '/') + "\n" +
+		keyword_prefixed_name + " true";
+
+	// Not null terminated, so the lexer must not read past the end to decide that "true" is a literal.
+	std::string const buffer = source + "_with_more";
+	auto const tokens = lex::tokenize(std::string_view(buffer).substr(0, source.size()));
+	REQUIRE(tokens.has_value());
+	REQUIRE(token_sources(*tokens, source) == std::vector<std::string_view>{long_name, keyword_prefixed_name, "true"});
+	REQUIRE(token_types(*tokens) == std::vector<Token::Type>{Token::Type::identifier, Token::Type::identifier, Token::Type::literal_bool});
+}
+
+TEST_CASE("A C comment that isn't closed is a syntax error")
+{
+	auto const tokens = lex::tokenize("let x = 3; /*" + std::string(100, '*') + " /");
+	REQUIRE(!tokens.has_value());
+	REQUIRE(tokens.error().error_message == "A C comment must be closed.");
+}
+
+TEST_CASE("Tokens store their length in 16 bits, and the length of longer tokens is found by reading them again")
+{
+	for (size_t const length : {size_t(lex::Token::long_length) - 1, size_t(lex::Token::long_length), size_t(lex::Token::long_length) + 1, size_t(100000)})
+	{
+		std::string const name = std::string(length, 'x');
+		std::string const source = "let " + name + " = \"" + name + "\";";
+		auto tokens = lex::tokenize(source);
+		REQUIRE(tokens.has_value());
+		REQUIRE(tokens->size() == 5);
+		REQUIRE((*tokens)[1].text(source) == name);
+		REQUIRE((*tokens)[2].text(source) == "=");
+		REQUIRE((*tokens)[3].text(source) == "\"" + name + "\"");
+		REQUIRE((*tokens)[4].text(source) == ";");
+	}
+}
+
+TEST_CASE("A token stream reads the same tokens as tokenize while keeping only a window of them")
+{
+	std::string source;
+	for (int i = 0; i < 1000; ++i)
+		source += "let x" + std::to_string(i) + " = f(" + std::to_string(i) + ", true) and y; // Comment\n";
+
+	auto tokens = lex::tokenize(source);
+	REQUIRE(tokens.has_value());
+
+	lex::TokenStream stream(source);
+	for (size_t i = 0; i < tokens->size(); ++i)
+	{
+		REQUIRE(stream.text(i) == (*tokens)[i].text(source));
+		REQUIRE(stream[i].type == (*tokens)[i].type);
+		if (i >= lex::TokenStream::window_size - 1) // Tokens in the window can still be looked up.
+			REQUIRE(stream.text(i + 1 - lex::TokenStream::window_size) == (*tokens)[i + 1 - lex::TokenStream::window_size].text(source));
+	}
+	REQUIRE(stream.at_end(tokens->size()));
+	REQUIRE(stream[tokens->size() + 5].type == Token::Type::end_of_source);
+	REQUIRE(!stream.error().has_value());
+}
+
+TEST_CASE("A token stream keeps every token from a mark on until the mark is released")
+{
+	std::string source;
+	for (int i = 0; i < 1000; ++i)
+		source += "a" + std::to_string(i) + "::";
+
+	auto tokens = lex::tokenize(source);
+	REQUIRE(tokens.has_value());
+
+	lex::TokenStream stream(source);
+	REQUIRE(stream.text(10) == (*tokens)[10].text(source));
+	{
+		lex::TokenStream::Mark const outer_mark(stream, 5);
+		REQUIRE(stream.text(500) == (*tokens)[500].text(source));
+		{
+			lex::TokenStream::Mark const inner_mark(stream, 300);
+			REQUIRE(stream.text(1500) == (*tokens)[1500].text(source));
+		}
+
+		// Going back to the marks, however far behind they are.
+		for (size_t i = 5; i <= 1500; ++i)
+			REQUIRE(stream.text(i) == (*tokens)[i].text(source));
+	}
+
+	// Without marks, only the window is kept again.
+	REQUIRE(stream.text(tokens->size() - 1) == (*tokens)[tokens->size() - 1].text(source));
+	for (size_t i = tokens->size() - lex::TokenStream::window_size; i < tokens->size(); ++i)
+		REQUIRE(stream.text(i) == (*tokens)[i].text(source));
+}
+
+TEST_CASE("A token stream ends at the first syntax error of the lexer")
+{
+	lex::TokenStream stream("let x = 3; let y = 4a;"sv);
+	REQUIRE(stream.text(7) == "=");
+	REQUIRE(stream.at_end(8));
+	REQUIRE(stream.error().has_value());
+	REQUIRE(stream.error()->error_message == "Unrecognized char in number literal.");
+}
+
+TEST_CASE("Lexer throughput", "[.][benchmark]")
+{
+	std::string_view constexpr snippet =
+		"// Computes the sum of the elements of an array.\n"
+		"let sum = fn(int[4] const & values) -> int\n"
+		"{\n"
+		"\tlet mut total = 0;\n"
+		"\tfor (let mut i = 0; i < 4; i = i + 1)\n"
+		"\t\ttotal = total + values[i] * 2; /* Doubled on purpose */\n"
+		"\treturn total;\n"
+		"};\n"
+		"\n"
+		"struct PointWithLongName { float x_coordinate; float y_coordinate; };\n"
+		"let is_ok = (sum([1, 2, 3, 4]) == 20) and not false;\n";
+
+	std::string source;
+	while (source.size() < 16 * 1024 * 1024)
+		source += snippet;
+
+	constexpr int iterations = 8;
+	std::vector<Token> tokens;
+	auto const start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i)
+	{
+		tokens.clear();
+		auto tokenized = lex::tokenize(source, std::move(tokens));
+		REQUIRE(tokenized.has_value());
+		tokens = std::move(*tokenized);
+	}
+	auto const end = std::chrono::steady_clock::now();
+
+	double const seconds = std::chrono::duration<double>(end - start).count();
+	double const megabytes = static_cast<double>(source.size()) * iterations / (1024.0 * 1024.0);
+	WARN("Lexer throughput: " << megabytes / seconds << " MB/s (" << tokens.size() << " tokens per iteration)");
+}
@@ -0,0 +1,64 @@
+#include <catch2/catch.hpp>
+#include "symbol.hh"
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Interning a name gives the same symbol every time and the symbol gives back the name")
+{
+	Symbol const a = intern("symbol_tests_a");
+	Symbol const b = intern("symbol_tests_b");
+	REQUIRE(a != b);
+	REQUIRE(intern("symbol_tests_a") == a);
+	REQUIRE(intern(std::string("symbol_tests_") + "b") == b);
+	REQUIRE(symbol_name(a) == "symbol_tests_a");
+	REQUIRE(find_symbol("symbol_tests_b") == b);
+	REQUIRE(!find_symbol("symbol_tests_never_interned").has_value());
+}
+
+TEST_CASE("Names interned while the symbol table grows can still be found")
+{
+	std::vector<Symbol> symbols;
+	for (int i = 0; i < 20000; ++i)
+		symbols.push_back(intern("symbol_tests_growth_" + std::to_string(i)));
+
+	for (int i = 0; i < 20000; ++i)
+	{
+		std::string const name = "symbol_tests_growth_" + std::to_string(i);
+		REQUIRE(symbol_name(symbols[i]) == name);
+		REQUIRE(find_symbol(name) == symbols[i]);
+		REQUIRE(intern(name) == symbols[i]);
+	}
+}
+
+TEST_CASE("Threads that intern the same names at the same time get the same symbols")
+{
+	constexpr int thread_count = 4;
+	constexpr int name_count = 4999; // Prime, so that every thread goes through every name.
+	std::vector<std::vector<Symbol>> symbols(thread_count, std::vector<Symbol>(name_count));
+	std::vector<std::thread> threads;
+	for (int t = 0; t < thread_count; ++t)
+	{
+		threads.emplace_back([&symbols, t]()
+		{
+			for (int i = 0; i < name_count; ++i)
+			{
+				// Each thread goes through the names in a different order, while the others are adding them.
+				int const name_index = (i * (2 * t + 1)) % name_count;
+				symbols[t][name_index] = intern("symbol_tests_threads_" + std::to_string(name_index));
+				static_cast<void>(find_symbol("symbol_tests_threads_" + std::to_string((name_index + 1) % name_count)));
+			}
+		});
+	}
+	for (std::thread & thread : threads)
+		thread.join();
+
+	for (int i = 0; i < name_count; ++i)
+	{
+		std::string const name = "symbol_tests_threads_" + std::to_string(i);
+		Symbol const symbol = *find_symbol(name);
+		REQUIRE(symbol_name(symbol) == name);
+		for (int t = 0; t < thread_count; ++t)
+			REQUIRE(symbols[t][i] == symbol);
+	}
+}
@@ -0,0 +1,149 @@
+#include <catch2/catch.hpp>
+#include "template_instantiation.hh"
+#include <vector>
+
+using Table = instantiation::TemplateInstantiationTable<complete::StructTemplateId, int>;
+
+namespace template_instantiation_tests
+{
+	auto type(unsigned index) noexcept -> complete::TypeId
+	{
+		return complete::TypeId::with_index(index);
+	}
+
+	// Keys that all start probing at the same slot of a table with 16 slots.
+	auto colliding_keys(int count) -> std::vector<complete::TypeId>
+	{
+		std::vector<complete::TypeId> keys;
+		size_t const home = Table::hash_key({0}, {type(0)}) & 15;
+		for (unsigned i = 0; static_cast<int>(keys.size()) < count; ++i)
+		{
+			complete::TypeId const key[] = {type(i)};
+			if ((Table::hash_key({0}, key) & 15) == home)
+				keys.push_back(type(i));
+		}
+		return keys;
+	}
+}
+
+TEST_CASE("Instantiations whose keys collide are found by probing")
+{
+	using namespace template_instantiation_tests;
+
+	std::vector<complete::TypeId> const keys = colliding_keys(4);
+	Table table;
+	for (size_t i = 0; i < keys.size(); ++i)
+		table.insert({0}, {&keys[i], 1}, static_cast<int>(i));
+
+	REQUIRE(table.slots.size() == 16);
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		int const * const value = table.find({0}, {&keys[i], 1});
+		REQUIRE(value != nullptr);
+		REQUIRE(*value == static_cast<int>(i));
+	}
+
+	// Same parameters but another template.
+	REQUIRE(table.find({1}, {&keys[0], 1}) == nullptr);
+
+	// Inserting an existing key keeps the first value.
+	table.insert({0}, {&keys[2], 1}, 100);
+	REQUIRE(*table.find({0}, {&keys[2], 1}) == 2);
+	REQUIRE(table.size() == keys.size());
+}
+
+TEST_CASE("Instantiations are found after the table grows")
+{
+	using namespace template_instantiation_tests;
+
+	Table table;
+	for (unsigned i = 0; i < 1000; ++i)
+	{
+		// Short keys are stored inline and long ones in the overflow buffer.
+		complete::TypeId const parameters[] = {type(i), type(i + 1), type(i + 2), type(i + 3), type(i + 4)};
+		table.insert({i % 7}, {parameters, 1 + i % 5}, static_cast<int>(i));
+	}
+
+	REQUIRE(table.size() == 1000);
+	REQUIRE(table.slots.size() >= 2000);
+	for (unsigned i = 0; i < 1000; ++i)
+	{
+		complete::TypeId const parameters[] = {type(i), type(i + 1), type(i + 2), type(i + 3), type(i + 4)};
+		int const * const value = table.find({i % 7}, {parameters, 1 + i % 5});
+		REQUIRE(value != nullptr);
+		REQUIRE(*value == static_cast<int>(i));
+	}
+}
+
+TEST_CASE("Truncating a table forgets the last instantiations and keeps the ones before")
+{
+	using namespace template_instantiation_tests;
+
+	// Colliding keys make truncation remove instantiations from the middle of probe sequences.
+	std::vector<complete::TypeId> const keys = colliding_keys(6);
+	complete::TypeId const long_key[] = {type(1), type(2), type(3), type(4)};
+
+	Table table;
+	table.insert({0}, {&keys[0], 1}, 0);
+	table.insert({0}, {&keys[1], 1}, 1);
+	table.insert({1}, long_key, 10);
+	size_t const state = table.size();
+	size_t const overflow_state = table.overflow_parameters.size();
+
+	table.insert({0}, {&keys[2], 1}, 2);
+	table.insert({2}, long_key, 20);
+	table.insert({0}, {&keys[3], 1}, 3);
+	table.truncate(state);
+
+	REQUIRE(table.size() == state);
+	REQUIRE(table.overflow_parameters.size() == overflow_state);
+	REQUIRE(*table.find({0}, {&keys[0], 1}) == 0);
+	REQUIRE(*table.find({0}, {&keys[1], 1}) == 1);
+	REQUIRE(*table.find({1}, long_key) == 10);
+	REQUIRE(table.find({0}, {&keys[2], 1}) == nullptr);
+	REQUIRE(table.find({2}, long_key) == nullptr);
+	REQUIRE(table.find({0}, {&keys[3], 1}) == nullptr);
+
+	// Removed keys may be inserted again with other values.
+	table.insert({0}, {&keys[3], 1}, 30);
+	table.insert({0}, {&keys[4], 1}, 40);
+	REQUIRE(*table.find({0}, {&keys[3], 1}) == 30);
+	REQUIRE(*table.find({0}, {&keys[4], 1}) == 40);
+	REQUIRE(*table.find({0}, {&keys[1], 1}) == 1);
+
+	table.truncate(0);
+	REQUIRE(table.size() == 0);
+	REQUIRE(table.find({0}, {&keys[0], 1}) == nullptr);
+	REQUIRE(table.find({1}, long_key) == nullptr);
+}
+
+TEST_CASE("Overload resolutions are cached by the overload set and forgotten when the cache is truncated")
+{
+	using namespace template_instantiation_tests;
+
+	FunctionId const first_function = {FunctionId::Type::program, 1};
+	FunctionId const second_function = {FunctionId::Type::program, 2};
+	FunctionId const one_overload[] = {first_function};
+	FunctionId const two_overloads[] = {first_function, second_function};
+	complete::TypeId const parameters[] = {type(3)};
+
+	complete::OverloadSetView one_overload_set;
+	one_overload_set.function_ids = one_overload;
+	complete::OverloadSetView two_overload_set;
+	two_overload_set.function_ids = two_overloads;
+
+	instantiation::OverloadResolutionCache cache;
+	cache.insert(one_overload_set, parameters, first_function);
+	size_t const state = cache.size();
+
+	// An overload added later makes a different key.
+	REQUIRE(cache.find(two_overload_set, parameters) == nullptr);
+	cache.insert(two_overload_set, parameters, second_function);
+	REQUIRE(*cache.find(one_overload_set, parameters) == first_function);
+	REQUIRE(*cache.find(two_overload_set, parameters) == second_function);
+
+	cache.truncate(state);
+	REQUIRE(cache.size() == state);
+	REQUIRE(cache.find(two_overload_set, parameters) == nullptr);
+	REQUIRE(*cache.find(one_overload_set, parameters) == first_function);
+}
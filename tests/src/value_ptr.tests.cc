@@ -6,3 +6,22 @@ TEST_CASE("value_ptr inherits constructors from unique_ptr")
 	auto p = value_ptr<int>(new int(4));
 	REQUIRE(*p == 4);
 }
+
+TEST_CASE("value_ptr allocates from the memory resource of the current thread")
+{
+	std::pmr::monotonic_buffer_resource arena;
+	value_ptr<int> heap_copy;
+	{
+		ScopedValuePtrResource const allocate_from_arena(&arena);
+		auto const p = allocate(4);
+		REQUIRE(p.get_deleter().resource == &arena);
+
+		heap_copy = allocate(5);
+		REQUIRE(heap_copy.get_deleter().resource == &arena);
+	}
+
+	// Copies made outside of the scope go to the heap, so they can outlive the arena.
+	value_ptr<int> const copy = heap_copy;
+	REQUIRE(*copy == 5);
+	REQUIRE(copy.get_deleter().resource == nullptr);
+}